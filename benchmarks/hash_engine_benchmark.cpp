@@ -0,0 +1,139 @@
+/**
+ * Cost of HashEngine::create("SHA-256") and SHA-256 throughput of
+ * update_from_fd() over a large file, for the engine the factory selects,
+ * Botan's provider and, with fs_hash_af_alg, the kernel AF_ALG engine.
+ *
+ * The file is written to the temporary directory and hashed from the page
+ * cache, so the numbers are hash throughput, not storage throughput.
+ *
+ * Usage: hash_engine_benchmark [size in MiB] [iterations], default 256 and 1000.
+ */
+
+#include "handle_update/hashEngine.h"
+#include "handle_update/afAlgHashEngine.h"
+
+#include <fus_updater_lib/config.h>
+#include <botan/hash.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include <fcntl.h>
+    #include <unistd.h>
+}
+
+namespace {
+    const std::string ALGORITHM = "SHA-256";
+
+    /* keeps the optimizer from dropping results */
+    volatile size_t sink;
+
+    /* Botan's default provider, bypassing the factory's selection */
+    class BotanProviderEngine : public updater::HashEngine {
+    private:
+        std::unique_ptr<Botan::HashFunction> hash_;
+
+    public:
+        BotanProviderEngine() : hash_(Botan::HashFunction::create_or_throw(ALGORITHM)) {}
+
+        std::string name() const override { return "botan/" + hash_->provider(); }
+        bool accelerated() const override { return false; }
+        size_t output_length() const override { return hash_->output_length(); }
+        void update(const uint8_t* data, size_t length) override { hash_->update(data, length); }
+        void final(uint8_t* out) override { hash_->final(out); }
+        using HashEngine::final;
+    };
+
+    double microseconds_per_call(unsigned long iterations, const std::function<size_t()>& call) {
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < iterations; ++i) {
+            sink = sink + call();
+        }
+        const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / static_cast<double>(iterations);
+    }
+
+    /* MiB/s of update_from_fd over the whole file, best of three runs */
+    double mib_per_second(updater::HashEngine& engine, int fd, uint64_t size) {
+        double best = 0;
+        for (int run = 0; run < 3; ++run) {
+            const auto start = std::chrono::steady_clock::now();
+            engine.update_from_fd(fd, 0, size);
+            sink = sink + engine.final()[0];
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            const double rate = static_cast<double>(size) / (1024.0 * 1024.0) / elapsed.count();
+            if (rate > best) {
+                best = rate;
+            }
+        }
+        return best;
+    }
+
+    void print(const std::string& engine, double create_us, double throughput) {
+        std::printf("%-28s %12.2f %14.1f\n", engine.c_str(), create_us, throughput);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const unsigned long size_mib = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 256;
+    const unsigned long iterations = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 1000;
+    if (size_mib == 0 || iterations == 0) {
+        std::fprintf(stderr, "usage: %s [size in MiB] [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const uint64_t size = static_cast<uint64_t>(size_mib) * 1024 * 1024;
+
+    std::string path = (std::filesystem::temp_directory_path() / "hash_engine_benchmark.XXXXXX").string();
+    const int fd = ::mkstemp(path.data());
+    if (fd < 0) {
+        std::perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    ::unlink(path.c_str());
+    std::vector<uint8_t> block(1024 * 1024);
+    for (size_t i = 0; i < block.size(); ++i) {
+        block[i] = static_cast<uint8_t>(i * 2654435761U >> 24);
+    }
+    for (unsigned long i = 0; i < size_mib; ++i) {
+        if (::write(fd, block.data(), block.size()) != static_cast<ssize_t>(block.size())) {
+            std::perror("write");
+            return EXIT_FAILURE;
+        }
+    }
+
+    const std::unique_ptr<updater::HashEngine> selected = updater::HashEngine::create(ALGORITHM);
+    std::printf("selected engine: %s%s\n", selected->name().c_str(),
+                selected->accelerated() ? " (accelerated)" : "");
+    std::printf("%-28s %12s %14s\n", "engine", "create [us]", "hash [MiB/s]");
+
+    print("HashEngine::create", microseconds_per_call(iterations, []() {
+        return updater::HashEngine::create(ALGORITHM)->output_length();
+    }), mib_per_second(*selected, fd, size));
+
+    BotanProviderEngine botan;
+    print(botan.name(), microseconds_per_call(iterations, []() {
+        return BotanProviderEngine().output_length();
+    }), mib_per_second(botan, fd, size));
+
+#if FUS_LIB_HASH_AF_ALG
+    const std::unique_ptr<updater::AfAlgHashEngine> kernel = updater::AfAlgHashEngine::open(ALGORITHM);
+    if (kernel) {
+        print(kernel->name(), microseconds_per_call(iterations, []() {
+            const std::unique_ptr<updater::AfAlgHashEngine> engine = updater::AfAlgHashEngine::open(ALGORITHM);
+            return engine ? engine->output_length() : 0;
+        }), mib_per_second(*kernel, fd, size));
+    } else {
+        std::printf("%-28s %12s\n", "af_alg", "unavailable");
+    }
+#endif
+
+    ::close(fd);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+/**
+ * Parse time of fsupdate.json and `rauc status` output: jsoncpp with a walk
+ * of the Json::Value tree, as before the typed parsers, against
+ * UpdateManifest::parse() and rauc::system_status::parse().
+ *
+ * Usage: parser_benchmark [iterations], default 200000.
+ */
+
+#include "handle_update/updateManifest.h"
+#include "rauc/rauc_json.h"
+
+#include <json/json.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+namespace {
+    const std::string MANIFEST = R"({
+    "images": {
+        "updates": [
+            {
+                "version": "20260101",
+                "handler": "rauc",
+                "file": "update.fw",
+                "size": 134217728,
+                "hashes": {
+                    "sha256": "4A2B7C1D9E8F60514233A4B5C6D7E8F90A1B2C3D4E5F60718293A4B5C6D7E8F9",
+                    "blake3": "0f1e2d3c4b5a69788796a5b4c3d2e1f00f1e2d3c4b5a69788796a5b4c3d2e1f0"
+                }
+            },
+            {
+                "version": "20260101",
+                "handler": "application",
+                "file": "update.app",
+                "size": 33554432,
+                "hashes": {
+                    "sha256": "9f8e7d6c5b4a39281706f5e4d3c2b1a09f8e7d6c5b4a39281706f5e4d3c2b1a0"
+                }
+            }
+        ]
+    }
+})";
+
+    const std::string RAUC_STATUS = R"({"compatible":"fus-armstone","variant":"","booted":"A","boot_primary":"rootfs.0",)"
+        R"("slots":[{"rootfs.0":{"class":"rootfs","device":"/dev/mmcblk2p5","type":"ext4","bootname":"A",)"
+        R"("state":"booted","description":"","parent":null,"mountpoint":"/","boot_status":"good",)"
+        R"("slot_status":{"bundle":{"compatible":"fus-armstone"},"status":"ok"}}},)"
+        R"({"rootfs.1":{"class":"rootfs","device":"/dev/mmcblk2p6","type":"ext4","bootname":"B",)"
+        R"("state":"inactive","description":"","parent":null,"mountpoint":null,"boot_status":"good",)"
+        R"("slot_status":{"bundle":{"compatible":"fus-armstone"},"status":"ok"}}}]})";
+
+    /* keeps the optimizer from dropping parse results */
+    volatile size_t sink;
+
+    Json::Value parse_tree(const std::string& text) {
+        Json::CharReaderBuilder builder;
+        const std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+        Json::Value root;
+        std::string errs;
+        if (!reader->parse(text.data(), text.data() + text.size(), &root, &errs)) {
+            std::fprintf(stderr, "jsoncpp: %s\n", errs.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        return root;
+    }
+
+    /* jsoncpp tree walk of the former CheckUpdateSha256Sum and CheckManifest */
+    updater::UpdateManifest jsoncpp_manifest(const std::string& text) {
+        const Json::Value root = parse_tree(text);
+        updater::UpdateManifest manifest;
+        if (!root.isObject() || !root["images"].isObject() || !root["images"]["updates"].isArray()) {
+            std::exit(EXIT_FAILURE);
+        }
+        for (const Json::Value& entry : root["images"]["updates"]) {
+            if (!entry.isObject() || !entry.isMember("version") || !entry.isMember("handler") ||
+                !entry.isMember("file") || !entry.isMember("hashes")) {
+                std::exit(EXIT_FAILURE);
+            }
+            updater::UpdateManifest::Image image;
+            image.version = entry["version"].asString();
+            image.handler = entry["handler"].asString();
+            image.file = entry["file"].asString();
+            const Json::Value& hashes = entry["hashes"];
+            if (hashes.isMember("blake3")) {
+                image.algorithm = "BLAKE3";
+                image.digest = hashes["blake3"].asString();
+            } else {
+                image.algorithm = "SHA-256";
+                image.digest = hashes["sha256"].asString();
+            }
+            std::transform(image.digest.begin(), image.digest.end(), image.digest.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (entry["size"].isUInt64()) {
+                image.size = entry["size"].asUInt64();
+            }
+            manifest.images.push_back(std::move(image));
+        }
+        return manifest;
+    }
+
+    /* jsoncpp tree walk of the former firmwareUpdate status lookups */
+    rauc::system_status jsoncpp_status(const std::string& text) {
+        const Json::Value root = parse_tree(text);
+        rauc::system_status status;
+        status.compatible = root["compatible"].asString();
+        status.variant = root["variant"].asString();
+        status.booted = root["booted"].asString();
+        status.boot_primary = root["boot_primary"].asString();
+        for (const Json::Value& slot : root["slots"]) {
+            for (const std::string& name : slot.getMemberNames()) {
+                const Json::Value& entry = slot[name];
+                rauc::slot_status parsed;
+                parsed.name = name;
+                parsed.slot_class = entry["class"].asString();
+                parsed.device = entry["device"].asString();
+                parsed.type = entry["type"].asString();
+                parsed.bootname = entry["bootname"].asString();
+                parsed.state = entry["state"].asString();
+                parsed.mountpoint = entry["mountpoint"].isString() ? entry["mountpoint"].asString() : std::string();
+                parsed.boot_status = entry["boot_status"].asString();
+                status.slots.push_back(std::move(parsed));
+            }
+        }
+        return status;
+    }
+
+    template <typename Parse>
+    double microseconds_per_parse(unsigned long iterations, Parse parse) {
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < iterations; ++i) {
+            sink = sink + parse();
+        }
+        const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / static_cast<double>(iterations);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const unsigned long iterations = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    if (iterations == 0) {
+        std::fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const double manifest_tree = microseconds_per_parse(iterations, []() {
+        return jsoncpp_manifest(MANIFEST).images.size();
+    });
+    const double manifest_typed = microseconds_per_parse(iterations, []() {
+        return updater::UpdateManifest::parse(MANIFEST).images.size();
+    });
+    const double status_tree = microseconds_per_parse(iterations, []() {
+        return jsoncpp_status(RAUC_STATUS).slots.size();
+    });
+    const double status_typed = microseconds_per_parse(iterations, []() {
+        return rauc::system_status::parse(RAUC_STATUS).slots.size();
+    });
+
+    std::printf("%-16s %12s %12s %8s\n", "input", "jsoncpp [us]", "typed [us]", "speedup");
+    std::printf("%-16s %12.2f %12.2f %7.1fx\n", "fsupdate.json", manifest_tree, manifest_typed,
+                manifest_tree / manifest_typed);
+    std::printf("%-16s %12.2f %12.2f %7.1fx\n", "rauc status", status_tree, status_typed,
+                status_tree / status_typed);
+    return EXIT_SUCCESS;
+}
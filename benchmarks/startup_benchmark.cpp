@@ -0,0 +1,89 @@
+/**
+ * Startup time of fs::FSUpdate: construction alone, which only stores the
+ * U-Boot configuration path, against construction followed by the first
+ * env or version query, which pays for libubootenv, fw_env.config and the
+ * application or firmware updater on first use.
+ *
+ * Queries need a device environment; on a host they fail and are reported
+ * as such, the construction time is still meaningful.
+ *
+ * Usage: startup_benchmark [iterations], default 1000.
+ */
+
+#include "handle_update/fsupdate.h"
+#include "logger/LoggerSinkEmpty.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace {
+    /* keeps the optimizer from dropping query results */
+    volatile size_t sink;
+
+    struct Timing {
+        double microseconds = 0;
+        std::string error;
+    };
+
+    /* constructs fs::FSUpdate and runs query on it, iterations times */
+    Timing time_startup(unsigned long iterations, const std::shared_ptr<logger::LoggerHandler>& logger,
+                        const std::function<size_t(fs::FSUpdate&)>& query) {
+        Timing timing;
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < iterations; ++i) {
+            fs::FSUpdate update(logger);
+            try {
+                sink = sink + query(update);
+            } catch (const std::exception& ex) {
+                timing.error = ex.what();
+                return timing;
+            }
+        }
+        const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        timing.microseconds = elapsed.count() / static_cast<double>(iterations);
+        return timing;
+    }
+
+    void print(const char* phase, const Timing& timing) {
+        if (timing.error.empty()) {
+            std::printf("%-32s %12.2f\n", phase, timing.microseconds);
+        } else {
+            std::printf("%-32s %12s  (%s)\n", phase, "failed", timing.error.c_str());
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const unsigned long iterations = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 1000;
+    if (iterations == 0) {
+        std::fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const std::shared_ptr<logger::LoggerHandler> logger =
+        logger::LoggerHandler::initLogger(std::make_shared<logger::LoggerSinkEmpty>(logger::logLevel::ERROR));
+
+    const Timing construct = time_startup(iterations, logger, [](fs::FSUpdate&) {
+        return size_t(0);
+    });
+    const Timing reboot_state = time_startup(iterations, logger, [](fs::FSUpdate& update) {
+        return static_cast<size_t>(update.get_update_reboot_state());
+    });
+    const Timing application_version = time_startup(iterations, logger, [](fs::FSUpdate& update) {
+        return update.get_application_version().size();
+    });
+    const Timing firmware_version = time_startup(iterations, logger, [](fs::FSUpdate& update) {
+        return update.get_firmware_version().size();
+    });
+
+    std::printf("%-32s %12s\n", "phase", "time [us]");
+    print("construct", construct);
+    print("construct + update_reboot_state", reboot_state);
+    print("construct + application version", application_version);
+    print("construct + firmware version", firmware_version);
+    return EXIT_SUCCESS;
+}
@@ -1,18 +1,28 @@
 #include "LibArchiveHandle.h"
 #include <archive.h>
 #include <archive_entry.h>
+#include <algorithm>
 #include <iostream>
+#include "resourcePolicy.h"
+
+extern "C" {
+    #include <errno.h>
+    #include <unistd.h>
+}
 
 namespace fs {
 
-LibArchiveHandle::LibArchiveHandle() : m_arch(nullptr)
+LibArchiveHandle::LibArchiveHandle(Format format) : m_arch(nullptr), m_section(nullptr)
 {
     m_arch = archive_read_new();
     if (!m_arch)
         throw fs::LibArchiveException("Failed to create libarchive handle", ENOMEM);
 
-    // Enable support for tar format
-    archive_read_support_format_tar(m_arch);
+    // Enable support for tar format, or raw data for container members
+    if (format == Format::RAW_BZIP2)
+        archive_read_support_format_raw(m_arch);
+    else
+        archive_read_support_format_tar(m_arch);
 
     // Enable only bzip2 filter
     int r = archive_read_support_filter_bzip2(m_arch);
@@ -81,15 +91,163 @@ void fs::LibArchiveHandle::open_stream(std::istream &input, size_t buffer_size)
     // Transfer ownership to libarchive: release() is required here.
     StreamData* raw_data = data.release();
 
+    // close_cb frees raw_data, libarchive calls it also when the open fails
     int r = archive_read_open(m_arch, raw_data, /*open_cb*/ nullptr, read_cb, close_cb);
     if (r != ARCHIVE_OK) {
-        // cleanup if open failed (libarchive won't call close_cb in that case)
-        delete raw_data;
-
         std::string err = "Failed to open archive from stream";
         if (const char* ae = archive_error_string(m_arch); ae && *ae) err += ": " + std::string(ae);
         throw LibArchiveException(err, archive_errno(m_arch));
     }
 }
 
+struct LibArchiveHandle::SectionData {
+    std::istream* stream;
+    int fd;
+    uint64_t remaining;
+    std::vector<char> buffer;
+    SectionData(std::istream* s, int f, uint64_t l, size_t sz) : stream(s), fd(f), remaining(l), buffer(sz) {}
+
+    /* next block of the section, 0 at its end, -1 with errno set if the source fails or ends early */
+    ssize_t read_block() {
+        if (remaining == 0) return 0;
+        const size_t want = static_cast<size_t>(std::min<uint64_t>(buffer.size(), remaining));
+        ssize_t n;
+        if (stream) {
+            stream->read(buffer.data(), static_cast<std::streamsize>(want));
+            n = static_cast<ssize_t>(stream->gcount());
+            if (n == 0) errno = EIO;
+        } else {
+            do {
+                n = ::read(fd, buffer.data(), want);
+            } while (n < 0 && errno == EINTR);
+            if (n == 0) errno = EIO;
+        }
+        if (n <= 0) return -1;
+        remaining -= static_cast<uint64_t>(n);
+        return n;
+    }
+
+    /* source has data after the section */
+    bool has_trailing_data() {
+        if (stream) return stream->peek() != std::istream::traits_type::eof();
+        char byte;
+        ssize_t n;
+        do {
+            n = ::read(fd, &byte, 1);
+        } while (n < 0 && errno == EINTR);
+        return n > 0;
+    }
+};
+
+void fs::LibArchiveHandle::open_section(std::istream &input, uint64_t length, size_t buffer_size)
+{
+    open_section(std::make_unique<SectionData>(&input, -1, length, buffer_size), "stream");
+}
+
+void fs::LibArchiveHandle::open_section(int fd, uint64_t length, size_t buffer_size)
+{
+    open_section(std::make_unique<SectionData>(nullptr, fd, length, buffer_size),
+                 "file descriptor " + std::to_string(fd));
+}
+
+void fs::LibArchiveHandle::open_section(std::unique_ptr<SectionData> data, const std::string &source)
+{
+    if (!m_arch)
+        throw LibArchiveException("Archive handle not initialized", EINVAL);
+
+    auto read_cb = [](archive* a, void* client_data, const void** buff) -> la_ssize_t {
+        auto* d = static_cast<SectionData*>(client_data);
+        const uint64_t missing = d->remaining;
+        const ssize_t n = d->read_block();
+        if (n < 0) {
+            archive_set_error(a, errno, "Update image ends %llu bytes before its declared size",
+                              static_cast<unsigned long long>(missing));
+            return ARCHIVE_FATAL;
+        }
+        *buff = d->buffer.data();
+        return static_cast<la_ssize_t>(n);
+    };
+
+    auto close_cb = [](archive*, void* client_data) -> int {
+        delete static_cast<SectionData*>(client_data);
+        return ARCHIVE_OK;
+    };
+
+    SectionData* raw_data = data.release();
+
+    /* close_cb frees raw_data, libarchive calls it also when the open fails */
+    int r = archive_read_open(m_arch, raw_data, /*open_cb*/ nullptr, read_cb, close_cb);
+    if (r != ARCHIVE_OK) {
+        std::string err = "Failed to open archive from " + source;
+        if (const char* ae = archive_error_string(m_arch); ae && *ae) err += ": " + std::string(ae);
+        throw LibArchiveException(err, archive_errno(m_arch));
+    }
+    m_section = raw_data;
+}
+
+void fs::LibArchiveHandle::finish_section()
+{
+    if (!m_section)
+        throw LibArchiveException("No section opened", EINVAL);
+
+    while (m_section->remaining > 0) {
+        const uint64_t missing = m_section->remaining;
+        if (m_section->read_block() < 0) {
+            throw LibArchiveException("Update image ends " + std::to_string(missing) +
+                                      " bytes before its declared size", errno);
+        }
+    }
+    if (m_section->has_trailing_data())
+        throw LibArchiveException("Update image continues after its declared size", EINVAL);
+}
+
+void fs::LibArchiveHandle::open_range(int fd, uint64_t offset, uint64_t length, size_t buffer_size)
+{
+    if (!m_arch)
+        throw LibArchiveException("Archive handle not initialized", EINVAL);
+
+    struct RangeData {
+        int fd;
+        uint64_t position;
+        uint64_t end;
+        std::vector<char> buffer;
+        RangeData(int f, uint64_t o, uint64_t l, size_t sz) : fd(f), position(o), end(o + l), buffer(sz) {}
+    };
+
+    auto data = std::make_unique<RangeData>(fd, offset, length, buffer_size);
+
+    auto read_cb = [](archive* a, void* client_data, const void** buff) -> la_ssize_t {
+        auto* d = static_cast<RangeData*>(client_data);
+        if (d->position >= d->end) return 0;
+        const size_t want = static_cast<size_t>(std::min<uint64_t>(d->buffer.size(), d->end - d->position));
+        ssize_t n;
+        do {
+            n = ::pread(d->fd, d->buffer.data(), want, static_cast<off_t>(d->position));
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            archive_set_error(a, n < 0 ? errno : EIO, "Range ends before %llu", static_cast<unsigned long long>(d->end));
+            return ARCHIVE_FATAL;
+        }
+        d->position += static_cast<uint64_t>(n);
+        updater::IoThrottle::account(static_cast<uint64_t>(n));
+        *buff = d->buffer.data();
+        return static_cast<la_ssize_t>(n);
+    };
+
+    auto close_cb = [](archive*, void* client_data) -> int {
+        delete static_cast<RangeData*>(client_data);
+        return ARCHIVE_OK;
+    };
+
+    RangeData* raw_data = data.release();
+
+    /* close_cb frees raw_data, libarchive calls it also when the open fails */
+    int r = archive_read_open(m_arch, raw_data, /*open_cb*/ nullptr, read_cb, close_cb);
+    if (r != ARCHIVE_OK) {
+        std::string err = "Failed to open archive range of file descriptor " + std::to_string(fd);
+        if (const char* ae = archive_error_string(m_arch); ae && *ae) err += ": " + std::string(ae);
+        throw LibArchiveException(err, archive_errno(m_arch));
+    }
+}
+
 } // namespace fs
@@ -15,13 +15,27 @@ namespace fs {
 /**
  * RAII wrapper for libarchive archive* handles.
  * Automatically initializes and frees the libarchive handle.
- * Supports tar + bzip2 compressed archives only.
+ * Supports tar + bzip2 compressed archives, and bzip2 compressed
+ * members of indexed containers.
  * TODO: Extend to support other formats/compressions if needed.
  */
 class LibArchiveHandle {
+public:
+    enum class Format {
+        TAR_BZIP2,
+        /* single bzip2 stream without tar framing */
+        RAW_BZIP2
+    };
+
 private:
     archive* m_arch;  // underlying libarchive handle
 
+    // Source of open_section(), owned by libarchive
+    struct SectionData;
+    SectionData* m_section;
+
+    void open_section(std::unique_ptr<SectionData> data, const std::string &source);
+
     // Internal RAII structure for stream reading
     struct StreamDataRAII {
         std::istream* stream;         // pointer to input stream
@@ -38,8 +52,8 @@ private:
 
 public:
 
-    // Constructor: initialize archive for reading tar + bz2
-    LibArchiveHandle();
+    // Constructor: initialize archive for reading tar + bz2 or a raw bz2 stream
+    explicit LibArchiveHandle(Format format = Format::TAR_BZIP2);
 
     // Destructor: free archive handle automatically
     ~LibArchiveHandle();
@@ -63,6 +77,47 @@ public:
      */
     void open_stream(std::istream &input, size_t buffer_size = STREAM_BUFFER_SIZE);
 
+    /**
+     * Open archive from the next length bytes of a stream, e.g. the payload
+     * of an update image with the size declared in its header. Reading
+     * fails if the stream ends before length bytes.
+     * @param input Input stream positioned at the archive
+     * @param length Declared length of the archive
+     * @param buffer_size Buffer size for reading (default: STREAM_BUFFER_SIZE)
+     * @throw GenericException if opening fails
+     */
+    void open_section(std::istream &input, uint64_t length, size_t buffer_size = STREAM_BUFFER_SIZE);
+
+    /**
+     * Open archive from the next length bytes of a file descriptor or pipe.
+     * The descriptor stays owned by the caller.
+     * @param fd Readable file descriptor positioned at the archive
+     * @param length Declared length of the archive
+     * @param buffer_size Buffer size for reading (default: STREAM_BUFFER_SIZE)
+     * @throw GenericException if opening fails
+     */
+    void open_section(int fd, uint64_t length, size_t buffer_size = STREAM_BUFFER_SIZE);
+
+    /**
+     * Consume the rest of a section opened by open_section(), libarchive
+     * stops reading at the end of the archive. The source must end with it.
+     * @throw LibArchiveException if the source ends before or continues
+     *        after the declared length
+     */
+    void finish_section();
+
+    /**
+     * Open archive from a byte range of a file with pread(), so several
+     * handles can read the same descriptor concurrently.
+     * The descriptor stays owned by the caller.
+     * @param fd Readable, seekable file descriptor
+     * @param offset First byte of the range
+     * @param length Length of the range
+     * @param buffer_size Buffer size for reading (default: STREAM_BUFFER_SIZE)
+     * @throw GenericException if opening fails
+     */
+    void open_range(int fd, uint64_t offset, uint64_t length, size_t buffer_size = STREAM_BUFFER_SIZE);
+
     // Non-copyable, non-movable
     LibArchiveHandle(const LibArchiveHandle&) = delete;
     LibArchiveHandle& operator=(const LibArchiveHandle&) = delete;
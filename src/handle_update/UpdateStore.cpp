@@ -7,131 +7,496 @@
 #include "../logger/LoggerEntry.h"
 #include "handleUpdate.h"
 #include "fs_consts.h"
+#include "blake3.h"
+#include "hashEngine.h"
+#include "progressJournal.h"
+#include "resourcePolicy.h"
+#include "indexedContainer.h"
+#include "updateMetrics.h"
 #include <archive.h>
 #include <archive_entry.h>
-#include <botan/hash.h>
 #include <botan/hex.h>
 #include <fstream>
 #include <iostream>
 #include <algorithm>
 #include <cctype>
+#include <cstring>
 #include <vector>
 #include <system_error>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+extern "C" {
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+}
 
 
 namespace fs {
 using namespace std;
 
+/* file range hashed between two cancel checks */
+static constexpr uint64_t HASH_SLICE_SIZE = 8 * 1024 * 1024;
+
 static constexpr unsigned char to_lower(unsigned char c)
 {
     return tolower(static_cast<unsigned char>(c));
 }
 
-UpdateStore::UpdateStore()
+/* free space for the extraction, unknown does not block it */
+static uint64_t available_bytes(const filesystem::path &dir)
+{
+    error_code ec;
+    const filesystem::space_info space = filesystem::space(dir, ec);
+    return ec ? UINT64_MAX : static_cast<uint64_t>(space.available);
+}
+
+UpdateStore::UpdateStore(std::shared_ptr<logger::LoggerHandler> logger)
+    : logger(std::move(logger))
 {
     this->app_available = false;
     this->fw_available = false;
 }
 
+void UpdateStore::SetExtractDirectory(const filesystem::path &dir)
+{
+    this->extract_dir = dir;
+}
+
+void UpdateStore::SetManifestPolicy(const updater::ManifestPolicy &policy,
+                                    function<string(const string &)> installed)
+{
+    this->manifest_policy = policy;
+    this->installed_version = std::move(installed);
+}
+
 void UpdateStore::ReadUpdateConfiguration(const string configuration_path)
 {
-    Json::CharReaderBuilder builder;
-    string errs;
     /* create stream for update configuration file */
-    ifstream update_configuration(configuration_path, ifstream::in);
+    ifstream update_configuration(configuration_path, ifstream::in | ifstream::binary);
     /* check if the stream good is and no error flags are set */
     if (!update_configuration.good())
     {
-        if (update_configuration.bad() || update_configuration.fail())
-        {
-            throw GenericException(configuration_path, ENOENT);
-        }
+        throw GenericException(configuration_path, ENOENT);
+    }
+    const string text((istreambuf_iterator<char>(update_configuration)), istreambuf_iterator<char>());
+    if (update_configuration.bad())
+    {
+        throw GenericException("Read " + configuration_path + " fails.", EIO);
+    }
+    std::unique_ptr<updater::HashEngine> hash = updater::HashEngine::create("SHA-256");
+    hash->update(reinterpret_cast<const uint8_t *>(text.data()), text.size());
+    this->manifest_digest = hash->final();
+
+    /* parse and validate in one pass */
+    try
+    {
+        updater::PhaseTimer timer(updater::Phase::HEADER_PARSE, text.size());
+        this->manifest = updater::UpdateManifest::parse(text);
     }
-    /* parse */
-    if (!Json::parseFromStream(builder, update_configuration, &root, &errs))
+    catch (const updater::ManifestInvalid &ex)
     {
-        update_configuration.close();
-        string fails("Parsing of update configuration fails.");
-        throw GenericException(fails, ENOENT);
+        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN, ex.what(), logger::logLevel::ERROR));
+        throw GenericException(ex.what(), EINVAL);
     }
-    update_configuration.close();
+}
+
+vector<uint8_t> UpdateStore::GetImageDigest(const string &file) const
+{
+    for (const updater::UpdateManifest::Image &image : this->manifest.images)
+    {
+        if (image.file == file)
+        {
+            return Botan::hex_decode(image.digest);
+        }
+    }
+    return {};
 }
 
 bool UpdateStore::CheckUpdateSha256Sum(const filesystem::path &path_to_update_image)
 {
-    if (root.isMember("images") && !root["images"].empty())
+    struct HashJob
+    {
+        string file;
+        string algorithm;
+        string expected;
+    };
+    vector<HashJob> jobs;
+
+    for (const updater::UpdateManifest::Image &image : this->manifest.images)
     {
-        Json::Value images = root["images"];
-        if (images.isMember("updates") && !images["updates"].empty())
+        if (!this->selected_components.empty() &&
+            find(this->selected_components.begin(), this->selected_components.end(), image.file) == this->selected_components.end())
         {
-            Json::Value updates = images["updates"];
-            string sha256_str;
-            string update_image_file;
+            /* not extracted, not installed */
+            continue;
+        }
+        if ((image.file.compare(app_store_name) != 0) && (image.file.compare(fw_store_name) != 0))
+        {
+            this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN,
+                "Image " + image.file + " is not supported.", logger::logLevel::ERROR));
+            errno = EINVAL;
+            return false;
+        }
+        jobs.push_back({image.file, image.algorithm, image.digest});
+    }
 
-            for (Json::Value::iterator counter = updates.begin(); counter != updates.end(); ++counter)
-            {
-                if(!(*counter).isMember("version") || !(*counter).isMember("handler")
-                || !(*counter).isMember("file") || !(*counter).isMember("hashes"))
-                {
-                    /* wrong format nodes needed */
-                    this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN, "Nodes version, handler, files or hashes not available.",
-                    logger::logLevel::DEBUG));
-                    errno = ENOENT;
-                    return false;
-                }
+    updater::PhaseTimer hash_timer(updater::Phase::MANIFEST_HASH);
+
+    /* images are independent, hash them concurrently and share the cores between them */
+    const unsigned cores = max(1u, thread::hardware_concurrency());
+    const unsigned workers = static_cast<unsigned>(min<size_t>(jobs.size(), cores));
+    const unsigned threads_per_job = max(1u, cores / max(1u, workers));
 
-                update_image_file = (*counter)["file"].asString();
-                sha256_str = (*counter)["hashes"]["sha256"].asString();
-                /* transform to low for hash compare */
-                transform(sha256_str.begin(), sha256_str.end(), sha256_str.begin(), to_lower);
-                filesystem::path image_full_path(path_to_update_image / update_image_file);
+    atomic<size_t> next_job{0};
+    atomic<bool> cancel{false};
+    mutex result_lock;
+    exception_ptr first_error;
+    string mismatch;
 
-                string calc_hash = CalculateCheckSum(image_full_path, string("SHA-256"));
-                if (calc_hash != sha256_str)
+    auto worker = [&]() {
+        while (!cancel.load())
+        {
+            const size_t index = next_job.fetch_add(1);
+            if (index >= jobs.size())
+            {
+                break;
+            }
+            const HashJob &job = jobs[index];
+            const filesystem::path image_full_path(path_to_update_image / job.file);
+
+            try
+            {
+                const auto start = chrono::steady_clock::now();
+                const string calc_hash = CalculateCheckSum(image_full_path, job.algorithm, threads_per_job, &cancel);
+                const auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+                if (calc_hash.empty())
                 {
-                    cerr << "Hash compare of " << image_full_path << " fails." << endl;
-                    return false;
+                    /* cancelled by another job */
+                    break;
                 }
 
-                if (update_image_file.compare(app_store_name) == 0)
+                this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN,
+                    job.algorithm + " of " + job.file + ": " + to_string(elapsed.count()) + " ms",
+                    logger::logLevel::DEBUG));
+                error_code ec;
+                const uintmax_t hashed = filesystem::file_size(image_full_path, ec);
+                if (!ec)
                 {
-                    this->SetApplicationAvailable(true);
+                    lock_guard<mutex> lock(result_lock);
+                    hash_timer.add_bytes(hashed);
                 }
-                else if (update_image_file.compare(fw_store_name) == 0)
+
+                if (calc_hash != job.expected)
                 {
-                    this->SetFirmwareAvailable(true);
+                    lock_guard<mutex> lock(result_lock);
+                    if (!cancel.exchange(true))
+                    {
+                        mismatch = image_full_path.string();
+                    }
+                    break;
                 }
-                else
+            }
+            catch (...)
+            {
+                lock_guard<mutex> lock(result_lock);
+                if (!cancel.exchange(true))
                 {
-                    cerr << "Image " << update_image_file << " is not supported." << endl;
-                    errno = EINVAL;
-                    return false;
+                    first_error = current_exception();
                 }
+                break;
             }
         }
+    };
+
+    vector<thread> pool;
+    for (unsigned i = 1; i < workers; ++i)
+    {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : pool)
+    {
+        t.join();
+    }
+
+    if (first_error)
+    {
+        rethrow_exception(first_error);
+    }
+    if (!mismatch.empty())
+    {
+        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN,
+            "Hash compare of " + mismatch + " fails.", logger::logLevel::ERROR));
+        errno = EBADMSG;
+        return false;
+    }
+
+    for (const HashJob &job : jobs)
+    {
+        if (job.file.compare(app_store_name) == 0)
+        {
+            this->SetApplicationAvailable(true);
+        }
         else
         {
-            /* wrong json file format. node updates needed..*/
-            const string fails = "Node updates is not available or empty.";
-            this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN, fails, logger::logLevel::DEBUG));
-            errno = EINVAL;
-            return false;
+            this->SetFirmwareAvailable(true);
         }
     }
-    else
+
+    return true;
+}
+
+uint64_t UpdateStore::CheckUpdateHeader(const struct fs_header_v1_0 &header)
+{
+    updater::PhaseTimer timer(updater::Phase::HEADER_PARSE, sizeof(header));
+    uint64_t file_size = 0;
+    file_size = header.info.file_size_high & 0xFFFFFFFF;
+    file_size = file_size << 32;
+    file_size = file_size | (header.info.file_size_low & 0xFFFFFFFF);
+
+    if (strncmp("CERT", header.type, 4) && (file_size > 0))
     {
-        /* wrong json file format. node images needed..*/
-        const string fails = "Node images not available or empty.";
-        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(BOOTSTATE_DOMAIN, fails, logger::logLevel::DEBUG));
-        errno = EINVAL;
-        return false;
+        throw GenericException(string("Update has wrong format"), ENOENT);
     }
+    return file_size;
+}
 
-    return true;
+uint32_t UpdateStore::ManifestSectionSize(const struct fs_header_v1_0 &header)
+{
+    if (strncmp(updater::manifest::SECTION_MAGIC, header.param.descr, 4))
+    {
+        return 0;
+    }
+    const uint32_t size = header.param.p32[1];
+    if (size == 0 || size > updater::manifest::MAX_SIZE)
+    {
+        throw GenericException("Invalid manifest section size " + to_string(size), EINVAL);
+    }
+    return size;
+}
+
+void UpdateStore::AcceptManifestSection(const string &manifest)
+{
+    updater::PhaseTimer timer(updater::Phase::HEADER_PARSE, manifest.size());
+    this->CheckManifest(manifest, true);
+
+    const filesystem::path manifest_path = this->extract_dir / updater::manifest::FILE_NAME;
+    ofstream out(manifest_path, ofstream::out | ofstream::binary | ofstream::trunc);
+    out.write(manifest.data(), static_cast<streamsize>(manifest.size()));
+    out.close();
+    if (!out.good())
+    {
+        throw GenericException("Write " + manifest_path.string() + " fails.", EIO);
+    }
+    this->checked_manifest = manifest;
+}
+
+void UpdateStore::CheckManifest(const string &manifest_text, bool before_payload)
+{
+    auto reject = [this](const string &msg, int error) {
+        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN, msg, logger::logLevel::ERROR));
+        throw GenericException(msg, error);
+    };
+
+    try
+    {
+        this->manifest = updater::UpdateManifest::parse(manifest_text);
+    }
+    catch (const updater::ManifestInvalid &ex)
+    {
+        reject(ex.what(), EINVAL);
+    }
+
+    uint64_t declared_size = 0;
+    for (const updater::UpdateManifest::Image &image : this->manifest.images)
+    {
+        const string &file = image.file;
+        if ((file.compare(app_store_name) != 0) && (file.compare(fw_store_name) != 0))
+        {
+            reject("Image " + file + " is not supported.", EINVAL);
+        }
+
+        const vector<string> &handlers = this->manifest_policy.handlers;
+        if (!handlers.empty() && find(handlers.begin(), handlers.end(), image.handler) == handlers.end())
+        {
+            reject("Handler " + image.handler + " of " + file + " is not accepted.", EPERM);
+        }
+
+        if (this->manifest_policy.newer_only && this->installed_version)
+        {
+            const string &version = image.version;
+            string installed;
+            try
+            {
+                installed = this->installed_version(file);
+            }
+            catch (const std::exception &ex)
+            {
+                /* first installation or broken version file, nothing to compare */
+                this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN,
+                    "Installed version of " + file + " unknown: " + ex.what(), logger::logLevel::WARNING));
+                continue;
+            }
+            /* numeric versions are ordered, other versions only differ */
+            auto numeric = [](const string &v) {
+                return !v.empty() && v.size() <= 19 &&
+                       all_of(v.begin(), v.end(), [](unsigned char c) { return isdigit(c); });
+            };
+            const bool newer = (numeric(version) && numeric(installed)) ? stoull(version) > stoull(installed)
+                                                                         : version != installed;
+            if (!newer)
+            {
+                reject("Version " + version + " of " + file + " is not newer than " + installed + ".", EPERM);
+            }
+        }
+
+        /* optional size of the extracted image */
+        if (image.size)
+        {
+            const uint64_t size = *image.size;
+            error_code ec;
+            const uintmax_t on_disk = filesystem::file_size(this->extract_dir / file, ec);
+            uint64_t needed = size;
+            if (!ec)
+            {
+                /* a resumed extraction already holds part of the image */
+                needed = (on_disk < size) ? size - on_disk : 0;
+            }
+            declared_size += needed;
+        }
+    }
+
+    if (before_payload && declared_size > 0)
+    {
+        const uint64_t available = available_bytes(this->extract_dir);
+        if (available != UINT64_MAX && available < declared_size + this->manifest_policy.reserve_bytes)
+        {
+            reject("Update images need " + to_string(declared_size) + " bytes, " + to_string(available) +
+                   " available in " + this->extract_dir.string() + ".", ENOSPC);
+        }
+    }
+}
+
+void UpdateStore::ExtractUpdateStore(std::istream &update_img)
+{
+    struct fs_header_v1_0 fsheader10;
+    update_img.read(reinterpret_cast<char *>(&fsheader10), static_cast<std::streamsize>(sizeof(struct fs_header_v1_0)));
+    if (update_img.gcount() != static_cast<std::streamsize>(sizeof(struct fs_header_v1_0)))
+    {
+        throw GenericException("Failed to read full header from stream", EIO);
+    }
+    const uint64_t file_size = this->CheckUpdateHeader(fsheader10);
+
+    const uint32_t manifest_size = this->ManifestSectionSize(fsheader10);
+    if (manifest_size > 0)
+    {
+        string manifest(manifest_size, '\0');
+        update_img.read(manifest.data(), static_cast<std::streamsize>(manifest_size));
+        if (update_img.gcount() != static_cast<std::streamsize>(manifest_size))
+        {
+            throw GenericException("Failed to read manifest section from stream", EIO);
+        }
+        this->AcceptManifestSection(manifest);
+    }
+
+    if (update_img.peek() == updater::container::MAGIC[0])
+    {
+        throw GenericException("Indexed container needs a seekable update image", ESPIPE);
+    }
+
+    /* archive size can not be checked in advance, the stream must end
+     * with the archive size declared in the header
+     */
+    try
+    {
+        fs::LibArchiveHandle archive_handle;
+        archive_handle.open_section(update_img, file_size);
+        ExtractTarBz2(archive_handle, this->extract_dir);
+        archive_handle.finish_section();
+    }
+    catch (const GenericException &ex)
+    {
+        throw GenericException("Failed to extract archive: " + std::string(ex.what()), ex.errorno);
+    }
+    catch (const std::exception &ex)
+    {
+        throw GenericException("Failed to extract archive: " + std::string(ex.what()), errno);
+    }
+}
+
+void UpdateStore::ExtractUpdateStore(int fd)
+{
+    struct fs_header_v1_0 fsheader10;
+    size_t filled = 0;
+    while (filled < sizeof(struct fs_header_v1_0))
+    {
+        ssize_t bytes = ::read(fd, reinterpret_cast<char *>(&fsheader10) + filled, sizeof(struct fs_header_v1_0) - filled);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+        {
+            throw GenericException("Failed to read full header from file descriptor " + to_string(fd), bytes < 0 ? errno : EIO);
+        }
+        filled += static_cast<size_t>(bytes);
+    }
+    const uint64_t file_size = this->CheckUpdateHeader(fsheader10);
+
+    const uint32_t manifest_size = this->ManifestSectionSize(fsheader10);
+    if (manifest_size > 0)
+    {
+        string manifest(manifest_size, '\0');
+        filled = 0;
+        while (filled < manifest_size)
+        {
+            ssize_t bytes = ::read(fd, manifest.data() + filled, manifest_size - filled);
+            if (bytes < 0 && errno == EINTR)
+                continue;
+            if (bytes <= 0)
+            {
+                throw GenericException("Failed to read manifest section from file descriptor " + to_string(fd), bytes < 0 ? errno : EIO);
+            }
+            filled += static_cast<size_t>(bytes);
+        }
+        this->AcceptManifestSection(manifest);
+    }
+
+    /* pipes can not be indexed, they fail on lseek() */
+    const off_t position = ::lseek(fd, 0, SEEK_CUR);
+    if (position >= 0 && updater::IndexedContainer::detect(fd, static_cast<uint64_t>(position)))
+    {
+        this->ExtractIndexed(fd, static_cast<uint64_t>(position), file_size, "<fd " + to_string(fd) + ">");
+        return;
+    }
+
+    try
+    {
+        fs::LibArchiveHandle archive_handle;
+        archive_handle.open_section(fd, file_size);
+        ExtractTarBz2(archive_handle, this->extract_dir);
+        archive_handle.finish_section();
+    }
+    catch (const GenericException &ex)
+    {
+        throw GenericException("Failed to extract archive: " + std::string(ex.what()), ex.errorno);
+    }
+    catch (const std::exception &ex)
+    {
+        throw GenericException("Failed to extract archive: " + std::string(ex.what()), errno);
+    }
 }
 
 void UpdateStore::ExtractUpdateStore(const filesystem::path &path_to_update_image)
 {
+    this->ExtractUpdateStore(path_to_update_image, {});
+}
+
+void UpdateStore::ExtractUpdateStore(const filesystem::path &path_to_update_image, const vector<string> &components)
+{
+    this->selected_components = components;
     unique_ptr<struct fs_header_v1_0> fsheader10 = make_unique<struct fs_header_v1_0>();
     ifstream update_img(path_to_update_image, (ifstream::in | ifstream::binary));
     string update_image_file = path_to_update_image;
@@ -152,15 +517,8 @@ void UpdateStore::ExtractUpdateStore(const filesystem::path &path_to_update_imag
         throw GenericException("Failed to read full header from " + update_image_file, EIO);
     }
 
-    uint64_t file_size = 0;
-    file_size = fsheader10->info.file_size_high & 0xFFFFFFFF;
-    file_size = file_size << 32;
-    file_size = file_size | (fsheader10->info.file_size_low & 0xFFFFFFFF);
-
-    if (strncmp("CERT", fsheader10->type, 4) && (file_size > 0))
-    {
-        throw GenericException(string("Update has wrong format"), ENOENT);
-    }
+    const uint64_t file_size = this->CheckUpdateHeader(*fsheader10);
+    const uint32_t manifest_size = this->ManifestSectionSize(*fsheader10);
 
     // Validate compressed archive size matches remaining file size
     auto current_pos = update_img.tellg();
@@ -173,62 +531,248 @@ void UpdateStore::ExtractUpdateStore(const filesystem::path &path_to_update_imag
         throw GenericException("File shorter than expected after header", EIO);
     }
 
-    if (static_cast<uint64_t>(actual_archive_size) != file_size)
+    if (static_cast<uint64_t>(actual_archive_size) != manifest_size + file_size)
     {
         std::string error_msg = "Archive size mismatch - expected: " +
-                                std::to_string(file_size) +
+                                std::to_string(manifest_size + file_size) +
                                 ", actual: " + std::to_string(actual_archive_size);
         throw GenericException(error_msg, EINVAL);
     }
 
-    /* set stream position to the start of the archive */
+    /* set stream position behind the header */
     update_img.seekg(current_pos);
     if (!update_img.good())
     {
         throw GenericException("seekg() to archive start failed", EIO);
     }
 
+    if (manifest_size > 0)
+    {
+        string manifest(manifest_size, '\0');
+        update_img.read(manifest.data(), static_cast<std::streamsize>(manifest_size));
+        if (update_img.gcount() != static_cast<std::streamsize>(manifest_size))
+        {
+            throw GenericException("Failed to read manifest section from " + update_image_file, EIO);
+        }
+        this->AcceptManifestSection(manifest);
+    }
+
+    int fd = ::open(update_image_file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw GenericException("Open file " + update_image_file + " fails", errno);
+    }
+    std::unique_ptr<int, void (*)(int *)> fd_guard(&fd, [](int *f) { ::close(*f); });
+    const uint64_t archive_offset = sizeof(struct fs_header_v1_0) + manifest_size;
+    if (updater::IndexedContainer::detect(fd, archive_offset))
+    {
+        this->ExtractIndexed(fd, archive_offset, file_size, update_image_file);
+        return;
+    }
+    if (!components.empty())
+    {
+        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN,
+            "tar.bz2 payload can not be extracted selectively, extract all images", logger::logLevel::DEBUG));
+    }
+
+    /* survives process abort, and power loss if the target is persistent */
+    const updater::ProgressJournal journal((this->extract_dir / ".extract.journal").string(),
+                                           "extract", update_image_file);
     try
     {
         fs::LibArchiveHandle archive_handle;
         archive_handle.open_stream(update_img);
 
         // Extract archive - no size validation here since it's the uncompressed size
-        ExtractTarBz2(archive_handle, TARGET_ARCHIV_DIR_PATH);
+        ExtractTarBz2(archive_handle, this->extract_dir, &journal);
 
         // Optional: Validate extracted content size if needed
-        // ValidateExtractedContent(TARGET_ARCHIV_DIR_PATH);
+        // ValidateExtractedContent(this->extract_dir);
+        journal.clear();
     }
     catch (const std::exception &ex)
     {
-        throw GenericException("Failed to extract archive: " + std::string(ex.what()), errno);
+        const int error = errno;
+        journal.clear();
+        throw GenericException("Failed to extract archive: " + std::string(ex.what()), error);
     }
 }
 
-string UpdateStore::CalculateCheckSum(const filesystem::path &filepath, const string &algorithm)
+void UpdateStore::ExtractIndexed(int fd, uint64_t base, uint64_t length, const string &path)
 {
+    using Member = updater::IndexedContainer::Member;
+    const filesystem::path &target_dir = this->extract_dir;
+
     try
     {
-        ifstream file(filepath, ios::binary);
-        if (!file)
+        const updater::IndexedContainer container(fd, base, length, path);
+
+        /* manifest first, a rejected bundle is not decompressed */
+        const Member *manifest_member = container.find(updater::manifest::FILE_NAME);
+        if (manifest_member)
+        {
+            const string manifest = container.read(*manifest_member, updater::manifest::MAX_SIZE);
+            if (this->checked_manifest.empty())
+            {
+                this->AcceptManifestSection(manifest);
+            }
+            else if (manifest != this->checked_manifest)
+            {
+                throw GenericException("fsupdate.json differs from manifest section", EINVAL);
+            }
+        }
+        else if (this->checked_manifest.empty())
+        {
+            throw GenericException("Container has no fsupdate.json", ENOENT);
+        }
+
+        vector<const Member *> jobs;
+        if (this->selected_components.empty())
+        {
+            for (const Member &member : container.members())
+            {
+                if (&member != manifest_member)
+                {
+                    jobs.push_back(&member);
+                }
+            }
+        }
+        else
+        {
+            for (const string &name : this->selected_components)
+            {
+                const Member *member = container.find(name);
+                if (!member)
+                {
+                    throw GenericException("Image " + name + " is not part of " + path, ENOENT);
+                }
+                jobs.push_back(member);
+            }
+        }
+
+        uint64_t needed = this->manifest_policy.reserve_bytes;
+        for (const Member *member : jobs)
+        {
+            if ((member->name.compare(app_store_name) != 0) && (member->name.compare(fw_store_name) != 0))
+            {
+                throw GenericException("Image " + member->name + " is not supported.", EINVAL);
+            }
+            /* an earlier extraction is overwritten */
+            error_code ec;
+            const uintmax_t on_disk = filesystem::file_size(target_dir / member->name, ec);
+            if (ec || on_disk < member->size)
+            {
+                needed += ec ? member->size : member->size - on_disk;
+            }
+        }
+        const uint64_t available = available_bytes(target_dir);
+        if (available != UINT64_MAX && available < needed)
+        {
+            throw GenericException("Update images need " + to_string(needed) + " bytes, " + to_string(available) +
+                                   " available in " + target_dir.string() + ".", ENOSPC);
+        }
+
+        uint64_t extracted = 0;
+        for (const Member *member : jobs)
+        {
+            extracted += member->size;
+        }
+        updater::PhaseTimer extract_timer(updater::Phase::EXTRACT, extracted);
+
+        /* members are independent, decompress them concurrently */
+        const unsigned workers = static_cast<unsigned>(min<size_t>(jobs.size(), max(1u, thread::hardware_concurrency())));
+        atomic<size_t> next_job{0};
+        atomic<bool> failed{false};
+        mutex result_lock;
+        exception_ptr first_error;
+
+        auto worker = [&]() {
+            while (!failed.load())
+            {
+                const size_t index = next_job.fetch_add(1);
+                if (index >= jobs.size())
+                {
+                    break;
+                }
+                const Member &member = *jobs[index];
+                try
+                {
+                    const auto start = chrono::steady_clock::now();
+                    container.extract(member, target_dir / member.name);
+                    const auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+                    this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN,
+                        "Extract " + member.name + ": " + to_string(elapsed.count()) + " ms", logger::logLevel::DEBUG));
+                }
+                catch (...)
+                {
+                    lock_guard<mutex> lock(result_lock);
+                    if (!failed.exchange(true))
+                    {
+                        first_error = current_exception();
+                    }
+                    break;
+                }
+            }
+        };
+
+        vector<thread> pool;
+        for (unsigned i = 1; i < workers; ++i)
+        {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto &t : pool)
+        {
+            t.join();
+        }
+        if (first_error)
+        {
+            rethrow_exception(first_error);
+        }
+    }
+    catch (const std::exception &ex)
+    {
+        throw GenericException("Failed to extract container: " + std::string(ex.what()), errno);
+    }
+}
+
+string UpdateStore::CalculateCheckSum(const filesystem::path &filepath, const string &algorithm,
+                                      unsigned threads, const atomic<bool> *cancel)
+{
+    try
+    {
+        if (algorithm == "BLAKE3")
+        {
+            /* tree hash, subtrees are hashed on all cores */
+            return updater::Blake3::hash_file(filepath.string(), threads, cancel);
+        }
+
+        int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
         {
             throw GenericException("Open file " + filepath.string() + " fails.", errno);
         }
-        auto hash = Botan::HashFunction::create(algorithm);
-        vector<char> buffer(BUFFER_SIZE);
-        char *buf_data = buffer.data();
-        const uint8_t *ubytes = reinterpret_cast<const uint8_t *>(buf_data);
+        unique_ptr<int, void (*)(int *)> fd_guard(&fd, [](int *f) { ::close(*f); });
 
-        while (file) {
-            file.read(buf_data, static_cast<streamsize>(BUFFER_SIZE));
-            streamsize got = file.gcount();
-            if (got > 0) {
-                hash->update(ubytes, static_cast<std::size_t>(got));
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            throw GenericException("Stat file " + filepath.string() + " fails.", errno);
+        }
+
+        unique_ptr<updater::HashEngine> hash = updater::HashEngine::create(algorithm, this->logger);
+        /* hash in slices to react on cancel */
+        const uint64_t file_size = static_cast<uint64_t>(st.st_size);
+        for (uint64_t offset = 0; offset < file_size; offset += HASH_SLICE_SIZE)
+        {
+            if (cancel && cancel->load())
+            {
+                return string();
             }
+            hash->update_from_fd(fd, offset, min<uint64_t>(HASH_SLICE_SIZE, file_size - offset));
         }
 
-        vector<uint8_t> output(hash->output_length());
-        hash->final(output.data());
+        vector<uint8_t> output = hash->final();
         string hashstr = Botan::hex_encode(output);
         /* transform to low for compare */
         transform(hashstr.begin(), hashstr.end(), hashstr.begin(), to_lower);
@@ -247,18 +791,180 @@ void UpdateStore::ExtractTarBz2(const filesystem::path &filepath, const filesyst
     ExtractTarBz2Internal(handle.get(), targetdir);
 }
 
-void UpdateStore::ExtractTarBz2(LibArchiveHandle &archive_handle, const filesystem::path &targetdir)
+void UpdateStore::ExtractTarBz2(LibArchiveHandle &archive_handle, const filesystem::path &targetdir,
+                                const updater::ProgressJournal *journal)
 {
-    ExtractTarBz2Internal(archive_handle.get(), targetdir);
+    ExtractTarBz2Internal(archive_handle.get(), targetdir, journal);
 }
 
-void UpdateStore::ExtractTarBz2Internal(struct archive* a, const std::filesystem::path& targetdir)
+void UpdateStore::ResumeEntry(struct archive *a, struct archive_entry *entry, const filesystem::path &dest,
+                              uint64_t resume_offset, uint64_t index, const updater::ProgressJournal &journal)
+{
+    int fd = ::open(dest.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw GenericException("Open file " + dest.string() + " fails.", errno);
+    }
+    unique_ptr<int, void (*)(int *)> fd_guard(&fd, [](int *f) { ::close(*f); });
+    if (::ftruncate(fd, static_cast<off_t>(resume_offset)) != 0)
+    {
+        throw GenericException("Truncate file " + dest.string() + " fails.", errno);
+    }
+
+    uint64_t next_checkpoint = resume_offset + updater::journal::CHECKPOINT_INTERVAL;
+    const void *buff;
+    size_t size;
+    la_int64_t offset;
+    while (true)
+    {
+        int r = archive_read_data_block(a, &buff, &size, &offset);
+        if (r == ARCHIVE_EOF)
+        {
+            break;
+        }
+        else if (r == ARCHIVE_WARN)
+        {
+            continue;
+        }
+        else if (r != ARCHIVE_OK)
+        {
+            std::string err = archive_error_string(a) ? archive_error_string(a) : "Unknown libarchive error";
+            throw GenericException("archive_read_data_block error for entry: " + dest.string() + " - " + err, archive_errno(a));
+        }
+
+        /* decompressed data written before interruption is dropped */
+        const uint64_t begin = static_cast<uint64_t>(offset);
+        const uint64_t end = begin + size;
+        if (end <= resume_offset)
+        {
+            continue;
+        }
+        const uint64_t skip = begin < resume_offset ? resume_offset - begin : 0;
+        const char *data = static_cast<const char *>(buff) + skip;
+        uint64_t position = begin + skip;
+        while (position < end)
+        {
+            ssize_t written = ::pwrite(fd, data, end - position, static_cast<off_t>(position));
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+            {
+                throw GenericException("Write file " + dest.string() + " fails.", errno);
+            }
+            data += written;
+            position += static_cast<uint64_t>(written);
+        }
+
+        if (end >= next_checkpoint)
+        {
+            updater::PhaseTimer sync_timer(updater::Phase::FSYNC);
+            if (::fdatasync(fd) != 0)
+            {
+                throw GenericException("Sync file " + dest.string() + " fails.", errno);
+            }
+            journal.checkpoint({index, end});
+            next_checkpoint = end + updater::journal::CHECKPOINT_INTERVAL;
+        }
+    }
+
+    /* attributes archive_write_disk sets on a fresh extraction */
+    if (archive_entry_size_is_set(entry) &&
+        ::ftruncate(fd, static_cast<off_t>(archive_entry_size(entry))) != 0)
+    {
+        throw GenericException("Truncate file " + dest.string() + " fails.", errno);
+    }
+    if (::geteuid() == 0 &&
+        ::fchown(fd, static_cast<uid_t>(archive_entry_uid(entry)), static_cast<gid_t>(archive_entry_gid(entry))) != 0)
+    {
+        throw GenericException("Change owner of " + dest.string() + " fails.", errno);
+    }
+    if (::fchmod(fd, archive_entry_perm(entry)) != 0)
+    {
+        throw GenericException("Change mode of " + dest.string() + " fails.", errno);
+    }
+    struct timespec times[2];
+    times[0].tv_sec = archive_entry_atime(entry);
+    times[0].tv_nsec = archive_entry_atime_is_set(entry) ? archive_entry_atime_nsec(entry) : UTIME_OMIT;
+    times[1].tv_sec = archive_entry_mtime(entry);
+    times[1].tv_nsec = archive_entry_mtime_is_set(entry) ? archive_entry_mtime_nsec(entry) : UTIME_OMIT;
+    ::futimens(fd, times);
+
+    if (::fsync(fd) != 0)
+    {
+        throw GenericException("Sync file " + dest.string() + " fails.", errno);
+    }
+}
+
+void UpdateStore::ExtractManifest(struct archive *a, struct archive *disk, struct archive_entry *entry, bool payload_seen)
+{
+    if (!archive_entry_size_is_set(entry) || archive_entry_size(entry) < 0 ||
+        static_cast<uint64_t>(archive_entry_size(entry)) > updater::manifest::MAX_SIZE)
+    {
+        throw GenericException("Invalid size of " + string(updater::manifest::FILE_NAME), EINVAL);
+    }
+
+    /* small, read completely before it is checked */
+    string manifest(static_cast<size_t>(archive_entry_size(entry)), '\0');
+    size_t filled = 0;
+    while (filled < manifest.size())
+    {
+        la_ssize_t bytes = archive_read_data(a, manifest.data() + filled, manifest.size() - filled);
+        if (bytes <= 0)
+        {
+            string err = archive_error_string(a) ? archive_error_string(a) : "Unexpected end of entry";
+            throw GenericException("archive_read_data failed for " + string(updater::manifest::FILE_NAME) + " - " + err, archive_errno(a));
+        }
+        filled += static_cast<size_t>(bytes);
+    }
+
+    if (!this->checked_manifest.empty())
+    {
+        if (manifest != this->checked_manifest)
+        {
+            throw GenericException("fsupdate.json differs from manifest section", EINVAL);
+        }
+    }
+    else if (payload_seen)
+    {
+        /* older layout, checked after extraction by ReadUpdateConfiguration */
+        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN,
+            "fsupdate.json follows the update images, no check before extraction", logger::logLevel::DEBUG));
+        this->CheckManifest(manifest, false);
+    }
+    else
+    {
+        this->CheckManifest(manifest, true);
+        this->checked_manifest = manifest;
+    }
+
+    int r = archive_write_header(disk, entry);
+    if (r == ARCHIVE_OK || r == ARCHIVE_WARN)
+    {
+        if (archive_write_data(disk, manifest.data(), manifest.size()) == static_cast<la_ssize_t>(manifest.size()))
+        {
+            r = archive_write_finish_entry(disk);
+        }
+        else
+        {
+            r = ARCHIVE_FATAL;
+        }
+    }
+    if (r != ARCHIVE_OK && r != ARCHIVE_WARN)
+    {
+        string err = archive_error_string(disk) ? archive_error_string(disk) : "Unknown write_disk error";
+        throw GenericException("Write " + string(updater::manifest::FILE_NAME) + " fails - " + err, archive_errno(disk));
+    }
+}
+
+void UpdateStore::ExtractTarBz2Internal(struct archive* a, const std::filesystem::path& targetdir,
+                                        const updater::ProgressJournal* journal)
 {
 #ifdef TEST_EXTRACT_TIME
     auto start = std::chrono::high_resolution_clock::now();
 #endif
 
     if (!a) throw GenericException("archive handle null", EINVAL);
+    updater::PhaseTimer extract_timer(updater::Phase::EXTRACT);
 
     /* RAII wrapper for archive_write_disk
      * Ensures automatic cleanup when function exits, even on expttions
@@ -298,6 +1004,14 @@ void UpdateStore::ExtractTarBz2Internal(struct archive* a, const std::filesystem
     uint64_t total_extracted_size = 0;
     size_t file_count = 0;
 
+    /* entries completed before an interruption, and progress of the next one */
+    updater::ProgressJournal::Position resume;
+    if (journal) {
+        resume = journal->resume_position();
+    }
+    uint64_t entry_index = 0;
+    bool payload_seen = false;
+
     while (true) {
         int r = archive_read_next_header(a, &entry);
         if (r == ARCHIVE_EOF) break;
@@ -305,6 +1019,7 @@ void UpdateStore::ExtractTarBz2Internal(struct archive* a, const std::filesystem
             std::string err = archive_error_string(a) ? archive_error_string(a) : "Unknown libarchive error";
             throw GenericException("archive_read_next_header failed: " + err, archive_errno(a));
         }
+        const uint64_t index = entry_index++;
 
         const char* entry_pathname = archive_entry_pathname(entry);
         if (!entry_pathname) {
@@ -336,6 +1051,57 @@ void UpdateStore::ExtractTarBz2Internal(struct archive* a, const std::filesystem
         /* Set pathname for libarchive extraction */
         archive_entry_set_pathname(entry, dest_full_str.c_str());
 
+        const bool regular_file = (archive_entry_filetype(entry) == AE_IFREG);
+        if (regular_file && rel == std::filesystem::path(updater::manifest::FILE_NAME)) {
+            /* rejects the bundle before the update images if the manifest comes first */
+            ExtractManifest(a, disk_archive.get(), entry, payload_seen);
+            ++file_count;
+            continue;
+        }
+        if (regular_file) {
+            payload_seen = true;
+        }
+        if (journal && regular_file && index < resume.item) {
+            std::error_code ec;
+            const uint64_t on_disk = std::filesystem::file_size(dest_full, ec);
+            if (!ec && archive_entry_size_is_set(entry) && on_disk == static_cast<uint64_t>(archive_entry_size(entry))) {
+                /* written before interruption, decompress only */
+                r = archive_read_data_skip(a);
+                if (r != ARCHIVE_OK) {
+                    std::string err = archive_error_string(a) ? archive_error_string(a) : "Unknown libarchive error";
+                    throw GenericException("archive_read_data_skip failed for entry: " + std::string(entry_pathname) + " - " + err, archive_errno(a));
+                }
+                ++file_count;
+                continue;
+            }
+            /* extracted files changed, extract the remaining entries completely */
+            resume = updater::ProgressJournal::Position();
+        }
+        if (journal && regular_file && index == resume.item && resume.offset > 0) {
+            std::error_code ec;
+            const uint64_t on_disk = std::filesystem::file_size(dest_full, ec);
+            if (!ec && on_disk >= resume.offset) {
+                if (this->logger) {
+                    this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN,
+                        "Resume extraction of " + std::string(entry_pathname) + " at " + std::to_string(resume.offset),
+                        logger::logLevel::DEBUG));
+                }
+                ResumeEntry(a, entry, dest_full, resume.offset, index, *journal);
+                journal->checkpoint({index + 1, 0});
+                ++file_count;
+                continue;
+            }
+        }
+
+        if (regular_file && archive_entry_size_is_set(entry)) {
+            const uint64_t available = available_bytes(canonical_target);
+            const uint64_t needed = static_cast<uint64_t>(archive_entry_size(entry)) + this->manifest_policy.reserve_bytes;
+            if (available != UINT64_MAX && available < needed) {
+                throw GenericException("Not enough space for " + std::string(entry_pathname) + ": " +
+                                       std::to_string(available) + " of " + std::to_string(needed) + " bytes available", ENOSPC);
+            }
+        }
+
         /* Write header (creates directory/file) */
         r = archive_write_header(disk_archive.get(), entry);
         if (r != ARCHIVE_OK && r != ARCHIVE_WARN) {
@@ -343,6 +1109,11 @@ void UpdateStore::ExtractTarBz2Internal(struct archive* a, const std::filesystem
             throw GenericException("archive_write_header failed for entry: " + std::string(entry_pathname) + " - " + err, archive_errno(disk_archive.get()));
         }
 
+        /* second descriptor to flush the file for checkpoints */
+        int sync_fd = (journal && regular_file) ? ::open(dest_full_str.c_str(), O_RDONLY | O_CLOEXEC) : -1;
+        std::unique_ptr<int, void (*)(int *)> sync_guard(&sync_fd, [](int *f) { if (*f >= 0) ::close(*f); });
+        uint64_t next_checkpoint = updater::journal::CHECKPOINT_INTERVAL;
+
         /* Extract data blocks */
         const void* buff;
         size_t size;
@@ -362,6 +1133,17 @@ void UpdateStore::ExtractTarBz2Internal(struct archive* a, const std::filesystem
                 }
                 /* accumulate total size */
                 total_extracted_size += size;
+                extract_timer.add_bytes(size);
+                updater::IoThrottle::account(size);
+
+                const uint64_t end = static_cast<uint64_t>(offset) + size;
+                if (sync_fd >= 0 && end >= next_checkpoint) {
+                    updater::PhaseTimer sync_timer(updater::Phase::FSYNC);
+                    if (::fdatasync(sync_fd) == 0) {
+                        journal->checkpoint({index, end});
+                    }
+                    next_checkpoint = end + updater::journal::CHECKPOINT_INTERVAL;
+                }
             } else if (r == ARCHIVE_WARN) {
                 /* Log warning but continue extraction */
                 std::string warn = archive_error_string(a) ? archive_error_string(a) : "Unknown libarchive warning";
@@ -382,6 +1164,12 @@ void UpdateStore::ExtractTarBz2Internal(struct archive* a, const std::filesystem
             std::string err = archive_error_string(disk_archive.get()) ? archive_error_string(disk_archive.get()) : "Unknown write_disk finish error";
             throw GenericException("archive_write_finish_entry failed for entry: " + std::string(entry_pathname) + " - " + err, archive_errno(disk_archive.get()));
         }
+        if (sync_fd >= 0) {
+            updater::PhaseTimer sync_timer(updater::Phase::FSYNC);
+            if (::fsync(sync_fd) == 0) {
+                journal->checkpoint({index + 1, 0});
+            }
+        }
         /*  count successfully extracted file */
         ++file_count;
     }
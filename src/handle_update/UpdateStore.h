@@ -1,19 +1,25 @@
 #pragma once
 
+#include "fs_consts.h"
 #include "fs_exceptions.h"        // fs::GenericException, fs::LibArchiveException
+#include "manifestPolicy.h"
+#include "updateManifest.h"
+#include <atomic>
 #include <filesystem>
+#include <functional>
+#include <istream>
 #include <string>
 #include <memory>
+#include <vector>
 #include <archive.h>
 #include <archive_entry.h>
 
-#include <json/json.h>
-
 // Forward declarations for libarchive types
 struct archive;
 struct archive_entry;
 
 namespace logger { class LoggerHandler; } // forward
+namespace updater { class ProgressJournal; } // forward
 namespace fs {
     class LibArchiveHandle; // forward
 
@@ -51,17 +57,77 @@ class UpdateStore
     bool fw_available;
     bool app_available;
     std::shared_ptr<logger::LoggerHandler> logger;
+    /* update images and fsupdate.json are extracted here */
+    std::filesystem::path extract_dir = TARGET_ARCHIV_DIR_PATH;
+    updater::ManifestPolicy manifest_policy;
+    std::function<std::string(const std::string &)> installed_version;
+    /* manifest checked before the update images, empty if not */
+    std::string checked_manifest;
+    /* update images to extract and check, empty for all */
+    std::vector<std::string> selected_components;
+    /* SHA-256 of the fsupdate.json read by ReadUpdateConfiguration */
+    std::vector<uint8_t> manifest_digest;
     /**
-     * Calculate SHA256 checksum of a file.
+     * Calculate checksum of a file.
      * @param filepath Path to the file
-     * @param algorithm Hash algorithm to use (e.g., "SHA-256")
-     * @return Hexadecimal string of the checksum
+     * @param algorithm Hash algorithm to use, "BLAKE3" or a Botan name (e.g., "SHA-256")
+     * @param threads Worker threads for tree hashes, 0 uses all cores
+     * @param cancel Optional flag, stops calculation when set
+     * @return Hexadecimal string of the checksum, empty if cancelled
      * @throw GenericException if file cannot be opened or hash calculation fails
      */
-    std::string CalculateCheckSum(const std::filesystem::path& filepath, const std::string& algorithm);
-    void ExtractTarBz2Internal(archive* a, const std::filesystem::path& targetdir);
+    std::string CalculateCheckSum(const std::filesystem::path& filepath, const std::string& algorithm,
+                                  unsigned threads = 0, const std::atomic<bool>* cancel = nullptr);
+    void ExtractTarBz2Internal(archive* a, const std::filesystem::path& targetdir,
+                               const updater::ProgressJournal* journal = nullptr);
+    /**
+     * Continue extraction of a regular file at the last checkpoint.
+     * Data before resume_offset is decompressed but not written again.
+     * @throw GenericException if writing fails
+     */
+    void ResumeEntry(archive* a, archive_entry* entry, const std::filesystem::path& dest,
+                     uint64_t resume_offset, uint64_t index, const updater::ProgressJournal& journal);
+    /**
+     * Check image type of update header.
+     * @return Size of the archive following the header
+     * @throw GenericException if update has wrong format
+     */
+    uint64_t CheckUpdateHeader(const struct fs_header_v1_0 &header);
+    /**
+     * Size of the manifest section following the update header.
+     * @return Section size, 0 if the header announces no section
+     * @throw GenericException if the section size is invalid
+     */
+    uint32_t ManifestSectionSize(const struct fs_header_v1_0 &header);
+    /**
+     * Check manifest read before the update images and store it as fsupdate.json.
+     * @throw GenericException if the manifest is rejected or can not be stored
+     */
+    void AcceptManifestSection(const std::string &manifest);
+    /**
+     * Parse manifest into root and apply manifest policy.
+     * @param manifest_text Content of fsupdate.json
+     * @param before_payload No update image is extracted yet, check free space
+     * @throw GenericException if the manifest is rejected
+     */
+    void CheckManifest(const std::string &manifest_text, bool before_payload);
+    /**
+     * Read fsupdate.json entry into memory, check it and write it to disk.
+     * @param payload_seen Update images were extracted before the manifest
+     * @throw GenericException if the manifest is rejected or writing fails
+     */
+    void ExtractManifest(archive *a, archive *disk, archive_entry *entry, bool payload_seen);
+    /**
+     * Extract selected members of an indexed container, concurrently.
+     * @param fd Update image
+     * @param base Offset of the container in the update image
+     * @param length Size of the container
+     * @param path Name of the update image for error messages
+     * @throw GenericException if the container is invalid or extraction fails
+     */
+    void ExtractIndexed(int fd, uint64_t base, uint64_t length, const std::string &path);
   protected:
-    Json::Value root;
+    updater::UpdateManifest manifest;
 
     bool parseFSUpdateJsonConfig();
     /**
@@ -74,9 +140,11 @@ class UpdateStore
     /* * Extract tar.bz2 archive to target directory.
      * @param archive_handle LibArchiveHandle object for managing libarchive resources
      * @param targetdir Target directory to extract files into
+     * @param journal Checkpoint journal, resumes an interrupted extraction of the same archive
      * @throw GenericException if extraction fails
      */
-    void ExtractTarBz2(LibArchiveHandle &archive_handle, const std::filesystem::path& targetdir);
+    void ExtractTarBz2(LibArchiveHandle &archive_handle, const std::filesystem::path& targetdir,
+                       const updater::ProgressJournal* journal = nullptr);
 
   public:
     bool IsFirmwareAvailable()
@@ -106,8 +174,22 @@ class UpdateStore
         return fw_store_name;
     }
 
+    /**
+     * SHA-256 of the fsupdate.json read by ReadUpdateConfiguration.
+     */
+    const std::vector<uint8_t> &GetManifestDigest() const
+    {
+        return manifest_digest;
+    }
+    /**
+     * Digest of an update image as listed in fsupdate.json.
+     * @param file File name of the update image, e.g. "update.fw"
+     * @return Raw digest, empty if the image is not listed
+     */
+    std::vector<uint8_t> GetImageDigest(const std::string &file) const;
+
   public:
-    UpdateStore();
+    explicit UpdateStore(std::shared_ptr<logger::LoggerHandler> logger);
     ~UpdateStore() = default;
 
     UpdateStore(const UpdateStore &) = delete;
@@ -115,8 +197,60 @@ class UpdateStore
     UpdateStore(UpdateStore &&) = delete;
     UpdateStore &operator=(UpdateStore &&) = delete;
 
+    /**
+     * Extract to another directory than TARGET_ARCHIV_DIR_PATH, e.g. in tests.
+     * @param dir Existing directory
+     */
+    void SetExtractDirectory(const std::filesystem::path &dir);
+
+    /**
+     * Set checks of the manifest before update images are extracted.
+     * @param policy Accepted handlers, version rule and reserved space
+     * @param installed Returns installed version for "update.fw" or
+     *        "update.app", needed by policy.newer_only
+     */
+    void SetManifestPolicy(const updater::ManifestPolicy &policy,
+                           std::function<std::string(const std::string &)> installed = nullptr);
+
+    /**
+     * Extract update image to TARGET_ARCHIV_DIR_PATH or the directory set by
+     * SetExtractDirectory(). An extraction of the same image interrupted by
+     * power loss or process abort resumes at the last checkpoint; files are
+     * verified by CheckUpdateSha256Sum afterwards.
+     * @throw GenericException if extraction fails
+     */
     void ExtractUpdateStore(const std::filesystem::path &path_to_update_image);
+    /**
+     * Extract fsupdate.json and the given update images only, e.g.
+     * update.app of a combined bundle. Members of an indexed container are
+     * decompressed selectively, a tar.bz2 payload is extracted completely.
+     * CheckUpdateSha256Sum afterwards checks the given images only.
+     * @param components File names of the update images, empty for all
+     * @throw GenericException if extraction fails or a component is missing
+     */
+    void ExtractUpdateStore(const std::filesystem::path &path_to_update_image,
+                            const std::vector<std::string> &components);
+    /**
+     * Extract update image while it is read from a stream, e.g. during
+     * download. The update image itself is never stored.
+     * @param update_img Stream positioned at the update header
+     * @throw GenericException if extraction fails
+     */
+    void ExtractUpdateStore(std::istream &update_img);
+    /**
+     * Extract update image while it is read from a file descriptor or pipe.
+     * @param fd Readable file descriptor positioned at the update header
+     * @throw GenericException if extraction fails
+     */
+    void ExtractUpdateStore(int fd);
     void ReadUpdateConfiguration(const std::string configuration_path);
+    /**
+     * Compare checksums of all update images listed in fsupdate.json.
+     * Images are hashed concurrently, the first mismatch cancels the others.
+     * @param path_to_update_image Directory of extracted update images
+     * @return All checksums match: true, else false and errno is set
+     * @throw GenericException if an image cannot be read
+     */
     bool CheckUpdateSha256Sum(const std::filesystem::path &path_to_update_image);
 };
 } // namespace fs
@@ -0,0 +1,243 @@
+#include "afAlgHashEngine.h"
+#include "resourcePolicy.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+extern "C" {
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <linux/if_alg.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+}
+
+#ifndef AF_ALG
+#define AF_ALG 38
+#endif
+
+namespace updater {
+
+namespace {
+    /* default pipe capacity, one splice round trip */
+    constexpr size_t SPLICE_CHUNK_SIZE = 64 * 1024;
+
+    struct KernelHash {
+        const char* name;
+        size_t output_length;
+    };
+
+    const std::map<std::string, KernelHash>& kernel_hashes() {
+        static const std::map<std::string, KernelHash> hashes = {
+            {"SHA-224", {"sha224", 28}},
+            {"SHA-256", {"sha256", 32}},
+            {"SHA-384", {"sha384", 48}},
+            {"SHA-512", {"sha512", 64}},
+        };
+        return hashes;
+    }
+
+    std::string trim(const std::string& value) {
+        const size_t first = value.find_first_not_of(" \t");
+        if (first == std::string::npos) {
+            return "";
+        }
+        const size_t last = value.find_last_not_of(" \t");
+        return value.substr(first, last - first + 1);
+    }
+
+    bool splice_unsupported(int error) {
+        return error == EINVAL || error == ENOSYS || error == EOPNOTSUPP;
+    }
+}
+
+AfAlgHashEngine::~AfAlgHashEngine() {
+    for (int fd : {op_fd_, tfm_fd_, pipe_fd_[0], pipe_fd_[1]}) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+std::unique_ptr<AfAlgHashEngine> AfAlgHashEngine::open(const std::string& algorithm) {
+    auto it = kernel_hashes().find(algorithm);
+    if (it == kernel_hashes().end()) {
+        return nullptr;
+    }
+
+    std::unique_ptr<AfAlgHashEngine> engine(new AfAlgHashEngine());
+    engine->output_length_ = it->second.output_length;
+
+    engine->tfm_fd_ = ::socket(AF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (engine->tfm_fd_ < 0) {
+        return nullptr;
+    }
+
+    struct sockaddr_alg sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.salg_family = AF_ALG;
+    std::strncpy(reinterpret_cast<char*>(sa.salg_type), "hash", sizeof(sa.salg_type) - 1);
+    std::strncpy(reinterpret_cast<char*>(sa.salg_name), it->second.name, sizeof(sa.salg_name) - 1);
+    if (::bind(engine->tfm_fd_, reinterpret_cast<struct sockaddr*>(&sa), sizeof(sa)) != 0) {
+        return nullptr;
+    }
+
+    engine->op_fd_ = ::accept4(engine->tfm_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (engine->op_fd_ < 0) {
+        return nullptr;
+    }
+
+    if (::pipe2(engine->pipe_fd_, O_CLOEXEC) != 0) {
+        return nullptr;
+    }
+
+    engine->driver_ = kernel_driver(algorithm);
+    if (engine->driver_.empty()) {
+        engine->driver_ = it->second.name;
+    }
+    return engine;
+}
+
+std::string AfAlgHashEngine::kernel_driver(const std::string& algorithm) {
+    auto it = kernel_hashes().find(algorithm);
+    if (it == kernel_hashes().end()) {
+        return "";
+    }
+
+    std::ifstream proc_crypto("/proc/crypto");
+    std::string line;
+    std::string name, driver, best_driver;
+    long priority = -1, best_priority = -1;
+
+    /* blocks of "key : value" lines, separated by empty lines */
+    auto finish_block = [&]() {
+        if (name == it->second.name && priority > best_priority) {
+            best_priority = priority;
+            best_driver = driver;
+        }
+        name.clear();
+        driver.clear();
+        priority = -1;
+    };
+
+    while (std::getline(proc_crypto, line)) {
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            finish_block();
+            continue;
+        }
+        const std::string key = trim(line.substr(0, colon));
+        const std::string value = trim(line.substr(colon + 1));
+        if (key == "name") {
+            name = value;
+        } else if (key == "driver") {
+            driver = value;
+        } else if (key == "priority") {
+            priority = std::strtol(value.c_str(), nullptr, 10);
+        }
+    }
+    finish_block();
+
+    return best_driver;
+}
+
+bool AfAlgHashEngine::is_generic_driver(const std::string& driver) {
+    auto ends_with = [&driver](const std::string& suffix) {
+        return driver.size() >= suffix.size() &&
+               driver.compare(driver.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    return driver.empty() || ends_with("-generic") || ends_with("-lib");
+}
+
+void AfAlgHashEngine::send_all(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        /* MSG_MORE keeps the hash open until final() */
+        ssize_t sent = ::send(op_fd_, data, length, MSG_MORE);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) {
+            throw std::runtime_error(std::string("AF_ALG send fails: ") + std::strerror(errno));
+        }
+        data += sent;
+        length -= static_cast<size_t>(sent);
+    }
+}
+
+void AfAlgHashEngine::update(const uint8_t* data, size_t length) {
+    send_all(data, length);
+}
+
+void AfAlgHashEngine::final(uint8_t* out) {
+    ssize_t bytes;
+    do {
+        bytes = ::read(op_fd_, out, output_length_);
+    } while (bytes < 0 && errno == EINTR);
+
+    if (bytes != static_cast<ssize_t>(output_length_)) {
+        throw std::runtime_error(std::string("AF_ALG digest read fails: ") + std::strerror(errno));
+    }
+}
+
+void AfAlgHashEngine::splice_range(int fd, uint64_t offset, uint64_t length) {
+    loff_t in_offset = static_cast<loff_t>(offset);
+    const uint64_t end = offset + length;
+
+    while (static_cast<uint64_t>(in_offset) < end) {
+        const size_t want = static_cast<size_t>(std::min<uint64_t>(SPLICE_CHUNK_SIZE, end - in_offset));
+        ssize_t in = ::splice(fd, &in_offset, pipe_fd_[1], nullptr, want, SPLICE_F_MORE);
+        if (in < 0 && errno == EINTR) continue;
+        if (in < 0 && splice_unsupported(errno)) {
+            splice_failed_ = true;
+            HashEngine::update_from_fd(fd, static_cast<uint64_t>(in_offset), end - in_offset);
+            return;
+        }
+        if (in < 0) {
+            throw std::runtime_error(std::string("splice from file fails: ") + std::strerror(errno));
+        }
+        if (in == 0) {
+            throw std::runtime_error("splice from file fails: unexpected end of file");
+        }
+
+        size_t pending = static_cast<size_t>(in);
+        while (pending > 0) {
+            /* SPLICE_F_MORE maps to MSG_MORE, the hash stays open */
+            ssize_t out = ::splice(pipe_fd_[0], nullptr, op_fd_, nullptr, pending, SPLICE_F_MORE);
+            if (out < 0 && errno == EINTR) continue;
+            if (out < 0 && splice_unsupported(errno)) {
+                /* socket does not take pages, drain the pipe by copy */
+                splice_failed_ = true;
+                std::vector<uint8_t> buffer(pending);
+                size_t filled = 0;
+                while (filled < pending) {
+                    ssize_t bytes = ::read(pipe_fd_[0], buffer.data() + filled, pending - filled);
+                    if (bytes < 0 && errno == EINTR) continue;
+                    if (bytes <= 0) {
+                        throw std::runtime_error(std::string("pipe read fails: ") + std::strerror(errno));
+                    }
+                    filled += static_cast<size_t>(bytes);
+                }
+                send_all(buffer.data(), pending);
+                HashEngine::update_from_fd(fd, static_cast<uint64_t>(in_offset), end - in_offset);
+                return;
+            }
+            if (out <= 0) {
+                throw std::runtime_error(std::string("splice to AF_ALG fails: ") + std::strerror(errno));
+            }
+            pending -= static_cast<size_t>(out);
+        }
+        IoThrottle::account(static_cast<uint64_t>(in));
+    }
+}
+
+void AfAlgHashEngine::update_from_fd(int fd, uint64_t offset, uint64_t length) {
+    if (splice_failed_) {
+        HashEngine::update_from_fd(fd, offset, length);
+        return;
+    }
+    splice_range(fd, offset, length);
+}
+
+} // namespace updater
@@ -0,0 +1,68 @@
+/**
+ * Hash engine on top of the kernel crypto API (AF_ALG).
+ *
+ * Files are spliced through a pipe into the hash socket, so the data is
+ * hashed by the kernel driver (crypto engine or CPU extensions) without a
+ * copy to user space. Works with every kernel that has CONFIG_CRYPTO_USER_API_HASH,
+ * with the software driver as last resort.
+ */
+
+#pragma once
+
+#include "hashEngine.h"
+
+#include <memory>
+#include <string>
+
+namespace updater {
+
+    class AfAlgHashEngine : public HashEngine {
+    private:
+        int tfm_fd_ = -1;
+        int op_fd_ = -1;
+        int pipe_fd_[2] = {-1, -1};
+        size_t output_length_ = 0;
+        std::string driver_;
+        /* splice not supported by source file system, use read/send */
+        bool splice_failed_ = false;
+
+        AfAlgHashEngine() = default;
+
+        void send_all(const uint8_t* data, size_t length);
+        void splice_range(int fd, uint64_t offset, uint64_t length);
+
+    public:
+        ~AfAlgHashEngine() override;
+
+        AfAlgHashEngine(const AfAlgHashEngine&) = delete;
+        AfAlgHashEngine& operator=(const AfAlgHashEngine&) = delete;
+
+        /**
+         * Open kernel hash.
+         * @param algorithm Botan hash name, e.g. "SHA-256".
+         * @return Engine or nullptr if AF_ALG or the algorithm is not available.
+         */
+        static std::unique_ptr<AfAlgHashEngine> open(const std::string& algorithm);
+
+        /**
+         * Kernel driver with the highest priority for algorithm, read from /proc/crypto.
+         * @param algorithm Botan hash name, e.g. "SHA-256".
+         * @return Driver name, e.g. "sha256-caam", or empty if unknown.
+         */
+        static std::string kernel_driver(const std::string& algorithm);
+
+        /**
+         * Driver is a plain software implementation.
+         */
+        static bool is_generic_driver(const std::string& driver);
+
+        std::string name() const override { return "af_alg/" + driver_; }
+        bool accelerated() const override { return !is_generic_driver(driver_); }
+        size_t output_length() const override { return output_length_; }
+        void update(const uint8_t* data, size_t length) override;
+        void final(uint8_t* out) override;
+        using HashEngine::final;
+        void update_from_fd(int fd, uint64_t offset, uint64_t length) override;
+    };
+
+} // namespace updater
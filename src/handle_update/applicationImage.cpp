@@ -1,12 +1,20 @@
 #include "applicationImage.h"
+#include "chunkManifest.h"
+#include "hashEngine.h"
+#include "progressJournal.h"
+#include "resourcePolicy.h"
+#include "updateMetrics.h"
+#include "writeEngine.h"
 #include "utils.h"
 
 extern "C" {
     #include <zlib.h>
     #include <fcntl.h>
+    #include <sys/stat.h>
     #include <unistd.h>
 }
 
+#include <algorithm>
 #include <iterator>
 #include <sstream>
 #include <chrono>
@@ -26,9 +34,13 @@ extern "C" {
 applicationImage::applicationImage(const std::string & path, const std::shared_ptr<logger::LoggerHandler> & logger):
     path(path),
     logger(logger),
-    header_size(4+8+4)
+    header_size(4+8+4),
+    payload_offset(4+8+4),
+    file_size(0),
+    sections{}
 {
     this->logger->setLogEntry(std::make_shared<logger::LogEntry>(APPLICATION, std::string("constructor: application image path: ") + path, logger::logLevel::DEBUG));
+    updater::PhaseTimer timer(updater::Phase::HEADER_PARSE, this->header_size);
     if (!std::filesystem::exists(path)) {
         throw std::runtime_error("File does not exist: " + path);
     }
@@ -100,7 +112,7 @@ applicationImage::applicationImage(const std::string & path, const std::shared_p
     crc32_calc = crc32(crc32_calc, application_image_size_binary, 8);
     crc32_calc = crc32(crc32_calc, header_version_binary, 4);
 
-    if (header_version != 1)
+    if (header_version != APP_IMAGE_VERSION_1 && header_version != APP_IMAGE_VERSION_2)
     {
         this->logger->setLogEntry(std::make_shared<logger::LogEntry>(APPLICATION, std::string("constructor: header version: ") + std::to_string(header_version), logger::logLevel::ERROR));
         throw(WrongHeaderVersion(header_version));
@@ -115,6 +127,20 @@ applicationImage::applicationImage(const std::string & path, const std::shared_p
         throw(WrongHeaderChecksum(crc32_calc, crc32_check));
     }
 
+    this->file_size = image_size;
+    if (header_version == APP_IMAGE_VERSION_2)
+    {
+        this->payload_offset = APP_V2_PAYLOAD_OFFSET;
+        this->readTrailer();
+        timer.add_bytes(APP_V2_TRAILER_SIZE);
+    }
+    else
+    {
+        /* v1: timestamp follows payload, signature and certificates are searched */
+        this->sections[size_t(ImageSection::PAYLOAD)] = {this->payload_offset, this->application_image_size};
+        this->sections[size_t(ImageSection::TIMESTAMP)] = {this->payload_offset + this->application_image_size, SIZE_CERT_APP_DATE_SIGN};
+    }
+
     this->logger->setLogEntry(std::make_shared<logger::LogEntry>(APPLICATION, std::string("constructor: application image size: ") + std::to_string(application_image_size), logger::logLevel::DEBUG));
     this->logger->setLogEntry(std::make_shared<logger::LogEntry>(APPLICATION, std::string("constructor: header version: ") + std::to_string(header_version), logger::logLevel::DEBUG));
 }
@@ -129,13 +155,137 @@ uint64_t applicationImage::getSizeOfImage() const
     return this->application_image_size;
 }
 
+uint32_t applicationImage::getHeaderVersion() const
+{
+    return this->header_version;
+}
+
+uint64_t applicationImage::getPayloadOffset() const
+{
+    return this->payload_offset;
+}
+
+applicationImage::Section applicationImage::getSectionLocation(ImageSection section) const
+{
+    return this->sections.at(size_t(section));
+}
+
+std::vector<uint8_t> applicationImage::readRange(uint64_t offset, uint64_t length)
+{
+    std::vector<uint8_t> data(length);
+    if (length == 0)
+    {
+        return data;
+    }
+
+    application.clear();
+    application.seekg(offset, std::ios::beg);
+    application.read(reinterpret_cast<char *>(data.data()), length);
+    if (!application.good() || uint64_t(application.gcount()) != length)
+    {
+        const std::string error_msg = "failed to read " + std::to_string(length) + " bytes at offset " + std::to_string(offset);
+        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(APPLICATION, std::string("readRange: ") + error_msg, logger::logLevel::ERROR));
+        throw(OpenApplicationImage(path, error_msg));
+    }
+    return data;
+}
+
+std::vector<uint8_t> applicationImage::getSection(ImageSection section)
+{
+    const Section location = this->getSectionLocation(section);
+    return this->readRange(location.offset, location.length);
+}
+
+void applicationImage::readTrailer()
+{
+    if (this->file_size < APP_V2_PAYLOAD_OFFSET + APP_V2_TRAILER_SIZE)
+    {
+        throw(ImageUpdatePackageToSmall());
+    }
+
+    const uint64_t trailer_offset = this->file_size - APP_V2_TRAILER_SIZE;
+    const std::vector<uint8_t> trailer = this->readRange(trailer_offset, APP_V2_TRAILER_SIZE);
+
+    auto be32 = [&trailer](size_t pos) {
+        uint32_t value = 0;
+        for (size_t i = 0; i < 4; ++i)
+            value = (value << 8) | trailer[pos + i];
+        return value;
+    };
+    auto be64 = [&trailer](size_t pos) {
+        uint64_t value = 0;
+        for (size_t i = 0; i < 8; ++i)
+            value = (value << 8) | trailer[pos + i];
+        return value;
+    };
+
+    if (std::memcmp(trailer.data(), APP_V2_TRAILER_MAGIC, sizeof(APP_V2_TRAILER_MAGIC)) != 0)
+    {
+        throw(WrongImageTrailer("magic mismatch"));
+    }
+
+    uint32_t crc32_calc = crc32(0L, Z_NULL, 0);
+    crc32_calc = crc32(crc32_calc, trailer.data(), APP_V2_TRAILER_SIZE - 4);
+    if (crc32_calc != be32(APP_V2_TRAILER_SIZE - 4))
+    {
+        throw(WrongImageTrailer("crc32 mismatch"));
+    }
+
+    if (be32(8) != APP_V2_TRAILER_VERSION || be32(12) != APP_V2_SECTION_COUNT)
+    {
+        throw(WrongImageTrailer("unsupported trailer version " + std::to_string(be32(8))));
+    }
+
+    for (size_t i = 0; i < APP_V2_SECTION_COUNT; ++i)
+    {
+        const uint64_t offset = be64(16 + i * 16);
+        const uint64_t length = be64(24 + i * 16);
+
+        if (i > size_t(ImageSection::METADATA_SIGNATURE) && (offset != 0 || length != 0))
+        {
+            throw(WrongImageTrailer("reserved section " + std::to_string(i) + " is used"));
+        }
+        /* sections lie between payload start and trailer */
+        if (length > 0 && (offset < APP_V2_PAYLOAD_OFFSET || offset > trailer_offset || length > trailer_offset - offset))
+        {
+            throw(WrongImageTrailer("section " + std::to_string(i) + " out of bounds"));
+        }
+        this->sections[i] = {offset, length};
+    }
+
+    const Section &payload = this->sections[size_t(ImageSection::PAYLOAD)];
+    if (payload.offset != APP_V2_PAYLOAD_OFFSET || payload.length != this->application_image_size)
+    {
+        throw(WrongImageTrailer("payload section does not match header"));
+    }
+
+    const Section &timestamp = this->sections[size_t(ImageSection::TIMESTAMP)];
+    if (timestamp.length == 0 || timestamp.length > SIZE_CERT_APP_DATE_SIGN)
+    {
+        throw(WrongImageTrailer("invalid timestamp length " + std::to_string(timestamp.length)));
+    }
+
+    if (this->sections[size_t(ImageSection::SIGNATURE)].length == 0)
+    {
+        throw(WrongImageTrailer("no signature section"));
+    }
+
+    this->logger->setLogEntry(std::make_shared<logger::LogEntry>(APPLICATION,
+        std::string("readTrailer: v2 sections: signature ") + std::to_string(this->sections[size_t(ImageSection::SIGNATURE)].length) +
+        " B, certificates " + std::to_string(this->sections[size_t(ImageSection::CERTIFICATES)].length) +
+        " B, metadata " + std::to_string(this->sections[size_t(ImageSection::METADATA)].length) + " B",
+        logger::logLevel::DEBUG));
+}
+
 // Read and parse signing timestamp from fixed-size field with dynamic trimming
 std::chrono::system_clock::time_point applicationImage::getTimeOfSigning()
 {
-    application.seekg(application_image_size + header_size, std::ios::beg);
+    const Section timestamp = this->getSectionLocation(ImageSection::TIMESTAMP);
+    application.clear();
+    application.seekg(timestamp.offset, std::ios::beg);
 
-    constexpr size_t MAX_TS = SIZE_CERT_APP_DATE_SIGN;
-    char buf[MAX_TS];
+    const size_t MAX_TS = std::min<uint64_t>(timestamp.length, SIZE_CERT_APP_DATE_SIGN);
+    char buf[SIZE_CERT_APP_DATE_SIGN];
     application.read(buf, MAX_TS);
     if (!application.good()) {
         if (application.eof()) {
@@ -172,6 +322,12 @@ std::chrono::system_clock::time_point applicationImage::getTimeOfSigning()
 
 std::vector<uint8_t> applicationImage::getSignature()
 {
+    if (this->header_version == APP_IMAGE_VERSION_2)
+    {
+        /* located through trailer, no search required */
+        return this->getSection(ImageSection::SIGNATURE);
+    }
+
     const uint64_t signature_offset = this->header_size + this->application_image_size + SIZE_CERT_APP_DATE_SIGN;
 
     application.clear();
@@ -225,91 +381,161 @@ std::string applicationImage::getPath() const
 
 void applicationImage::read_img(std::function<void(char *, uint32_t)> func)
 {
-    application.seekg(this->header_size, application.beg);
-    char BUFFER[FILE_CHUNK_BUFFER] = {0};
+    /* squashfs content followed by timestamp */
+    this->read_img_content_only(func, this->application_image_size);
 
-    while (application.tellg() < std::streampos(uint64_t(this->header_size) + SIZE_CERT_APP_DATE_SIGN + this->application_image_size - uint64_t(FILE_CHUNK_BUFFER)))
+    std::vector<uint8_t> timestamp = this->getTimestamp();
+    func(reinterpret_cast<char *>(timestamp.data()), timestamp.size());
+}
+
+
+bool applicationImage::compareCopied(int fd, uint64_t length, const std::function<void(const char *, size_t)> &feed)
+{
+    char source[FILE_CHUNK_BUFFER];
+    char copied[FILE_CHUNK_BUFFER];
+
+    application.clear();
+    application.seekg(this->payload_offset, application.beg);
+
+    for (uint64_t cursor = 0; cursor < length;)
     {
-        application.read(BUFFER, FILE_CHUNK_BUFFER);
-        if (!application.good())
+        const size_t chunk = static_cast<size_t>(std::min<uint64_t>(FILE_CHUNK_BUFFER, length - cursor));
+        application.read(source, chunk);
+        if (!application.good() || pread(fd, copied, chunk, static_cast<off_t>(cursor)) != (ssize_t)chunk ||
+            memcmp(source, copied, chunk) != 0)
         {
-            const std::string error_msg = util::describe_stream_error(application);
-            this->logger->setLogEntry(std::make_shared<logger::LogEntry>(APPLICATION, std::string("read_img: ") + error_msg, logger::logLevel::ERROR));
-            throw(OpenApplicationImage(path, error_msg));
+            return false;
         }
-        func(BUFFER, FILE_CHUNK_BUFFER);
+        feed(source, chunk);
+        cursor += chunk;
     }
-    uint32_t residual_data = this->header_size + this->application_image_size + SIZE_CERT_APP_DATE_SIGN - application.tellg();
-    application.read(BUFFER, std::streampos(residual_data));
-    if (!application.good())
-    {
-        const std::string error_msg = util::describe_stream_error(application);
-        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(APPLICATION, std::string("read_img: ") + error_msg, logger::logLevel::ERROR));
-        throw(OpenApplicationImage(path, error_msg));
-    }
-    func(BUFFER, residual_data);
+    return true;
 }
 
-
-void applicationImage::copyImage(const std::string &dest)
+void applicationImage::copyImage(const std::string &dest, const updater::ChunkManifest *manifest,
+                                 const std::vector<uint8_t> *payload_digest)
 {
     int fd = -1;
+    const updater::ProgressJournal journal(dest + ".journal", "copy", this->path);
     try
     {
+        std::unique_ptr<updater::ChunkStreamVerifier> chunk_verifier;
+        std::unique_ptr<updater::HashEngine> payload_hash;
+        auto reset_verifiers = [&]()
+        {
+            if (manifest != nullptr)
+            {
+                chunk_verifier = std::make_unique<updater::ChunkStreamVerifier>(*manifest);
+            }
+            if (payload_digest != nullptr)
+            {
+                payload_hash = updater::HashEngine::create(crypto::HASH_ALGORITHM, this->logger);
+            }
+        };
+        auto feed = [&](const char *data, size_t length)
+        {
+            if (chunk_verifier)
+            {
+                chunk_verifier->update(reinterpret_cast<const uint8_t *>(data), length);
+            }
+            if (payload_hash)
+            {
+                payload_hash->update(reinterpret_cast<const uint8_t *>(data), length);
+            }
+        };
+        reset_verifiers();
+
+        /* resume interrupted copy of the same image, the copied part is
+         * compared with the source and fed to the verifiers again
+         */
+        uint64_t cursor = journal.resume_position().offset;
+        if (cursor > 0 && cursor < this->application_image_size)
+        {
+            struct stat st;
+            fd = open(dest.c_str(), O_RDWR);
+            /* writing continues at the cursor, not at the start of the file */
+            if (fd >= 0 && fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) >= cursor &&
+                this->compareCopied(fd, cursor, feed) && ftruncate(fd, static_cast<off_t>(cursor)) == 0 &&
+                lseek(fd, static_cast<off_t>(cursor), SEEK_SET) == static_cast<off_t>(cursor))
+            {
+                this->logger->setLogEntry(std::make_shared<logger::LogEntry>(APPLICATION,
+                    "copyImage: resume at " + std::to_string(cursor) + " of " + std::to_string(this->application_image_size),
+                    logger::logLevel::DEBUG));
+            }
+            else
+            {
+                if (fd >= 0)
+                    close(fd);
+                fd = -1;
+                cursor = 0;
+                reset_verifiers();
+            }
+        }
+        else
+        {
+            cursor = 0;
+        }
+
         // open temp file
-        fd = open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            fd = open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
         if (fd < 0)
         {
             throw DuringWriteApplicationImage("open() failed: " + std::string(strerror(errno)));
         }
 
-        application.seekg(this->header_size, application.beg);
+        /* bounded dirty pages instead of one long fsync at the end */
+        updater::WriteEngine writer(fd, dest, cursor);
+        writer.preallocate(this->application_image_size);
+
+        application.clear();
+        application.seekg(this->payload_offset + cursor, application.beg);
 
-        uint64_t cursor = 0;
         char buffer[FILE_CHUNK_BUFFER];
+        uint64_t next_checkpoint = cursor + updater::journal::CHECKPOINT_INTERVAL;
 
-        while ((cursor + FILE_CHUNK_BUFFER) <= this->application_image_size)
+        while (cursor < this->application_image_size)
         {
-            application.read(buffer, FILE_CHUNK_BUFFER);
+            const size_t length = static_cast<size_t>(std::min<uint64_t>(FILE_CHUNK_BUFFER, this->application_image_size - cursor));
+            application.read(buffer, length);
 
             if (!application.good())
             {
                 throw DuringWriteApplicationImage("read error");
             }
 
-            ssize_t written = write(fd, buffer, FILE_CHUNK_BUFFER);
-            if (written != FILE_CHUNK_BUFFER)
+            updater::IoThrottle::account(length);
+            feed(buffer, length);
+            writer.write(buffer, length);
+
+            cursor += length;
+            if (cursor >= next_checkpoint && cursor < this->application_image_size)
             {
-                throw DuringWriteApplicationImage("write error");
+                /* checkpoint only covers data on storage */
+                writer.sync();
+                journal.checkpoint({0, cursor});
+                next_checkpoint = cursor + updater::journal::CHECKPOINT_INTERVAL;
             }
-
-            cursor += FILE_CHUNK_BUFFER;
         }
 
-        // remaining bytes
-        size_t remaining = this->application_image_size - cursor;
-        if (remaining > 0)
+        if (chunk_verifier)
         {
-            application.read(buffer, remaining);
-
-            if (!application.good())
-            {
-                throw DuringWriteApplicationImage("read error (remaining)");
-            }
-
-            ssize_t written = write(fd, buffer, remaining);
-            if (written != (ssize_t)remaining)
-            {
-                throw DuringWriteApplicationImage("write error (remaining)");
-            }
+            chunk_verifier->finish();
+        }
+        if (payload_hash && payload_hash->final() != *payload_digest)
+        {
+            throw DuringWriteApplicationImage("payload does not match verified digest");
         }
 
         // ensure file content is on storage
-        if (fsync(fd) != 0)
-            throw DuringWriteApplicationImage("fsync(file) failed: " + std::string(strerror(errno)));
+        writer.finish();
 
         if (close(fd) != 0)
             throw DuringWriteApplicationImage("close(file) failed");
+
+        journal.clear();
     }
     catch (const std::exception &e)
     {
@@ -317,6 +543,7 @@ void applicationImage::copyImage(const std::string &dest)
             close(fd);
 
         unlink(dest.c_str()); // cleanup temp file
+        journal.clear();
 
         this->logger->setLogEntry(
             std::make_shared<logger::LogEntry>(
@@ -346,16 +573,18 @@ std::vector<uint8_t> applicationImage::getHeader()
 
 std::vector<uint8_t> applicationImage::getTimestamp()
 {
+    const Section location = this->getSectionLocation(ImageSection::TIMESTAMP);
+
     // Reset any error flags and seek to correct position
     application.clear();
-    application.seekg(this->application_image_size + header_size, application.beg);
+    application.seekg(location.offset, application.beg);
 
     if (application.fail()) {
         throw OpenApplicationImage(path, "getTimestamp: failed to seek to timestamp position");
     }
 
-    std::vector<uint8_t> timestamp(SIZE_CERT_APP_DATE_SIGN);
-    application.read(reinterpret_cast<char*>(timestamp.data()), SIZE_CERT_APP_DATE_SIGN);
+    std::vector<uint8_t> timestamp(location.length);
+    application.read(reinterpret_cast<char*>(timestamp.data()), location.length);
 
     if (!application.good()) {
         throw OpenApplicationImage(path, "getTimestamp: failed to read timestamp data");
@@ -366,7 +595,8 @@ std::vector<uint8_t> applicationImage::getTimestamp()
 
 void applicationImage::read_img_content_only(std::function<void(char *, uint32_t)> func, uint64_t content_size)
 {
-    application.seekg(this->header_size, application.beg);
+    application.clear();
+    application.seekg(this->payload_offset, application.beg);
     char BUFFER[FILE_CHUNK_BUFFER] = {0};
 
     uint64_t bytes_read = 0;
@@ -16,6 +16,7 @@
 #include <stdexcept>
 
 #include <vector>
+#include <array>
 #include <memory>
 #include <functional>
 
@@ -29,6 +30,32 @@
 #define FILE_CHUNK_BUFFER BUFSIZ
 inline constexpr size_t SIZE_CERT_APP_DATE_SIGN = 26;
 
+/* application image format versions */
+inline constexpr uint32_t APP_IMAGE_VERSION_1 = 1;
+inline constexpr uint32_t APP_IMAGE_VERSION_2 = 2;
+
+/* v2: payload starts at fixed aligned offset, sections located through trailer at EOF */
+inline constexpr uint64_t APP_V2_PAYLOAD_OFFSET = 4096;
+inline constexpr char APP_V2_TRAILER_MAGIC[8] = {'F', 'S', 'A', 'P', 'P', 'T', 'R', 'L'};
+inline constexpr uint32_t APP_V2_TRAILER_VERSION = 1;
+inline constexpr size_t APP_V2_SECTION_COUNT = 8;
+/* magic + version + count + sections(offset, length) + reserved + crc32 */
+inline constexpr size_t APP_V2_TRAILER_SIZE = 8 + 4 + 4 + APP_V2_SECTION_COUNT * 16 + 4 + 4;
+
+/**
+ * Sections of the v2 trailer table. Remaining slots are reserved and must be empty.
+ */
+enum class ImageSection : size_t
+{
+    PAYLOAD = 0,
+    TIMESTAMP = 1,
+    SIGNATURE = 2,
+    /* sequence of uint32 big-endian length + DER certificate, signer first */
+    CERTIFICATES = 3,
+    METADATA = 4,
+    METADATA_SIGNATURE = 5
+};
+
 namespace crypto {
     // Hash algorithm configuration
     inline const std::string HASH_ALGORITHM = "SHA-256";
@@ -36,6 +63,9 @@ namespace crypto {
 
     // Signature algorithm configuration
     inline const std::string SIGNATURE_SCHEME = "PSSR(SHA-256)";
+    // Same scheme for a precomputed SHA-256 digest
+    inline const std::string SIGNATURE_SCHEME_RAW = "PSSR_Raw(SHA-256)";
+    inline const std::string SIGNATURE_HASH = "SHA-256";
 
     // Certificate fingerprint algorithm
     inline const std::string FINGERPRINT_ALGORITHM = "SHA-256";
@@ -43,6 +73,10 @@ namespace crypto {
 
 constexpr char APPLICATION[] = "application image";
 
+namespace updater {
+    class ChunkManifest;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 /// applicationImage' exception definitions
 ///////////////////////////////////////////////////////////////////////////
@@ -71,7 +105,7 @@ class WrongHeaderVersion : public fs::BaseFSUpdateException
         explicit WrongHeaderVersion(const uint32_t header_version)
         {
             this->error_msg = std::string("Wrong header version: ") + std::to_string(header_version);
-            this->error_msg += std::string(" expected version: 1");
+            this->error_msg += std::string(" expected version: 1 or 2");
         }
 };
 
@@ -118,6 +152,19 @@ class WrongHeaderChecksum : public fs::BaseFSUpdateException
         }
 };
 
+class WrongImageTrailer : public fs::BaseFSUpdateException
+{
+    public:
+        /**
+         * Section table of v2 application image is malformed.
+         * @param msg Reason of rejection.
+         */
+        explicit WrongImageTrailer(const std::string & msg)
+        {
+            this->error_msg = std::string("Invalid application image trailer: ") + msg;
+        }
+};
+
 class DuringWriteApplicationImage : public fs::BaseFSUpdateException
 {
     public:
@@ -137,13 +184,37 @@ class DuringWriteApplicationImage : public fs::BaseFSUpdateException
 
 class applicationImage
 {
+    public:
+        struct Section
+        {
+            uint64_t offset;
+            uint64_t length;
+        };
+
     private:
         std::string path;
         const std::shared_ptr<logger::LoggerHandler> logger;
         uint32_t header_version, crc32_check, header_size;
         uint64_t application_image_size;
+        /* offset of squashfs content: header size (v1) or APP_V2_PAYLOAD_OFFSET (v2) */
+        uint64_t payload_offset;
+        uint64_t file_size;
+        /* v2 section table, v1 only knows payload and timestamp */
+        std::array<Section, APP_V2_SECTION_COUNT> sections;
         std::ifstream application;
 
+        /**
+         * Read and validate v2 trailer with section table.
+         * @throw WrongImageTrailer
+         */
+        void readTrailer();
+        std::vector<uint8_t> readRange(uint64_t offset, uint64_t length);
+        /**
+         * Compare already copied part of payload with source, feed source data.
+         * @return Copied part is identical: true, else false.
+         */
+        bool compareCopied(int fd, uint64_t length, const std::function<void(const char *, size_t)> &feed);
+
       public:
         /**
          * Application image mapping.
@@ -167,6 +238,34 @@ class applicationImage
          */
         uint64_t getSizeOfImage() const;
 
+        /**
+         * Get header version of application image.
+         * @return APP_IMAGE_VERSION_1 or APP_IMAGE_VERSION_2.
+         */
+        uint32_t getHeaderVersion() const;
+
+        /**
+         * Get offset of squashfs content in application image.
+         * @return Offset in bytes.
+         */
+        uint64_t getPayloadOffset() const;
+
+        /**
+         * Get location of section in application image.
+         * Sections which are not present have length 0.
+         * @param section Section of trailer table.
+         * @return Offset and length of section.
+         */
+        Section getSectionLocation(ImageSection section) const;
+
+        /**
+         * Read complete section of v2 application image.
+         * @param section Section of trailer table.
+         * @return Section content, empty if not present.
+         * @throw OpenApplicationImage
+         */
+        std::vector<uint8_t> getSection(ImageSection section);
+
         /**
          * Get time of signing application image.
          * @return Time object.
@@ -195,10 +294,18 @@ class applicationImage
 
         /**
          * Extract application image out of update package and save it in persistent memory.
+         * Progress is journaled in dest + ".journal", an interrupted copy of
+         * the same package resumes at the last checkpoint. Data is written
+         * back in windows while copying, see WriteEngine.
+         * @param dest Destination path.
+         * @param manifest Verify every copied chunk against this manifest, if given.
+         * @param payload_digest Expected SHA-256 of the copied payload, if given.
          * @throw OpenApplicationImage
          * @throw DuringWriteApplicationImage
+         * @throw updater::WriteFailed
          */
-        void copyImage(const std::string &);
+        void copyImage(const std::string &, const updater::ChunkManifest * = nullptr,
+                       const std::vector<uint8_t> *payload_digest = nullptr);
         /**
          * Get header data (size + version + CRC).
          * @return Header data as byte vector.
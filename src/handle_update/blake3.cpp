@@ -0,0 +1,331 @@
+#include "blake3.h"
+#include "resourcePolicy.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+extern "C" {
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+}
+
+namespace updater {
+
+namespace {
+    constexpr uint32_t CHUNK_START = 1 << 0;
+    constexpr uint32_t CHUNK_END = 1 << 1;
+    constexpr uint32_t PARENT = 1 << 2;
+    constexpr uint32_t ROOT = 1 << 3;
+
+    constexpr Blake3::ChainingValue IV = {
+        0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+        0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+    };
+
+    constexpr size_t MSG_PERMUTATION[16] = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+    inline uint32_t rotr(uint32_t value, int bits) {
+        return (value >> bits) | (value << (32 - bits));
+    }
+
+    inline void g(uint32_t* state, size_t a, size_t b, size_t c, size_t d, uint32_t mx, uint32_t my) {
+        state[a] = state[a] + state[b] + mx;
+        state[d] = rotr(state[d] ^ state[a], 16);
+        state[c] = state[c] + state[d];
+        state[b] = rotr(state[b] ^ state[c], 12);
+        state[a] = state[a] + state[b] + my;
+        state[d] = rotr(state[d] ^ state[a], 8);
+        state[c] = state[c] + state[d];
+        state[b] = rotr(state[b] ^ state[c], 7);
+    }
+
+    inline void round_function(uint32_t* state, const uint32_t* m) {
+        /* columns */
+        g(state, 0, 4, 8, 12, m[0], m[1]);
+        g(state, 1, 5, 9, 13, m[2], m[3]);
+        g(state, 2, 6, 10, 14, m[4], m[5]);
+        g(state, 3, 7, 11, 15, m[6], m[7]);
+        /* diagonals */
+        g(state, 0, 5, 10, 15, m[8], m[9]);
+        g(state, 1, 6, 11, 12, m[10], m[11]);
+        g(state, 2, 7, 8, 13, m[12], m[13]);
+        g(state, 3, 4, 9, 14, m[14], m[15]);
+    }
+
+    std::array<uint32_t, 16> compress(const Blake3::ChainingValue& cv, const std::array<uint32_t, 16>& block_words,
+                                      uint64_t counter, uint32_t block_len, uint32_t flags) {
+        uint32_t state[16] = {
+            cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+            IV[0], IV[1], IV[2], IV[3],
+            static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), block_len, flags
+        };
+
+        uint32_t m[16];
+        std::copy(block_words.begin(), block_words.end(), m);
+        for (int r = 0; r < 7; ++r) {
+            round_function(state, m);
+            if (r < 6) {
+                uint32_t permuted[16];
+                for (size_t i = 0; i < 16; ++i) permuted[i] = m[MSG_PERMUTATION[i]];
+                std::memcpy(m, permuted, sizeof(m));
+            }
+        }
+
+        std::array<uint32_t, 16> out;
+        for (size_t i = 0; i < 8; ++i) {
+            out[i] = state[i] ^ state[i + 8];
+            out[i + 8] = state[i + 8] ^ cv[i];
+        }
+        return out;
+    }
+
+    std::array<uint32_t, 16> words_from_block(const uint8_t* block) {
+        std::array<uint32_t, 16> words;
+        for (size_t i = 0; i < 16; ++i) {
+            const uint8_t* p = block + 4 * i;
+            words[i] = uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+        }
+        return words;
+    }
+
+    Blake3::ChainingValue first_8_words(const std::array<uint32_t, 16>& words) {
+        Blake3::ChainingValue cv;
+        std::copy(words.begin(), words.begin() + 8, cv.begin());
+        return cv;
+    }
+
+    std::string to_hex(const uint8_t* data, size_t length) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        hex.reserve(length * 2);
+        for (size_t i = 0; i < length; ++i) {
+            hex.push_back(digits[data[i] >> 4]);
+            hex.push_back(digits[data[i] & 0x0f]);
+        }
+        return hex;
+    }
+
+    void read_full(int fd, uint8_t* buffer, size_t length, uint64_t offset) {
+        size_t filled = 0;
+        while (filled < length) {
+            ssize_t bytes = ::pread(fd, buffer + filled, length - filled, static_cast<off_t>(offset + filled));
+            if (bytes < 0 && errno == EINTR) continue;
+            if (bytes <= 0) {
+                throw std::runtime_error("BLAKE3: short read at offset " + std::to_string(offset + filled));
+            }
+            filled += static_cast<size_t>(bytes);
+            IoThrottle::account(static_cast<uint64_t>(bytes));
+        }
+    }
+}
+
+Blake3::ChainingValue Blake3::Output::chaining_value() const {
+    return first_8_words(compress(input_cv, block_words, counter, block_len, flags));
+}
+
+void Blake3::Output::root_bytes(uint8_t* out, size_t out_len) const {
+    uint64_t output_block_counter = 0;
+    while (out_len > 0) {
+        const std::array<uint32_t, 16> words =
+            compress(input_cv, block_words, output_block_counter, block_len, flags | ROOT);
+        for (size_t i = 0; i < 16 && out_len > 0; ++i) {
+            for (size_t b = 0; b < 4 && out_len > 0; ++b) {
+                *out++ = static_cast<uint8_t>(words[i] >> (8 * b));
+                --out_len;
+            }
+        }
+        ++output_block_counter;
+    }
+}
+
+Blake3::ChunkState::ChunkState(uint64_t counter)
+    : cv(IV), chunk_counter(counter), block{}, block_len(0), blocks_compressed(0) {}
+
+size_t Blake3::ChunkState::len() const {
+    return blake3::BLOCK_LEN * blocks_compressed + block_len;
+}
+
+void Blake3::ChunkState::update(const uint8_t* input, size_t input_len) {
+    while (input_len > 0) {
+        /* a full block is only compressed when more input follows, the last one needs CHUNK_END */
+        if (block_len == blake3::BLOCK_LEN) {
+            const uint32_t flags = blocks_compressed == 0 ? CHUNK_START : 0;
+            cv = first_8_words(compress(cv, words_from_block(block), chunk_counter, blake3::BLOCK_LEN, flags));
+            ++blocks_compressed;
+            std::memset(block, 0, sizeof(block));
+            block_len = 0;
+        }
+
+        const size_t take = std::min(blake3::BLOCK_LEN - block_len, input_len);
+        std::memcpy(block + block_len, input, take);
+        block_len = static_cast<uint8_t>(block_len + take);
+        input += take;
+        input_len -= take;
+    }
+}
+
+Blake3::Output Blake3::ChunkState::output() const {
+    const uint32_t flags = (blocks_compressed == 0 ? CHUNK_START : 0) | CHUNK_END;
+    return Output{cv, words_from_block(block), chunk_counter, block_len, flags};
+}
+
+Blake3::Blake3(uint64_t chunk_counter)
+    : start_counter_(chunk_counter), chunk_state_(chunk_counter) {}
+
+Blake3::Output Blake3::parent_output(const ChainingValue& left, const ChainingValue& right) {
+    std::array<uint32_t, 16> block_words;
+    std::copy(left.begin(), left.end(), block_words.begin());
+    std::copy(right.begin(), right.end(), block_words.begin() + 8);
+    return Output{IV, block_words, 0, blake3::BLOCK_LEN, PARENT};
+}
+
+void Blake3::add_chunk_chaining_value(ChainingValue new_cv, uint64_t total_chunks) {
+    /* every completed subtree is merged as soon as its sibling is complete */
+    while ((total_chunks & 1) == 0) {
+        new_cv = parent_output(cv_stack_.back(), new_cv).chaining_value();
+        cv_stack_.pop_back();
+        total_chunks >>= 1;
+    }
+    cv_stack_.push_back(new_cv);
+}
+
+void Blake3::update(const uint8_t* input, size_t input_len) {
+    while (input_len > 0) {
+        if (chunk_state_.len() == blake3::CHUNK_LEN) {
+            const ChainingValue chunk_cv = chunk_state_.output().chaining_value();
+            const uint64_t total_chunks = chunk_state_.chunk_counter + 1;
+            add_chunk_chaining_value(chunk_cv, total_chunks - start_counter_);
+            chunk_state_ = ChunkState(total_chunks);
+        }
+
+        const size_t take = std::min(blake3::CHUNK_LEN - chunk_state_.len(), input_len);
+        chunk_state_.update(input, take);
+        input += take;
+        input_len -= take;
+    }
+}
+
+Blake3::Output Blake3::output() const {
+    Output output = chunk_state_.output();
+    for (auto it = cv_stack_.rbegin(); it != cv_stack_.rend(); ++it) {
+        output = parent_output(*it, output.chaining_value());
+    }
+    return output;
+}
+
+std::array<uint8_t, blake3::OUT_LEN> Blake3::final() const {
+    std::array<uint8_t, blake3::OUT_LEN> digest;
+    output().root_bytes(digest.data(), digest.size());
+    return digest;
+}
+
+std::string Blake3::hash_file(const std::string& path, unsigned threads, const std::atomic<bool>* cancel) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("BLAKE3: open " + path + " fails: " + std::strerror(errno));
+    }
+    std::unique_ptr<int, void (*)(int*)> fd_guard(&fd, [](int* f) { ::close(*f); });
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throw std::runtime_error("BLAKE3: stat " + path + " fails: " + std::strerror(errno));
+    }
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    const uint64_t segments = size == 0 ? 1 : (size + blake3::SEGMENT_SIZE - 1) / blake3::SEGMENT_SIZE;
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(std::min<uint64_t>(threads, segments));
+
+    /* every segment but the last is a complete subtree, the last one may be partial */
+    constexpr uint64_t CHUNKS_PER_SEGMENT = blake3::SEGMENT_SIZE / blake3::CHUNK_LEN;
+    std::vector<ChainingValue> segment_cvs(segments - 1);
+    Output last_output{};
+
+    std::atomic<uint64_t> next_segment{0};
+    std::atomic<bool> failed{false};
+    std::mutex error_lock;
+    std::string error_msg;
+
+    auto worker = [&]() {
+        try {
+            std::vector<uint8_t> buffer(blake3::SEGMENT_SIZE);
+            while (!failed.load(std::memory_order_relaxed) &&
+                   !(cancel && cancel->load(std::memory_order_relaxed))) {
+                const uint64_t index = next_segment.fetch_add(1, std::memory_order_relaxed);
+                if (index >= segments) {
+                    break;
+                }
+
+                const uint64_t offset = index * blake3::SEGMENT_SIZE;
+                const size_t length = static_cast<size_t>(std::min<uint64_t>(blake3::SEGMENT_SIZE, size - offset));
+                read_full(fd, buffer.data(), length, offset);
+
+                Blake3 subtree(index * CHUNKS_PER_SEGMENT);
+                subtree.update(buffer.data(), length);
+                if (index + 1 < segments) {
+                    segment_cvs[index] = subtree.output().chaining_value();
+                } else {
+                    last_output = subtree.output();
+                }
+            }
+        } catch (const std::exception& e) {
+            failed.store(true);
+            std::lock_guard<std::mutex> lock(error_lock);
+            if (error_msg.empty()) {
+                error_msg = e.what();
+            }
+        }
+    };
+
+    if (threads <= 1) {
+        worker();
+    } else {
+        std::vector<std::thread> pool;
+        pool.reserve(threads);
+        for (unsigned i = 0; i < threads; ++i) {
+            pool.emplace_back(worker);
+        }
+        for (auto& thread : pool) {
+            thread.join();
+        }
+    }
+
+    if (failed.load()) {
+        throw std::runtime_error(error_msg);
+    }
+    if (cancel && cancel->load()) {
+        return "";
+    }
+
+    /* merge segment subtrees like the sequential hasher merges chunks */
+    std::vector<ChainingValue> cv_stack;
+    for (uint64_t index = 0; index + 1 < segments; ++index) {
+        ChainingValue cv = segment_cvs[index];
+        uint64_t total = index + 1;
+        while ((total & 1) == 0) {
+            cv = parent_output(cv_stack.back(), cv).chaining_value();
+            cv_stack.pop_back();
+            total >>= 1;
+        }
+        cv_stack.push_back(cv);
+    }
+
+    Output output = last_output;
+    for (auto it = cv_stack.rbegin(); it != cv_stack.rend(); ++it) {
+        output = parent_output(*it, output.chaining_value());
+    }
+
+    uint8_t digest[blake3::OUT_LEN];
+    output.root_bytes(digest, sizeof(digest));
+    return to_hex(digest, sizeof(digest));
+}
+
+} // namespace updater
@@ -0,0 +1,99 @@
+/**
+ * BLAKE3 hash for update image digests.
+ *
+ * Portable implementation of the BLAKE3 hash mode (no key, no derive key,
+ * 32 byte output). Files are hashed as independent subtrees of SEGMENT_SIZE
+ * bytes on several threads; the subtree chaining values are merged to the
+ * same root digest the single-threaded hash produces.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace updater {
+
+    namespace blake3 {
+        constexpr size_t OUT_LEN = 32;
+        constexpr size_t BLOCK_LEN = 64;
+        constexpr size_t CHUNK_LEN = 1024;
+        /* subtree hashed by one worker, must be a power of two multiple of CHUNK_LEN */
+        constexpr size_t SEGMENT_SIZE = 1024 * CHUNK_LEN;
+    }
+
+    class Blake3 {
+    public:
+        using ChainingValue = std::array<uint32_t, 8>;
+
+        /**
+         * Compression input of a node, root flag is applied on finalize.
+         */
+        struct Output {
+            ChainingValue input_cv;
+            std::array<uint32_t, 16> block_words;
+            uint64_t counter;
+            uint32_t block_len;
+            uint32_t flags;
+
+            ChainingValue chaining_value() const;
+            void root_bytes(uint8_t* out, size_t out_len) const;
+        };
+
+    private:
+        struct ChunkState {
+            ChainingValue cv;
+            uint64_t chunk_counter;
+            uint8_t block[blake3::BLOCK_LEN];
+            uint8_t block_len;
+            uint8_t blocks_compressed;
+
+            explicit ChunkState(uint64_t counter);
+            size_t len() const;
+            void update(const uint8_t* input, size_t input_len);
+            Output output() const;
+        };
+
+        const uint64_t start_counter_;
+        ChunkState chunk_state_;
+        std::vector<ChainingValue> cv_stack_;
+
+        void add_chunk_chaining_value(ChainingValue new_cv, uint64_t total_chunks);
+
+    public:
+        /**
+         * @param chunk_counter Index of first chunk, non zero for subtrees of a larger input.
+         */
+        explicit Blake3(uint64_t chunk_counter = 0);
+
+        void update(const uint8_t* input, size_t input_len);
+
+        /**
+         * Node output of all input fed so far, used to merge subtrees.
+         */
+        Output output() const;
+
+        /**
+         * Root digest of all input fed so far.
+         */
+        std::array<uint8_t, blake3::OUT_LEN> final() const;
+
+        static Output parent_output(const ChainingValue& left, const ChainingValue& right);
+
+        /**
+         * Hash a file with several threads.
+         * @param path Path to file.
+         * @param threads Number of worker threads, 0 uses all cores.
+         * @param cancel Optional flag, stops hashing when set.
+         * @return Digest as lowercase hex string, empty if cancelled.
+         * @throw std::runtime_error File can not be read.
+         */
+        static std::string hash_file(const std::string& path, unsigned threads = 0,
+                                     const std::atomic<bool>* cancel = nullptr);
+    };
+
+} // namespace updater
@@ -0,0 +1,428 @@
+#include <fus_updater_lib/config.h>
+#include "certificateCache.h"
+
+#include <botan/data_src.h>
+#include <botan/hash.h>
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+extern "C" {
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <stdlib.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+}
+
+namespace updater {
+
+namespace {
+    constexpr char DER_CACHE_MAGIC[8] = {'F', 'S', 'K', 'E', 'Y', 'D', 'E', 'R'};
+    constexpr uint32_t DER_CACHE_FORMAT = 1;
+    constexpr size_t DER_CACHE_DIGEST_SIZE = 32;
+    /* keyrings are a handful of certificates, refuse anything larger */
+    constexpr size_t DER_CACHE_MAX_SIZE = 1024 * 1024;
+
+    void append_u32(std::vector<uint8_t>& out, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    void append_u64(std::vector<uint8_t>& out, uint64_t value) {
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    class BlobReader {
+    private:
+        const std::vector<uint8_t>& data_;
+        size_t pos_ = 0;
+        size_t end_;
+
+    public:
+        BlobReader(const std::vector<uint8_t>& data, size_t end) : data_(data), end_(end) {}
+
+        bool read_u32(uint32_t& value) {
+            if (end_ - pos_ < 4) return false;
+            value = 0;
+            for (int i = 0; i < 4; ++i) value = (value << 8) | data_[pos_++];
+            return true;
+        }
+
+        bool read_u64(uint64_t& value) {
+            if (end_ - pos_ < 8) return false;
+            value = 0;
+            for (int i = 0; i < 8; ++i) value = (value << 8) | data_[pos_++];
+            return true;
+        }
+
+        bool read_bytes(size_t length, const uint8_t*& ptr) {
+            if (end_ - pos_ < length) return false;
+            ptr = data_.data() + pos_;
+            pos_ += length;
+            return true;
+        }
+
+        bool at_end() const { return pos_ == end_; }
+    };
+
+    std::vector<uint8_t> sha256(const uint8_t* data, size_t length) {
+        std::unique_ptr<Botan::HashFunction> hash = Botan::HashFunction::create("SHA-256");
+        if (!hash) {
+            throw std::runtime_error("SHA-256 not available");
+        }
+        hash->update(data, length);
+        Botan::secure_vector<uint8_t> digest = hash->final();
+        return std::vector<uint8_t>(digest.begin(), digest.end());
+    }
+}
+
+std::mutex KeyringCache::global_cache_lock;
+std::map<std::string, KeyringCache::Entry> KeyringCache::global_keyring_store;
+uint64_t KeyringCache::global_generation = 0;
+
+KeyringCache::FileKey KeyringCache::stat_keyring(const std::string& keyring_path) {
+    struct stat st;
+    if (::stat(keyring_path.c_str(), &st) != 0) {
+        throw std::runtime_error("Failed to stat keyring file: " + keyring_path + ": " + std::strerror(errno));
+    }
+
+    FileKey key;
+    key.device = static_cast<uint64_t>(st.st_dev);
+    key.inode = static_cast<uint64_t>(st.st_ino);
+    key.mtime_sec = static_cast<int64_t>(st.st_mtim.tv_sec);
+    key.mtime_nsec = static_cast<int64_t>(st.st_mtim.tv_nsec);
+    key.size = static_cast<uint64_t>(st.st_size);
+    return key;
+}
+
+std::vector<Botan::X509_Certificate> KeyringCache::parse_pem_keyring(
+    const std::string& keyring_path,
+    const std::shared_ptr<logger::LoggerHandler>& logger) {
+
+    int fd = ::open(keyring_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open keyring file: " + keyring_path);
+    }
+
+    std::string content;
+    char buffer[4096];
+    ssize_t bytes;
+    while ((bytes = ::read(fd, buffer, sizeof(buffer))) != 0) {
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            ::close(fd);
+            throw std::runtime_error("Failed to read keyring file: " + keyring_path);
+        }
+        content.append(buffer, static_cast<size_t>(bytes));
+    }
+    ::close(fd);
+
+    constexpr std::string_view PEM_BEGIN = "-----BEGIN CERTIFICATE-----";
+    constexpr std::string_view PEM_END = "-----END CERTIFICATE-----";
+
+    std::vector<Botan::X509_Certificate> certificates;
+    size_t pos = 0;
+    while (pos < content.size()) {
+        auto begin_pos = content.find(PEM_BEGIN, pos);
+        if (begin_pos == std::string::npos) break;
+        auto end_pos = content.find(PEM_END, begin_pos + PEM_BEGIN.size());
+        if (end_pos == std::string::npos) break;
+        end_pos += PEM_END.size();
+        pos = end_pos;
+        try {
+            Botan::DataSource_Memory mem(reinterpret_cast<const uint8_t*>(content.data() + begin_pos),
+                                         end_pos - begin_pos);
+            certificates.emplace_back(mem);
+            logger->setLogEntry(std::make_shared<logger::LogEntry>(
+                KEYRING_CACHE, "Loaded trusted certificate: Subject=" +
+                certificates.back().subject_dn().to_string(), logger::logLevel::DEBUG));
+        } catch (const std::exception& e) {
+            logger->setLogEntry(std::make_shared<logger::LogEntry>(
+                KEYRING_CACHE, "Failed to parse trusted certificate: " + std::string(e.what()),
+                logger::logLevel::WARNING));
+        }
+    }
+
+    return certificates;
+}
+
+bool KeyringCache::load_der_cache(const std::string& cache_path,
+                                  const std::string& keyring_path,
+                                  const FileKey& key,
+                                  std::vector<Botan::X509_Certificate>& certificates) {
+    int fd = ::open(cache_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    /* only trust a blob written by ourselves and not writable by others */
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != ::geteuid() ||
+        (st.st_mode & (S_IWGRP | S_IWOTH)) != 0 ||
+        static_cast<uint64_t>(st.st_size) > DER_CACHE_MAX_SIZE) {
+        ::close(fd);
+        return false;
+    }
+
+    std::vector<uint8_t> blob(static_cast<size_t>(st.st_size));
+    size_t offset = 0;
+    while (offset < blob.size()) {
+        ssize_t bytes = ::read(fd, blob.data() + offset, blob.size() - offset);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) {
+            ::close(fd);
+            return false;
+        }
+        offset += static_cast<size_t>(bytes);
+    }
+    ::close(fd);
+
+    if (blob.size() < sizeof(DER_CACHE_MAGIC) + DER_CACHE_DIGEST_SIZE ||
+        std::memcmp(blob.data(), DER_CACHE_MAGIC, sizeof(DER_CACHE_MAGIC)) != 0) {
+        return false;
+    }
+
+    const size_t payload_end = blob.size() - DER_CACHE_DIGEST_SIZE;
+    if (sha256(blob.data(), payload_end) !=
+        std::vector<uint8_t>(blob.begin() + payload_end, blob.end())) {
+        return false;
+    }
+
+    BlobReader reader(blob, payload_end);
+    const uint8_t* ptr;
+    reader.read_bytes(sizeof(DER_CACHE_MAGIC), ptr);
+
+    uint32_t format, path_length;
+    if (!reader.read_u32(format) || format != DER_CACHE_FORMAT ||
+        !reader.read_u32(path_length) || !reader.read_bytes(path_length, ptr) ||
+        std::string(reinterpret_cast<const char*>(ptr), path_length) != keyring_path) {
+        return false;
+    }
+
+    FileKey cached;
+    uint64_t mtime_sec, mtime_nsec;
+    if (!reader.read_u64(cached.device) || !reader.read_u64(cached.inode) ||
+        !reader.read_u64(mtime_sec) || !reader.read_u64(mtime_nsec) ||
+        !reader.read_u64(cached.size)) {
+        return false;
+    }
+    cached.mtime_sec = static_cast<int64_t>(mtime_sec);
+    cached.mtime_nsec = static_cast<int64_t>(mtime_nsec);
+    if (!(cached == key)) {
+        return false;
+    }
+
+    uint32_t count;
+    if (!reader.read_u32(count)) {
+        return false;
+    }
+
+    std::vector<Botan::X509_Certificate> loaded;
+    loaded.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t der_length;
+        if (!reader.read_u32(der_length) || !reader.read_bytes(der_length, ptr)) {
+            return false;
+        }
+        try {
+            loaded.emplace_back(std::vector<uint8_t>(ptr, ptr + der_length));
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+
+    if (!reader.at_end()) {
+        return false;
+    }
+
+    certificates = std::move(loaded);
+    return true;
+}
+
+void KeyringCache::store_der_cache(const std::string& cache_path,
+                                   const std::string& keyring_path,
+                                   const FileKey& key,
+                                   const std::vector<Botan::X509_Certificate>& certificates,
+                                   const std::shared_ptr<logger::LoggerHandler>& logger) {
+    std::vector<uint8_t> blob(DER_CACHE_MAGIC, DER_CACHE_MAGIC + sizeof(DER_CACHE_MAGIC));
+    append_u32(blob, DER_CACHE_FORMAT);
+    append_u32(blob, static_cast<uint32_t>(keyring_path.size()));
+    blob.insert(blob.end(), keyring_path.begin(), keyring_path.end());
+    append_u64(blob, key.device);
+    append_u64(blob, key.inode);
+    append_u64(blob, static_cast<uint64_t>(key.mtime_sec));
+    append_u64(blob, static_cast<uint64_t>(key.mtime_nsec));
+    append_u64(blob, key.size);
+    append_u32(blob, static_cast<uint32_t>(certificates.size()));
+    for (const auto& cert : certificates) {
+        const std::vector<uint8_t> der = cert.BER_encode();
+        append_u32(blob, static_cast<uint32_t>(der.size()));
+        blob.insert(blob.end(), der.begin(), der.end());
+    }
+    const std::vector<uint8_t> digest = sha256(blob.data(), blob.size());
+    blob.insert(blob.end(), digest.begin(), digest.end());
+
+    const auto slash = cache_path.rfind('/');
+    if (slash != std::string::npos && slash > 0) {
+        const std::string cache_dir = cache_path.substr(0, slash);
+        if (::mkdir(cache_dir.c_str(), S_IRWXU) != 0 && errno != EEXIST) {
+            logger->setLogEntry(std::make_shared<logger::LogEntry>(
+                KEYRING_CACHE, "Can not create cache directory " + cache_dir + ": " + std::strerror(errno),
+                logger::logLevel::WARNING));
+            return;
+        }
+    }
+
+    /* write to temporary file and rename, readers never see a partial blob;
+     * mkostemp creates a new file (O_EXCL), a planted symlink is not followed */
+    std::vector<char> tmp_template(cache_path.begin(), cache_path.end());
+    const char suffix[] = ".XXXXXX";
+    tmp_template.insert(tmp_template.end(), suffix, suffix + sizeof(suffix));
+    int fd = ::mkostemp(tmp_template.data(), O_CLOEXEC);
+    const std::string tmp_path(tmp_template.data());
+    if (fd < 0) {
+        logger->setLogEntry(std::make_shared<logger::LogEntry>(
+            KEYRING_CACHE, "Can not create " + tmp_path + ": " + std::strerror(errno),
+            logger::logLevel::WARNING));
+        return;
+    }
+
+    size_t offset = 0;
+    while (offset < blob.size()) {
+        ssize_t bytes = ::write(fd, blob.data() + offset, blob.size() - offset);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) {
+            logger->setLogEntry(std::make_shared<logger::LogEntry>(
+                KEYRING_CACHE, "Can not write " + tmp_path + ": " + std::strerror(errno),
+                logger::logLevel::WARNING));
+            ::close(fd);
+            ::unlink(tmp_path.c_str());
+            return;
+        }
+        offset += static_cast<size_t>(bytes);
+    }
+    ::close(fd);
+
+    if (::rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+        logger->setLogEntry(std::make_shared<logger::LogEntry>(
+            KEYRING_CACHE, "Can not rename " + tmp_path + ": " + std::strerror(errno),
+            logger::logLevel::WARNING));
+        ::unlink(tmp_path.c_str());
+    }
+}
+
+std::shared_ptr<const TrustedKeyring> KeyringCache::get(
+    const std::string& keyring_path,
+    const std::shared_ptr<logger::LoggerHandler>& logger) {
+
+    const FileKey key = stat_keyring(keyring_path);
+
+    std::lock_guard<std::mutex> lock(global_cache_lock);
+    auto it = global_keyring_store.find(keyring_path);
+    if (it != global_keyring_store.end() && it->second.key == key) {
+        return it->second.keyring;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<Botan::X509_Certificate> certificates;
+    bool from_der_cache = false;
+    const std::string cache_path = FUS_LIB_KEYRING_DER_CACHE;
+
+    if (!cache_path.empty()) {
+        from_der_cache = load_der_cache(cache_path, keyring_path, key, certificates);
+    }
+
+    if (!from_der_cache) {
+        certificates = parse_pem_keyring(keyring_path, logger);
+        if (!cache_path.empty() && !certificates.empty()) {
+            store_der_cache(cache_path, keyring_path, key, certificates, logger);
+        }
+    }
+
+    auto keyring = std::make_shared<TrustedKeyring>();
+    keyring->certificates = std::move(certificates);
+    keyring->generation = ++global_generation;
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    logger->setLogEntry(std::make_shared<logger::LogEntry>(
+        KEYRING_CACHE, "Loaded " + std::to_string(keyring->certificates.size()) +
+        " trusted certificates from " + (from_der_cache ? cache_path : keyring_path) +
+        " in " + std::to_string(elapsed.count()) + " us",
+        logger::logLevel::DEBUG));
+
+    global_keyring_store[keyring_path] = Entry{key, keyring};
+    return keyring;
+}
+
+void KeyringCache::invalidate() {
+    std::lock_guard<std::mutex> lock(global_cache_lock);
+    global_keyring_store.clear();
+}
+
+std::mutex ChainValidationCache::global_cache_lock;
+std::map<std::string, ChainValidationCache::Result> ChainValidationCache::global_validation_store;
+uint64_t ChainValidationCache::global_use_counter = 0;
+
+std::string ChainValidationCache::make_key(const Botan::X509_Certificate& leaf,
+                                           const std::vector<Botan::X509_Certificate>& intermediates,
+                                           uint64_t keyring_generation) {
+    std::string key = std::to_string(keyring_generation);
+    key += '/';
+    key += leaf.fingerprint("SHA-256");
+    for (const auto& cert : intermediates) {
+        key += '/';
+        key += cert.fingerprint("SHA-256");
+    }
+    return key;
+}
+
+bool ChainValidationCache::lookup(const std::string& key) {
+    const auto now = std::chrono::system_clock::now();
+
+    std::lock_guard<std::mutex> lock(global_cache_lock);
+    auto it = global_validation_store.find(key);
+    if (it == global_validation_store.end()) {
+        return false;
+    }
+
+    /* path validation is done against the current time, honor the same window */
+    if (now < it->second.valid_from || now > it->second.valid_until) {
+        global_validation_store.erase(it);
+        return false;
+    }
+
+    it->second.last_use = ++global_use_counter;
+    return true;
+}
+
+void ChainValidationCache::store(const std::string& key,
+                                 std::chrono::system_clock::time_point valid_from,
+                                 std::chrono::system_clock::time_point valid_until) {
+    std::lock_guard<std::mutex> lock(global_cache_lock);
+    if (global_validation_store.find(key) == global_validation_store.end() &&
+        global_validation_store.size() >= MAX_ENTRIES) {
+        auto oldest = global_validation_store.begin();
+        for (auto it = global_validation_store.begin(); it != global_validation_store.end(); ++it) {
+            if (it->second.last_use < oldest->second.last_use) {
+                oldest = it;
+            }
+        }
+        global_validation_store.erase(oldest);
+    }
+
+    global_validation_store[key] = Result{valid_from, valid_until, ++global_use_counter};
+}
+
+void ChainValidationCache::invalidate() {
+    std::lock_guard<std::mutex> lock(global_cache_lock);
+    global_validation_store.clear();
+}
+
+} // namespace updater
@@ -0,0 +1,163 @@
+/**
+ * Process-wide cache of the RAUC trusted keyring and of chain validation results.
+ *
+ * The keyring is parsed once per process and shared as an immutable object
+ * between all update handlers. Optionally the parsed certificates are stored
+ * as DER blob on a tmpfs, so the PEM keyring is parsed only once per boot.
+ * Successful chain validations are remembered per leaf, intermediates and
+ * keyring generation.
+ */
+
+#pragma once
+
+#include "../logger/LoggerHandler.h"
+#include "../logger/LoggerEntry.h"
+
+#include <botan/x509cert.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include <sys/types.h>
+}
+
+constexpr char KEYRING_CACHE[] = "keyring cache";
+
+namespace updater {
+
+    /**
+     * Parsed trusted keyring. Immutable once published by the cache.
+     */
+    struct TrustedKeyring {
+        std::vector<Botan::X509_Certificate> certificates;
+        /* changes whenever the keyring is reloaded from a modified file */
+        uint64_t generation;
+    };
+
+    /**
+     * Thread-safe keyring cache keyed on path, device, inode, mtime and size.
+     */
+    class KeyringCache {
+    private:
+        struct FileKey {
+            uint64_t device;
+            uint64_t inode;
+            int64_t mtime_sec;
+            int64_t mtime_nsec;
+            uint64_t size;
+
+            bool operator==(const FileKey& other) const {
+                return device == other.device && inode == other.inode &&
+                       mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec &&
+                       size == other.size;
+            }
+        };
+
+        struct Entry {
+            FileKey key;
+            std::shared_ptr<const TrustedKeyring> keyring;
+        };
+
+        static std::mutex global_cache_lock;
+        static std::map<std::string, Entry> global_keyring_store;
+        static uint64_t global_generation;
+
+        static FileKey stat_keyring(const std::string& keyring_path);
+        static std::vector<Botan::X509_Certificate> parse_pem_keyring(
+            const std::string& keyring_path,
+            const std::shared_ptr<logger::LoggerHandler>& logger);
+
+        // DER blob cache on disk
+        static bool load_der_cache(const std::string& cache_path,
+                                   const std::string& keyring_path,
+                                   const FileKey& key,
+                                   std::vector<Botan::X509_Certificate>& certificates);
+        static void store_der_cache(const std::string& cache_path,
+                                    const std::string& keyring_path,
+                                    const FileKey& key,
+                                    const std::vector<Botan::X509_Certificate>& certificates,
+                                    const std::shared_ptr<logger::LoggerHandler>& logger);
+
+    public:
+        KeyringCache() = delete;
+
+        /**
+         * Return the trusted certificates of the given keyring.
+         * The keyring is only parsed again if the file has been replaced or modified.
+         * @param keyring_path Path to PEM keyring.
+         * @param logger Logger object reference.
+         * @return Shared immutable keyring.
+         * @throw std::runtime_error If the keyring can not be read.
+         */
+        static std::shared_ptr<const TrustedKeyring> get(
+            const std::string& keyring_path,
+            const std::shared_ptr<logger::LoggerHandler>& logger);
+
+        /**
+         * Drop all cached keyrings of this process. The DER blob on disk is kept.
+         */
+        static void invalidate();
+    };
+
+    /**
+     * Thread-safe cache of successful certificate chain validations.
+     * Only successful results are kept, failures are always validated again.
+     */
+    class ChainValidationCache {
+    private:
+        struct Result {
+            /* intersection of the validity periods of the validated path */
+            std::chrono::system_clock::time_point valid_from;
+            std::chrono::system_clock::time_point valid_until;
+            uint64_t last_use;
+        };
+
+        static std::mutex global_cache_lock;
+        static std::map<std::string, Result> global_validation_store;
+        static uint64_t global_use_counter;
+
+    public:
+        /* bundles are signed by a few leaf certificates only */
+        static constexpr size_t MAX_ENTRIES = 16;
+
+        ChainValidationCache() = delete;
+
+        /**
+         * Build cache key from the fingerprints of leaf and intermediates
+         * and the generation of the keyring they were validated against.
+         */
+        static std::string make_key(const Botan::X509_Certificate& leaf,
+                                    const std::vector<Botan::X509_Certificate>& intermediates,
+                                    uint64_t keyring_generation);
+
+        /**
+         * Check for a successful validation of the chain which is still valid now.
+         * @param key Key created by make_key.
+         * @return Cached successful validation: true, else false.
+         */
+        static bool lookup(const std::string& key);
+
+        /**
+         * Remember successful validation. Least recently used entry is dropped
+         * when the cache is full.
+         * @param key Key created by make_key.
+         * @param valid_from Latest not_before of the validated path.
+         * @param valid_until Earliest not_after of the validated path.
+         */
+        static void store(const std::string& key,
+                          std::chrono::system_clock::time_point valid_from,
+                          std::chrono::system_clock::time_point valid_until);
+
+        /**
+         * Drop all cached validation results.
+         */
+        static void invalidate();
+    };
+
+} // namespace updater
@@ -0,0 +1,68 @@
+#include "certificateScanner.h"
+
+#include <algorithm>
+#include <string_view>
+
+namespace updater {
+
+namespace {
+    constexpr std::string_view PEM_BEGIN = "-----BEGIN CERTIFICATE-----";
+    constexpr std::string_view PEM_END = "-----END CERTIFICATE-----";
+}
+
+PemCertificateScanner::PemCertificateScanner(uint64_t byte_budget, size_t max_block_size,
+                                             size_t max_certificates, BlockHandler on_block)
+    : byte_budget_(byte_budget),
+      max_block_size_(max_block_size),
+      max_certificates_(max_certificates),
+      on_block_(std::move(on_block)) {}
+
+void PemCertificateScanner::feed(const uint8_t* data, size_t length) {
+    bytes_scanned_ += length;
+    if (bytes_scanned_ > byte_budget_) {
+        throw CertificateScanLimit("more than " + std::to_string(byte_budget_) + " bytes");
+    }
+
+    window_.append(reinterpret_cast<const char*>(data), length);
+    peak_buffer_ = std::max(peak_buffer_, window_.size());
+    scan();
+}
+
+void PemCertificateScanner::scan() {
+    while (true) {
+        if (!in_block_) {
+            const size_t begin = window_.find(PEM_BEGIN);
+            if (begin == std::string::npos) {
+                /* keep only a possible partial marker at the end */
+                if (window_.size() >= PEM_BEGIN.size()) {
+                    window_.erase(0, window_.size() - (PEM_BEGIN.size() - 1));
+                }
+                return;
+            }
+            window_.erase(0, begin);
+            in_block_ = true;
+        }
+
+        size_t end = window_.find(PEM_END, PEM_BEGIN.size());
+        if (end == std::string::npos) {
+            if (window_.size() > max_block_size_) {
+                throw CertificateScanLimit("PEM block larger than " + std::to_string(max_block_size_) + " bytes");
+            }
+            return;
+        }
+        end += PEM_END.size();
+        if (end > max_block_size_) {
+            throw CertificateScanLimit("PEM block larger than " + std::to_string(max_block_size_) + " bytes");
+        }
+
+        if (++certificates_ > max_certificates_) {
+            throw CertificateScanLimit("more than " + std::to_string(max_certificates_) + " certificates");
+        }
+
+        on_block_(reinterpret_cast<const uint8_t*>(window_.data()), end);
+        window_.erase(0, end);
+        in_block_ = false;
+    }
+}
+
+} // namespace updater
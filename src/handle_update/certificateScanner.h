@@ -0,0 +1,73 @@
+/**
+ * Streaming PEM certificate scanner.
+ *
+ * Finds PEM certificate blocks in a byte stream with a fixed memory
+ * bound: only the current block, or the last few bytes that may start a
+ * block marker, are kept. Input beyond the byte budget, oversized blocks
+ * and too many certificates are rejected.
+ */
+
+#pragma once
+
+#include "./../BaseException.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace updater {
+
+    class CertificateScanLimit : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Certificate region exceeds a scanner limit.
+         * @param msg Exceeded limit.
+         */
+        explicit CertificateScanLimit(const std::string& msg) {
+            this->error_msg = std::string("Certificate extraction aborted: ") + msg;
+        }
+    };
+
+    class PemCertificateScanner {
+    public:
+        /* complete PEM block including BEGIN and END lines */
+        using BlockHandler = std::function<void(const uint8_t* block, size_t length)>;
+
+    private:
+        const uint64_t byte_budget_;
+        const size_t max_block_size_;
+        const size_t max_certificates_;
+        BlockHandler on_block_;
+
+        std::string window_;
+        bool in_block_ = false;
+        uint64_t bytes_scanned_ = 0;
+        size_t certificates_ = 0;
+        size_t peak_buffer_ = 0;
+
+        void scan();
+
+    public:
+        /**
+         * @param byte_budget Maximum number of bytes fed.
+         * @param max_block_size Maximum size of one PEM block.
+         * @param max_certificates Maximum number of PEM blocks.
+         * @param on_block Called for every complete block, data is valid during the call only.
+         */
+        PemCertificateScanner(uint64_t byte_budget, size_t max_block_size,
+                              size_t max_certificates, BlockHandler on_block);
+
+        /**
+         * Feed next bytes of the stream.
+         * @throw CertificateScanLimit A limit is exceeded.
+         */
+        void feed(const uint8_t* data, size_t length);
+
+        uint64_t bytes_scanned() const { return bytes_scanned_; }
+        size_t certificates() const { return certificates_; }
+        /* largest amount of buffered bytes */
+        size_t peak_buffer() const { return peak_buffer_; }
+    };
+
+} // namespace updater
@@ -0,0 +1,317 @@
+#include "chunkIndex.h"
+#include "hashEngine.h"
+#include "resourcePolicy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
+
+extern "C" {
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+}
+
+namespace updater {
+
+namespace {
+    constexpr size_t READ_SIZE = 1024 * 1024;
+
+    /* gear table: splitmix64 sequence with seed 0, fixed by the record format */
+    constexpr std::array<uint64_t, 256> make_gear_table() {
+        std::array<uint64_t, 256> table{};
+        uint64_t state = 0;
+        for (auto& value : table) {
+            state += 0x9E3779B97F4A7C15ULL;
+            uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            value = z ^ (z >> 31);
+        }
+        return table;
+    }
+    constexpr std::array<uint64_t, 256> GEAR = make_gear_table();
+
+    uint32_t read_u32(const uint8_t* data) {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) value = (value << 8) | data[i];
+        return value;
+    }
+
+    uint64_t read_u64(const uint8_t* data) {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; ++i) value = (value << 8) | data[i];
+        return value;
+    }
+
+    std::string digest_key(const std::array<uint8_t, cdc::DIGEST_SIZE>& digest) {
+        return std::string(reinterpret_cast<const char*>(digest.data()), digest.size());
+    }
+
+    std::unique_ptr<HashEngine> create_chunk_hash(const std::shared_ptr<logger::LoggerHandler>& logger) {
+        try {
+            return HashEngine::create("SHA-256", logger);
+        } catch (const std::runtime_error&) {
+            throw ChunkIndexInvalid("SHA-256 not available");
+        }
+    }
+
+    void read_full(int fd, uint8_t* buffer, size_t length, uint64_t offset) {
+        size_t filled = 0;
+        while (filled < length) {
+            ssize_t bytes = ::pread(fd, buffer + filled, length - filled, static_cast<off_t>(offset + filled));
+            if (bytes < 0 && errno == EINTR) continue;
+            if (bytes <= 0) {
+                throw ChunkAssemblyFailed(std::string("short read: ") + (bytes < 0 ? std::strerror(errno) : "end of file"));
+            }
+            filled += static_cast<size_t>(bytes);
+        }
+    }
+
+    /* copy range between files, in kernel if possible; use_read_write is
+     * set once the kernel refuses to copy from in_fd */
+    void copy_range(int in_fd, uint64_t in_offset, int out_fd, uint64_t out_offset, uint64_t length,
+                    bool& use_read_write, std::vector<uint8_t>& buffer) {
+        while (length > 0) {
+            if (!use_read_write) {
+                loff_t in_pos = static_cast<loff_t>(in_offset);
+                loff_t out_pos = static_cast<loff_t>(out_offset);
+                ssize_t bytes = ::copy_file_range(in_fd, &in_pos, out_fd, &out_pos, length, 0);
+                if (bytes < 0 && errno == EINTR) continue;
+                if (bytes < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+                                  errno == EOPNOTSUPP)) {
+                    use_read_write = true;
+                    continue;
+                }
+                if (bytes <= 0) {
+                    throw ChunkAssemblyFailed(std::string("copy_file_range: ") +
+                                              (bytes < 0 ? std::strerror(errno) : "end of file"));
+                }
+                in_offset += static_cast<uint64_t>(bytes);
+                out_offset += static_cast<uint64_t>(bytes);
+                length -= static_cast<uint64_t>(bytes);
+                /* read and written */
+                IoThrottle::account(2 * static_cast<uint64_t>(bytes));
+                continue;
+            }
+
+            const size_t step = static_cast<size_t>(std::min<uint64_t>(length, buffer.size()));
+            read_full(in_fd, buffer.data(), step, in_offset);
+            size_t written = 0;
+            while (written < step) {
+                ssize_t bytes = ::pwrite(out_fd, buffer.data() + written, step - written,
+                                         static_cast<off_t>(out_offset + written));
+                if (bytes < 0 && errno == EINTR) continue;
+                if (bytes <= 0) {
+                    throw ChunkAssemblyFailed(std::string("write: ") + std::strerror(errno));
+                }
+                written += static_cast<size_t>(bytes);
+            }
+            IoThrottle::account(2 * static_cast<uint64_t>(step));
+            in_offset += step;
+            out_offset += step;
+            length -= step;
+        }
+    }
+}
+
+ChunkIndex ChunkIndex::parse(const std::vector<uint8_t>& value) {
+    constexpr size_t FIXED_SIZE = 4 + 4 + 4 + 4 + 8 + 4;
+    constexpr size_t ENTRY_SIZE = 4 + cdc::DIGEST_SIZE;
+    if (value.size() < FIXED_SIZE) {
+        throw ChunkIndexInvalid("record too small");
+    }
+
+    const uint32_t algorithm = read_u32(value.data());
+    if (algorithm != cdc::ALGORITHM_GEAR_SHA256) {
+        throw ChunkIndexInvalid("unsupported algorithm " + std::to_string(algorithm));
+    }
+
+    ChunkIndex index;
+    index.min_size_ = read_u32(value.data() + 4);
+    index.avg_size_ = read_u32(value.data() + 8);
+    index.max_size_ = read_u32(value.data() + 12);
+    index.image_size_ = read_u64(value.data() + 16);
+    const uint32_t count = read_u32(value.data() + 24);
+
+    if (index.min_size_ < cdc::MIN_CHUNK_SIZE || index.min_size_ > index.avg_size_ ||
+        index.avg_size_ > index.max_size_ || index.max_size_ > cdc::MAX_CHUNK_SIZE ||
+        (index.avg_size_ & (index.avg_size_ - 1)) != 0) {
+        throw ChunkIndexInvalid("invalid chunk sizes");
+    }
+    if (index.image_size_ == 0 || count == 0 || value.size() != FIXED_SIZE + uint64_t(count) * ENTRY_SIZE) {
+        throw ChunkIndexInvalid("chunk count does not match record size");
+    }
+
+    index.chunks_.reserve(count);
+    const uint8_t* entry = value.data() + FIXED_SIZE;
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < count; ++i, entry += ENTRY_SIZE) {
+        Chunk chunk;
+        chunk.offset = offset;
+        chunk.length = read_u32(entry);
+        std::copy(entry + 4, entry + ENTRY_SIZE, chunk.digest.begin());
+
+        /* only the last chunk may be shorter than the minimum */
+        if (chunk.length == 0 || chunk.length > index.max_size_ ||
+            (chunk.length < index.min_size_ && i + 1 != count)) {
+            throw ChunkIndexInvalid("invalid length of chunk " + std::to_string(i));
+        }
+        offset += chunk.length;
+        index.chunks_.push_back(chunk);
+    }
+    if (offset != index.image_size_) {
+        throw ChunkIndexInvalid("chunks do not cover image");
+    }
+
+    return index;
+}
+
+std::vector<ChunkIndex::Chunk> ChunkIndex::split(int fd, uint64_t size,
+                                                 const std::shared_ptr<logger::LoggerHandler>& logger) const {
+    /* boundary where the top log2(avg) bits of the rolling hash are zero */
+    unsigned bits = 0;
+    while ((uint64_t(1) << bits) < avg_size_) ++bits;
+    const uint64_t mask = bits == 0 ? 0 : ~uint64_t(0) << (64 - bits);
+
+    std::vector<Chunk> chunks;
+    std::unique_ptr<HashEngine> hash = create_chunk_hash(logger);
+    std::vector<uint8_t> buffer(static_cast<size_t>(std::min<uint64_t>(READ_SIZE, size)));
+
+    Chunk current{0, 0, {}};
+    uint64_t rolling = 0;
+    for (uint64_t pos = 0; pos < size;) {
+        const size_t length = static_cast<size_t>(std::min<uint64_t>(buffer.size(), size - pos));
+        read_full(fd, buffer.data(), length, pos);
+
+        size_t hashed = 0;
+        for (size_t i = 0; i < length; ++i) {
+            rolling = (rolling << 1) + GEAR[buffer[i]];
+            ++current.length;
+            if ((current.length >= min_size_ && (rolling & mask) == 0) || current.length == max_size_) {
+                hash->update(buffer.data() + hashed, i + 1 - hashed);
+                hashed = i + 1;
+                hash->final(current.digest.data());
+                chunks.push_back(current);
+                current = Chunk{current.offset + current.length, 0, {}};
+                rolling = 0;
+            }
+        }
+        hash->update(buffer.data() + hashed, length - hashed);
+        pos += length;
+    }
+    if (current.length > 0) {
+        hash->final(current.digest.data());
+        chunks.push_back(current);
+    }
+
+    return chunks;
+}
+
+ChunkReuseStatistics ChunkIndex::assemble(const std::string& seed_path, const std::string& source_path,
+                                          uint64_t source_offset, const std::string& dest_path,
+                                          const std::shared_ptr<logger::LoggerHandler>& logger) const {
+    const auto start = std::chrono::steady_clock::now();
+    ChunkReuseStatistics stats;
+    stats.chunks = chunks_.size();
+
+    int source_fd = ::open(source_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source_fd < 0) {
+        throw ChunkAssemblyFailed("cannot open " + source_path + ": " + std::strerror(errno));
+    }
+    std::unique_ptr<int, void (*)(int*)> source_guard(&source_fd, [](int* f) { ::close(*f); });
+
+    /* digest to offset of chunks already on the device */
+    std::unordered_map<std::string, uint64_t> seed_chunks;
+    int seed_fd = ::open(seed_path.c_str(), O_RDONLY | O_CLOEXEC);
+    std::unique_ptr<int, void (*)(int*)> seed_guard(&seed_fd, [](int* f) { if (*f >= 0) ::close(*f); });
+    struct stat st;
+    if (seed_fd >= 0 && fstat(seed_fd, &st) == 0) {
+        for (const Chunk& chunk : split(seed_fd, static_cast<uint64_t>(st.st_size), logger)) {
+            seed_chunks.emplace(digest_key(chunk.digest), chunk.offset);
+        }
+    } else {
+        logger->setLogEntry(std::make_shared<logger::LogEntry>(
+            CHUNK_INDEX, "assemble: no seed " + seed_path + ", copying all chunks",
+            logger::logLevel::WARNING));
+    }
+
+    int dest_fd = ::open(dest_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (dest_fd < 0) {
+        throw ChunkAssemblyFailed("cannot create " + dest_path + ": " + std::strerror(errno));
+    }
+    std::unique_ptr<int, void (*)(int*)> dest_guard(&dest_fd, [](int* f) { ::close(*f); });
+
+    /* per source file, a bundle on tmpfs must not disable reflinks from the seed slot */
+    bool seed_read_write = false;
+    bool source_read_write = false;
+    std::vector<uint8_t> buffer(READ_SIZE);
+
+    /* consecutive chunks from the same file are copied in one go */
+    int range_fd = -1;
+    uint64_t range_offset = 0;
+    uint64_t range_dest = 0;
+    uint64_t range_length = 0;
+    auto flush = [&]() {
+        if (range_length > 0) {
+            copy_range(range_fd, range_offset, dest_fd, range_dest, range_length,
+                       (range_fd == seed_fd) ? seed_read_write : source_read_write, buffer);
+        }
+        range_length = 0;
+    };
+
+    for (const Chunk& chunk : chunks_) {
+        int fd = source_fd;
+        uint64_t offset = source_offset + chunk.offset;
+        auto found = seed_chunks.find(digest_key(chunk.digest));
+        if (found != seed_chunks.end()) {
+            fd = seed_fd;
+            offset = found->second;
+            ++stats.reused_chunks;
+            stats.reused_bytes += chunk.length;
+        } else {
+            stats.copied_bytes += chunk.length;
+        }
+
+        if (range_length > 0 && fd == range_fd && offset == range_offset + range_length) {
+            range_length += chunk.length;
+        } else {
+            flush();
+            range_fd = fd;
+            range_offset = offset;
+            range_dest = chunk.offset;
+            range_length = chunk.length;
+        }
+    }
+    flush();
+
+    /* seed may have changed since it was split, check what was written */
+    std::unique_ptr<HashEngine> hash = create_chunk_hash(logger);
+    std::array<uint8_t, cdc::DIGEST_SIZE> digest;
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+        hash->update_from_fd(dest_fd, chunks_[i].offset, chunks_[i].length);
+        hash->final(digest.data());
+        if (digest != chunks_[i].digest) {
+            throw ChunkAssemblyFailed("chunk " + std::to_string(i) + " does not match index");
+        }
+    }
+
+    if (fsync(dest_fd) != 0) {
+        throw ChunkAssemblyFailed(std::string("fsync: ") + std::strerror(errno));
+    }
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    logger->setLogEntry(std::make_shared<logger::LogEntry>(
+        CHUNK_INDEX, "assemble: " + std::to_string(stats.reused_chunks) + "/" + std::to_string(stats.chunks) +
+        " chunks reused, " + std::to_string(stats.reused_bytes) + " bytes from seed" +
+        (seed_read_write ? " (read/write)" : "") + ", " + std::to_string(stats.copied_bytes) + " bytes from bundle" +
+        (source_read_write ? " (read/write)" : "") + " in " + std::to_string(elapsed.count()) + " ms",
+        logger::logLevel::DEBUG));
+
+    return stats;
+}
+
+} // namespace updater
@@ -0,0 +1,122 @@
+/**
+ * Content-defined chunk index of the application image.
+ *
+ * The index is carried as record of the signed metadata section of v2
+ * application images. It splits the squashfs into variable-sized chunks at
+ * content-defined boundaries (gear rolling hash), so chunks unchanged since
+ * the active image keep their digest even if data before them moved. On
+ * installation the active image is split the same way and every chunk found
+ * there is copied locally, only the remaining chunks are read from the bundle.
+ */
+
+#pragma once
+
+#include "../logger/LoggerHandler.h"
+#include "../logger/LoggerEntry.h"
+#include "./../BaseException.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+constexpr char CHUNK_INDEX[] = "chunk index";
+
+namespace updater {
+
+    namespace cdc {
+        /* gear rolling hash with splitmix64 table, SHA-256 chunk digests */
+        constexpr uint32_t ALGORITHM_GEAR_SHA256 = 1;
+        constexpr size_t DIGEST_SIZE = 32;
+        constexpr uint32_t MIN_CHUNK_SIZE = 1024;
+        constexpr uint32_t MAX_CHUNK_SIZE = 16 * 1024 * 1024;
+    }
+
+    class ChunkIndexInvalid : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Chunk index record is malformed.
+         * @param msg Reason of rejection.
+         */
+        explicit ChunkIndexInvalid(const std::string& msg) {
+            this->error_msg = std::string("Invalid chunk index: ") + msg;
+        }
+    };
+
+    class ChunkAssemblyFailed : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Image could not be assembled from chunks.
+         * @param msg Error message.
+         */
+        explicit ChunkAssemblyFailed(const std::string& msg) {
+            this->error_msg = std::string("Error assembling application image: ") + msg;
+        }
+    };
+
+    // Result of ChunkIndex::assemble()
+    struct ChunkReuseStatistics {
+        size_t chunks = 0;
+        size_t reused_chunks = 0;
+        uint64_t reused_bytes = 0;
+        uint64_t copied_bytes = 0;
+    };
+
+    class ChunkIndex {
+    public:
+        struct Chunk {
+            uint64_t offset;
+            uint32_t length;
+            std::array<uint8_t, cdc::DIGEST_SIZE> digest;
+        };
+
+    private:
+        uint32_t min_size_ = 0;
+        uint32_t avg_size_ = 0;
+        uint32_t max_size_ = 0;
+        uint64_t image_size_ = 0;
+        std::vector<Chunk> chunks_;
+
+    public:
+        /**
+         * Parse index record.
+         * Layout (big-endian): uint32 algorithm, uint32 min, average and max chunk size,
+         * uint64 image size, uint32 chunk count, per chunk uint32 length and digest.
+         * @param value Value of CHUNK_INDEX metadata record.
+         * @return Parsed index.
+         * @throw ChunkIndexInvalid
+         */
+        static ChunkIndex parse(const std::vector<uint8_t>& value);
+
+        uint64_t image_size() const { return image_size_; }
+        const std::vector<Chunk>& chunks() const { return chunks_; }
+
+        /**
+         * Split file into chunks with the parameters of this index.
+         * @param fd Open file.
+         * @param size Number of bytes from file start to split.
+         * @param logger Logger object reference.
+         * @throw ChunkAssemblyFailed Read error.
+         */
+        std::vector<Chunk> split(int fd, uint64_t size,
+                                 const std::shared_ptr<logger::LoggerHandler>& logger) const;
+
+        /**
+         * Write image described by index. Chunks present in seed are copied
+         * from there with copy_file_range (reflinked where the file system
+         * supports it), all others from source. The result is checked
+         * against the chunk digests.
+         * @param seed_path Active application image, may be missing.
+         * @param source_path Application image with full payload.
+         * @param source_offset Offset of payload in source_path.
+         * @param dest_path Target file, removed on failure by caller.
+         * @param logger Logger object reference.
+         * @throw ChunkAssemblyFailed I/O error or digest mismatch.
+         */
+        ChunkReuseStatistics assemble(const std::string& seed_path, const std::string& source_path,
+                                      uint64_t source_offset, const std::string& dest_path,
+                                      const std::shared_ptr<logger::LoggerHandler>& logger) const;
+    };
+
+} // namespace updater
@@ -0,0 +1,230 @@
+#include "chunkManifest.h"
+#include "resourcePolicy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+extern "C" {
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+}
+
+namespace updater {
+
+namespace {
+    uint32_t read_u32(const uint8_t* data) {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) value = (value << 8) | data[i];
+        return value;
+    }
+
+    uint64_t read_u64(const uint8_t* data) {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; ++i) value = (value << 8) | data[i];
+        return value;
+    }
+
+    std::unique_ptr<HashEngine> create_chunk_hash(const std::shared_ptr<logger::LoggerHandler>& logger = nullptr) {
+        try {
+            return HashEngine::create("SHA-256", logger);
+        } catch (const std::runtime_error&) {
+            throw ChunkManifestInvalid("SHA-256 not available");
+        }
+    }
+}
+
+ChunkManifest ChunkManifest::parse(const std::vector<uint8_t>& value) {
+    constexpr size_t FIXED_SIZE = 4 + 4 + 8 + 4 + chunk::DIGEST_SIZE;
+    if (value.size() < FIXED_SIZE) {
+        throw ChunkManifestInvalid("record too small");
+    }
+
+    const uint32_t algorithm = read_u32(value.data());
+    if (algorithm != chunk::HASH_SHA256) {
+        throw ChunkManifestInvalid("unsupported hash algorithm " + std::to_string(algorithm));
+    }
+
+    ChunkManifest manifest;
+    manifest.chunk_size_ = read_u32(value.data() + 4);
+    manifest.payload_size_ = read_u64(value.data() + 8);
+    const uint32_t count = read_u32(value.data() + 16);
+
+    if (manifest.chunk_size_ < chunk::MIN_CHUNK_SIZE || manifest.chunk_size_ > chunk::MAX_CHUNK_SIZE ||
+        manifest.chunk_size_ % chunk::MIN_CHUNK_SIZE != 0) {
+        throw ChunkManifestInvalid("invalid chunk size " + std::to_string(manifest.chunk_size_));
+    }
+
+    const uint64_t expected_count = (manifest.payload_size_ + manifest.chunk_size_ - 1) / manifest.chunk_size_;
+    if (manifest.payload_size_ == 0 || count != expected_count ||
+        value.size() != FIXED_SIZE + uint64_t(count) * chunk::DIGEST_SIZE) {
+        throw ChunkManifestInvalid("chunk count does not match payload size");
+    }
+
+    const uint8_t* root = value.data() + 20;
+    manifest.digests_.assign(value.begin() + FIXED_SIZE, value.end());
+
+    /* root digest binds the digest list */
+    std::unique_ptr<HashEngine> hash = create_chunk_hash();
+    hash->update(manifest.digests_.data(), manifest.digests_.size());
+    const std::vector<uint8_t> calculated = hash->final();
+    if (std::memcmp(calculated.data(), root, chunk::DIGEST_SIZE) != 0) {
+        throw ChunkManifestInvalid("root digest mismatch");
+    }
+
+    return manifest;
+}
+
+size_t ChunkManifest::chunk_length(size_t index) const {
+    const uint64_t offset = uint64_t(index) * chunk_size_;
+    return static_cast<size_t>(std::min<uint64_t>(chunk_size_, payload_size_ - offset));
+}
+
+bool ChunkManifest::matches(size_t index, const uint8_t* digest) const {
+    if (index >= chunk_count()) {
+        return false;
+    }
+    return std::memcmp(digests_.data() + index * chunk::DIGEST_SIZE, digest, chunk::DIGEST_SIZE) == 0;
+}
+
+bool ChunkManifest::verify_file(const std::string& path, uint64_t payload_offset,
+                                const std::shared_ptr<logger::LoggerHandler>& logger,
+                                unsigned threads) const {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        logger->setLogEntry(std::make_shared<logger::LogEntry>(
+            CHUNK_MANIFEST, "verify_file: can not open " + path + ": " + std::strerror(errno),
+            logger::logLevel::ERROR));
+        return false;
+    }
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(std::min<size_t>(threads, chunk_count()));
+
+    const auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next_chunk{0};
+    std::atomic<bool> failed{false};
+    std::mutex error_lock;
+    size_t first_bad = chunk_count();
+    std::string error_msg;
+
+    auto worker = [&]() {
+        try {
+            std::unique_ptr<HashEngine> hash = create_chunk_hash(logger);
+            std::vector<uint8_t> buffer(chunk_size_);
+            uint8_t digest[chunk::DIGEST_SIZE];
+
+            while (!failed.load(std::memory_order_relaxed)) {
+                const size_t index = next_chunk.fetch_add(1, std::memory_order_relaxed);
+                if (index >= chunk_count()) {
+                    break;
+                }
+
+                const size_t length = chunk_length(index);
+                const off_t offset = static_cast<off_t>(payload_offset + uint64_t(index) * chunk_size_);
+                size_t filled = 0;
+                while (filled < length) {
+                    ssize_t bytes = ::pread(fd, buffer.data() + filled, length - filled, offset + filled);
+                    if (bytes < 0 && errno == EINTR) continue;
+                    if (bytes <= 0) {
+                        throw ChunkManifestInvalid("short read of chunk " + std::to_string(index));
+                    }
+                    filled += static_cast<size_t>(bytes);
+                    IoThrottle::account(static_cast<uint64_t>(bytes));
+                }
+
+                hash->update(buffer.data(), length);
+                hash->final(digest);
+                if (!matches(index, digest)) {
+                    failed.store(true);
+                    std::lock_guard<std::mutex> lock(error_lock);
+                    if (index < first_bad) {
+                        first_bad = index;
+                        error_msg = ChunkMismatch(index).what();
+                    }
+                    break;
+                }
+            }
+        } catch (const std::exception& e) {
+            failed.store(true);
+            std::lock_guard<std::mutex> lock(error_lock);
+            if (error_msg.empty()) {
+                error_msg = e.what();
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+        pool.emplace_back(worker);
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    ::close(fd);
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    if (failed.load()) {
+        logger->setLogEntry(std::make_shared<logger::LogEntry>(
+            CHUNK_MANIFEST, "verify_file: " + error_msg + " after " + std::to_string(elapsed.count()) + " ms",
+            logger::logLevel::ERROR));
+        return false;
+    }
+
+    logger->setLogEntry(std::make_shared<logger::LogEntry>(
+        CHUNK_MANIFEST, "verify_file: " + std::to_string(chunk_count()) + " chunks, " +
+        std::to_string(payload_size_) + " bytes, " + std::to_string(threads) + " threads in " +
+        std::to_string(elapsed.count()) + " ms",
+        logger::logLevel::DEBUG));
+    return true;
+}
+
+ChunkStreamVerifier::ChunkStreamVerifier(const ChunkManifest& manifest)
+    : manifest_(manifest), hash_(create_chunk_hash()) {}
+
+void ChunkStreamVerifier::finish_chunk() {
+    uint8_t digest[chunk::DIGEST_SIZE];
+    hash_->final(digest);
+    if (!manifest_.matches(index_, digest)) {
+        throw ChunkMismatch(index_);
+    }
+    ++index_;
+    chunk_filled_ = 0;
+}
+
+void ChunkStreamVerifier::update(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        if (index_ >= manifest_.chunk_count()) {
+            /* more payload than described by manifest */
+            throw ChunkMismatch(index_);
+        }
+
+        const size_t missing = manifest_.chunk_length(index_) - chunk_filled_;
+        const size_t take = std::min(missing, length);
+        hash_->update(data, take);
+        chunk_filled_ += take;
+        data += take;
+        length -= take;
+
+        if (chunk_filled_ == manifest_.chunk_length(index_)) {
+            finish_chunk();
+        }
+    }
+}
+
+void ChunkStreamVerifier::finish() {
+    if (index_ != manifest_.chunk_count() || chunk_filled_ != 0) {
+        throw ChunkMismatch(index_);
+    }
+}
+
+} // namespace updater
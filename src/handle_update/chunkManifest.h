@@ -0,0 +1,130 @@
+/**
+ * Chunk hash manifest of the application payload.
+ *
+ * The manifest is carried as record of the signed metadata section of v2
+ * application images. It lists one digest per fixed-size payload chunk plus
+ * a root digest over the chunk digest list. Once the metadata signature is
+ * verified, the payload can be checked chunk by chunk: in parallel before
+ * installation and again while it is copied to the application slot.
+ */
+
+#pragma once
+
+#include "../logger/LoggerHandler.h"
+#include "../logger/LoggerEntry.h"
+#include "./../BaseException.h"
+
+#include "hashEngine.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+constexpr char CHUNK_MANIFEST[] = "chunk manifest";
+
+namespace updater {
+
+    namespace chunk {
+        constexpr uint32_t HASH_SHA256 = 1;
+        constexpr size_t DIGEST_SIZE = 32;
+        constexpr uint32_t MIN_CHUNK_SIZE = 4096;
+        constexpr uint32_t MAX_CHUNK_SIZE = 16 * 1024 * 1024;
+    }
+
+    class ChunkManifestInvalid : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Chunk manifest record is malformed.
+         * @param msg Reason of rejection.
+         */
+        explicit ChunkManifestInvalid(const std::string& msg) {
+            this->error_msg = std::string("Invalid chunk manifest: ") + msg;
+        }
+    };
+
+    class ChunkMismatch : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Payload chunk does not match digest of manifest.
+         * @param index Index of first bad chunk.
+         */
+        explicit ChunkMismatch(size_t index) {
+            this->error_msg = std::string("Payload chunk ") + std::to_string(index) + " does not match manifest";
+        }
+    };
+
+    class ChunkManifest {
+    private:
+        uint32_t chunk_size_ = 0;
+        uint64_t payload_size_ = 0;
+        /* chunk digests, DIGEST_SIZE bytes each */
+        std::vector<uint8_t> digests_;
+
+    public:
+        /**
+         * Parse manifest record.
+         * Layout (big-endian): uint32 hash algorithm, uint32 chunk size, uint64 payload size,
+         * uint32 chunk count, root digest, chunk digests.
+         * @param value Value of CHUNK_MANIFEST metadata record.
+         * @return Parsed manifest.
+         * @throw ChunkManifestInvalid
+         */
+        static ChunkManifest parse(const std::vector<uint8_t>& value);
+
+        uint32_t chunk_size() const { return chunk_size_; }
+        uint64_t payload_size() const { return payload_size_; }
+        size_t chunk_count() const { return digests_.size() / chunk::DIGEST_SIZE; }
+
+        /**
+         * Length of chunk, the last chunk may be shorter.
+         */
+        size_t chunk_length(size_t index) const;
+
+        /**
+         * Compare digest with the one of the manifest.
+         */
+        bool matches(size_t index, const uint8_t* digest) const;
+
+        /**
+         * Hash all payload chunks of file in parallel. Stops at the first bad chunk.
+         * @param path Path to application image.
+         * @param payload_offset Offset of payload in application image.
+         * @param logger Logger object reference.
+         * @param threads Number of worker threads, 0 uses all cores.
+         * @return All chunks match: true, else false.
+         */
+        bool verify_file(const std::string& path, uint64_t payload_offset,
+                         const std::shared_ptr<logger::LoggerHandler>& logger,
+                         unsigned threads = 0) const;
+    };
+
+    /**
+     * Verify sequential payload stream, e.g. while copying, against manifest.
+     */
+    class ChunkStreamVerifier {
+    private:
+        const ChunkManifest& manifest_;
+        std::unique_ptr<HashEngine> hash_;
+        size_t index_ = 0;
+        uint64_t chunk_filled_ = 0;
+
+        void finish_chunk();
+
+    public:
+        explicit ChunkStreamVerifier(const ChunkManifest& manifest);
+
+        /**
+         * Feed next payload bytes.
+         * @throw ChunkMismatch When a completed chunk does not match.
+         */
+        void update(const uint8_t* data, size_t length);
+
+        /**
+         * Check the last chunk and that the whole payload was fed.
+         * @throw ChunkMismatch
+         */
+        void finish();
+    };
+
+} // namespace updater
@@ -0,0 +1,231 @@
+#include "deltaPatch.h"
+#include "hashEngine.h"
+#include "resourcePolicy.h"
+#include "writeEngine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+}
+
+#if FUS_LIB_DELTA_UPDATE
+#include <zstd.h>
+#endif
+
+namespace updater {
+
+namespace {
+    uint64_t read_u64(const uint8_t* data) {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; ++i) value = (value << 8) | data[i];
+        return value;
+    }
+
+#if FUS_LIB_DELTA_UPDATE
+    /* file range mapped for the lifetime of the object */
+    class Mapping {
+    private:
+        void* base_ = MAP_FAILED;
+        size_t map_length_ = 0;
+        uint8_t* data_ = nullptr;
+
+    public:
+        Mapping(int fd, uint64_t offset, uint64_t length, int prot, int flags) {
+            const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+            const uint64_t aligned = offset - offset % page;
+            map_length_ = static_cast<size_t>(length + (offset - aligned));
+            base_ = mmap(nullptr, map_length_, prot, flags, fd, static_cast<off_t>(aligned));
+            if (base_ == MAP_FAILED) {
+                throw DeltaApplyFailed(std::string("mmap: ") + std::strerror(errno));
+            }
+            data_ = static_cast<uint8_t*>(base_) + (offset - aligned);
+            madvise(base_, map_length_, MADV_SEQUENTIAL);
+        }
+        ~Mapping() { munmap(base_, map_length_); }
+
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+
+        uint8_t* data() const { return data_; }
+    };
+
+    void check_zstd(size_t result, const std::string& what) {
+        if (ZSTD_isError(result)) {
+            throw DeltaApplyFailed(what + ": " + ZSTD_getErrorName(result));
+        }
+    }
+#endif
+}
+
+DeltaDescriptor DeltaDescriptor::parse(const std::vector<uint8_t>& value) {
+    if (value.size() != delta::RECORD_SIZE) {
+        throw DeltaPatchInvalid("record size " + std::to_string(value.size()));
+    }
+
+    DeltaDescriptor descriptor;
+    const uint8_t* pos = value.data();
+    descriptor.format = *pos++;
+    if (descriptor.format != delta::FORMAT_ZSTD_PATCH_FROM) {
+        throw DeltaPatchInvalid("unsupported format " + std::to_string(descriptor.format));
+    }
+    descriptor.base_size = read_u64(pos);
+    pos += 8;
+    descriptor.base_digest.assign(pos, pos + delta::DIGEST_SIZE);
+    pos += delta::DIGEST_SIZE;
+    descriptor.target_size = read_u64(pos);
+    pos += 8;
+    descriptor.target_digest.assign(pos, pos + delta::DIGEST_SIZE);
+
+    if (descriptor.base_size == 0 || descriptor.target_size == 0) {
+        throw DeltaPatchInvalid("empty base or target image");
+    }
+    if (descriptor.base_size > SIZE_MAX || descriptor.target_size > SIZE_MAX) {
+        throw DeltaPatchInvalid("image size exceeds address space");
+    }
+    return descriptor;
+}
+
+bool DeltaPatch::supported() {
+    return FUS_LIB_DELTA_UPDATE != 0;
+}
+
+#if FUS_LIB_DELTA_UPDATE
+void DeltaPatch::apply(const DeltaDescriptor& descriptor, const std::string& base_path,
+                       const std::string& patch_path, uint64_t patch_offset, uint64_t patch_size,
+                       const std::string& dest_path,
+                       const std::shared_ptr<logger::LoggerHandler>& logger) {
+    const auto start = std::chrono::steady_clock::now();
+
+    int base_fd = ::open(base_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (base_fd < 0) {
+        throw DeltaBaseMismatch(base_path);
+    }
+    std::unique_ptr<int, void (*)(int*)> base_guard(&base_fd, [](int* f) { ::close(*f); });
+
+    /* a patch against another image produces garbage, reject before writing */
+    struct stat st;
+    if (fstat(base_fd, &st) != 0 || static_cast<uint64_t>(st.st_size) != descriptor.base_size) {
+        throw DeltaBaseMismatch(base_path);
+    }
+    std::unique_ptr<HashEngine> base_hash = HashEngine::create("SHA-256", logger);
+    base_hash->update_from_fd(base_fd, 0, descriptor.base_size);
+    if (base_hash->final() != descriptor.base_digest) {
+        throw DeltaBaseMismatch(base_path);
+    }
+
+    int patch_fd = ::open(patch_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (patch_fd < 0) {
+        throw DeltaApplyFailed("cannot open " + patch_path + ": " + std::strerror(errno));
+    }
+    std::unique_ptr<int, void (*)(int*)> patch_guard(&patch_fd, [](int* f) { ::close(*f); });
+
+    int dest_fd = ::open(dest_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (dest_fd < 0) {
+        throw DeltaApplyFailed("cannot create " + dest_path + ": " + std::strerror(errno));
+    }
+    std::unique_ptr<int, void (*)(int*)> dest_guard(&dest_fd, [](int* f) { ::close(*f); });
+
+    /* bounded dirty pages and throttled writes like a plain copy */
+    WriteEngine writer(dest_fd, dest_path);
+    writer.preallocate(descriptor.target_size);
+
+    {
+        /* the base is the prefix of the frame and stays in page cache, the
+         * patch is read and the target written in stream buffers */
+        Mapping base(base_fd, 0, descriptor.base_size, PROT_READ, MAP_PRIVATE);
+
+        std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> dctx(ZSTD_createDCtx(), &ZSTD_freeDCtx);
+        if (!dctx) {
+            throw DeltaApplyFailed("cannot create zstd context");
+        }
+        /* window of a patch spans the whole base image */
+        const ZSTD_bounds window_log = ZSTD_dParam_getBounds(ZSTD_d_windowLogMax);
+        check_zstd(window_log.error, "window size");
+        check_zstd(ZSTD_DCtx_setParameter(dctx.get(), ZSTD_d_windowLogMax, window_log.upperBound), "window size");
+        check_zstd(ZSTD_DCtx_refPrefix(dctx.get(), base.data(), descriptor.base_size), "base image");
+
+        std::unique_ptr<HashEngine> target_hash = HashEngine::create("SHA-256", logger);
+        std::vector<uint8_t> in_buffer(ZSTD_DStreamInSize());
+        std::vector<uint8_t> out_buffer(ZSTD_DStreamOutSize());
+        uint64_t consumed = 0;
+        uint64_t produced = 0;
+        /* 0 once the frame is complete */
+        size_t remaining = 1;
+
+        while (consumed < patch_size) {
+            const size_t want = static_cast<size_t>(std::min<uint64_t>(in_buffer.size(), patch_size - consumed));
+            const ssize_t bytes = ::pread(patch_fd, in_buffer.data(), want, static_cast<off_t>(patch_offset + consumed));
+            if (bytes < 0 && errno == EINTR) continue;
+            if (bytes <= 0) {
+                throw DeltaApplyFailed("cannot read patch at offset " + std::to_string(consumed));
+            }
+            IoThrottle::account(static_cast<uint64_t>(bytes));
+
+            if (consumed == 0) {
+                const unsigned long long content_size = ZSTD_getFrameContentSize(in_buffer.data(), static_cast<size_t>(bytes));
+                if (content_size == ZSTD_CONTENTSIZE_ERROR) {
+                    throw DeltaApplyFailed("payload is not a zstd frame");
+                }
+                if (content_size != ZSTD_CONTENTSIZE_UNKNOWN && content_size != descriptor.target_size) {
+                    throw DeltaApplyFailed("frame size does not match target size");
+                }
+            }
+            consumed += static_cast<uint64_t>(bytes);
+
+            /* zstd keeps the last byte of a frame until all of its output is flushed */
+            ZSTD_inBuffer input = {in_buffer.data(), static_cast<size_t>(bytes), 0};
+            while (input.pos < input.size) {
+                if (remaining == 0) {
+                    throw DeltaApplyFailed("data after the zstd frame");
+                }
+                ZSTD_outBuffer output = {out_buffer.data(), out_buffer.size(), 0};
+                remaining = ZSTD_decompressStream(dctx.get(), &output, &input);
+                check_zstd(remaining, "decompress");
+                if (output.pos > descriptor.target_size - produced) {
+                    throw DeltaApplyFailed("target size mismatch");
+                }
+                target_hash->update(out_buffer.data(), output.pos);
+                writer.write(reinterpret_cast<const char*>(out_buffer.data()), output.pos);
+                produced += output.pos;
+            }
+        }
+
+        if (remaining != 0) {
+            throw DeltaApplyFailed("truncated zstd frame");
+        }
+        if (produced != descriptor.target_size) {
+            throw DeltaApplyFailed("target size mismatch");
+        }
+        if (target_hash->final() != descriptor.target_digest) {
+            throw DeltaApplyFailed("target digest mismatch");
+        }
+    }
+
+    writer.finish();
+
+    if (logger) {
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+        logger->setLogEntry(std::make_shared<logger::LogEntry>(DELTA_PATCH,
+            "applied " + std::to_string(patch_size) + " byte patch to " + base_path + ", " +
+            std::to_string(descriptor.target_size) + " bytes written in " +
+            std::to_string(elapsed.count()) + " ms",
+            logger::logLevel::DEBUG));
+    }
+}
+#else
+void DeltaPatch::apply(const DeltaDescriptor&, const std::string&, const std::string&, uint64_t, uint64_t,
+                       const std::string&, const std::shared_ptr<logger::LoggerHandler>&) {
+    throw DeltaPatchInvalid("not supported by this build");
+}
+#endif
+
+} // namespace updater
@@ -0,0 +1,109 @@
+/**
+ * Delta application images.
+ *
+ * The payload of a delta image is a zstd frame compressed with the active
+ * application image as prefix (zstd --patch-from). The signed metadata
+ * carries a delta record with size and SHA-256 of the base image and of the
+ * resulting target image. The patch is applied straight into the file of
+ * the inactive slot, the result must match the signed target digest.
+ */
+
+#pragma once
+
+#include <fus_updater_lib/config.h>
+#include "../logger/LoggerHandler.h"
+#include "../logger/LoggerEntry.h"
+#include "./../BaseException.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+constexpr char DELTA_PATCH[] = "delta patch";
+
+namespace updater {
+
+    namespace delta {
+        constexpr uint8_t FORMAT_ZSTD_PATCH_FROM = 1;
+        constexpr size_t DIGEST_SIZE = 32;
+        /* format + base size + base digest + target size + target digest */
+        constexpr size_t RECORD_SIZE = 1 + 8 + DIGEST_SIZE + 8 + DIGEST_SIZE;
+    }
+
+    class DeltaPatchInvalid : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Delta record is malformed or delta images are not supported.
+         * @param msg Reason of rejection.
+         */
+        explicit DeltaPatchInvalid(const std::string& msg) {
+            this->error_msg = std::string("Invalid delta image: ") + msg;
+        }
+    };
+
+    class DeltaBaseMismatch : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Active application image is not the base of the delta image.
+         * @param path Active application image.
+         */
+        explicit DeltaBaseMismatch(const std::string& path) {
+            this->error_msg = std::string("Delta image does not apply to ") + path;
+        }
+    };
+
+    class DeltaApplyFailed : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Patch could not be applied or result does not match target digest.
+         * @param msg Error message.
+         */
+        explicit DeltaApplyFailed(const std::string& msg) {
+            this->error_msg = std::string("Error applying delta image: ") + msg;
+        }
+    };
+
+    struct DeltaDescriptor {
+        uint8_t format = 0;
+        uint64_t base_size = 0;
+        std::vector<uint8_t> base_digest;
+        uint64_t target_size = 0;
+        std::vector<uint8_t> target_digest;
+
+        /**
+         * Parse delta record of metadata section.
+         * @throw DeltaPatchInvalid Record is malformed or format unknown.
+         */
+        static DeltaDescriptor parse(const std::vector<uint8_t>& value);
+    };
+
+    class DeltaPatch {
+    public:
+        DeltaPatch() = delete;
+
+        /**
+         * Library is built with delta support (fs_delta_update).
+         */
+        static bool supported();
+
+        /**
+         * Apply patch to base image and write target image.
+         * @param descriptor Signed delta record.
+         * @param base_path Active application image.
+         * @param patch_path Application image with the patch as payload.
+         * @param patch_offset Offset of patch in patch_path.
+         * @param patch_size Size of patch.
+         * @param dest_path Target file, removed on failure by caller.
+         * @param logger Logger object reference.
+         * @throw DeltaBaseMismatch Base has wrong size or digest.
+         * @throw DeltaApplyFailed Patch is corrupt, I/O error or target digest mismatch.
+         * @throw DeltaPatchInvalid Built without delta support.
+         */
+        static void apply(const DeltaDescriptor& descriptor, const std::string& base_path,
+                          const std::string& patch_path, uint64_t patch_offset, uint64_t patch_size,
+                          const std::string& dest_path,
+                          const std::shared_ptr<logger::LoggerHandler>& logger);
+    };
+
+} // namespace updater
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 namespace fs {
     // Use inline constexpr so it's header-only and avoids ODR violations
     inline constexpr char FSUPDATE_DOMAIN[] = "fsupdate";
@@ -4,15 +4,22 @@
 #include "updateApplication.h"
 #include "LibArchiveHandle.h"
 #include "UpdateStore.h"
+#include "verificationRecord.h"
+#include "httpSource.h"
+#include "writeEngine.h"
 #include "utils.h"
 #include "../uboot_interface/allowed_uboot_variable_states.h"
+#include "../trace/trace.h"
 #include <botan/hash.h>
 #include <botan/hex.h>
 #include <iostream>  /* cout */
 #include <algorithm> /* transform */
 #include <cctype>    /* tolower */
+#include <chrono>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -31,6 +38,29 @@ fs::FSUpdate::~FSUpdate()
     this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN, "fsupdate: deconstruct", logger::logLevel::DEBUG));
 }
 
+updater::applicationUpdate &fs::FSUpdate::application_updater()
+{
+    if (!this->app_updater)
+    {
+        const auto start = chrono::steady_clock::now();
+        this->app_updater = make_unique<updater::applicationUpdate>(this->uboot_handler, this->logger);
+        this->tmp_app_path = this->app_updater->getTempAppPath();
+        const auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN,
+            "application_updater: created in " + to_string(elapsed.count()) + " us", logger::logLevel::DEBUG));
+    }
+    return *this->app_updater;
+}
+
+updater::firmwareUpdate &fs::FSUpdate::firmware_updater()
+{
+    if (!this->fw_updater)
+    {
+        this->fw_updater = make_unique<updater::firmwareUpdate>(this->uboot_handler, this->logger);
+    }
+    return *this->fw_updater;
+}
+
 bool fs::FSUpdate::create_work_dir()
 {
     string msg = work_dir;
@@ -62,11 +92,28 @@ filesystem::path fs::FSUpdate::get_work_dir()
     return this->work_dir;
 }
 
-void fs::FSUpdate::decorator_update_state(function<void()> func)
+void fs::FSUpdate::set_resource_policy(const updater::ResourcePolicy &policy)
+{
+    this->resource_policy = policy;
+}
+
+void fs::FSUpdate::set_manifest_policy(const updater::ManifestPolicy &policy)
+{
+    this->manifest_policy = policy;
+}
+
+const updater::UpdateMetrics &fs::FSUpdate::get_update_metrics() const
+{
+    return this->update_metrics;
+}
+
+void fs::FSUpdate::decorator_update_state(const string &operation, function<void()> func)
 {
     if (this->update_handler.noUpdateProcessing())
     {
         this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN, "decorator_update_state: no update in progress pending", logger::logLevel::DEBUG));
+        updater::ResourceScope resource_scope(this->resource_policy, this->logger);
+        updater::MetricsScope metrics_scope(operation, this->update_metrics, *this->uboot_handler);
         func();
     }
     else if (this->update_handler.failedFirmwareUpdate())
@@ -103,7 +150,8 @@ void fs::FSUpdate::decorator_update_state(function<void()> func)
 
 void fs::FSUpdate::update_firmware(const string &path_to_firmware)
 {
-    updater::firmwareUpdate update_fw(this->uboot_handler, this->logger);
+    trace::Span span("fsupdate", "update_firmware");
+    updater::firmwareUpdate &update_fw = this->firmware_updater();
 
     function<void()> update_firmware = [&](){
         {
@@ -135,15 +183,15 @@ void fs::FSUpdate::update_firmware(const string &path_to_firmware)
         }
     };
 
-    this->decorator_update_state(update_firmware);
+    this->decorator_update_state("update_firmware", update_firmware);
 }
 
 void fs::FSUpdate::update_application(const string &path_to_application)
 {
-    auto update_app = std::make_shared<updater::applicationUpdate>(this->uboot_handler, this->logger);
-    this->tmp_app_path = update_app->getTempAppPath();
+    trace::Span span("fsupdate", "update_application");
+    updater::applicationUpdate &update_app = this->application_updater();
 
-    function<void()> update_application = [this, update_app, path_to_application]() {
+    function<void()> update_application = [this, &update_app, path_to_application]() {
         {
             UBoot::UBoot::EnvTransaction txn(*this->uboot_handler);
             vector<uint8_t> update = util::to_array(this->uboot_handler->getVariable("update", validate_update_bits));
@@ -155,7 +203,7 @@ void fs::FSUpdate::update_application(const string &path_to_application)
         }
 
         try {
-            update_app->install(path_to_application);
+            update_app.install(path_to_application);
         }
         catch (const exception &e)
         {
@@ -167,16 +215,15 @@ void fs::FSUpdate::update_application(const string &path_to_application)
             throw;
         }
     };
-    this->decorator_update_state(update_application);
+    this->decorator_update_state("update_application", update_application);
 }
 
 void fs::FSUpdate::update_firmware_and_application(const string &path_to_firmware,
                                                    const string &path_to_application)
 {
-    updater::applicationUpdate update_app(this->uboot_handler, this->logger);
-    updater::firmwareUpdate update_fw(this->uboot_handler, this->logger);
-
-    this->tmp_app_path = update_app.getTempAppPath();
+    trace::Span span("fsupdate", "update_firmware_and_application");
+    updater::applicationUpdate &update_app = this->application_updater();
+    updater::firmwareUpdate &update_fw = this->firmware_updater();
     vector<uint8_t> update;
 
     function<void()> update_firmware_and_application = [&](){
@@ -238,16 +285,11 @@ void fs::FSUpdate::update_firmware_and_application(const string &path_to_firmwar
         }
     };
 
-    this->decorator_update_state(update_firmware_and_application);
+    this->decorator_update_state("update_firmware_and_application", update_firmware_and_application);
 }
 
-void fs::FSUpdate::update_image(string &path_to_update_image, string &update_type, uint8_t &installed_update_type)
+void fs::FSUpdate::create_archive_dir(const filesystem::path &target_archiv_dir)
 {
-    UpdateStore update_store;
-    filesystem::path target_archiv_dir(TARGET_ARCHIV_DIR_PATH);
-    filesystem::path updateInstalled_path(work_dir / "updateInstalled");
-    bool use_common_update = false;
-
     /* create temporary directory to extract and install update file */
     try
     {
@@ -262,6 +304,147 @@ void fs::FSUpdate::update_image(string &path_to_update_image, string &update_typ
         this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN, ex.what(), logger::logLevel::DEBUG));
         throw GenericException(ex.what(), ex.code().value());
     }
+}
+
+bool fs::FSUpdate::use_prepared_image(const string &path_to_update_image, UpdateStore &update_store)
+{
+    const filesystem::path target_archiv_dir(TARGET_ARCHIV_DIR_PATH);
+    const filesystem::path fw_path(target_archiv_dir / update_store.getFirmwareStoreName());
+    const filesystem::path app_path(target_archiv_dir / update_store.getApplicationStoreName());
+    vector<uint8_t> digest;
+
+    if (!updater::VerificationRecord::lookup(path_to_update_image, "", digest, this->logger))
+    {
+        return false;
+    }
+
+    /* the prepared manifest is the one checked by prepare_image */
+    try
+    {
+        update_store.ReadUpdateConfiguration((target_archiv_dir / "fsupdate.json"));
+    }
+    catch (const GenericException &)
+    {
+        return false;
+    }
+    if (digest.empty() || digest != update_store.GetManifestDigest())
+    {
+        return false;
+    }
+
+    /* firmware record holds the manifest checksum its file was checked
+     * against, application has its own record, checked on installation */
+    const bool fw_available = filesystem::exists(fw_path);
+    const bool app_available = filesystem::exists(app_path);
+    if (!fw_available && !app_available)
+    {
+        return false;
+    }
+    if (fw_available &&
+        (!updater::VerificationRecord::lookup(fw_path, "", digest, this->logger) || digest.empty() ||
+         digest != update_store.GetImageDigest(update_store.getFirmwareStoreName())))
+    {
+        return false;
+    }
+
+    update_store.SetFirmwareAvailable(fw_available);
+    update_store.SetApplicationAvailable(app_available);
+    return true;
+}
+
+/* version_t is a number or a string, depending on the build */
+[[maybe_unused]] static string version_string(uint64_t version)
+{
+    return to_string(version);
+}
+
+[[maybe_unused]] static string version_string(const string &version)
+{
+    return version;
+}
+
+void fs::FSUpdate::apply_manifest_policy(UpdateStore &update_store)
+{
+    const string fw_store_name = update_store.getFirmwareStoreName();
+    update_store.SetManifestPolicy(this->manifest_policy, [this, fw_store_name](const string &file) {
+        return version_string((file == fw_store_name) ? this->get_firmware_version() : this->get_application_version());
+    });
+}
+
+void fs::FSUpdate::check_update_store(UpdateStore &update_store)
+{
+    filesystem::path target_archiv_dir(TARGET_ARCHIV_DIR_PATH);
+
+    /* read and parse fsupdate.json */
+    update_store.ReadUpdateConfiguration((target_archiv_dir / "fsupdate.json"));
+    /* read fw and/or application hashes from update configuration and compare it
+     * calculated.
+     */
+    if (!update_store.CheckUpdateSha256Sum(target_archiv_dir))
+    {
+        /* removing the directory may change errno */
+        const int error = errno;
+        try
+        {
+            /* remove arch directory */
+            filesystem::remove_all(target_archiv_dir);
+        }
+        catch (filesystem::filesystem_error const &ex)
+        {
+            this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN, ex.what(), logger::logLevel::DEBUG));
+            throw GenericException(ex.what(), ex.code().value());
+        }
+        string output = "Checksum calculation " + target_archiv_dir.string() + " fails.";
+        throw GenericException(output.c_str(), error);
+    }
+}
+
+void fs::FSUpdate::verify_application(const string &path_to_application)
+{
+    trace::Span span("fsupdate", "verify_application");
+    updater::ResourceScope resource_scope(this->resource_policy, this->logger);
+    updater::MetricsScope metrics_scope("verify_application", this->update_metrics, *this->uboot_handler);
+    this->application_updater().verify_only(path_to_application);
+}
+
+void fs::FSUpdate::prepare_image(const string &path_to_update_image)
+{
+    trace::Span span("fsupdate", "prepare_image");
+    updater::ResourceScope resource_scope(this->resource_policy, this->logger);
+    updater::MetricsScope metrics_scope("prepare_image", this->update_metrics, *this->uboot_handler);
+    UpdateStore update_store(this->logger);
+    filesystem::path target_archiv_dir(TARGET_ARCHIV_DIR_PATH);
+    this->apply_manifest_policy(update_store);
+
+    this->create_archive_dir(target_archiv_dir);
+    update_store.ExtractUpdateStore(path_to_update_image);
+    this->check_update_store(update_store);
+
+    if (update_store.IsFirmwareAvailable())
+    {
+        /* RAUC verifies the bundle signature again on installation */
+        updater::VerificationRecord::store((target_archiv_dir / update_store.getFirmwareStoreName()),
+                                           update_store.GetImageDigest(update_store.getFirmwareStoreName()), "",
+                                           this->logger);
+    }
+    if (update_store.IsApplicationAvailable())
+    {
+        this->verify_application((target_archiv_dir / update_store.getApplicationStoreName()));
+    }
+    updater::VerificationRecord::store(path_to_update_image, update_store.GetManifestDigest(), "", this->logger);
+}
+
+void fs::FSUpdate::update_image(string &path_to_update_image, string &update_type, uint8_t &installed_update_type)
+{
+    trace::Span span("fsupdate", "update_image");
+    updater::ResourceScope resource_scope(this->resource_policy, this->logger);
+    updater::MetricsScope metrics_scope("update_image", this->update_metrics, *this->uboot_handler);
+    UpdateStore update_store(this->logger);
+    filesystem::path target_archiv_dir(TARGET_ARCHIV_DIR_PATH);
+    this->apply_manifest_policy(update_store);
+    bool use_common_update = false;
+
+    this->create_archive_dir(target_archiv_dir);
 
     if (update_type.empty())
     {
@@ -269,31 +452,20 @@ void fs::FSUpdate::update_image(string &path_to_update_image, string &update_typ
     }
 
     /* check for update_type */
-    if (use_common_update == true)
+    if (use_common_update == true && this->use_prepared_image(path_to_update_image, update_store))
+    {
+        /* extracted and checked by prepare_image, records are single use */
+        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN,
+            "update_image: use prepared " + path_to_update_image, logger::logLevel::DEBUG));
+        updater::VerificationRecord::remove(path_to_update_image);
+        updater::VerificationRecord::remove((target_archiv_dir / update_store.getFirmwareStoreName()));
+    }
+    else if (use_common_update == true)
     {
         /* uptate type is empty so use common update functionality */
         /* extract update image */
         update_store.ExtractUpdateStore(path_to_update_image);
-        /* read and parse fsupdate.json */
-        update_store.ReadUpdateConfiguration((target_archiv_dir / "fsupdate.json"));
-        /* read fw and/or application hashes from update configuration and compare it
-         * calculated.
-         */
-        if (!update_store.CheckUpdateSha256Sum(target_archiv_dir))
-        {
-            try
-            {
-                /* remove arch directory */
-                filesystem::remove_all(target_archiv_dir);
-            }
-            catch (filesystem::filesystem_error const &ex)
-            {
-                this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN, ex.what(), logger::logLevel::DEBUG));
-                throw GenericException(ex.what(), ex.code().value());
-            }
-            string output = "Checksum calculation " + target_archiv_dir.string() + " fails.";
-            throw GenericException(output.c_str(), errno);
-        }
+        this->check_update_store(update_store);
     }
     else
     {
@@ -308,6 +480,15 @@ void fs::FSUpdate::update_image(string &path_to_update_image, string &update_typ
         }
     }
 
+    this->install_update_store(update_store, path_to_update_image, use_common_update, installed_update_type);
+}
+
+void fs::FSUpdate::install_update_store(UpdateStore &update_store, const string &path_to_update_image,
+                                        bool use_common_update, uint8_t &installed_update_type)
+{
+    filesystem::path target_archiv_dir(TARGET_ARCHIV_DIR_PATH);
+    filesystem::path updateInstalled_path(work_dir / "updateInstalled");
+
     /* Check update for firmware, application or both */
     if (update_store.IsApplicationAvailable() && update_store.IsFirmwareAvailable())
     {
@@ -409,8 +590,162 @@ void fs::FSUpdate::update_image(string &path_to_update_image, string &update_typ
     }
 }
 
+void fs::FSUpdate::update_image(istream &update_image, uint8_t &installed_update_type)
+{
+    trace::Span span("fsupdate", "update_image");
+    updater::ResourceScope resource_scope(this->resource_policy, this->logger);
+    updater::MetricsScope metrics_scope("update_image", this->update_metrics, *this->uboot_handler);
+    UpdateStore update_store(this->logger);
+    filesystem::path target_archiv_dir(TARGET_ARCHIV_DIR_PATH);
+    this->apply_manifest_policy(update_store);
+
+    this->create_archive_dir(target_archiv_dir);
+    /* extract while reading, the update image is not stored */
+    update_store.ExtractUpdateStore(update_image);
+    this->check_update_store(update_store);
+    this->install_update_store(update_store, "<stream>", true, installed_update_type);
+}
+
+void fs::FSUpdate::update_image(int fd, uint8_t &installed_update_type)
+{
+    trace::Span span("fsupdate", "update_image");
+    updater::ResourceScope resource_scope(this->resource_policy, this->logger);
+    updater::MetricsScope metrics_scope("update_image", this->update_metrics, *this->uboot_handler);
+    UpdateStore update_store(this->logger);
+    filesystem::path target_archiv_dir(TARGET_ARCHIV_DIR_PATH);
+    this->apply_manifest_policy(update_store);
+
+    this->create_archive_dir(target_archiv_dir);
+    update_store.ExtractUpdateStore(fd);
+    this->check_update_store(update_store);
+    this->install_update_store(update_store, "<fd " + to_string(fd) + ">", true, installed_update_type);
+}
+
+void fs::FSUpdate::update_image_components(const string &path_to_update_image, const vector<string> &components,
+                                           uint8_t &installed_update_type)
+{
+    trace::Span span("fsupdate", "update_image_components");
+    updater::ResourceScope resource_scope(this->resource_policy, this->logger);
+    updater::MetricsScope metrics_scope("update_image_components", this->update_metrics, *this->uboot_handler);
+    UpdateStore update_store(this->logger);
+    filesystem::path target_archiv_dir(TARGET_ARCHIV_DIR_PATH);
+    this->apply_manifest_policy(update_store);
+
+    this->create_archive_dir(target_archiv_dir);
+    update_store.ExtractUpdateStore(path_to_update_image, components);
+    this->check_update_store(update_store);
+    this->install_update_store(update_store, path_to_update_image, true, installed_update_type);
+}
+
+void fs::FSUpdate::update_image_from_url(const string &url, uint8_t &installed_update_type)
+{
+    trace::Span span("fsupdate", "update_image_from_url");
+    /* includes the download */
+    updater::MetricsScope metrics_scope("update_image_from_url", this->update_metrics, *this->uboot_handler);
+    updater::HttpSource source(url, this->logger);
+    istream update_image(&source);
+    try
+    {
+        this->update_image(update_image, installed_update_type);
+    }
+    catch (...)
+    {
+        /* extraction only sees the end of the stream, report the cause */
+        source.check();
+        throw;
+    }
+}
+
+string fs::FSUpdate::fd_source_path(int fd, const string &spool_name, bool &spooled)
+{
+    spooled = false;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        throw GenericException("fstat of file descriptor " + to_string(fd) + " fails", errno);
+    }
+    /* files are opened again by path, also by rauc */
+    if (S_ISREG(st.st_mode))
+    {
+        return "/proc/" + to_string(getpid()) + "/fd/" + to_string(fd);
+    }
+
+    /* RAUC bundles and application images need random access */
+    this->create_work_dir();
+    const filesystem::path spool_path(this->work_dir / spool_name);
+    int out = open(spool_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (out < 0)
+    {
+        throw GenericException("Can not create " + spool_path.string(), errno);
+    }
+    std::unique_ptr<int, void (*)(int *)> out_guard(&out, [](int *f) { close(*f); });
+    updater::WriteEngine writer(out, spool_path.string());
+    vector<char> buffer(STREAM_BUFFER_SIZE);
+    while (true)
+    {
+        ssize_t bytes = read(fd, buffer.data(), buffer.size());
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes < 0)
+        {
+            const int error = errno;
+            filesystem::remove(spool_path);
+            throw GenericException("Read of file descriptor " + to_string(fd) + " fails", error);
+        }
+        if (bytes == 0)
+            break;
+        writer.write(buffer.data(), static_cast<size_t>(bytes));
+    }
+    writer.finish();
+    spooled = true;
+    return spool_path.string();
+}
+
+void fs::FSUpdate::update_firmware(int fd)
+{
+    trace::Span span("fsupdate", "update_firmware");
+    /* includes spooling of pipes */
+    updater::MetricsScope metrics_scope("update_firmware", this->update_metrics, *this->uboot_handler);
+    bool spooled = false;
+    const string path = this->fd_source_path(fd, "stream.fw", spooled);
+    try
+    {
+        this->update_firmware(path);
+    }
+    catch (...)
+    {
+        if (spooled)
+            filesystem::remove(path);
+        throw;
+    }
+    if (spooled)
+        filesystem::remove(path);
+}
+
+void fs::FSUpdate::update_application(int fd)
+{
+    trace::Span span("fsupdate", "update_application");
+    /* includes spooling of pipes */
+    updater::MetricsScope metrics_scope("update_application", this->update_metrics, *this->uboot_handler);
+    bool spooled = false;
+    const string path = this->fd_source_path(fd, "stream.app", spooled);
+    try
+    {
+        this->update_application(path);
+    }
+    catch (...)
+    {
+        if (spooled)
+            filesystem::remove(path);
+        throw;
+    }
+    if (spooled)
+        filesystem::remove(path);
+}
+
 bool fs::FSUpdate::commit_update()
 {
+    trace::Span span("fsupdate", "commit_update");
     UBoot::UBoot::EnvTransaction txn(*this->uboot_handler);
     this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FSUPDATE_DOMAIN, "commit_update: commit update", logger::logLevel::DEBUG));
     bool retValue = false;
@@ -492,18 +827,17 @@ update_definitions::UBootBootstateFlags fs::FSUpdate::get_update_reboot_state()
 
 version_t fs::FSUpdate::get_application_version()
 {
-    updater::applicationUpdate update_app(this->uboot_handler, this->logger);
-    return update_app.getCurrentVersion();
+    return this->application_updater().getCurrentVersion();
 }
 
 version_t fs::FSUpdate::get_firmware_version()
 {
-    updater::firmwareUpdate update_fw(this->uboot_handler, this->logger);
-    return update_fw.getCurrentVersion();
+    return this->firmware_updater().getCurrentVersion();
 }
 
 void fs::FSUpdate::rollback_firmware()
 {
+    trace::Span span("fsupdate", "rollback_firmware");
     UBoot::UBoot::EnvTransaction txn(*this->uboot_handler);
     try
     {
@@ -521,8 +855,7 @@ void fs::FSUpdate::rollback_firmware()
             if (app_fw_update_pending == true)
             {
                 /* rollback fw and application progress  */
-                updater::applicationUpdate app_update(this->uboot_handler, this->logger);
-                app_update.rollback();
+                this->application_updater().rollback();
                 this->uboot_handler->addVariable(
                     "update_reboot_state",
                     update_definitions::to_string(
@@ -646,10 +979,11 @@ void fs::FSUpdate::rollback_firmware()
 
 void fs::FSUpdate::rollback_application()
 {
+    trace::Span span("fsupdate", "rollback_application");
     UBoot::UBoot::EnvTransaction txn(*this->uboot_handler);
     try
     {
-        updater::applicationUpdate app_update(this->uboot_handler, this->logger);
+        updater::applicationUpdate &app_update = this->application_updater();
         bool app_pendig = this->update_handler.pendingApplicationUpdate();
         if (app_pendig == true || this->update_handler.pendingApplicationFirmwareUpdate())
         {
@@ -10,10 +10,15 @@
 #include "handleUpdate.h"
 #include "fs_exceptions.h"
 #include "fs_consts.h"
+#include "resourcePolicy.h"
+#include "manifestPolicy.h"
+#include "updateMetrics.h"
 #include <exception>
 #include <string>
 #include <memory>
 #include <functional>
+#include <istream>
+#include <vector>
 
 #include <json/json.h> /* json update configuration*/
 
@@ -22,6 +27,12 @@
 #define TEMP_ADU_WORK_DIR "/tmp/adu/.work"
 #endif
 
+namespace updater
+{
+class applicationUpdate;
+class firmwareUpdate;
+}
+
 /**
  * Extern interface for usage of F&S Update Framework.
  *
@@ -30,6 +41,8 @@
  */
 namespace fs
 {
+class UpdateStore;
+
 ///////////////////////////////////////////////////////////////////////////
 /// FSUpdate declaration
 //////////////////////////////////////////////////////////////////////////
@@ -45,12 +58,31 @@ class FSUpdate
     std::filesystem::perms work_dir_perms;
     /* path to tmp app update */
     std::filesystem::path tmp_app_path;
+    /* update handlers, created on first use and reused afterwards */
+    std::unique_ptr<updater::applicationUpdate> app_updater;
+    std::unique_ptr<updater::firmwareUpdate> fw_updater;
+    /* applied to every update operation */
+    updater::ResourcePolicy resource_policy;
+    /* applied to fsupdate.json of every update image */
+    updater::ManifestPolicy manifest_policy;
+    /* phases of the last update operation */
+    updater::UpdateMetrics update_metrics;
 
-    void decorator_update_state(std::function<void()>);
+    void decorator_update_state(const std::string &, std::function<void()>);
+    updater::applicationUpdate &application_updater();
+    updater::firmwareUpdate &firmware_updater();
+    void create_archive_dir(const std::filesystem::path &);
+    bool use_prepared_image(const std::string &, UpdateStore &);
+    void apply_manifest_policy(UpdateStore &);
+    void check_update_store(UpdateStore &);
+    void install_update_store(UpdateStore &, const std::string &, bool, uint8_t &);
+    std::string fd_source_path(int, const std::string &, bool &);
 
   public:
     /**
      * Init F&S update instance. Set logger handler object as refrence.
+     * The U-Boot environment, RAUC configuration and keyring are not touched
+     * until an operation needs them.
      */
     explicit FSUpdate(const std::shared_ptr<logger::LoggerHandler> &);
     ~FSUpdate();
@@ -70,12 +102,40 @@ class FSUpdate
      */
     bool create_work_dir();
     std::filesystem::path get_work_dir();
+    /**
+     * Set resource usage of the following update operations, e.g.
+     * updater::ResourcePolicy::least_intrusive() next to a busy application.
+     * @param policy I/O rate, priorities and cgroup of update operations.
+     */
+    void set_resource_policy(const updater::ResourcePolicy &policy);
+    /**
+     * Set checks of fsupdate.json. Bundles carrying the manifest before the
+     * update images are rejected before any image is extracted.
+     * @param policy Accepted handlers, version rule and reserved space.
+     */
+    void set_manifest_policy(const updater::ManifestPolicy &policy);
+    /**
+     * Return duration, bytes and throughput per phase of the last update,
+     * install, prepare or verify operation, also if it failed. Export with
+     * updater::UpdateMetrics::write() e.g. for the node_exporter textfile
+     * collector.
+     * @return Metrics of the last operation, empty operation name before the first one.
+     */
+    const updater::UpdateMetrics &get_update_metrics() const;
     /**
      * Initiate firmware update.
      * @param path_to_firmware Path to RAUC artifact image.
      * @throw UpdateInProgress
      */
     void update_firmware(const std::string &path_to_firmware);
+    /**
+     * Initiate firmware update from an open RAUC artifact. A regular file is
+     * used in place, a pipe is stored in the work directory first since RAUC
+     * needs random access.
+     * @param fd Readable file descriptor, owned by the caller.
+     * @throw UpdateInProgress
+     */
+    void update_firmware(int fd);
 
     /**
      * Initiate application update.
@@ -83,6 +143,14 @@ class FSUpdate
      * @throw UpdateInProgress
      */
     void update_application(const std::string &path_to_application);
+    /**
+     * Initiate application update from an open application image. A
+     * regular file is used in place, a pipe is stored in the work directory
+     * first since the image trailer is read before the payload.
+     * @param fd Readable file descriptor, owned by the caller.
+     * @throw UpdateInProgress
+     */
+    void update_application(int fd);
 
     /**
      * Initiate firmware and application update.
@@ -99,6 +167,62 @@ class FSUpdate
      * @throw UpdateInProgress
      */
     void update_image(std::string &path_to_update_image, std::string &update_type, uint8_t &installed_update_type);
+    /**
+     * Install update image while it is read from a stream, e.g. during
+     * download. Extraction overlaps the transfer and the update image itself
+     * is never stored. Update type is detected from fsupdate.json.
+     * @param update_image Stream positioned at the update header.
+     * @param installed_update_type Same as for the path based update_image().
+     * @throw Same as the path based update_image().
+     */
+    void update_image(std::istream &update_image, uint8_t &installed_update_type);
+    /**
+     * Install update image while it is read from a file descriptor or pipe.
+     * @param fd Readable file descriptor positioned at the update header, owned by the caller.
+     * @param installed_update_type Same as for the path based update_image().
+     * @throw Same as the path based update_image().
+     */
+    void update_image(int fd, uint8_t &installed_update_type);
+    /**
+     * Install selected update images of a bundle, e.g. only update.app of
+     * a combined bundle. Bundles with indexed container decompress only the
+     * selected images, tar.bz2 bundles are extracted completely.
+     * @param path_to_update_image Path to fs update image.
+     * @param components "update.fw" and/or "update.app".
+     * @param installed_update_type Same as for update_image().
+     * @throw Same as update_image().
+     */
+    void update_image_components(const std::string &path_to_update_image, const std::vector<std::string> &components,
+                                 uint8_t &installed_update_type);
+    /**
+     * Install update image while it is downloaded over HTTP(S). Interrupted
+     * transfers are resumed with range requests. Requires fs_http_source.
+     * @param url http:// or https:// URL of the update image.
+     * @param installed_update_type Same as for the path based update_image().
+     * @throw updater::HttpSourceError Download fails or not supported by this build.
+     * @throw Same as the path based update_image().
+     */
+    void update_image_from_url(const std::string &url, uint8_t &installed_update_type);
+
+    /**
+     * Verify application image ahead of installation.
+     * Runs certificate chain and signature verification and stores a
+     * verification record. A later update_application() of the unchanged
+     * file skips verification.
+     * @param path_to_application Path to application bundle.
+     * @throw std::runtime_error Verification failed.
+     */
+    void verify_application(const std::string &path_to_application);
+
+    /**
+     * Prepare fs update image ahead of installation.
+     * Extracts the image, checks the checksums of fsupdate.json and verifies
+     * a contained application. A later update_image() of the unchanged file
+     * starts with the installation.
+     * @param path_to_update_image Path to fs update image.
+     * @throw GenericException Extraction or checksum check failed.
+     */
+    void prepare_image(const std::string &path_to_update_image);
 
     /**
      * Commit running updates.
@@ -2,6 +2,7 @@
 
 #include "../uboot_interface/allowed_uboot_variable_states.h"
 #include "utils.h"
+#include "../trace/trace.h"
 #include <algorithm>
 #include <fstream>
 
@@ -50,6 +51,7 @@ const std::vector<update_definitions::Flags> updater::Bootstate::get_complete_up
 
 bool updater::Bootstate::pendingApplicationUpdate()
 {
+    trace::Span span("bootstate", "pendingApplicationUpdate");
     bool retValue = false;
     std::vector<update_definitions::Flags> update_state = this->get_complete_update(false);
 
@@ -74,6 +76,7 @@ bool updater::Bootstate::pendingApplicationUpdate()
 
 bool updater::Bootstate::pendingFirmwareUpdate()
 {
+    trace::Span span("bootstate", "pendingFirmwareUpdate");
     bool retValue = false;
     std::vector<update_definitions::Flags> update_state = this->get_complete_update(false);
 
@@ -119,6 +122,7 @@ bool updater::Bootstate::pendingFirmwareUpdate()
 
 bool updater::Bootstate::pendingApplicationFirmwareUpdate()
 {
+    trace::Span span("bootstate", "pendingApplicationFirmwareUpdate");
     bool retValue = false;
     std::vector<update_definitions::Flags> update_state = this->get_complete_update(false);
 
@@ -167,6 +171,7 @@ bool updater::Bootstate::pendingApplicationFirmwareUpdate()
 
 bool updater::Bootstate::failedFirmwareUpdate()
 {
+    trace::Span span("bootstate", "failedFirmwareUpdate");
     bool retValue = false;
     std::vector<update_definitions::Flags> update_state = this->get_complete_update(true);
 
@@ -190,6 +195,7 @@ bool updater::Bootstate::failedFirmwareUpdate()
 
 bool updater::Bootstate::failedRebootFirmwareUpdate()
 {
+    trace::Span span("bootstate", "failedRebootFirmwareUpdate");
     bool retValue = false;
     std::vector<update_definitions::Flags> update_state = this->get_complete_update(false);
 
@@ -214,6 +220,7 @@ bool updater::Bootstate::failedRebootFirmwareUpdate()
 
 bool updater::Bootstate::failedApplicationUpdate()
 {
+    trace::Span span("bootstate", "failedApplicationUpdate");
     bool retValue = false;
     std::vector<update_definitions::Flags> update_state = this->get_complete_update(true);
 
@@ -238,6 +245,7 @@ bool updater::Bootstate::failedApplicationUpdate()
 
 bool updater::Bootstate::pendingFirmwareRollback()
 {
+    trace::Span span("bootstate", "pendingFirmwareRollback");
 
     const std::string boot_order_old = this->uboot_handler->getVariable("BOOT_ORDER_OLD", allowed_boot_order_variables);
     const std::string boot_order = this->uboot_handler->getVariable("BOOT_ORDER", allowed_boot_order_variables);
@@ -283,6 +291,7 @@ bool updater::Bootstate::pendingFirmwareRollback()
 
 bool updater::Bootstate::pendingUpdateRollback(update_definitions::UBootBootstateFlags &update_reboot_state)
 {
+    trace::Span span("bootstate", "pendingUpdateRollback");
     /* Check for incomplete state */
     if (update_reboot_state == update_definitions::UBootBootstateFlags::INCOMPLETE_APP_FW_ROLLBACK)
     {
@@ -800,6 +809,7 @@ void updater::Bootstate::confirmUpdateRollback()
 
 bool updater::Bootstate::noUpdateProcessing()
 {
+    trace::Span span("bootstate", "noUpdateProcessing");
     bool retValue = false;
     const update_definitions::UBootBootstateFlags update_reboot_state = update_definitions::to_UBootBootstateFlags(
         this->uboot_handler->getVariable("update_reboot_state", allowed_update_reboot_state_variables));
@@ -0,0 +1,183 @@
+#include "hashEngine.h"
+#include "afAlgHashEngine.h"
+#include "resourcePolicy.h"
+
+#include <fus_updater_lib/config.h>
+#include <botan/hash.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+
+extern "C" {
+    #include <errno.h>
+    #include <unistd.h>
+#if defined(__aarch64__) || defined(__arm__)
+    #include <sys/auxv.h>
+#elif defined(__x86_64__) || defined(__i386__)
+    #include <cpuid.h>
+#endif
+}
+
+namespace updater {
+
+namespace {
+    constexpr size_t READ_BUFFER_SIZE = 256 * 1024;
+
+    /* Botan reports the dispatched implementation through provider() */
+    bool is_accelerated_provider(const std::string& provider) {
+        return provider == "armv8" || provider == "shani" || provider == "openssl";
+    }
+
+    class BotanHashEngine : public HashEngine {
+    private:
+        std::unique_ptr<Botan::HashFunction> hash_;
+
+    public:
+        explicit BotanHashEngine(std::unique_ptr<Botan::HashFunction> hash)
+            : hash_(std::move(hash)) {}
+
+        std::string name() const override { return "botan/" + hash_->provider(); }
+        bool accelerated() const override { return is_accelerated_provider(hash_->provider()); }
+        size_t output_length() const override { return hash_->output_length(); }
+        void update(const uint8_t* data, size_t length) override { hash_->update(data, length); }
+        void final(uint8_t* out) override { hash_->final(out); }
+        using HashEngine::final;
+    };
+
+    std::unique_ptr<HashEngine> create_botan_engine(const std::string& algorithm) {
+        std::unique_ptr<Botan::HashFunction> fallback;
+
+        for (const std::string& provider : Botan::HashFunction::providers(algorithm)) {
+            std::unique_ptr<Botan::HashFunction> hash = Botan::HashFunction::create(algorithm, provider);
+            if (!hash) {
+                continue;
+            }
+            /* openssl is only faster if the CPU has SHA-2 instructions */
+            if (is_accelerated_provider(hash->provider()) &&
+                (hash->provider() != "openssl" || HashEngine::cpu_has_sha2())) {
+                return std::make_unique<BotanHashEngine>(std::move(hash));
+            }
+            if (!fallback || provider == "base") {
+                fallback = std::move(hash);
+            }
+        }
+
+        if (!fallback) {
+            fallback = Botan::HashFunction::create(algorithm);
+        }
+        if (!fallback) {
+            throw std::runtime_error("Hash algorithm " + algorithm + " not available");
+        }
+        return std::make_unique<BotanHashEngine>(std::move(fallback));
+    }
+
+#if FUS_LIB_HASH_AF_ALG
+    /* kernel hash is used if it has an accelerated driver and Botan does not */
+    bool prefer_kernel_hash(const std::string& algorithm) {
+        static std::mutex decision_lock;
+        static std::map<std::string, bool> decisions;
+
+        std::lock_guard<std::mutex> lock(decision_lock);
+        auto it = decisions.find(algorithm);
+        if (it == decisions.end()) {
+            const bool prefer = !AfAlgHashEngine::is_generic_driver(AfAlgHashEngine::kernel_driver(algorithm));
+            it = decisions.emplace(algorithm, prefer).first;
+        }
+        return it->second;
+    }
+#endif
+
+    void report_engine(const std::string& algorithm, const HashEngine& engine,
+                       const std::shared_ptr<logger::LoggerHandler>& logger) {
+        static std::mutex report_lock;
+        static std::set<std::string> reported;
+
+        if (!logger) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(report_lock);
+            if (!reported.insert(algorithm).second) {
+                return;
+            }
+        }
+
+        logger->setLogEntry(std::make_shared<logger::LogEntry>(
+            HASH_ENGINE, algorithm + ": using " + engine.name(), logger::logLevel::DEBUG));
+
+        if (!engine.accelerated() && HashEngine::cpu_has_sha2() && algorithm.compare(0, 5, "SHA-2") == 0) {
+            logger->setLogEntry(std::make_shared<logger::LogEntry>(
+                HASH_ENGINE, algorithm + ": CPU supports SHA-2 instructions, but " + engine.name() +
+                " does not use them", logger::logLevel::WARNING));
+        }
+    }
+}
+
+std::vector<uint8_t> HashEngine::final() {
+    std::vector<uint8_t> digest(output_length());
+    final(digest.data());
+    return digest;
+}
+
+void HashEngine::update_from_fd(int fd, uint64_t offset, uint64_t length) {
+    std::vector<uint8_t> buffer(static_cast<size_t>(std::min<uint64_t>(READ_BUFFER_SIZE, length)));
+
+    while (length > 0) {
+        const size_t want = static_cast<size_t>(std::min<uint64_t>(buffer.size(), length));
+        ssize_t bytes = ::pread(fd, buffer.data(), want, static_cast<off_t>(offset));
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes < 0) {
+            throw std::runtime_error(std::string("Hash read fails: ") + std::strerror(errno));
+        }
+        if (bytes == 0) {
+            throw std::runtime_error("Hash read fails: unexpected end of file");
+        }
+        update(buffer.data(), static_cast<size_t>(bytes));
+        IoThrottle::account(static_cast<uint64_t>(bytes));
+        offset += static_cast<uint64_t>(bytes);
+        length -= static_cast<uint64_t>(bytes);
+    }
+}
+
+std::unique_ptr<HashEngine> HashEngine::create(const std::string& algorithm,
+                                               const std::shared_ptr<logger::LoggerHandler>& logger) {
+    std::unique_ptr<HashEngine> engine = create_botan_engine(algorithm);
+#if FUS_LIB_HASH_AF_ALG
+    if (!engine->accelerated() && prefer_kernel_hash(algorithm)) {
+        std::unique_ptr<AfAlgHashEngine> kernel_engine = AfAlgHashEngine::open(algorithm);
+        if (kernel_engine) {
+            engine = std::move(kernel_engine);
+        }
+    }
+#endif
+    report_engine(algorithm, *engine, logger);
+    return engine;
+}
+
+bool HashEngine::cpu_has_sha2() {
+    static const bool has_sha2 = []() {
+#if defined(__aarch64__)
+        constexpr unsigned long HWCAP_SHA2_BIT = 1UL << 6;
+        return (getauxval(AT_HWCAP) & HWCAP_SHA2_BIT) != 0;
+#elif defined(__arm__)
+        constexpr unsigned long HWCAP2_SHA2_BIT = 1UL << 3;
+        return (getauxval(AT_HWCAP2) & HWCAP2_SHA2_BIT) != 0;
+#elif defined(__x86_64__) || defined(__i386__)
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+            return false;
+        }
+        return (ebx & (1U << 29)) != 0;
+#else
+        return false;
+#endif
+    }();
+    return has_sha2;
+}
+
+} // namespace updater
@@ -0,0 +1,77 @@
+/**
+ * Hash engine selection.
+ *
+ * All digests over update images are computed through a HashEngine. The
+ * factory checks at runtime which SHA-2 implementation is available (CPU
+ * crypto extensions through Botan, OpenSSL provider, kernel crypto API
+ * with an accelerated driver, portable code) and
+ * reports the chosen engine once per algorithm, so it is visible on the
+ * target whether the fast path is used.
+ */
+
+#pragma once
+
+#include "../logger/LoggerHandler.h"
+#include "../logger/LoggerEntry.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+constexpr char HASH_ENGINE[] = "hash engine";
+
+namespace updater {
+
+    class HashEngine {
+    public:
+        virtual ~HashEngine() = default;
+
+        /**
+         * Name of engine, e.g. "botan/armv8".
+         */
+        virtual std::string name() const = 0;
+
+        /**
+         * Engine uses hardware acceleration.
+         */
+        virtual bool accelerated() const = 0;
+
+        virtual size_t output_length() const = 0;
+
+        virtual void update(const uint8_t* data, size_t length) = 0;
+
+        /**
+         * Write digest and reset engine for the next message.
+         * @param out Buffer of output_length() bytes.
+         */
+        virtual void final(uint8_t* out) = 0;
+
+        std::vector<uint8_t> final();
+
+        /**
+         * Hash a range of a file.
+         * @param fd Open file descriptor.
+         * @param offset Start of range.
+         * @param length Length of range.
+         * @throw std::runtime_error Read error or file shorter than range.
+         */
+        virtual void update_from_fd(int fd, uint64_t offset, uint64_t length);
+
+        /**
+         * Select engine for algorithm.
+         * @param algorithm Botan hash name, e.g. "SHA-256".
+         * @param logger Logger for engine report, may be null.
+         * @return Engine.
+         * @throw std::runtime_error Algorithm is not available.
+         */
+        static std::unique_ptr<HashEngine> create(const std::string& algorithm,
+                                                  const std::shared_ptr<logger::LoggerHandler>& logger = nullptr);
+
+        /**
+         * CPU provides SHA-2 instructions (ARMv8 crypto extensions, x86 SHA-NI).
+         */
+        static bool cpu_has_sha2();
+    };
+
+} // namespace updater
@@ -0,0 +1,434 @@
+#include "httpSource.h"
+#include "writeEngine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+extern "C" {
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <strings.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+}
+
+#if FUS_LIB_HTTP_SOURCE
+#include <curl/curl.h>
+#endif
+
+namespace updater {
+
+namespace {
+    constexpr size_t CHUNK_SIZE = 64 * 1024;
+    constexpr unsigned MAX_BACKOFF_S = 30;
+
+    std::string trim(const std::string& value) {
+        const size_t begin = value.find_first_not_of(" \t\r\n");
+        if (begin == std::string::npos) {
+            return std::string();
+        }
+        const size_t end = value.find_last_not_of(" \t\r\n");
+        return value.substr(begin, end - begin + 1);
+    }
+
+    /* value of header line if name matches, case insensitive */
+    bool header_value(const std::string& line, const char* name, std::string& value) {
+        const size_t length = std::strlen(name);
+        if (line.size() <= length || line[length] != ':' || strncasecmp(line.c_str(), name, length) != 0) {
+            return false;
+        }
+        value = trim(line.substr(length + 1));
+        return true;
+    }
+
+#if FUS_LIB_HTTP_SOURCE
+    int on_progress(void* stop, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+        return static_cast<std::atomic<bool>*>(stop)->load() ? 1 : 0;
+    }
+#endif
+}
+
+bool HttpSource::supported() {
+    return FUS_LIB_HTTP_SOURCE != 0;
+}
+
+HttpSource::HttpSource(std::string url, std::shared_ptr<logger::LoggerHandler> logger, HttpSourceOptions options,
+                       uint64_t offset, std::string validator)
+    : url_(std::move(url)), logger_(std::move(logger)), options_(std::move(options)),
+      ring_(std::max<size_t>(options_.read_ahead, CHUNK_SIZE)), delivered_(offset), received_(offset),
+      validator_(std::move(validator)), chunk_(CHUNK_SIZE) {
+    if (!supported()) {
+        throw HttpSourceError(url_, "not supported by this build");
+    }
+#if FUS_LIB_HTTP_SOURCE
+    static std::once_flag curl_initialized;
+    std::call_once(curl_initialized, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+#endif
+    setg(chunk_.data(), chunk_.data(), chunk_.data());
+    worker_ = std::thread(&HttpSource::run, this);
+}
+
+HttpSource::~HttpSource() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    space_ready_.notify_all();
+    data_ready_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+std::string HttpSource::validator() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return validator_;
+}
+
+void HttpSource::check() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (changed_) {
+        throw HttpSourceChanged(url_);
+    }
+    if (!error_.empty()) {
+        throw HttpSourceError(url_, error_);
+    }
+}
+
+HttpSource::int_type HttpSource::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+
+    size_t length = 0;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        data_ready_.wait(lock, [this]() { return ring_size_ > 0 || finished_ || stop_; });
+        if (ring_size_ == 0) {
+            if (changed_) {
+                throw HttpSourceChanged(url_);
+            }
+            if (!error_.empty()) {
+                throw HttpSourceError(url_, error_);
+            }
+            return traits_type::eof();
+        }
+
+        length = std::min(chunk_.size(), ring_size_);
+        const size_t first = std::min(length, ring_.size() - ring_head_);
+        std::memcpy(chunk_.data(), ring_.data() + ring_head_, first);
+        std::memcpy(chunk_.data() + first, ring_.data(), length - first);
+        ring_head_ = (ring_head_ + length) % ring_.size();
+        ring_size_ -= length;
+        delivered_ += length;
+    }
+    space_ready_.notify_one();
+
+    setg(chunk_.data(), chunk_.data(), chunk_.data() + length);
+    return traits_type::to_int_type(*gptr());
+}
+
+bool HttpSource::push(const char* data, size_t length) {
+    while (length > 0) {
+        size_t copied = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            space_ready_.wait(lock, [this]() { return ring_size_ < ring_.size() || stop_; });
+            if (stop_) {
+                return false;
+            }
+            const size_t tail = (ring_head_ + ring_size_) % ring_.size();
+            copied = std::min({length, ring_.size() - ring_size_, ring_.size() - tail});
+            std::memcpy(ring_.data() + tail, data, copied);
+            ring_size_ += copied;
+        }
+        data_ready_.notify_one();
+        data += copied;
+        length -= copied;
+        received_ += copied;
+    }
+    return true;
+}
+
+size_t HttpSource::on_header(char* data, size_t size, size_t count, void* self) {
+    HttpSource* source = static_cast<HttpSource*>(self);
+    const std::string line(data, size * count);
+    std::string value;
+
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        /* headers of a new response, e.g. after a redirect */
+        const size_t space = line.find(' ');
+        source->status_ = (space != std::string::npos) ? std::strtol(line.c_str() + space + 1, nullptr, 10) : 0;
+        source->response_etag_.clear();
+        source->response_modified_.clear();
+    } else if (header_value(line, "ETag", value)) {
+        /* weak validators are not allowed in If-Range */
+        if (value.compare(0, 2, "W/") != 0) {
+            source->response_etag_ = value;
+        }
+    } else if (header_value(line, "Last-Modified", value)) {
+        source->response_modified_ = value;
+    } else if (header_value(line, "Content-Range", value)) {
+        /* bytes first-last/total */
+        const size_t slash = value.find('/');
+        if (slash != std::string::npos && value.compare(slash + 1, 1, "*") != 0) {
+            source->total_ = std::strtoull(value.c_str() + slash + 1, nullptr, 10);
+        }
+    } else if (header_value(line, "Content-Length", value) && source->status_ == 200) {
+        source->total_ = std::strtoull(value.c_str(), nullptr, 10);
+    }
+    return size * count;
+}
+
+size_t HttpSource::on_body(char* data, size_t size, size_t count, void* self) {
+    HttpSource* source = static_cast<HttpSource*>(self);
+    size_t length = size * count;
+
+    if (!source->response_checked_) {
+        source->response_checked_ = true;
+        const std::string validator = !source->response_etag_.empty() ? source->response_etag_
+                                                                      : source->response_modified_;
+        std::lock_guard<std::mutex> lock(source->mutex_);
+        if (source->status_ != 200 && source->status_ != 206) {
+            source->error_ = "unexpected HTTP status " + std::to_string(source->status_);
+            source->permanent_ = true;
+            return 0;
+        }
+        if (!source->validator_.empty() && source->range_start_ > 0 && validator != source->validator_) {
+            /* If-Range did not match, this is a different resource */
+            source->changed_ = true;
+            return 0;
+        }
+        if (source->status_ == 200 && source->range_start_ > 0) {
+            /* server ignores ranges, drop what was received before */
+            source->skip_ = source->range_start_;
+        }
+        if (source->validator_.empty()) {
+            source->validator_ = validator;
+        }
+    }
+
+    if (source->skip_ > 0) {
+        const size_t skipped = static_cast<size_t>(std::min<uint64_t>(source->skip_, length));
+        source->skip_ -= skipped;
+        data += skipped;
+        length -= skipped;
+    }
+    if (!source->push(data, length)) {
+        return 0;
+    }
+    return size * count;
+}
+
+#if FUS_LIB_HTTP_SOURCE
+bool HttpSource::transfer(std::string& error) {
+    if (received_ > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (validator_.empty()) {
+            if (delivered_ > 0) {
+                /* a Range request could splice a changed resource into read data */
+                error = "no ETag or Last-Modified to resume after " + std::to_string(received_) + " bytes";
+                permanent_ = true;
+                return false;
+            }
+            /* nothing read yet, start over */
+            ring_head_ = 0;
+            ring_size_ = 0;
+            received_ = 0;
+        }
+    }
+    range_start_ = received_;
+    response_checked_ = false;
+    status_ = 0;
+    skip_ = 0;
+    if (total_ > 0 && received_ >= total_) {
+        return true;
+    }
+
+    std::unique_ptr<CURL, void (*)(CURL*)> curl(curl_easy_init(), curl_easy_cleanup);
+    if (!curl) {
+        error = "curl_easy_init fails";
+        return false;
+    }
+    std::unique_ptr<curl_slist, void (*)(curl_slist*)> headers(nullptr, curl_slist_free_all);
+    CURL* handle = curl.get();
+
+    curl_easy_setopt(handle, CURLOPT_URL, url_.c_str());
+#if LIBCURL_VERSION_NUM >= 0x075500
+    curl_easy_setopt(handle, CURLOPT_PROTOCOLS_STR, "http,https");
+    curl_easy_setopt(handle, CURLOPT_REDIR_PROTOCOLS_STR, "http,https");
+#else
+    curl_easy_setopt(handle, CURLOPT_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
+    curl_easy_setopt(handle, CURLOPT_REDIR_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
+#endif
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(handle, CURLOPT_MAXREDIRS, 5L);
+    curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, options_.connect_timeout_s);
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME, options_.stall_timeout_s);
+    if (!options_.ca_file.empty()) {
+        curl_easy_setopt(handle, CURLOPT_CAINFO, options_.ca_file.c_str());
+    }
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, &HttpSource::on_header);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, this);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, &HttpSource::on_body);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, this);
+    curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, &on_progress);
+    curl_easy_setopt(handle, CURLOPT_XFERINFODATA, &stop_);
+    curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+
+    const std::string range = std::to_string(received_) + "-";
+    if (received_ > 0) {
+        /* only resumed with a validator, see above */
+        std::string known_validator;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            known_validator = validator_;
+        }
+        curl_easy_setopt(handle, CURLOPT_RANGE, range.c_str());
+        headers.reset(curl_slist_append(nullptr, ("If-Range: " + known_validator).c_str()));
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers.get());
+    }
+
+    const CURLcode result = curl_easy_perform(handle);
+    if (result == CURLE_OK) {
+        if (total_ == 0 || received_ >= total_) {
+            return true;
+        }
+        error = "connection closed after " + std::to_string(received_) + " of " + std::to_string(total_) + " bytes";
+        return false;
+    }
+
+    long status = 0;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+    error = curl_easy_strerror(result);
+    if (status >= 400) {
+        error += " (HTTP " + std::to_string(status) + ")";
+    }
+    /* server errors, timeouts and throttling may pass */
+    if (status >= 400 && status < 500 && status != 408 && status != 429) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        permanent_ = true;
+    }
+    return false;
+}
+#else
+bool HttpSource::transfer(std::string& error) {
+    error = "not supported by this build";
+    return false;
+}
+#endif
+
+void HttpSource::run() {
+    unsigned failures = 0;
+    while (!stop_) {
+        const uint64_t before = received_;
+        std::string error;
+        if (transfer(error)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finished_ = true;
+            break;
+        }
+        if (stop_) {
+            break;
+        }
+
+        bool give_up = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            give_up = changed_ || permanent_;
+        }
+        failures = (received_ > before) ? 1 : failures + 1;
+        if (give_up || failures > options_.max_retries) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (error_.empty()) {
+                error_ = error;
+            }
+            logger_->setLogEntry(std::make_shared<logger::LogEntry>(HTTP_SOURCE,
+                url_ + ": " + (changed_ ? std::string("resource changed during download") : error_),
+                logger::logLevel::ERROR));
+            finished_ = true;
+            break;
+        }
+
+        const unsigned backoff = std::min(MAX_BACKOFF_S, 1u << std::min(failures - 1, 5u));
+        logger_->setLogEntry(std::make_shared<logger::LogEntry>(HTTP_SOURCE,
+            url_ + ": " + error + ", resume at " + std::to_string(received_) + " in " + std::to_string(backoff) + " s",
+            logger::logLevel::WARNING));
+        std::unique_lock<std::mutex> lock(mutex_);
+        space_ready_.wait_for(lock, std::chrono::seconds(backoff), [this]() { return stop_.load(); });
+    }
+    data_ready_.notify_all();
+}
+
+void HttpSource::fetch(const std::string& url, const std::string& dest,
+                       const std::shared_ptr<logger::LoggerHandler>& logger, HttpSourceOptions options) {
+    const std::string meta_path = dest + ".http";
+    std::string validator;
+    {
+        std::ifstream meta(meta_path);
+        std::getline(meta, validator);
+    }
+    uint64_t offset = 0;
+    struct stat st;
+    if (!validator.empty() && ::stat(dest.c_str(), &st) == 0) {
+        offset = static_cast<uint64_t>(st.st_size);
+    } else {
+        validator.clear();
+    }
+
+    bool restarted = false;
+    while (true) {
+        int fd = ::open(dest.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw HttpSourceError(url, "cannot open " + dest + ": " + std::strerror(errno));
+        }
+        std::unique_ptr<int, void (*)(int*)> fd_guard(&fd, [](int* f) { ::close(*f); });
+        if (::ftruncate(fd, static_cast<off_t>(offset)) != 0) {
+            throw HttpSourceError(url, "cannot truncate " + dest + ": " + std::strerror(errno));
+        }
+        if (offset > 0) {
+            logger->setLogEntry(std::make_shared<logger::LogEntry>(HTTP_SOURCE,
+                "resume " + url + " at " + std::to_string(offset), logger::logLevel::DEBUG));
+        }
+
+        try {
+            HttpSource source(url, logger, options, offset, validator);
+            WriteEngine writer(fd, dest, offset);
+            std::vector<char> buffer(CHUNK_SIZE);
+            bool recorded = !validator.empty();
+            while (true) {
+                const std::streamsize length = source.sgetn(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                if (length <= 0) {
+                    break;
+                }
+                if (!recorded) {
+                    /* without validator a later run starts from the beginning */
+                    std::ofstream meta(meta_path, std::ios::trunc);
+                    meta << source.validator() << '\n';
+                    recorded = true;
+                }
+                writer.write(buffer.data(), static_cast<size_t>(length));
+            }
+            writer.finish();
+        } catch (const HttpSourceChanged&) {
+            if (restarted) {
+                throw;
+            }
+            /* partial file belongs to the former resource, start once more */
+            restarted = true;
+            offset = 0;
+            validator.clear();
+            ::unlink(meta_path.c_str());
+            continue;
+        }
+        ::unlink(meta_path.c_str());
+        return;
+    }
+}
+
+} // namespace updater
@@ -0,0 +1,172 @@
+/**
+ * HTTP(S) source of update images.
+ *
+ * A background thread downloads the resource with libcurl into a bounded
+ * read-ahead window, the reading side consumes it as std::streambuf. An
+ * interrupted transfer is continued with a Range request at the current
+ * offset. The ETag (or Last-Modified) of the first response is sent as
+ * If-Range, so a resource changed in between is never spliced together.
+ * Without validator the transfer starts over while the reader has not
+ * consumed any data yet, and fails otherwise.
+ * Requires a build with fs_http_source.
+ */
+
+#pragma once
+
+#include <fus_updater_lib/config.h>
+#include "../logger/LoggerHandler.h"
+#include "../logger/LoggerEntry.h"
+#include "./../BaseException.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr char HTTP_SOURCE[] = "http source";
+
+namespace updater {
+
+    namespace http {
+        /* bytes downloaded ahead of the reader */
+        constexpr size_t READ_AHEAD = 4 * 1024 * 1024;
+        /* failed attempts in a row without progress */
+        constexpr unsigned MAX_RETRIES = 5;
+    }
+
+    class HttpSourceError : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Download fails or is not supported by this build.
+         * @param url Requested resource.
+         * @param msg Reason.
+         */
+        HttpSourceError(const std::string& url, const std::string& msg) {
+            this->error_msg = std::string("Download of ") + url + " fails: " + msg;
+        }
+    };
+
+    class HttpSourceChanged : public HttpSourceError {
+    public:
+        /**
+         * Resource changed while a transfer was resumed.
+         * @param url Requested resource.
+         */
+        explicit HttpSourceChanged(const std::string& url)
+            : HttpSourceError(url, "resource changed during download") {}
+    };
+
+    struct HttpSourceOptions {
+        size_t read_ahead = http::READ_AHEAD;
+        unsigned max_retries = http::MAX_RETRIES;
+        long connect_timeout_s = 30;
+        /* abort attempt below 1 byte/s for this long, then resume */
+        long stall_timeout_s = 60;
+        /* CA bundle for https, empty uses the libcurl default */
+        std::string ca_file;
+    };
+
+    class HttpSource : public std::streambuf {
+    private:
+        std::string url_;
+        std::shared_ptr<logger::LoggerHandler> logger_;
+        HttpSourceOptions options_;
+
+        /* read-ahead window filled by the download thread */
+        std::mutex mutex_;
+        std::condition_variable data_ready_;
+        std::condition_variable space_ready_;
+        std::vector<char> ring_;
+        size_t ring_head_ = 0;
+        size_t ring_size_ = 0;
+        bool finished_ = false;
+        std::atomic<bool> stop_{false};
+        std::string error_;
+        bool changed_ = false;
+        /* retrying does not help, e.g. 404 */
+        bool permanent_ = false;
+        /* bytes the reader holds, including the initial offset */
+        uint64_t delivered_;
+
+        /* owned by the download thread */
+        uint64_t received_;
+        uint64_t total_ = 0;
+        std::string validator_;
+        long status_ = 0;
+        uint64_t skip_ = 0;
+        bool response_checked_ = false;
+        std::string response_etag_;
+        std::string response_modified_;
+        uint64_t range_start_ = 0;
+
+        /* get area */
+        std::vector<char> chunk_;
+
+        std::thread worker_;
+
+        void run();
+        bool transfer(std::string& error);
+        bool push(const char* data, size_t length);
+
+        static size_t on_header(char* data, size_t size, size_t count, void* self);
+        static size_t on_body(char* data, size_t size, size_t count, void* self);
+
+    protected:
+        int_type underflow() override;
+
+    public:
+        /**
+         * Start downloading.
+         * @param url http:// or https:// URL of the resource.
+         * @param logger Logger object reference.
+         * @param options Read-ahead, retries and timeouts.
+         * @param offset First byte to fetch, e.g. size of a partial file.
+         * @param validator ETag or Last-Modified the partial data belongs to.
+         * @throw HttpSourceError Not supported by this build.
+         */
+        HttpSource(std::string url, std::shared_ptr<logger::LoggerHandler> logger,
+                   HttpSourceOptions options = HttpSourceOptions(),
+                   uint64_t offset = 0, std::string validator = std::string());
+        ~HttpSource() override;
+
+        HttpSource(const HttpSource&) = delete;
+        HttpSource& operator=(const HttpSource&) = delete;
+
+        /**
+         * @return Built with libcurl: true, else false.
+         */
+        static bool supported();
+
+        /**
+         * Validator of the resource, known after the first byte was read.
+         */
+        std::string validator();
+
+        /**
+         * Report a failed download. The stream only signals end or error to
+         * its reader, e.g. libarchive, this tells the reason.
+         * @throw HttpSourceError Download failed.
+         * @throw HttpSourceChanged Resource changed while resuming.
+         */
+        void check();
+
+        /**
+         * Download resource to file. A partial file left by an interrupted
+         * fetch of the same, unchanged resource is continued.
+         * @param url http:// or https:// URL of the resource.
+         * @param dest Destination file, dest + ".http" holds the validator.
+         * @param logger Logger object reference.
+         * @param options Read-ahead, retries and timeouts.
+         * @throw HttpSourceError
+         */
+        static void fetch(const std::string& url, const std::string& dest,
+                          const std::shared_ptr<logger::LoggerHandler>& logger,
+                          HttpSourceOptions options = HttpSourceOptions());
+    };
+
+} // namespace updater
@@ -0,0 +1,49 @@
+#include "imageMetadata.h"
+
+namespace updater {
+
+ImageMetadata ImageMetadata::parse(const std::vector<uint8_t>& data) {
+    constexpr size_t RECORD_HEADER_SIZE = 2 + 4;
+
+    ImageMetadata metadata;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        if (data.size() - pos < RECORD_HEADER_SIZE) {
+            throw ImageMetadataInvalid("truncated record header at offset " + std::to_string(pos));
+        }
+
+        const uint16_t type = static_cast<uint16_t>((data[pos] << 8) | data[pos + 1]);
+        uint32_t length = 0;
+        for (size_t i = 2; i < RECORD_HEADER_SIZE; ++i) {
+            length = (length << 8) | data[pos + i];
+        }
+        pos += RECORD_HEADER_SIZE;
+
+        if (length > data.size() - pos) {
+            throw ImageMetadataInvalid("record " + std::to_string(type) + " exceeds section");
+        }
+
+        auto inserted = metadata.records_.emplace(
+            type, std::vector<uint8_t>(data.begin() + pos, data.begin() + pos + length));
+        if (!inserted.second) {
+            throw ImageMetadataInvalid("duplicate record " + std::to_string(type));
+        }
+        pos += length;
+    }
+
+    return metadata;
+}
+
+bool ImageMetadata::has(MetadataType type) const {
+    return records_.find(static_cast<uint16_t>(type)) != records_.end();
+}
+
+const std::vector<uint8_t>& ImageMetadata::get(MetadataType type) const {
+    auto it = records_.find(static_cast<uint16_t>(type));
+    if (it == records_.end()) {
+        throw ImageMetadataInvalid("record " + std::to_string(static_cast<uint16_t>(type)) + " not present");
+    }
+    return it->second;
+}
+
+} // namespace updater
@@ -0,0 +1,61 @@
+/**
+ * Signed metadata section of v2 application images.
+ *
+ * The section is a sequence of records: uint16 type, uint32 length (both
+ * big-endian) followed by the value. Unknown record types are skipped so
+ * newer producers stay compatible with older devices.
+ */
+
+#pragma once
+
+#include "./../BaseException.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace updater {
+
+    enum class MetadataType : uint16_t {
+        CHUNK_MANIFEST = 1,
+        /* payload is a patch against the active application image */
+        DELTA = 2,
+        /* content-defined chunks of the payload, reused from the active image */
+        CHUNK_INDEX = 3
+    };
+
+    class ImageMetadataInvalid : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Metadata section of application image is malformed.
+         * @param msg Reason of rejection.
+         */
+        explicit ImageMetadataInvalid(const std::string& msg) {
+            this->error_msg = std::string("Invalid application image metadata: ") + msg;
+        }
+    };
+
+    class ImageMetadata {
+    private:
+        std::map<uint16_t, std::vector<uint8_t>> records_;
+
+    public:
+        /**
+         * Parse metadata records.
+         * @param data Content of metadata section.
+         * @return Parsed records.
+         * @throw ImageMetadataInvalid Truncated or duplicate record.
+         */
+        static ImageMetadata parse(const std::vector<uint8_t>& data);
+
+        bool has(MetadataType type) const;
+
+        /**
+         * Value of record.
+         * @throw ImageMetadataInvalid Record is not present.
+         */
+        const std::vector<uint8_t>& get(MetadataType type) const;
+    };
+
+} // namespace updater
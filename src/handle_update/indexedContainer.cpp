@@ -0,0 +1,216 @@
+#include "indexedContainer.h"
+#include "LibArchiveHandle.h"
+#include "resourcePolicy.h"
+#include "writeEngine.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+
+extern "C" {
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+}
+
+namespace updater {
+
+namespace {
+    constexpr size_t READ_SIZE = 1024 * 1024;
+    constexpr uint32_t CRC32_POLYNOMIAL = 0xEDB88320;
+
+    uint32_t read_u32(const uint8_t* data) {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; ++i) value = (value << 8) | data[i];
+        return value;
+    }
+
+    uint64_t read_u64(const uint8_t* data) {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; ++i) value = (value << 8) | data[i];
+        return value;
+    }
+
+    uint32_t crc32(const uint8_t* data, size_t length) {
+        uint32_t crc = 0xFFFFFFFF;
+        for (size_t i = 0; i < length; ++i) {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLYNOMIAL : crc >> 1;
+            }
+        }
+        return crc ^ 0xFFFFFFFF;
+    }
+
+    bool read_full(int fd, uint8_t* buffer, size_t length, uint64_t offset) {
+        size_t filled = 0;
+        while (filled < length) {
+            ssize_t bytes = ::pread(fd, buffer + filled, length - filled, static_cast<off_t>(offset + filled));
+            if (bytes < 0 && errno == EINTR) continue;
+            if (bytes <= 0) {
+                if (bytes == 0) errno = EIO;
+                return false;
+            }
+            filled += static_cast<size_t>(bytes);
+        }
+        return true;
+    }
+}
+
+IndexedContainer::IndexedContainer(int fd, uint64_t base, uint64_t length, std::string path)
+    : fd_(fd), base_(base), path_(std::move(path)) {
+    uint8_t header[container::HEADER_SIZE];
+    if (length < container::HEADER_SIZE + 4 || !read_full(fd_, header, sizeof(header), base_)) {
+        throw ContainerInvalid(path_, "header truncated");
+    }
+    if (std::memcmp(header, container::MAGIC, container::MAGIC_SIZE) != 0) {
+        throw ContainerInvalid(path_, "wrong magic");
+    }
+    if (read_u32(header + 8) != container::VERSION) {
+        throw ContainerInvalid(path_, "unsupported version " + std::to_string(read_u32(header + 8)));
+    }
+    const uint32_t count = read_u32(header + 12);
+    if (count == 0 || count > container::MAX_MEMBERS) {
+        throw ContainerInvalid(path_, "invalid member count " + std::to_string(count));
+    }
+
+    const size_t table_size = container::HEADER_SIZE + count * container::ENTRY_SIZE;
+    if (length < table_size + 4) {
+        throw ContainerInvalid(path_, "member table truncated");
+    }
+    std::vector<uint8_t> table(table_size + 4);
+    if (!read_full(fd_, table.data(), table.size(), base_)) {
+        throw ContainerInvalid(path_, "member table truncated");
+    }
+    if (crc32(table.data(), table_size) != read_u32(table.data() + table_size)) {
+        throw ContainerInvalid(path_, "member table checksum mismatch");
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint8_t* entry = table.data() + container::HEADER_SIZE + i * container::ENTRY_SIZE;
+        Member member;
+        member.name.assign(reinterpret_cast<const char*>(entry),
+                           strnlen(reinterpret_cast<const char*>(entry), container::NAME_SIZE));
+        member.offset = read_u64(entry + 32);
+        member.length = read_u64(entry + 40);
+        member.size = read_u64(entry + 48);
+        member.compression = read_u32(entry + 56);
+
+        if (member.name.empty() || member.name.find('/') != std::string::npos || member.name == "." || member.name == "..") {
+            throw ContainerInvalid(path_, "invalid member name");
+        }
+        if (find(member.name)) {
+            throw ContainerInvalid(path_, "member " + member.name + " appears twice");
+        }
+        if (member.offset < table.size() || member.offset > length || member.length > length - member.offset) {
+            throw ContainerInvalid(path_, "member " + member.name + " outside of container");
+        }
+        if (member.compression != container::COMPRESSION_STORED && member.compression != container::COMPRESSION_BZIP2) {
+            throw ContainerInvalid(path_, "member " + member.name + " has unknown compression");
+        }
+        if (member.compression == container::COMPRESSION_STORED && member.length != member.size) {
+            throw ContainerInvalid(path_, "stored member " + member.name + " has wrong size");
+        }
+        members_.push_back(std::move(member));
+    }
+}
+
+bool IndexedContainer::detect(int fd, uint64_t base) {
+    uint8_t magic[container::MAGIC_SIZE];
+    return read_full(fd, magic, sizeof(magic), base) &&
+           std::memcmp(magic, container::MAGIC, container::MAGIC_SIZE) == 0;
+}
+
+const IndexedContainer::Member* IndexedContainer::find(const std::string& name) const {
+    for (const Member& member : members_) {
+        if (member.name == name) {
+            return &member;
+        }
+    }
+    return nullptr;
+}
+
+namespace {
+    /* hand decompressed data of a member to sink, returns extracted bytes */
+    uint64_t decode(int fd, uint64_t offset, const IndexedContainer::Member& member, const std::string& path,
+                    const std::function<void(const char*, size_t)>& sink) {
+        uint64_t produced = 0;
+
+        if (member.compression == container::COMPRESSION_STORED) {
+            std::vector<uint8_t> buffer(static_cast<size_t>(std::min<uint64_t>(READ_SIZE, member.length)));
+            while (produced < member.length) {
+                const size_t length = static_cast<size_t>(std::min<uint64_t>(buffer.size(), member.length - produced));
+                if (!read_full(fd, buffer.data(), length, offset + produced)) {
+                    throw ContainerInvalid(path, "read " + member.name + ": " + std::strerror(errno));
+                }
+                IoThrottle::account(length);
+                sink(reinterpret_cast<const char*>(buffer.data()), length);
+                produced += length;
+            }
+            return produced;
+        }
+
+        fs::LibArchiveHandle handle(fs::LibArchiveHandle::Format::RAW_BZIP2);
+        handle.open_range(fd, offset, member.length);
+        archive* a = handle.get();
+        archive_entry* entry = nullptr;
+        if (archive_read_next_header(a, &entry) != ARCHIVE_OK) {
+            const char* err = archive_error_string(a);
+            throw ContainerInvalid(path, "open " + member.name + ": " + (err ? err : "unknown libarchive error"));
+        }
+
+        const void* block;
+        size_t size;
+        la_int64_t block_offset;
+        while (true) {
+            int r = archive_read_data_block(a, &block, &size, &block_offset);
+            if (r == ARCHIVE_EOF) {
+                break;
+            }
+            if (r != ARCHIVE_OK && r != ARCHIVE_WARN) {
+                const char* err = archive_error_string(a);
+                throw ContainerInvalid(path, "decompress " + member.name + ": " + (err ? err : "unknown libarchive error"));
+            }
+            if (static_cast<uint64_t>(block_offset) != produced || size > member.size - produced) {
+                throw ContainerInvalid(path, "member " + member.name + " larger than announced");
+            }
+            sink(static_cast<const char*>(block), size);
+            produced += size;
+        }
+        return produced;
+    }
+}
+
+std::string IndexedContainer::read(const Member& member, size_t max_size) const {
+    if (member.size > max_size) {
+        throw ContainerInvalid(path_, "member " + member.name + " too large");
+    }
+    std::string data;
+    data.reserve(static_cast<size_t>(member.size));
+    const uint64_t produced = decode(fd_, base_ + member.offset, member, path_,
+                                     [&data](const char* block, size_t size) { data.append(block, size); });
+    if (produced != member.size) {
+        throw ContainerInvalid(path_, "member " + member.name + " smaller than announced");
+    }
+    return data;
+}
+
+void IndexedContainer::extract(const Member& member, const std::filesystem::path& dest) const {
+    int out = ::open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        throw WriteFailed(dest.string(), std::string("open: ") + std::strerror(errno));
+    }
+    std::unique_ptr<int, void (*)(int*)> out_guard(&out, [](int* f) { ::close(*f); });
+
+    WriteEngine writer(out, dest.string());
+    writer.preallocate(member.size);
+    const uint64_t produced = decode(fd_, base_ + member.offset, member, path_,
+                                     [&writer](const char* block, size_t size) { writer.write(block, size); });
+    if (produced != member.size) {
+        throw ContainerInvalid(path_, "member " + member.name + " smaller than announced");
+    }
+    writer.finish();
+}
+
+} // namespace updater
@@ -0,0 +1,110 @@
+/**
+ * Seekable payload of update bundles with independently compressed members.
+ *
+ * A tar.bz2 payload is a single compressed stream, getting to update.app
+ * means decompressing everything before it. The indexed container starts
+ * with a table of its members (name, offset, length, size, compression), so
+ * each member is located with one read and decompressed on its own. Members
+ * can be extracted selectively and in parallel. The container needs a
+ * seekable source, streams keep using tar.bz2.
+ */
+
+#pragma once
+
+#include "./../BaseException.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace updater {
+
+    namespace container {
+        constexpr char MAGIC[] = "FSUPDIDX";
+        constexpr size_t MAGIC_SIZE = 8;
+        constexpr uint32_t VERSION = 1;
+        /* magic, version, member count */
+        constexpr size_t HEADER_SIZE = 16;
+        constexpr size_t ENTRY_SIZE = 64;
+        constexpr size_t NAME_SIZE = 32;
+        constexpr uint32_t MAX_MEMBERS = 16;
+        constexpr uint32_t COMPRESSION_STORED = 0;
+        constexpr uint32_t COMPRESSION_BZIP2 = 1;
+    }
+
+    class ContainerInvalid : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Indexed container is malformed or a member can not be extracted.
+         * @param path Update image.
+         * @param msg Reason.
+         */
+        ContainerInvalid(const std::string& path, const std::string& msg) {
+            this->error_msg = std::string("Indexed container ") + path + ": " + msg;
+        }
+    };
+
+    class IndexedContainer {
+    public:
+        struct Member {
+            std::string name;
+            /* from start of the container */
+            uint64_t offset;
+            /* stored bytes */
+            uint64_t length;
+            /* extracted bytes */
+            uint64_t size;
+            uint32_t compression;
+        };
+
+    private:
+        int fd_;
+        uint64_t base_;
+        std::string path_;
+        std::vector<Member> members_;
+
+    public:
+        /**
+         * Read and check member table.
+         * Layout (big-endian): magic "FSUPDIDX", uint32 version, uint32
+         * member count, per member 32 byte name, uint64 offset, length and
+         * size, uint32 compression, uint32 reserved, then uint32 CRC32 over
+         * all bytes before.
+         * @param fd Update image, owned by the caller.
+         * @param base Offset of the container in the update image.
+         * @param length Size of the container.
+         * @param path Name of the update image for error messages.
+         * @throw ContainerInvalid
+         */
+        IndexedContainer(int fd, uint64_t base, uint64_t length, std::string path);
+
+        /**
+         * @return Container magic found at base: true, else false.
+         */
+        static bool detect(int fd, uint64_t base);
+
+        const std::vector<Member>& members() const { return members_; }
+
+        /**
+         * @return Member with name, nullptr if missing.
+         */
+        const Member* find(const std::string& name) const;
+
+        /**
+         * Read small member into memory, e.g. the manifest.
+         * @throw ContainerInvalid Member larger than max_size or corrupt.
+         */
+        std::string read(const Member& member, size_t max_size) const;
+
+        /**
+         * Decompress member into file. Safe to call concurrently for
+         * different members.
+         * @throw ContainerInvalid Member corrupt or size mismatch.
+         * @throw WriteFailed Writing dest fails.
+         */
+        void extract(const Member& member, const std::filesystem::path& dest) const;
+    };
+
+} // namespace updater
@@ -0,0 +1,327 @@
+#include "jsonReader.h"
+
+#include <limits>
+
+namespace updater {
+namespace json {
+
+namespace {
+    bool is_digit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    int hex_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    void append_utf8(std::string& out, uint32_t code_point) {
+        if (code_point < 0x80) {
+            out += static_cast<char>(code_point);
+        } else if (code_point < 0x800) {
+            out += static_cast<char>(0xC0 | (code_point >> 6));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        } else if (code_point < 0x10000) {
+            out += static_cast<char>(0xE0 | (code_point >> 12));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code_point >> 18));
+            out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+    }
+}
+
+void Reader::fail(const std::string& msg) const {
+    throw JsonInvalid(pos_, msg);
+}
+
+void Reader::skip_whitespace() {
+    while (pos_ < text_.size() &&
+           (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+        ++pos_;
+    }
+}
+
+void Reader::expect(char c) {
+    skip_whitespace();
+    if (pos_ >= text_.size() || text_[pos_] != c) {
+        fail(std::string("expected '") + c + "'");
+    }
+    ++pos_;
+}
+
+Type Reader::peek() {
+    skip_whitespace();
+    if (pos_ >= text_.size()) {
+        fail("unexpected end of input");
+    }
+    switch (text_[pos_]) {
+    case '{': return Type::OBJECT;
+    case '[': return Type::ARRAY;
+    case '"': return Type::STRING;
+    case 't':
+    case 'f': return Type::BOOLEAN;
+    case 'n': return Type::NUL;
+    default:
+        if (text_[pos_] == '-' || is_digit(text_[pos_])) {
+            return Type::NUMBER;
+        }
+        fail("expected value");
+    }
+}
+
+void Reader::enter(char c) {
+    expect(c);
+    if (depth_ >= MAX_DEPTH) {
+        fail("nested too deep");
+    }
+    first_[depth_++] = true;
+}
+
+bool Reader::next(char close) {
+    skip_whitespace();
+    if (pos_ < text_.size() && text_[pos_] == close) {
+        ++pos_;
+        --depth_;
+        return false;
+    }
+    if (!first_[depth_ - 1]) {
+        expect(',');
+    }
+    first_[depth_ - 1] = false;
+    return true;
+}
+
+void Reader::begin_object() {
+    enter('{');
+}
+
+bool Reader::next_member(std::string_view& key) {
+    if (!next('}')) {
+        return false;
+    }
+    if (peek() != Type::STRING) {
+        fail("expected member name");
+    }
+    key = string_value();
+    expect(':');
+    return true;
+}
+
+void Reader::begin_array() {
+    enter('[');
+}
+
+bool Reader::next_element() {
+    return next(']');
+}
+
+std::string_view Reader::string_value() {
+    expect('"');
+    const size_t start = pos_;
+    while (pos_ < text_.size() && text_[pos_] != '"' && text_[pos_] != '\\') {
+        if (static_cast<unsigned char>(text_[pos_]) < 0x20) {
+            fail("control character in string");
+        }
+        ++pos_;
+    }
+    if (pos_ >= text_.size()) {
+        fail("unterminated string");
+    }
+    if (text_[pos_] == '"') {
+        /* common case, no copy */
+        return text_.substr(start, pos_++ - start);
+    }
+
+    scratch_.assign(text_.data() + start, pos_ - start);
+    while (true) {
+        if (pos_ >= text_.size()) {
+            fail("unterminated string");
+        }
+        const char c = text_[pos_++];
+        if (c == '"') {
+            return scratch_;
+        }
+        if (static_cast<unsigned char>(c) < 0x20) {
+            fail("control character in string");
+        }
+        if (c != '\\') {
+            scratch_ += c;
+            continue;
+        }
+        if (pos_ >= text_.size()) {
+            fail("unterminated escape");
+        }
+        switch (text_[pos_++]) {
+        case '"': scratch_ += '"'; break;
+        case '\\': scratch_ += '\\'; break;
+        case '/': scratch_ += '/'; break;
+        case 'b': scratch_ += '\b'; break;
+        case 'f': scratch_ += '\f'; break;
+        case 'n': scratch_ += '\n'; break;
+        case 'r': scratch_ += '\r'; break;
+        case 't': scratch_ += '\t'; break;
+        case 'u': {
+            auto read_hex4 = [this]() {
+                if (text_.size() - pos_ < 4) {
+                    fail("truncated unicode escape");
+                }
+                uint32_t value = 0;
+                for (int i = 0; i < 4; ++i) {
+                    const int digit = hex_value(text_[pos_++]);
+                    if (digit < 0) {
+                        fail("invalid unicode escape");
+                    }
+                    value = (value << 4) | static_cast<uint32_t>(digit);
+                }
+                return value;
+            };
+            uint32_t code_point = read_hex4();
+            if (code_point >= 0xD800 && code_point < 0xDC00) {
+                /* surrogate pair */
+                if (text_.size() - pos_ < 2 || text_[pos_] != '\\' || text_[pos_ + 1] != 'u') {
+                    fail("unpaired surrogate");
+                }
+                pos_ += 2;
+                const uint32_t low = read_hex4();
+                if (low < 0xDC00 || low > 0xDFFF) {
+                    fail("unpaired surrogate");
+                }
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+            } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+                fail("unpaired surrogate");
+            }
+            append_utf8(scratch_, code_point);
+            break;
+        }
+        default:
+            fail("invalid escape");
+        }
+    }
+}
+
+std::string_view Reader::number_text() {
+    if (peek() != Type::NUMBER) {
+        fail("expected number");
+    }
+    const size_t start = pos_;
+    if (text_[pos_] == '-') {
+        ++pos_;
+    }
+    if (pos_ >= text_.size() || !is_digit(text_[pos_])) {
+        fail("invalid number");
+    }
+    if (text_[pos_] == '0') {
+        ++pos_;
+    } else {
+        while (pos_ < text_.size() && is_digit(text_[pos_])) ++pos_;
+    }
+    if (pos_ < text_.size() && text_[pos_] == '.') {
+        ++pos_;
+        if (pos_ >= text_.size() || !is_digit(text_[pos_])) {
+            fail("invalid number");
+        }
+        while (pos_ < text_.size() && is_digit(text_[pos_])) ++pos_;
+    }
+    if (pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E')) {
+        ++pos_;
+        if (pos_ < text_.size() && (text_[pos_] == '+' || text_[pos_] == '-')) {
+            ++pos_;
+        }
+        if (pos_ >= text_.size() || !is_digit(text_[pos_])) {
+            fail("invalid number");
+        }
+        while (pos_ < text_.size() && is_digit(text_[pos_])) ++pos_;
+    }
+    return text_.substr(start, pos_ - start);
+}
+
+uint64_t Reader::uint_value() {
+    skip_whitespace();
+    const size_t start = pos_;
+    const std::string_view number = number_text();
+    uint64_t value = 0;
+    for (char c : number) {
+        if (!is_digit(c)) {
+            pos_ = start;
+            fail("expected unsigned integer");
+        }
+        const uint64_t digit = static_cast<uint64_t>(c - '0');
+        if (value > (std::numeric_limits<uint64_t>::max() - digit) / 10) {
+            pos_ = start;
+            fail("integer out of range");
+        }
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+bool Reader::bool_value() {
+    skip_whitespace();
+    if (text_.substr(pos_, 4) == "true") {
+        pos_ += 4;
+        return true;
+    }
+    if (text_.substr(pos_, 5) == "false") {
+        pos_ += 5;
+        return false;
+    }
+    fail("expected boolean");
+}
+
+bool Reader::null_value() {
+    skip_whitespace();
+    if (text_.substr(pos_, 4) == "null") {
+        pos_ += 4;
+        return true;
+    }
+    return false;
+}
+
+void Reader::skip() {
+    switch (peek()) {
+    case Type::OBJECT: {
+        begin_object();
+        std::string_view key;
+        while (next_member(key)) {
+            skip();
+        }
+        break;
+    }
+    case Type::ARRAY:
+        begin_array();
+        while (next_element()) {
+            skip();
+        }
+        break;
+    case Type::STRING:
+        string_value();
+        break;
+    case Type::NUMBER:
+        number_text();
+        break;
+    case Type::BOOLEAN:
+        bool_value();
+        break;
+    case Type::NUL:
+        if (!null_value()) {
+            fail("expected null");
+        }
+        break;
+    }
+}
+
+void Reader::finish() {
+    skip_whitespace();
+    if (pos_ != text_.size()) {
+        fail("trailing characters");
+    }
+}
+
+} // namespace json
+} // namespace updater
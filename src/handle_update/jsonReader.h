@@ -0,0 +1,116 @@
+/**
+ * Single-pass JSON pull parser.
+ *
+ * fsupdate.json and the output of `rauc status` and `rauc info` are small
+ * documents with a fixed schema. Instead of building a Json::Value tree and
+ * looking members up by name afterwards, callers walk the document once and
+ * keep only the values they need. Strings without escapes are returned as
+ * views into the input, nothing is allocated for skipped values.
+ */
+
+#pragma once
+
+#include "./../BaseException.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace updater {
+namespace json {
+
+    /* nesting of objects and arrays */
+    constexpr size_t MAX_DEPTH = 32;
+
+    class JsonInvalid : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Document is not valid JSON or has an unexpected type.
+         * @param offset Byte offset of the error.
+         * @param msg Reason.
+         */
+        JsonInvalid(size_t offset, const std::string& msg) {
+            this->error_msg = std::string("Invalid JSON at offset ") + std::to_string(offset) + ": " + msg;
+        }
+    };
+
+    enum class Type {
+        OBJECT,
+        ARRAY,
+        STRING,
+        NUMBER,
+        BOOLEAN,
+        NUL
+    };
+
+    class Reader {
+    private:
+        std::string_view text_;
+        size_t pos_ = 0;
+        size_t depth_ = 0;
+        /* no member or element read yet, per nesting level */
+        std::array<bool, MAX_DEPTH> first_{};
+        /* decoded strings with escapes */
+        std::string scratch_;
+
+        void skip_whitespace();
+        void expect(char c);
+        void enter(char c);
+        /* comma between members and elements, false at closing bracket */
+        bool next(char close);
+        [[noreturn]] void fail(const std::string& msg) const;
+
+    public:
+        explicit Reader(std::string_view text) : text_(text) {}
+
+        /**
+         * @return Type of the next value.
+         * @throw JsonInvalid End of input or no value.
+         */
+        Type peek();
+
+        void begin_object();
+        /**
+         * Read the next member name of the current object.
+         * @param key Member name, valid until the next string is read.
+         * @return Member read: true, end of object: false.
+         */
+        bool next_member(std::string_view& key);
+
+        void begin_array();
+        /**
+         * @return Next element follows: true, end of array: false.
+         */
+        bool next_element();
+
+        /**
+         * @return String, valid until the next string is read.
+         */
+        std::string_view string_value();
+        /**
+         * @return Number as written, e.g. for versions.
+         */
+        std::string_view number_text();
+        uint64_t uint_value();
+        bool bool_value();
+        /**
+         * Consume null.
+         * @return Value was null: true, else false and nothing is consumed.
+         */
+        bool null_value();
+        /**
+         * Skip the next value including nested objects and arrays.
+         */
+        void skip();
+        /**
+         * @throw JsonInvalid Anything but whitespace follows the document.
+         */
+        void finish();
+
+        size_t offset() const { return pos_; }
+    };
+
+} // namespace json
+} // namespace updater
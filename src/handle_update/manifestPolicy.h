@@ -0,0 +1,36 @@
+/**
+ * Checks of fsupdate.json before update images are extracted.
+ *
+ * If a bundle carries its manifest in a section after the F&S header or as
+ * first tar entry, it is checked before any update image is decompressed.
+ * A bundle for the wrong handler or version, or one that does not fit into
+ * the extraction directory, is rejected without extracting anything.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace updater {
+
+    namespace manifest {
+        /* larger manifests are rejected */
+        constexpr size_t MAX_SIZE = 1024 * 1024;
+        /* first bytes of fs_header_v1_0.param if a manifest section follows the header */
+        constexpr char SECTION_MAGIC[] = "MNFT";
+        constexpr char FILE_NAME[] = "fsupdate.json";
+    }
+
+    struct ManifestPolicy {
+        /* accepted values of "handler", empty accepts all */
+        std::vector<std::string> handlers;
+        /* reject images whose version is not newer than the installed one */
+        bool newer_only = false;
+        /* bytes kept free in the extraction directory */
+        uint64_t reserve_bytes = 0;
+    };
+
+} // namespace updater
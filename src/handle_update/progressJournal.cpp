@@ -0,0 +1,82 @@
+#include "progressJournal.h"
+
+#include <fstream>
+
+extern "C" {
+    #include <fcntl.h>
+    #include <stdio.h>
+    #include <unistd.h>
+}
+
+namespace updater {
+
+namespace {
+    constexpr char JOURNAL_MAGIC[] = "FSJOURNAL";
+    constexpr int JOURNAL_VERSION = 1;
+}
+
+ProgressJournal::ProgressJournal(std::string path, std::string operation, const std::string& source_path)
+    : path_(std::move(path)), operation_(std::move(operation)) {
+    try {
+        source_ = VerificationRecord::identify(source_path);
+        valid_source_ = true;
+    } catch (const std::runtime_error&) {
+        valid_source_ = false;
+    }
+}
+
+ProgressJournal::Position ProgressJournal::resume_position() const {
+    Position position;
+    if (!valid_source_) {
+        return position;
+    }
+
+    std::ifstream journal(path_);
+    std::string magic, operation;
+    int version = 0;
+    VerificationRecord::FileIdentity id;
+    Position stored;
+    if (!(journal >> magic >> version >> operation >> id.device >> id.inode >> id.size >> id.mtime_sec >>
+          id.mtime_nsec >> id.ctime_sec >> id.ctime_nsec >> stored.item >> stored.offset)) {
+        return position;
+    }
+    if (magic != JOURNAL_MAGIC || version != JOURNAL_VERSION || operation != operation_ || id != source_) {
+        return position;
+    }
+    return stored;
+}
+
+void ProgressJournal::checkpoint(const Position& position) const {
+    if (!valid_source_) {
+        return;
+    }
+
+    const std::string tmp_path = path_ + ".tmp";
+    {
+        std::ofstream journal(tmp_path, std::ios::trunc);
+        journal << JOURNAL_MAGIC << ' ' << JOURNAL_VERSION << ' ' << operation_ << ' '
+                << source_.device << ' ' << source_.inode << ' ' << source_.size << ' '
+                << source_.mtime_sec << ' ' << source_.mtime_nsec << ' '
+                << source_.ctime_sec << ' ' << source_.ctime_nsec << ' '
+                << position.item << ' ' << position.offset << '\n';
+        if (!journal.flush()) {
+            return;
+        }
+    }
+
+    int fd = ::open(tmp_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    fdatasync(fd);
+    ::close(fd);
+    /* a lost rename leaves the previous, smaller checkpoint */
+    ::rename(tmp_path.c_str(), path_.c_str());
+}
+
+void ProgressJournal::clear() const {
+    ::unlink(path_.c_str());
+    ::unlink((path_ + ".tmp").c_str());
+}
+
+} // namespace updater
@@ -0,0 +1,67 @@
+/**
+ * Checkpoint journal of long running writes.
+ *
+ * Records how far the extraction of a bundle or the copy of an application
+ * image has durably progressed. The journal is bound to the identity of the
+ * source file, so a re-run with the same, unchanged file resumes at the last
+ * checkpoint and any other file starts from the beginning. Callers flush the
+ * written data before every checkpoint; results are verified completely
+ * after resuming anyway.
+ */
+
+#pragma once
+
+#include "verificationRecord.h"
+
+#include <cstdint>
+#include <string>
+
+namespace updater {
+
+    namespace journal {
+        /* flush and record progress every CHECKPOINT_INTERVAL bytes */
+        constexpr uint64_t CHECKPOINT_INTERVAL = 16 * 1024 * 1024;
+    }
+
+    class ProgressJournal {
+    public:
+        struct Position {
+            /* number of completed items, e.g. archive entries */
+            uint64_t item = 0;
+            /* durable bytes of the next item */
+            uint64_t offset = 0;
+        };
+
+    private:
+        std::string path_;
+        std::string operation_;
+        VerificationRecord::FileIdentity source_;
+        bool valid_source_ = false;
+
+    public:
+        /**
+         * @param path Journal file, next to the written data.
+         * @param operation Name of the operation, e.g. "copy".
+         * @param source_path File the data is read from.
+         */
+        ProgressJournal(std::string path, std::string operation, const std::string& source_path);
+
+        /**
+         * Last checkpoint of the same operation on the same source file.
+         * @return Position, zero if there is none.
+         */
+        Position resume_position() const;
+
+        /**
+         * Record position. Written data must be flushed before.
+         * Failures are ignored, a re-run starts earlier then.
+         */
+        void checkpoint(const Position& position) const;
+
+        /**
+         * Remove journal, e.g. after completion or on error.
+         */
+        void clear() const;
+    };
+
+} // namespace updater
@@ -0,0 +1,199 @@
+#include "resourcePolicy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <mutex>
+#include <thread>
+
+extern "C" {
+    #include <errno.h>
+    #include <sys/resource.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+}
+
+namespace updater {
+
+namespace {
+    constexpr int IOPRIO_CLASS_SHIFT = 13;
+    constexpr int IOPRIO_CLASS_BE = 2;
+    constexpr int IOPRIO_CLASS_IDLE = 3;
+    /* thread with who 0 */
+    constexpr int IOPRIO_WHO_PROCESS = 1;
+    constexpr char CGROUP_ROOT[] = "/sys/fs/cgroup";
+
+    /* shared token bucket, bytes may go negative to queue callers */
+    struct TokenBucket {
+        std::atomic<uint64_t> rate{0};
+        std::mutex mutex;
+        double tokens = 0;
+        std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+    };
+
+    TokenBucket& bucket() {
+        static TokenBucket instance;
+        return instance;
+    }
+
+    void set_rate(uint64_t rate) {
+        TokenBucket& b = bucket();
+        std::lock_guard<std::mutex> lock(b.mutex);
+        b.rate.store(rate);
+        b.tokens = 0;
+        b.last = std::chrono::steady_clock::now();
+    }
+
+    /* cgroup v2 directory of this process */
+    std::string current_cgroup() {
+        std::ifstream cgroup("/proc/self/cgroup");
+        std::string line;
+        while (std::getline(cgroup, line)) {
+            if (line.compare(0, 3, "0::") == 0) {
+                return std::string(CGROUP_ROOT) + line.substr(3);
+            }
+        }
+        return std::string();
+    }
+
+    /* CAP_SYS_NICE in the effective set of this process */
+    bool has_cap_sys_nice() {
+        constexpr int CAP_SYS_NICE_BIT = 23;
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, 7, "CapEff:") == 0) {
+                return (std::stoull(line.substr(7), nullptr, 16) >> CAP_SYS_NICE_BIT) & 1;
+            }
+        }
+        return false;
+    }
+
+    /* nice value may be lowered back to value after it was raised */
+    bool can_restore_nice(int value) {
+        if (has_cap_sys_nice()) {
+            return true;
+        }
+        /* RLIMIT_NICE allows nice values down to 20 - rlim_cur */
+        rlimit limit;
+        if (::getrlimit(RLIMIT_NICE, &limit) != 0) {
+            return false;
+        }
+        return limit.rlim_cur == RLIM_INFINITY || 20 - static_cast<long long>(limit.rlim_cur) <= value;
+    }
+
+    bool move_to_cgroup(const std::string& dir) {
+        std::ofstream procs(dir + "/cgroup.procs");
+        procs << "0\n";
+        procs.flush();
+        return procs.good();
+    }
+}
+
+ResourcePolicy ResourcePolicy::fastest() {
+    return ResourcePolicy();
+}
+
+ResourcePolicy ResourcePolicy::least_intrusive() {
+    ResourcePolicy policy;
+    policy.bytes_per_second = 8 * 1024 * 1024;
+    /* idle class would starve next to a busy control application */
+    policy.io_class = IoClass::BEST_EFFORT;
+    policy.io_level = 7;
+    policy.nice = 19;
+    return policy;
+}
+
+void IoThrottle::account(uint64_t bytes) {
+    TokenBucket& b = bucket();
+    if (b.rate.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    double wait_seconds = 0;
+    {
+        std::lock_guard<std::mutex> lock(b.mutex);
+        const uint64_t rate = b.rate.load();
+        if (rate == 0) {
+            return;
+        }
+        /* burst of an eighth of a second, at least 256 KiB */
+        const double burst = std::max<double>(static_cast<double>(rate) / 8, 256 * 1024);
+        const auto now = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double>(now - b.last).count();
+        b.last = now;
+        b.tokens = std::min(burst, b.tokens + elapsed * static_cast<double>(rate));
+        b.tokens -= static_cast<double>(bytes);
+        if (b.tokens < 0) {
+            wait_seconds = -b.tokens / static_cast<double>(rate);
+        }
+    }
+
+    if (wait_seconds > 0) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(wait_seconds));
+    }
+}
+
+ResourceScope::ResourceScope(const ResourcePolicy& policy, std::shared_ptr<logger::LoggerHandler> logger)
+    : logger_(std::move(logger)), previous_rate_(bucket().rate.load()) {
+    if (policy.io_class != IoClass::UNCHANGED) {
+        const int io_class = (policy.io_class == IoClass::IDLE) ? IOPRIO_CLASS_IDLE : IOPRIO_CLASS_BE;
+        const int level = (policy.io_class == IoClass::IDLE) ? 0 : std::clamp(policy.io_level, 0, 7);
+        previous_ioprio_ = static_cast<int>(::syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0));
+        if (::syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, (io_class << IOPRIO_CLASS_SHIFT) | level) != 0) {
+            warn(std::string("ioprio_set: ") + std::strerror(errno));
+            previous_ioprio_ = -1;
+        }
+    }
+
+    if (policy.nice) {
+        errno = 0;
+        const int nice = ::getpriority(PRIO_PROCESS, 0);
+        if (errno != 0) {
+            warn(std::string("getpriority: ") + std::strerror(errno));
+        } else if (*policy.nice > nice && !can_restore_nice(nice)) {
+            /* the thread would keep the raised value after the operation */
+            warn("keep nice value " + std::to_string(nice) + ", it cannot be restored without CAP_SYS_NICE or RLIMIT_NICE");
+        } else if (::setpriority(PRIO_PROCESS, 0, *policy.nice) == 0) {
+            previous_nice_ = nice;
+        } else {
+            warn(std::string("setpriority: ") + std::strerror(errno));
+        }
+    }
+
+    if (!policy.cgroup.empty()) {
+        const std::string cgroup = current_cgroup();
+        if (move_to_cgroup(policy.cgroup)) {
+            previous_cgroup_ = cgroup;
+        } else {
+            warn("cannot move process to " + policy.cgroup);
+        }
+    }
+
+    set_rate(policy.bytes_per_second);
+}
+
+ResourceScope::~ResourceScope() {
+    set_rate(previous_rate_);
+    if (!previous_cgroup_.empty() && !move_to_cgroup(previous_cgroup_)) {
+        warn("cannot move process back to " + previous_cgroup_);
+    }
+    /* checked by the constructor, may still fail if the limit changed */
+    if (previous_nice_ && ::setpriority(PRIO_PROCESS, 0, *previous_nice_) != 0) {
+        warn(std::string("restore nice value: ") + std::strerror(errno));
+    }
+    if (previous_ioprio_ >= 0) {
+        ::syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, previous_ioprio_);
+    }
+}
+
+void ResourceScope::warn(const std::string& msg) const {
+    if (logger_) {
+        logger_->setLogEntry(std::make_shared<logger::LogEntry>(RESOURCE_POLICY, msg, logger::logLevel::WARNING));
+    }
+}
+
+} // namespace updater
@@ -0,0 +1,90 @@
+/**
+ * Resource usage of update operations.
+ *
+ * Updates run next to the production application. A policy lowers the I/O
+ * and CPU priority of the updating thread, optionally moves the process into
+ * a cgroup v2 group and limits the bytes read and written per second. Worker
+ * threads started during an operation inherit priorities from the updating
+ * thread. The default policy changes nothing and runs at full speed.
+ */
+
+#pragma once
+
+#include "../logger/LoggerHandler.h"
+#include "../logger/LoggerEntry.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+constexpr char RESOURCE_POLICY[] = "resource policy";
+
+namespace updater {
+
+    enum class IoClass {
+        /* keep class of calling thread */
+        UNCHANGED,
+        BEST_EFFORT,
+        /* I/O only if the device is idle otherwise, may starve */
+        IDLE
+    };
+
+    struct ResourcePolicy {
+        /* bytes read plus written per second, 0 for unlimited */
+        uint64_t bytes_per_second = 0;
+        IoClass io_class = IoClass::UNCHANGED;
+        /* 0 (highest) to 7 (lowest), best effort class only */
+        int io_level = 4;
+        /* nice value of the updating threads, unset keeps it; not raised if it
+           could not be lowered back without CAP_SYS_NICE or RLIMIT_NICE */
+        std::optional<int> nice;
+        /* cgroup v2 directory for the process, e.g. /sys/fs/cgroup/update, empty keeps it */
+        std::string cgroup;
+
+        /**
+         * Full speed, nothing changed.
+         */
+        static ResourcePolicy fastest();
+
+        /**
+         * Lowest best effort I/O level, nice 19 and 8 MiB/s.
+         */
+        static ResourcePolicy least_intrusive();
+    };
+
+    class IoThrottle {
+    public:
+        /**
+         * Account bytes read or written by an update operation. Sleeps as
+         * long as the rate of the active policy is exceeded, returns
+         * immediately without a limit.
+         */
+        static void account(uint64_t bytes);
+    };
+
+    class ResourceScope {
+    private:
+        std::shared_ptr<logger::LoggerHandler> logger_;
+        uint64_t previous_rate_;
+        int previous_ioprio_ = -1;
+        std::optional<int> previous_nice_;
+        std::string previous_cgroup_;
+
+        void warn(const std::string& msg) const;
+
+    public:
+        /**
+         * Apply policy to calling thread and process until destruction.
+         * Settings that can not be applied are logged and skipped.
+         * @param policy Policy of the operation.
+         * @param logger Logger object reference.
+         */
+        ResourceScope(const ResourcePolicy& policy, std::shared_ptr<logger::LoggerHandler> logger);
+        ~ResourceScope();
+
+        ResourceScope(const ResourceScope&) = delete;
+        ResourceScope& operator=(const ResourceScope&) = delete;
+    };
+
+} // namespace updater
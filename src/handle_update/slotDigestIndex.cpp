@@ -0,0 +1,156 @@
+#include "slotDigestIndex.h"
+#include "hashEngine.h"
+#include "verificationRecord.h"
+
+#include <botan/hex.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+extern "C" {
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+}
+
+namespace updater {
+
+namespace {
+    constexpr char INDEX_FILE[] = "slot_digests";
+}
+
+struct SlotDigestIndex::Entry {
+    std::string name;
+    VerificationRecord::FileIdentity identity;
+    std::vector<uint8_t> digest;
+};
+
+SlotDigestIndex::SlotDigestIndex(const std::string& store_dir, std::shared_ptr<logger::LoggerHandler> logger)
+    : index_path_((std::filesystem::path(store_dir) / INDEX_FILE).string()), logger_(std::move(logger)) {}
+
+std::vector<SlotDigestIndex::Entry> SlotDigestIndex::load() const {
+    std::vector<Entry> entries;
+    std::ifstream index(index_path_);
+    std::string line;
+    while (std::getline(index, line)) {
+        std::istringstream fields(line);
+        Entry entry;
+        std::string hex;
+        VerificationRecord::FileIdentity& id = entry.identity;
+        if (!(fields >> entry.name >> id.device >> id.inode >> id.size >> id.mtime_sec >> id.mtime_nsec >>
+              id.ctime_sec >> id.ctime_nsec >> hex)) {
+            continue;
+        }
+        try {
+            entry.digest = Botan::hex_decode(hex);
+        } catch (const std::exception&) {
+            continue;
+        }
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+void SlotDigestIndex::save(const std::vector<Entry>& entries) const {
+    const std::string tmp_path = index_path_ + ".tmp";
+    {
+        std::ofstream index(tmp_path, std::ios::trunc);
+        for (const Entry& entry : entries) {
+            const VerificationRecord::FileIdentity& id = entry.identity;
+            index << entry.name << ' ' << id.device << ' ' << id.inode << ' ' << id.size << ' '
+                  << id.mtime_sec << ' ' << id.mtime_nsec << ' ' << id.ctime_sec << ' ' << id.ctime_nsec << ' '
+                  << Botan::hex_encode(entry.digest, false) << '\n';
+        }
+        if (!index.flush()) {
+            throw std::runtime_error("cannot write " + tmp_path);
+        }
+    }
+
+    int fd = ::open(tmp_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+    std::filesystem::rename(tmp_path, index_path_);
+}
+
+bool SlotDigestIndex::matches(const std::string& slot_path, const std::vector<uint8_t>& digest) {
+    VerificationRecord::FileIdentity identity;
+    try {
+        identity = VerificationRecord::identify(slot_path);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+
+    const std::string name = std::filesystem::path(slot_path).filename().string();
+    for (const Entry& entry : load()) {
+        if (entry.name == name && entry.identity == identity) {
+            return entry.digest == digest;
+        }
+    }
+
+    /* not recorded for this file, hash it once */
+    const auto start = std::chrono::steady_clock::now();
+    int fd = ::open(slot_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    std::unique_ptr<int, void (*)(int*)> fd_guard(&fd, [](int* f) { ::close(*f); });
+    std::unique_ptr<HashEngine> hash = HashEngine::create("SHA-256", logger_);
+    hash->update_from_fd(fd, 0, identity.size);
+    const std::vector<uint8_t> slot_digest = hash->final();
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    logger_->setLogEntry(std::make_shared<logger::LogEntry>(
+        SLOT_DIGEST_INDEX, "hashed " + slot_path + " in " + std::to_string(elapsed.count()) + " ms",
+        logger::logLevel::DEBUG));
+
+    /* file changed while hashing, do not record */
+    try {
+        if (VerificationRecord::identify(slot_path) == identity) {
+            record(slot_path, slot_digest);
+        }
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    return slot_digest == digest;
+}
+
+void SlotDigestIndex::record(const std::string& slot_path, const std::vector<uint8_t>& digest) {
+    try {
+        const std::string name = std::filesystem::path(slot_path).filename().string();
+        std::vector<Entry> entries = load();
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [&name](const Entry& entry) { return entry.name == name; }),
+                      entries.end());
+        entries.push_back(Entry{name, VerificationRecord::identify(slot_path), digest});
+        save(entries);
+    } catch (const std::exception& e) {
+        logger_->setLogEntry(std::make_shared<logger::LogEntry>(
+            SLOT_DIGEST_INDEX, "record " + slot_path + ": " + e.what(), logger::logLevel::WARNING));
+    }
+}
+
+void SlotDigestIndex::forget(const std::string& slot_path) {
+    try {
+        const std::string name = std::filesystem::path(slot_path).filename().string();
+        std::vector<Entry> entries = load();
+        const size_t count = entries.size();
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [&name](const Entry& entry) { return entry.name == name; }),
+                      entries.end());
+        if (entries.size() != count) {
+            save(entries);
+        }
+    } catch (const std::exception& e) {
+        logger_->setLogEntry(std::make_shared<logger::LogEntry>(
+            SLOT_DIGEST_INDEX, "forget " + slot_path + ": " + e.what(), logger::logLevel::WARNING));
+    }
+}
+
+} // namespace updater
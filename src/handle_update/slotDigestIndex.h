@@ -0,0 +1,62 @@
+/**
+ * Content digests of the installed application slot images.
+ *
+ * The index is a small text file next to the slot images. Every entry binds
+ * the identity of a slot file (device, inode, size, mtime and ctime) to the
+ * SHA-256 of its content, so an entry is ignored as soon as the file changes.
+ * Digests are recorded on installation where they are known anyway and
+ * computed on demand otherwise.
+ */
+
+#pragma once
+
+#include "../logger/LoggerHandler.h"
+#include "../logger/LoggerEntry.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+constexpr char SLOT_DIGEST_INDEX[] = "slot digest index";
+
+namespace updater {
+
+    class SlotDigestIndex {
+    private:
+        std::string index_path_;
+        std::shared_ptr<logger::LoggerHandler> logger_;
+
+        struct Entry;
+        std::vector<Entry> load() const;
+        void save(const std::vector<Entry>& entries) const;
+
+    public:
+        /**
+         * @param store_dir Directory of slot images, holds the index file.
+         * @param logger Logger object reference.
+         */
+        SlotDigestIndex(const std::string& store_dir, std::shared_ptr<logger::LoggerHandler> logger);
+
+        /**
+         * Compare content of slot image with digest. The slot image is
+         * hashed and recorded if no entry matches its current identity.
+         * @param slot_path Slot image.
+         * @param digest SHA-256 of the image to install.
+         * @return Slot image has this digest: true, else false (also if missing).
+         */
+        bool matches(const std::string& slot_path, const std::vector<uint8_t>& digest);
+
+        /**
+         * Record digest of freshly written slot image.
+         * Failures are logged only, the digest is computed on demand then.
+         */
+        void record(const std::string& slot_path, const std::vector<uint8_t>& digest);
+
+        /**
+         * Drop entry of slot image.
+         */
+        void forget(const std::string& slot_path);
+    };
+
+} // namespace updater
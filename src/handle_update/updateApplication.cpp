@@ -1,4 +1,8 @@
 #include "updateApplication.h"
+#include "hashEngine.h"
+#include "resourcePolicy.h"
+#include "certificateScanner.h"
+#include "updateMetrics.h"
 #include "../uboot_interface/allowed_uboot_variable_states.h"
 
 #include <botan/pkix_types.h>
@@ -19,6 +23,7 @@
 #include <ctime>
 
 extern "C" {
+    #include <errno.h>
     #include <fcntl.h>
     #include <unistd.h>
 }
@@ -43,7 +48,8 @@ bool CertificateVerifier::verify_certificate_chain(const std::vector<Botan::X509
     }
 
     try {
-        std::vector<Botan::X509_Certificate> trusted_certs = load_trusted_certificates();
+        const std::shared_ptr<const TrustedKeyring> keyring = load_trusted_certificates();
+        const std::vector<Botan::X509_Certificate>& trusted_certs = keyring->certificates;
         if (trusted_certs.empty()) {
             logger_->setLogEntry(std::make_shared<logger::LogEntry>(
                 config::APP_UPDATE, "No trusted certificates found in keyring", logger::logLevel::ERROR));
@@ -60,7 +66,7 @@ bool CertificateVerifier::verify_certificate_chain(const std::vector<Botan::X509
             ", intermediates=" + std::to_string(intermediates.size()) +
             ", trusted=" + std::to_string(trusted_certs.size()),
             logger::logLevel::DEBUG));
-        return validate_certificate_chain(leaf, intermediates, trusted_certs);
+        return validate_certificate_chain(leaf, intermediates, *keyring);
 
     } catch (const std::exception& e) {
         logger_->setLogEntry(std::make_shared<logger::LogEntry>(
@@ -71,10 +77,65 @@ bool CertificateVerifier::verify_certificate_chain(const std::vector<Botan::X509
 }
 
 std::vector<Botan::X509_Certificate> CertificateVerifier::extract_certificates_from_image(
-    const std::filesystem::path& image_path) {
+    applicationImage& application) {
+
+    if (application.getHeaderVersion() != APP_IMAGE_VERSION_2) {
+        return extract_certificates_from_image(std::filesystem::path(application.getPath()));
+    }
 
-    constexpr std::string_view PEM_BEGIN = "-----BEGIN CERTIFICATE-----";
-    constexpr std::string_view PEM_END = "-----END CERTIFICATE-----";
+    // Sequence of (uint32 big-endian length, DER certificate)
+    if (application.getSectionLocation(ImageSection::CERTIFICATES).length > config::MAX_CERTIFICATE_REGION) {
+        throw CertificateScanLimit("certificate section larger than " +
+                                   std::to_string(config::MAX_CERTIFICATE_REGION) + " bytes");
+    }
+    const std::vector<uint8_t> section = application.getSection(ImageSection::CERTIFICATES);
+    stats_ = VerificationStatistics{};
+    stats_.certificate_bytes_scanned = section.size();
+    stats_.certificate_peak_buffer = section.size();
+
+    std::vector<Botan::X509_Certificate> certificates;
+    size_t pos = 0;
+    while (pos < section.size()) {
+        if (stats_.certificates == config::MAX_CERTIFICATES) {
+            throw CertificateScanLimit("more than " + std::to_string(config::MAX_CERTIFICATES) + " certificates");
+        }
+        ++stats_.certificates;
+        if (section.size() - pos < 4) {
+            throw std::runtime_error("Truncated certificate length in certificate section");
+        }
+        const uint32_t der_length = parse_uint32_be(section.data() + pos);
+        pos += 4;
+        if (der_length == 0 || der_length > section.size() - pos) {
+            throw std::runtime_error("Invalid certificate length in certificate section");
+        }
+        try {
+            certificates.emplace_back(section.data() + pos, der_length);
+            log_certificate_info(certificates.back(), "Extracted certificate");
+        } catch (const std::exception& e) {
+            logger_->setLogEntry(std::make_shared<logger::LogEntry>(
+                config::APP_UPDATE, "Failed to parse certificate: " + std::string(e.what()),
+                logger::logLevel::WARNING));
+        }
+        pos += der_length;
+    }
+
+    logger_->setLogEntry(std::make_shared<logger::LogEntry>(
+        config::APP_UPDATE, "Extracted " + std::to_string(certificates.size()) + " DER certificates",
+        logger::logLevel::DEBUG));
+
+    return certificates;
+}
+
+uint32_t CertificateVerifier::parse_uint32_be(const uint8_t* data) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+std::vector<Botan::X509_Certificate> CertificateVerifier::extract_certificates_from_image(
+    const std::filesystem::path& image_path) {
 
     std::ifstream in{image_path, std::ios::binary};
     if (!in.is_open()) {
@@ -97,6 +158,9 @@ std::vector<Botan::X509_Certificate> CertificateVerifier::extract_certificates_f
     if (!header.is_valid()) {
         throw std::runtime_error("Invalid header data");
     }
+    if (header.version != APP_IMAGE_VERSION_1) {
+        throw std::runtime_error("Certificates of v2 image are located through the section table");
+    }
 
     // Seek past SquashFS content to certificate section
     const auto seek_pos = static_cast<std::streamoff>(config::HEADER_SIZE + header.squashfs_size);
@@ -105,37 +169,13 @@ std::vector<Botan::X509_Certificate> CertificateVerifier::extract_certificates_f
         throw std::runtime_error("Failed to seek past squashfs content");
     }
 
-    // Read remaining content and extract certificates
+    // Stream remaining content through the PEM scanner, memory stays bounded
     std::vector<Botan::X509_Certificate> certificates;
-    std::string accumulated;
-    accumulated.reserve(16384);
-
-    std::vector<char> buffer(config::CHUNK_SIZE);
-    while (in.good() && !in.eof()) {
-        in.read(buffer.data(), config::CHUNK_SIZE);
-        auto read_bytes = in.gcount();
-        if (read_bytes > 0) {
-            accumulated.append(buffer.data(), static_cast<size_t>(read_bytes));
-        }
-    }
-
-    // Parse PEM certificates
-    size_t pos = 0;
-    while (pos < accumulated.size()) {
-        auto begin_pos = accumulated.find(PEM_BEGIN, pos);
-        if (begin_pos == std::string::npos) break;
-
-        auto end_pos = accumulated.find(PEM_END, begin_pos + PEM_BEGIN.size());
-        if (end_pos == std::string::npos) break;
-
-        end_pos += PEM_END.size();
-        if (end_pos < accumulated.size() && accumulated[end_pos] == '\n') {
-            ++end_pos;
-        }
-
-        std::string pem_block = accumulated.substr(begin_pos, end_pos - begin_pos);
+    PemCertificateScanner scanner(config::MAX_CERTIFICATE_REGION, config::MAX_CERTIFICATE_SIZE,
+                                  config::MAX_CERTIFICATES,
+                                  [this, &certificates](const uint8_t* block, size_t length) {
         try {
-            Botan::DataSource_Memory src(pem_block);
+            Botan::DataSource_Memory src(block, length);
             certificates.emplace_back(src);
             log_certificate_info(certificates.back(), "Extracted certificate");
         } catch (const std::exception& e) {
@@ -143,78 +183,60 @@ std::vector<Botan::X509_Certificate> CertificateVerifier::extract_certificates_f
                 config::APP_UPDATE, "Failed to parse certificate: " + std::string(e.what()),
                 logger::logLevel::WARNING));
         }
-        pos = end_pos;
+    });
+
+    std::vector<char> buffer(config::CHUNK_SIZE);
+    while (in.good() && !in.eof()) {
+        in.read(buffer.data(), config::CHUNK_SIZE);
+        auto read_bytes = in.gcount();
+        if (read_bytes > 0) {
+            scanner.feed(reinterpret_cast<const uint8_t*>(buffer.data()), static_cast<size_t>(read_bytes));
+        }
     }
 
+    stats_ = VerificationStatistics{};
+    stats_.certificates = scanner.certificates();
+    stats_.certificate_bytes_scanned = scanner.bytes_scanned();
+    stats_.certificate_peak_buffer = scanner.peak_buffer() + buffer.size();
+
     logger_->setLogEntry(std::make_shared<logger::LogEntry>(
-        config::APP_UPDATE, "Extracted " + std::to_string(certificates.size()) + " certificates",
+        config::APP_UPDATE, "Extracted " + std::to_string(certificates.size()) + " certificates, scanned " +
+        std::to_string(stats_.certificate_bytes_scanned) + " bytes, peak buffer " +
+        std::to_string(stats_.certificate_peak_buffer) + " bytes",
         logger::logLevel::DEBUG));
 
     return certificates;
 }
 
-std::vector<Botan::X509_Certificate> CertificateVerifier::load_trusted_certificates() const {
-    if (cache_valid_) {
-        return trusted_certs_cache_;
-    }
-
-    std::vector<Botan::X509_Certificate> trusted_certs;
-
+std::shared_ptr<const TrustedKeyring> CertificateVerifier::load_trusted_certificates() const {
     try {
-        std::ifstream keyring_file(keyring_path_);
-        if (!keyring_file) {
-            throw std::runtime_error("Failed to open keyring file: " + keyring_path_);
-        }
-
-        std::stringstream buffer;
-        buffer << keyring_file.rdbuf();
-        std::string content = buffer.str();
-
-        // Parse PEM certificates from keyring using find()-based loop
-        constexpr std::string_view PEM_BEGIN = "-----BEGIN CERTIFICATE-----";
-        constexpr std::string_view PEM_END = "-----END CERTIFICATE-----";
-        size_t pos = 0;
-        while (pos < content.size()) {
-            auto begin_pos = content.find(PEM_BEGIN, pos);
-            if (begin_pos == std::string::npos) break;
-            auto end_pos = content.find(PEM_END, begin_pos + PEM_BEGIN.size());
-            if (end_pos == std::string::npos) break;
-            end_pos += PEM_END.size();
-            std::string pem = content.substr(begin_pos, end_pos - begin_pos);
-            pos = end_pos;
-            try {
-                Botan::DataSource_Memory mem(pem);
-                Botan::X509_Certificate cert(mem);
-                trusted_certs.push_back(cert);
-                log_certificate_info(cert, "Loaded trusted certificate");
-            } catch (const std::exception& e) {
-                logger_->setLogEntry(std::make_shared<logger::LogEntry>(
-                    config::APP_UPDATE, "Failed to parse trusted certificate: " + std::string(e.what()),
-                    logger::logLevel::WARNING));
-            }
-        }
-        // Cache the results
-        trusted_certs_cache_ = trusted_certs;
-        cache_valid_ = true;
+        return KeyringCache::get(keyring_path_, logger_);
     } catch (const std::exception& e) {
         logger_->setLogEntry(std::make_shared<logger::LogEntry>(
             config::APP_UPDATE, "load_trusted_certificates: " + std::string(e.what()),
             logger::logLevel::ERROR));
         throw;
     }
-
-    return trusted_certs;
 }
 
 bool CertificateVerifier::validate_certificate_chain(
     const Botan::X509_Certificate& leaf,
     const std::vector<Botan::X509_Certificate>& intermediates,
-    const std::vector<Botan::X509_Certificate>& trusted_certs) const {
+    const TrustedKeyring& keyring) const {
 
     try {
+        // Chains validated before against the same keyring skip path building
+        const std::string cache_key = ChainValidationCache::make_key(leaf, intermediates, keyring.generation);
+        if (ChainValidationCache::lookup(cache_key)) {
+            logger_->setLogEntry(std::make_shared<logger::LogEntry>(
+                config::APP_UPDATE, "Certificate chain validation succeeded (cached)",
+                logger::logLevel::DEBUG));
+            return true;
+        }
+
         // Prepare certificate stores
         Botan::Certificate_Store_In_Memory trusted_store;
-        for (const auto& cert : trusted_certs) {
+        for (const auto& cert : keyring.certificates) {
             trusted_store.add_certificate(cert);
         }
 
@@ -274,6 +296,24 @@ bool CertificateVerifier::validate_certificate_chain(
             return false;
         }
 
+        // Result stays valid while every certificate of the path is valid
+        auto valid_from = std::chrono::system_clock::time_point::min();
+        auto valid_until = std::chrono::system_clock::time_point::max();
+        for (const auto& cert : validated_chain) {
+            /* times before 1970, from 2400 (e.g. notAfter 99991231) or beyond a
+             * 32 bit time_t are not representable; the chain is valid now, so
+             * such a bound lies outside of the window and is left open */
+            try {
+                valid_from = std::max(valid_from, cert->not_before().to_std_timepoint());
+            } catch (const Botan::Exception&) {
+            }
+            try {
+                valid_until = std::min(valid_until, cert->not_after().to_std_timepoint());
+            } catch (const Botan::Exception&) {
+            }
+        }
+        ChainValidationCache::store(cache_key, valid_from, valid_until);
+
         logger_->setLogEntry(std::make_shared<logger::LogEntry>(
             config::APP_UPDATE, "Certificate chain validation succeeded",
             logger::logLevel::DEBUG));
@@ -326,26 +366,55 @@ bool ImageVerifier::verify_signature(const Botan::X509_Certificate& cert,
                                      applicationImage& application,
                                      uint64_t squashfs_size,
                                      const std::vector<uint8_t>& timestamp,
-                                     const std::vector<uint8_t>& signature) const {
+                                     const std::vector<uint8_t>& signature,
+                                     std::vector<uint8_t>* payload_digest) const {
     try {
-        Botan::AutoSeeded_RNG rng;
+        if (!rng_) {
+            rng_ = std::make_unique<Botan::AutoSeeded_RNG>();
+        }
         std::unique_ptr<Botan::Public_Key> pub_key = cert.load_subject_public_key();
-        if (!pub_key || !pub_key->check_key(rng, false)) {
+        if (!pub_key || !pub_key->check_key(*rng_, false)) {
             logger_->setLogEntry(std::make_shared<logger::LogEntry>(
                 config::APP_UPDATE, "Invalid public key", logger::logLevel::ERROR));
             return false;
         }
 
-        Botan::PK_Verifier verifier(*pub_key, crypto::SIGNATURE_SCHEME, Botan::IEEE_1363);
-        
-        // Hash the SquashFS content directly (like original implementation)
-        auto crypto_wrapper = [&verifier](char *buffer, uint32_t length) {
-            verifier.update(reinterpret_cast<const uint8_t *>(buffer), length);
-        };
-        application.read_img_content_only(crypto_wrapper, squashfs_size);
-
-        // Add timestamp to hash
-        verifier.update(timestamp.data(), timestamp.size());
+        // Hash SquashFS content and timestamp with the selected engine
+        int fd = ::open(application.getPath().c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open " + application.getPath());
+        }
+        std::unique_ptr<int, void (*)(int*)> fd_guard(&fd, [](int* f) { ::close(*f); });
+
+        std::unique_ptr<HashEngine> hash = HashEngine::create(crypto::SIGNATURE_HASH, logger_);
+        if (payload_digest == nullptr) {
+            hash->update_from_fd(fd, application.getPayloadOffset(), squashfs_size);
+        } else {
+            /* one read of the payload feeds both digests */
+            std::unique_ptr<HashEngine> payload_hash = HashEngine::create(crypto::HASH_ALGORITHM, logger_);
+            std::vector<uint8_t> buffer(static_cast<size_t>(std::min<uint64_t>(config::PAYLOAD_READ_SIZE, squashfs_size)));
+            uint64_t offset = application.getPayloadOffset();
+            uint64_t remaining = squashfs_size;
+            while (remaining > 0) {
+                const size_t want = static_cast<size_t>(std::min<uint64_t>(buffer.size(), remaining));
+                const ssize_t bytes = ::pread(fd, buffer.data(), want, static_cast<off_t>(offset));
+                if (bytes < 0 && errno == EINTR) continue;
+                if (bytes <= 0) {
+                    throw std::runtime_error("Cannot read payload of " + application.getPath());
+                }
+                hash->update(buffer.data(), static_cast<size_t>(bytes));
+                payload_hash->update(buffer.data(), static_cast<size_t>(bytes));
+                IoThrottle::account(static_cast<uint64_t>(bytes));
+                offset += static_cast<uint64_t>(bytes);
+                remaining -= static_cast<uint64_t>(bytes);
+            }
+            *payload_digest = payload_hash->final();
+        }
+        hash->update(timestamp.data(), timestamp.size());
+        const std::vector<uint8_t> digest = hash->final();
+
+        Botan::PK_Verifier verifier(*pub_key, crypto::SIGNATURE_SCHEME_RAW, Botan::IEEE_1363);
+        verifier.update(digest.data(), digest.size());
 
         return verifier.check_signature(signature);
     } catch (const Botan::Exception& e) {
@@ -353,6 +422,38 @@ bool ImageVerifier::verify_signature(const Botan::X509_Certificate& cert,
             config::APP_UPDATE, "Signature verification failed: " + std::string(e.what()),
             logger::logLevel::ERROR));
         return false;
+    } catch (const std::runtime_error& e) {
+        logger_->setLogEntry(std::make_shared<logger::LogEntry>(
+            config::APP_UPDATE, "Signature verification failed: " + std::string(e.what()),
+            logger::logLevel::ERROR));
+        return false;
+    }
+}
+
+bool ImageVerifier::verify_metadata_signature(const Botan::X509_Certificate& cert,
+                                              const std::vector<uint8_t>& metadata,
+                                              const std::vector<uint8_t>& timestamp,
+                                              const std::vector<uint8_t>& signature) const {
+    try {
+        if (!rng_) {
+            rng_ = std::make_unique<Botan::AutoSeeded_RNG>();
+        }
+        std::unique_ptr<Botan::Public_Key> pub_key = cert.load_subject_public_key();
+        if (!pub_key || !pub_key->check_key(*rng_, false)) {
+            logger_->setLogEntry(std::make_shared<logger::LogEntry>(
+                config::APP_UPDATE, "Invalid public key", logger::logLevel::ERROR));
+            return false;
+        }
+
+        Botan::PK_Verifier verifier(*pub_key, crypto::SIGNATURE_SCHEME, Botan::IEEE_1363);
+        verifier.update(metadata.data(), metadata.size());
+        verifier.update(timestamp.data(), timestamp.size());
+        return verifier.check_signature(signature);
+    } catch (const Botan::Exception& e) {
+        logger_->setLogEntry(std::make_shared<logger::LogEntry>(
+            config::APP_UPDATE, "Metadata signature verification failed: " + std::string(e.what()),
+            logger::logLevel::ERROR));
+        return false;
     }
 }
 
@@ -449,10 +550,25 @@ applicationUpdate::applicationUpdate(const std::shared_ptr<UBoot::UBoot>& uboot_
     logger->setLogEntry(std::make_shared<logger::LogEntry>(
         config::APP_UPDATE, "applicationUpdate: constructor start", logger::logLevel::DEBUG));
 
-    initialize_from_rauc_config();
+    /* RAUC keyring configuration is read on first verification only,
+     * version queries and rollback do not need it.
+     */
     setup_paths();
 }
 
+CertificateVerifier& applicationUpdate::certificate_verifier() {
+    if (!cert_verifier_) {
+        const auto start = std::chrono::steady_clock::now();
+        initialize_from_rauc_config();
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        logger->setLogEntry(std::make_shared<logger::LogEntry>(
+            config::APP_UPDATE, "RAUC config initialized in " + std::to_string(elapsed.count()) + " us",
+            logger::logLevel::DEBUG));
+    }
+    return *cert_verifier_;
+}
+
 void applicationUpdate::initialize_from_rauc_config() {
     if (!std::filesystem::exists(config::RAUC_SYSTEM_PATH)) {
         logger->setLogEntry(std::make_shared<logger::LogEntry>(
@@ -489,21 +605,25 @@ void applicationUpdate::setup_paths() {
         config::APP_UPDATE, "Paths and verifiers initialized", logger::logLevel::DEBUG));
 }
 
-bool applicationUpdate::verify_application_bundle(applicationImage& application) {
+bool applicationUpdate::verify_application_bundle(applicationImage& application,
+                                                  std::vector<uint8_t>* payload_digest) {
     try {
         logger->setLogEntry(std::make_shared<logger::LogEntry>(
             config::APP_UPDATE, "Starting application bundle verification", logger::logLevel::DEBUG));
 
         // Step 1: Extract and verify certificates
-        std::vector<Botan::X509_Certificate> embedded_certs =
-            cert_verifier_->extract_certificates_from_image(application.getPath());
+        std::vector<Botan::X509_Certificate> embedded_certs;
+        {
+            PhaseTimer timer(Phase::CHAIN_VALIDATION);
+            embedded_certs = certificate_verifier().extract_certificates_from_image(application);
 
-        if (embedded_certs.empty()) {
-            throw std::runtime_error("No certificates found in application image");
-        }
+            if (embedded_certs.empty()) {
+                throw std::runtime_error("No certificates found in application image");
+            }
 
-        if (!cert_verifier_->verify_certificate_chain(embedded_certs)) {
-            throw std::runtime_error("Certificate chain verification failed");
+            if (!certificate_verifier().verify_certificate_chain(embedded_certs)) {
+                throw std::runtime_error("Certificate chain verification failed");
+            }
         }
 
         Botan::X509_Certificate signer_cert = embedded_certs.front();
@@ -525,11 +645,11 @@ bool applicationUpdate::verify_application_bundle(applicationImage& application)
             throw std::runtime_error("Header verification failed");
         }
 
-        // Step 4: Verify content signature
+        // Step 4: Verify content signature or signed chunk manifest
         std::vector<uint8_t> timestamp = application.getTimestamp();
-        std::vector<uint8_t> signature = application.getSignature();
 
-        if (!image_verifier_->verify_signature(signer_cert, application, squashfs_size, timestamp, signature)) {
+        PhaseTimer timer(Phase::SIGNATURE_VERIFICATION, squashfs_size);
+        if (!verify_payload(application, signer_cert, squashfs_size, timestamp, payload_digest)) {
             throw std::runtime_error("Signature verification failed");
         }
 
@@ -546,6 +666,41 @@ bool applicationUpdate::verify_application_bundle(applicationImage& application)
     }
 }
 
+bool applicationUpdate::verify_payload(applicationImage& application,
+                                       const Botan::X509_Certificate& signer_cert,
+                                       uint64_t squashfs_size,
+                                       const std::vector<uint8_t>& timestamp,
+                                       std::vector<uint8_t>* payload_digest) {
+    chunk_manifest_.reset();
+    delta_.reset();
+    chunk_index_.reset();
+
+    const std::vector<uint8_t> metadata = application.getSection(ImageSection::METADATA);
+    if (!metadata.empty()) {
+        const std::vector<uint8_t> metadata_signature = application.getSection(ImageSection::METADATA_SIGNATURE);
+        if (metadata_signature.empty()) {
+            throw std::runtime_error("Metadata section without signature");
+        }
+        if (!image_verifier_->verify_metadata_signature(signer_cert, metadata, timestamp, metadata_signature)) {
+            throw std::runtime_error("Metadata signature verification failed");
+        }
+
+        read_install_records(ImageMetadata::parse(metadata), squashfs_size);
+        if (chunk_manifest_) {
+            /* signed manifest replaces the sequential signature over the payload */
+            if (!chunk_manifest_->verify_file(application.getPath(), application.getPayloadOffset(), logger)) {
+                chunk_manifest_.reset();
+                return false;
+            }
+            return true;
+        }
+    }
+
+    std::vector<uint8_t> signature = application.getSignature();
+    return image_verifier_->verify_signature(signer_cert, application, squashfs_size, timestamp, signature,
+                                             payload_digest);
+}
+
 void applicationUpdate::install(const std::string& path_to_bundle) {
     try {
         char current_app = get_current_application();
@@ -559,11 +714,38 @@ void applicationUpdate::install(const std::string& path_to_bundle) {
 
         applicationImage application(path_to_bundle, logger);
 
-        if (!verify_application_bundle(application)) {
+        std::vector<uint8_t> payload_digest;
+        const bool preverified = lookup_verification_record(application, payload_digest);
+        if (preverified) {
+            /* metadata signature was checked by verify_only(), the record binds its digest */
+            chunk_manifest_.reset();
+            delta_.reset();
+            chunk_index_.reset();
+            const std::vector<uint8_t> metadata = application.getSection(ImageSection::METADATA);
+            if (!metadata.empty()) {
+                read_install_records(ImageMetadata::parse(metadata),
+                                     application.getSectionLocation(ImageSection::PAYLOAD).length);
+            }
+            logger->setLogEntry(std::make_shared<logger::LogEntry>(
+                config::APP_UPDATE, "Using verification record of " + path_to_bundle,
+                logger::logLevel::DEBUG));
+        } else if (!verify_application_bundle(application)) {
             throw std::runtime_error("Application bundle verification failed");
         }
 
-        perform_installation(path_to_bundle);
+        /* a retried rollout may bring the image already in the inactive slot */
+        const std::vector<uint8_t>* verified_digest = payload_digest.empty() ? nullptr : &payload_digest;
+        const std::vector<uint8_t> image_digest = incoming_image_digest(application, target_path, verified_digest);
+        if (!image_digest.empty() && SlotDigestIndex(application_image_path_, logger).matches(target_path, image_digest)) {
+            logger->setLogEntry(std::make_shared<logger::LogEntry>(
+                config::APP_UPDATE, "Image identical to " + target_path + ", switching slot only",
+                logger::logLevel::DEBUG));
+        } else {
+            /* the recorded digest is checked while copying, also if the slot differs in size */
+            perform_installation(path_to_bundle, verified_digest != nullptr ? verified_digest
+                                                 : image_digest.empty() ? nullptr : &image_digest);
+        }
+        VerificationRecord::remove(path_to_bundle);
         update_boot_variable(current_app);
 
         /* Write 'application' env. to bootloader env.
@@ -583,24 +765,180 @@ void applicationUpdate::install(const std::string& path_to_bundle) {
     }
 }
 
-void applicationUpdate::perform_installation(const std::string& source_path) {
-    // Remove temporary file if it exists
-    std::filesystem::remove(tmp_app_path_);
+void applicationUpdate::verify_only(const std::string& path_to_bundle) {
+    const auto start = std::chrono::steady_clock::now();
+    applicationImage application(path_to_bundle, logger);
 
-    // Copy to temporary location
-    applicationImage application(source_path, logger);
-    application.copyImage(tmp_app_path_.string());
+    /* digest of the payload from the signature check, checked again while it
+     * is copied at installation; chunk manifest images are checked per chunk */
+    std::vector<uint8_t> payload_digest;
+    if (!verify_application_bundle(application, &payload_digest)) {
+        throw std::runtime_error("Application bundle verification failed");
+    }
+
+    std::vector<uint8_t> record = signed_metadata_digest(application);
+    record.insert(record.end(), payload_digest.begin(), payload_digest.end());
+    VerificationRecord::store(path_to_bundle, record, certificate_verifier().keyring_path(), logger);
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    logger->setLogEntry(std::make_shared<logger::LogEntry>(
+        config::APP_UPDATE, "Verified " + path_to_bundle + " in " + std::to_string(elapsed.count()) + " ms",
+        logger::logLevel::DEBUG));
+}
+
+std::vector<uint8_t> applicationUpdate::signed_metadata_digest(applicationImage& application) const {
+    const std::vector<uint8_t> metadata = application.getSection(ImageSection::METADATA);
+    const std::vector<uint8_t> signature = application.getSection(ImageSection::METADATA_SIGNATURE);
+    uint8_t length[8];
+    for (int i = 0; i < 8; ++i) {
+        length[i] = static_cast<uint8_t>(uint64_t(metadata.size()) >> (56 - 8 * i));
+    }
+    std::unique_ptr<HashEngine> hash = HashEngine::create(crypto::HASH_ALGORITHM, logger);
+    hash->update(length, sizeof(length));
+    hash->update(metadata.data(), metadata.size());
+    hash->update(signature.data(), signature.size());
+    return hash->final();
+}
+
+bool applicationUpdate::lookup_verification_record(applicationImage& application,
+                                                   std::vector<uint8_t>& payload_digest) {
+    std::vector<uint8_t> record;
+    if (!VerificationRecord::lookup(application.getPath(), certificate_verifier().keyring_path(), record, logger)) {
+        return false;
+    }
+
+    /* metadata the records below are read from must be the verified one */
+    const std::vector<uint8_t> metadata_digest = signed_metadata_digest(application);
+    if (record.size() < metadata_digest.size() ||
+        !std::equal(metadata_digest.begin(), metadata_digest.end(), record.begin())) {
+        logger->setLogEntry(std::make_shared<logger::LogEntry>(
+            config::APP_UPDATE, "Verification record of " + application.getPath() + " does not match its metadata",
+            logger::logLevel::WARNING));
+        return false;
+    }
+    payload_digest.assign(record.begin() + static_cast<std::ptrdiff_t>(metadata_digest.size()), record.end());
+    return true;
+}
+
+void applicationUpdate::read_install_records(const ImageMetadata& records, uint64_t payload_size) {
+    if (records.has(MetadataType::CHUNK_MANIFEST)) {
+        auto manifest = std::make_unique<ChunkManifest>(
+            ChunkManifest::parse(records.get(MetadataType::CHUNK_MANIFEST)));
+        if (manifest->payload_size() != payload_size) {
+            throw std::runtime_error("Chunk manifest does not match payload size");
+        }
+        chunk_manifest_ = std::move(manifest);
+    }
+
+    if (records.has(MetadataType::DELTA)) {
+        if (!DeltaPatch::supported()) {
+            throw DeltaPatchInvalid("not supported by this build");
+        }
+        if (records.has(MetadataType::CHUNK_INDEX)) {
+            throw DeltaPatchInvalid("delta image with chunk index");
+        }
+        delta_ = std::make_unique<DeltaDescriptor>(DeltaDescriptor::parse(records.get(MetadataType::DELTA)));
+    }
+
+    if (records.has(MetadataType::CHUNK_INDEX)) {
+        auto index = std::make_unique<ChunkIndex>(ChunkIndex::parse(records.get(MetadataType::CHUNK_INDEX)));
+        if (index->image_size() != payload_size) {
+            throw std::runtime_error("Chunk index does not match payload size");
+        }
+        chunk_index_ = std::move(index);
+    }
+}
+
+std::vector<uint8_t> applicationUpdate::incoming_image_digest(applicationImage& application,
+                                                             const std::string& slot_path,
+                                                             const std::vector<uint8_t>* payload_digest) {
+    std::error_code ec;
+    const uint64_t slot_size = std::filesystem::file_size(slot_path, ec);
+    if (ec) {
+        return {};
+    }
 
+    if (delta_) {
+        return delta_->target_size == slot_size ? delta_->target_digest : std::vector<uint8_t>();
+    }
+
+    /* images of different size differ, no need to hash */
+    const applicationImage::Section payload = application.getSectionLocation(ImageSection::PAYLOAD);
+    if (payload.length != slot_size) {
+        return {};
+    }
+    if (payload_digest != nullptr) {
+        return *payload_digest;
+    }
+
+    int fd = ::open(application.getPath().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return {};
+    }
+    std::unique_ptr<int, void (*)(int*)> fd_guard(&fd, [](int* f) { ::close(*f); });
+    std::unique_ptr<HashEngine> hash = HashEngine::create(crypto::HASH_ALGORITHM, logger);
+    hash->update_from_fd(fd, payload.offset, payload.length);
+    return hash->final();
+}
+
+void applicationUpdate::perform_installation(const std::string& source_path,
+                                             const std::vector<uint8_t>* payload_digest) {
+    // A temporary file left by an interrupted copy is resumed or truncated by the writers
+    applicationImage application(source_path, logger);
     char current_app = get_current_application();
     std::string target_path = application_image_path_;
     target_path += (current_app == 'A') ? "app_b.squashfs" : "app_a.squashfs";
 
-    // Atomic rename to final location
-    std::filesystem::rename(tmp_app_path_, target_path);
+    std::string active_path = application_image_path_;
+    active_path += (current_app == 'A') ? "app_a.squashfs" : "app_b.squashfs";
+
+    {
+        /* delta and chunk assembly replace the copy */
+        PhaseTimer copy_timer(Phase::COPY, delta_ ? delta_->target_size
+                                                  : application.getSectionLocation(ImageSection::PAYLOAD).length);
+        if (delta_) {
+            // Patch the active image into the temporary location, the result is checked against the signed target digest
+            const applicationImage::Section patch = application.getSectionLocation(ImageSection::PAYLOAD);
+            try {
+                DeltaPatch::apply(*delta_, active_path, source_path, patch.offset, patch.length,
+                                  tmp_app_path_.string(), logger);
+            } catch (...) {
+                std::filesystem::remove(tmp_app_path_);
+                throw;
+            }
+        } else if (chunk_index_) {
+            // Chunks of the active image are copied locally, the others from the bundle
+            try {
+                chunk_index_->assemble(active_path, source_path, application.getPayloadOffset(),
+                                       tmp_app_path_.string(), logger);
+            } catch (...) {
+                std::filesystem::remove(tmp_app_path_);
+                throw;
+            }
+        } else {
+            // Copy to temporary location, chunks are checked again while copying
+            application.copyImage(tmp_app_path_.string(), chunk_manifest_.get(), payload_digest);
+        }
+
+        // Atomic rename to final location
+        std::filesystem::rename(tmp_app_path_, target_path);
+    }
+
+    /* checked content digest, the chunk index path is checked per chunk only */
+    SlotDigestIndex slots(application_image_path_, logger);
+    if (delta_) {
+        slots.record(target_path, delta_->target_digest);
+    } else if (payload_digest != nullptr && !chunk_index_) {
+        slots.record(target_path, *payload_digest);
+    } else {
+        slots.forget(target_path);
+    }
 
     // fsync directory
     int dir_fd = open(application_image_path_.c_str(), O_DIRECTORY | O_RDONLY);
     if (dir_fd >= 0) {
+        PhaseTimer timer(Phase::FSYNC);
         fsync(dir_fd);
         close(dir_fd);
     }
@@ -6,6 +6,13 @@
 #include "../uboot_interface/UBoot.h"
 #include "updateBase.h"
 #include "applicationImage.h"
+#include "certificateCache.h"
+#include "chunkManifest.h"
+#include "chunkIndex.h"
+#include "deltaPatch.h"
+#include "slotDigestIndex.h"
+#include "imageMetadata.h"
+#include "verificationRecord.h"
 #include "../logger/LoggerHandler.h"
 #include "../logger/LoggerEntry.h"
 #include "./../BaseException.h"
@@ -15,6 +22,7 @@
 #include <vector>
 #include <cstdint>
 #include <botan/x509cert.h>
+#include <botan/auto_rng.h>
 
 // Configuration constants
 namespace updater::config {
@@ -30,6 +38,13 @@ namespace updater::config {
     constexpr std::size_t CHUNK_SIZE = 4096;
     constexpr uint32_t CRC32_POLYNOMIAL = 0xEDB88320;
     constexpr uint32_t CRC32_INITIAL = 0xFFFFFFFF;
+    // Read size of the payload when hashed for signature and record together
+    constexpr std::size_t PAYLOAD_READ_SIZE = 256 * 1024;
+
+    // Certificate extraction limits
+    constexpr std::size_t MAX_CERTIFICATE_REGION = 256 * 1024;
+    constexpr std::size_t MAX_CERTIFICATE_SIZE = 32 * 1024;
+    constexpr std::size_t MAX_CERTIFICATES = 8;
 }
 
 namespace updater {
@@ -39,15 +54,20 @@ namespace updater {
     class ImageVerifier;
     class HeaderParser;
 
+    // Statistics of the last certificate extraction
+    struct VerificationStatistics {
+        size_t certificates = 0;
+        uint64_t certificate_bytes_scanned = 0;
+        // Peak memory held for certificate data
+        size_t certificate_peak_buffer = 0;
+    };
+
     // Separate certificate verification class
     class CertificateVerifier {
     private:
         std::string keyring_path_;
         std::shared_ptr<logger::LoggerHandler> logger_;
-
-        // Cache for loaded certificates
-        mutable std::vector<Botan::X509_Certificate> trusted_certs_cache_;
-        mutable bool cache_valid_ = false;
+        VerificationStatistics stats_;
 
     public:
         explicit CertificateVerifier(const std::string& keyring_path,
@@ -55,21 +75,28 @@ namespace updater {
 
         // Main verification methods
         bool verify_certificate_chain(const std::vector<Botan::X509_Certificate>& chain);
+        // v1: PEM certificates behind squashfs content
         std::vector<Botan::X509_Certificate> extract_certificates_from_image(
             const std::filesystem::path& image_path);
+        // v1 or v2 (DER certificate section located through trailer)
+        std::vector<Botan::X509_Certificate> extract_certificates_from_image(
+            applicationImage& application);
+
+        const VerificationStatistics& statistics() const { return stats_; }
+        const std::string& keyring_path() const { return keyring_path_; }
 
     private:
-        // Certificate loading and validation
-        std::vector<Botan::X509_Certificate> load_trusted_certificates() const;
+        // Certificate loading and validation, shared process-wide by KeyringCache
+        std::shared_ptr<const TrustedKeyring> load_trusted_certificates() const;
         bool validate_certificate_chain(
             const Botan::X509_Certificate& leaf,
             const std::vector<Botan::X509_Certificate>& intermediates,
-            const std::vector<Botan::X509_Certificate>& trusted_certs) const;
+            const TrustedKeyring& keyring) const;
 
         // Utility methods
         void log_certificate_info(const Botan::X509_Certificate& cert,
                                  const std::string& context) const;
-        void clear_cache() const { cache_valid_ = false; trusted_certs_cache_.clear(); }
+        static uint32_t parse_uint32_be(const uint8_t* data);
     };
 
     // Separate image verification class
@@ -77,6 +104,9 @@ namespace updater {
     private:
         std::shared_ptr<logger::LoggerHandler> logger_;
 
+        // Seeded on first signature check and reused afterwards
+        mutable std::unique_ptr<Botan::AutoSeeded_RNG> rng_;
+
     public:
         explicit ImageVerifier(std::shared_ptr<logger::LoggerHandler> logger);
 
@@ -84,12 +114,19 @@ namespace updater {
         bool verify_header(const std::vector<uint8_t>& header_data, uint64_t& size,
                           uint32_t& version, uint32_t& crc) const;
 
-        // Signature verification
+        // Signature verification, optionally SHA-256 of the payload from the same read
         bool verify_signature(const Botan::X509_Certificate& cert,
                             applicationImage& application,
                             uint64_t squashfs_size,
                             const std::vector<uint8_t>& timestamp,
-                            const std::vector<uint8_t>& signature) const;
+                            const std::vector<uint8_t>& signature,
+                            std::vector<uint8_t>* payload_digest = nullptr) const;
+
+        // Metadata signature verification (covers metadata + timestamp)
+        bool verify_metadata_signature(const Botan::X509_Certificate& cert,
+                                       const std::vector<uint8_t>& metadata,
+                                       const std::vector<uint8_t>& timestamp,
+                                       const std::vector<uint8_t>& signature) const;
 
     private:
         // CRC calculation
@@ -109,7 +146,8 @@ namespace updater {
             uint32_t crc;
 
             bool is_valid() const {
-                return squashfs_size > 0 && version > 0;
+                return squashfs_size > 0 &&
+                       (version == APP_IMAGE_VERSION_1 || version == APP_IMAGE_VERSION_2);
             }
         };
 
@@ -124,6 +162,12 @@ namespace updater {
         // Core components
         std::unique_ptr<CertificateVerifier> cert_verifier_;
         std::unique_ptr<ImageVerifier> image_verifier_;
+        // Signed chunk manifest of the bundle being installed, if present
+        std::unique_ptr<ChunkManifest> chunk_manifest_;
+        // Signed delta record, if the payload is a patch against the active image
+        std::unique_ptr<DeltaDescriptor> delta_;
+        // Signed chunk index, chunks of the active image are reused on installation
+        std::unique_ptr<ChunkIndex> chunk_index_;
 
         // Paths
         std::string application_image_path_;
@@ -134,6 +178,9 @@ namespace updater {
         void initialize_from_rauc_config();
         void setup_paths();
 
+        // Reads the RAUC keyring configuration on first use
+        CertificateVerifier& certificate_verifier();
+
     public:
         // Constructor/Destructor
         applicationUpdate(const std::shared_ptr<UBoot::UBoot>& uboot_ptr,
@@ -147,7 +194,17 @@ namespace updater {
         applicationUpdate& operator=(applicationUpdate&&) = delete;
 
         // Public interface
+        /**
+         * Install application image. Verification is skipped if verify_only()
+         * left a record that still matches the file; the payload is then
+         * checked against the recorded digest while it is copied.
+         */
         void install(const std::string& path_to_bundle) override;
+        /**
+         * Run all checks of install() and store a verification record.
+         * @throw std::runtime_error Verification failed.
+         */
+        void verify_only(const std::string& path_to_bundle);
         void rollback() override;
         version_t getCurrentVersion() override;
 
@@ -156,10 +213,30 @@ namespace updater {
 
     private:
         // Core verification logic
-        bool verify_application_bundle(applicationImage& application);
+        // payload_digest receives SHA-256 of the payload if it was read as a whole, else stays empty
+        bool verify_application_bundle(applicationImage& application,
+                                       std::vector<uint8_t>* payload_digest = nullptr);
+        bool verify_payload(applicationImage& application,
+                            const Botan::X509_Certificate& signer_cert,
+                            uint64_t squashfs_size,
+                            const std::vector<uint8_t>& timestamp,
+                            std::vector<uint8_t>* payload_digest);
+        // Chunk manifest, delta and chunk index records of verified metadata section
+        void read_install_records(const ImageMetadata& records, uint64_t payload_size);
+
+        // SHA-256 over metadata and metadata signature sections, first part of the verification record
+        std::vector<uint8_t> signed_metadata_digest(applicationImage& application) const;
+        // Payload digest of a verification record matching file and metadata, may be empty
+        bool lookup_verification_record(applicationImage& application, std::vector<uint8_t>& payload_digest);
+
+        // SHA-256 of the image to install if it may equal the slot image, else empty
+        std::vector<uint8_t> incoming_image_digest(applicationImage& application,
+                                                   const std::string& slot_path,
+                                                   const std::vector<uint8_t>* payload_digest);
 
         // Installation helpers
-        void perform_installation(const std::string& source_path);
+        void perform_installation(const std::string& source_path,
+                                  const std::vector<uint8_t>* payload_digest = nullptr);
         void update_boot_variable(char current_app);
         char get_current_application() const;
     };
@@ -1,13 +1,101 @@
 #include <fus_updater_lib/config.h>
 #include "updateFirmware.h"
+#include "updateApplication.h"
+#include "updateMetrics.h"
 #include "utils.h"
-#include "../subprocess/subprocess.h"
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/ini_parser.hpp>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
+#include <sstream>
+
+extern "C" {
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+}
+
+namespace {
+    /**
+     * Devices of the U-Boot environment, RAUC switches the boot order there.
+     */
+    std::vector<std::string> uboot_env_devices()
+    {
+        std::vector<std::string> devices;
+        std::ifstream config(UBOOT_CONFIG_PATH);
+        std::string line;
+        while (std::getline(config, line))
+        {
+            std::istringstream fields(line);
+            std::string device;
+            if ((fields >> device) && device[0] != '#')
+            {
+                devices.push_back(device);
+            }
+        }
+        return devices;
+    }
+
+    /**
+     * Devices of RAUC slots as configured in system.conf.
+     * @return Device of every slot that has one.
+     */
+    std::vector<std::string> slot_devices(const std::vector<std::string> &slots)
+    {
+        std::vector<std::string> devices;
+        boost::property_tree::ptree rauc_config;
+        try
+        {
+            boost::property_tree::ini_parser::read_ini(updater::config::RAUC_SYSTEM_PATH, rauc_config);
+        }
+        catch (const boost::property_tree::ptree_error &)
+        {
+            return devices;
+        }
+        /* sections are named slot.<name>, iterate since a ptree path would split the name */
+        for (const auto &section : rauc_config)
+        {
+            if (section.first.compare(0, 5, "slot.") != 0 ||
+                std::find(slots.begin(), slots.end(), section.first.substr(5)) == slots.end())
+            {
+                continue;
+            }
+            const std::string device = section.second.get<std::string>("device", std::string());
+            if (!device.empty())
+            {
+                devices.push_back(device);
+            }
+        }
+        return devices;
+    }
+
+    /**
+     * Flush a written slot or environment device.
+     * @return false if the device can not be opened, true else.
+     */
+    bool flush_device(const std::string &device)
+    {
+        int fd = ::open(device.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        std::unique_ptr<int, void (*)(int *)> fd_guard(&fd, [](int *f) { ::close(*f); });
+        /* mtd character devices write synchronously and have no fsync */
+        if (::fsync(fd) != 0 && errno != EINVAL && errno != EROFS)
+        {
+            throw updater::FirmwareUpdateInstall("fsync of " + device + " fails: " + std::strerror(errno));
+        }
+        return true;
+    }
+
+}
 
 updater::firmwareUpdate::firmwareUpdate(const std::shared_ptr<UBoot::UBoot> &ptr, const std::shared_ptr<logger::LoggerHandler> &logger):
-    updateBase(ptr, logger),
-    system_installer(ptr, logger)
+    updateBase(ptr, logger)
 {
 
     this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FIRMWARE_UPDATE, "firmwareUpdate: constructor", logger::logLevel::DEBUG));
@@ -40,10 +128,15 @@ updater::firmwareUpdate::~firmwareUpdate()
  */
 void updater::firmwareUpdate::install(const std::string & path_to_bundle)
 {
+    std::vector<std::string> slots;
     try
     {
         this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FIRMWARE_UPDATE, std::string("install: firmware update: ") + path_to_bundle, logger::logLevel::DEBUG));
-        this->system_installer.installBundle(path_to_bundle);
+        rauc::rauc_handler system_installer(this->uboot_handler, this->logger);
+        std::error_code ec;
+        const uintmax_t bundle_size = std::filesystem::file_size(path_to_bundle, ec);
+        updater::PhaseTimer timer(updater::Phase::RAUC_INSTALL, ec ? 0 : bundle_size);
+        slots = system_installer.installBundle(path_to_bundle);
     }
     catch(rauc::RaucBaseException & err)
     {
@@ -51,15 +144,38 @@ void updater::firmwareUpdate::install(const std::string & path_to_bundle)
         throw(FirmwareUpdateInstall(std::string(err.what())));
     }
 
-    /* lets call sync to be sure data write back */
-    std::string command = std::string("sync");
-    subprocess::Popen handler = subprocess::Popen(command);
+    /* be sure data is written back */
+    this->syncInstalledSlots(slots);
+}
+
+void updater::firmwareUpdate::syncInstalledSlots(const std::vector<std::string> &slots)
+{
+    const auto start = std::chrono::steady_clock::now();
+    /* RAUC unmounts slots it mounted for writing, the devices hold all data */
+    const std::vector<std::string> devices = slot_devices(slots);
+
+    updater::PhaseTimer timer(updater::Phase::FSYNC);
+    bool flushed = !slots.empty() && devices.size() == slots.size();
+    for (const std::string &device : devices)
+    {
+        flushed = flush_device(device) && flushed;
+    }
+    for (const std::string &device : uboot_env_devices())
+    {
+        flush_device(device);
+    }
 
-    if (handler.successful() == false)
+    std::string scope = std::to_string(devices.size()) + " slot device(s)";
+    if (!flushed)
     {
-        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FIRMWARE_UPDATE, std::string("Command sync: execution fails: ") + handler.output(), logger::logLevel::ERROR));
-        throw(FirmwareUpdateInstall(std::string("Sync of firmware update fails.")));
+        /* written slots unknown, fall back to all file systems */
+        ::sync();
+        scope = "all file systems";
     }
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FIRMWARE_UPDATE,
+        "syncInstalledSlots: flushed " + scope + " in " + std::to_string(elapsed.count()) + " ms", logger::logLevel::DEBUG));
 }
 
 void updater::firmwareUpdate::rollback()
@@ -67,7 +183,8 @@ void updater::firmwareUpdate::rollback()
     try
     {
         this->logger->setLogEntry(std::make_shared<logger::LogEntry>(FIRMWARE_UPDATE, "rollback: rollback", logger::logLevel::DEBUG));
-        this->system_installer.rollback();
+        rauc::rauc_handler system_installer(this->uboot_handler, this->logger);
+        system_installer.rollback();
     }
     catch(const rauc::RaucBaseException & err)
     {
@@ -141,8 +258,12 @@ version_t updater::firmwareUpdate::getCurrentVersion()
 
 bool updater::firmwareUpdate::failedUpdateReboot()
 {
-    const Json::Value ret_value = this->system_installer.getStatus();
-    const std::string booted_slot = ret_value["booted"].asString();
+    rauc::system_status status;
+    {
+        rauc::rauc_handler system_installer(this->uboot_handler, this->logger);
+        status = system_installer.getSystemStatus();
+    }
+    const std::string booted_slot = status.booted;
     std::string updated_slot;
 
     if (booted_slot == "A")
@@ -159,20 +280,17 @@ bool updater::firmwareUpdate::failedUpdateReboot()
         throw(WrongVariableContent(booted_slot));
     }
 
-    for (auto & slot: ret_value["slots"])
+    for (const rauc::slot_status & slot: status.slots)
     {
-        for (auto & entry: slot)
+        if (slot.bootname == updated_slot)
         {
-            if (entry["bootname"] == updated_slot)
+            if (slot.boot_status == "bad")
+            {
+                return true;
+            }
+            else
             {
-                if (entry["boot_status"] == "bad")
-                {
-                    return true;
-                }
-                else
-                {
-                    return false;
-                }
+                return false;
             }
         }
     }
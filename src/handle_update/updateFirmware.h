@@ -19,6 +19,7 @@
 #include <string>
 #include <memory>
 #include <fstream>
+#include <vector>
 
 inline constexpr const char* PATH_TO_FIRMWARE_VERSION_FILE = "/etc/fw_version";
 constexpr char FIRMWARE_UPDATE[] = "firmware update";
@@ -102,12 +103,22 @@ namespace updater
     class firmwareUpdate : public updateBase
     {
         private:
-            rauc::rauc_handler system_installer;
+            /**
+             * Flush the slots written by RAUC and the U-Boot environment,
+             * instead of every mounted file system. Devices are taken from
+             * system.conf. Falls back to sync() if a slot device is unknown
+             * or can not be opened. Duration is logged.
+             * @param slots Names of the slots reported by installBundle.
+             * @throw FirmwareUpdateInstall Flushing a device fails.
+             */
+            void syncInstalledSlots(const std::vector<std::string> &slots);
 
         public:
 
             /**
              * Create firmware update object. Use reference from UBoot and Loggerhandler object.
+             * The RAUC handler is created per operation only, so constructing this object
+             * has no side effects on the UBoot-Environment memory.
              * @param ptr UBoot::UBoot reference.
              * @param logger logger::LoggerHandler reference.
              */
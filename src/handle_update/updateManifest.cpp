@@ -0,0 +1,165 @@
+#include "updateManifest.h"
+#include "jsonReader.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace updater {
+
+namespace {
+    /* 32 byte digests, SHA-256 and BLAKE3 */
+    constexpr size_t DIGEST_HEX_SIZE = 64;
+
+    std::string hex_digest(json::Reader& reader, std::string_view name) {
+        if (reader.peek() != json::Type::STRING) {
+            throw ManifestInvalid(std::string(name) + " is no string");
+        }
+        std::string digest(reader.string_value());
+        if (digest.size() != DIGEST_HEX_SIZE ||
+            !std::all_of(digest.begin(), digest.end(), [](unsigned char c) { return std::isxdigit(c); })) {
+            throw ManifestInvalid(std::string(name) + " is no 32 byte hex digest");
+        }
+        /* producers differ in case */
+        std::transform(digest.begin(), digest.end(), digest.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return digest;
+    }
+
+    std::string string_member(json::Reader& reader, std::string_view name) {
+        if (reader.peek() != json::Type::STRING) {
+            throw ManifestInvalid(std::string(name) + " is no string");
+        }
+        return std::string(reader.string_value());
+    }
+
+    UpdateManifest::Image parse_image(json::Reader& reader) {
+        if (reader.peek() != json::Type::OBJECT) {
+            throw ManifestInvalid("update entry is no object");
+        }
+        UpdateManifest::Image image;
+        bool has_version = false, has_handler = false, has_file = false, has_hashes = false;
+        std::string sha256, blake3;
+
+        reader.begin_object();
+        std::string_view key;
+        while (reader.next_member(key)) {
+            if (key == "version") {
+                /* numbers are accepted as written */
+                image.version = (reader.peek() == json::Type::NUMBER) ? std::string(reader.number_text())
+                                                                      : string_member(reader, "version");
+                has_version = true;
+            } else if (key == "handler") {
+                image.handler = string_member(reader, "handler");
+                has_handler = true;
+            } else if (key == "file") {
+                image.file = string_member(reader, "file");
+                has_file = true;
+            } else if (key == "size") {
+                if (reader.peek() != json::Type::NUMBER) {
+                    throw ManifestInvalid("size is no number");
+                }
+                image.size = reader.uint_value();
+            } else if (key == "hashes") {
+                if (reader.peek() != json::Type::OBJECT) {
+                    throw ManifestInvalid("hashes is no object");
+                }
+                reader.begin_object();
+                std::string_view algorithm;
+                while (reader.next_member(algorithm)) {
+                    if (algorithm == "sha256") {
+                        sha256 = hex_digest(reader, "sha256");
+                    } else if (algorithm == "blake3") {
+                        blake3 = hex_digest(reader, "blake3");
+                    } else {
+                        reader.skip();
+                    }
+                }
+                has_hashes = true;
+            } else {
+                reader.skip();
+            }
+        }
+
+        if (!has_version || !has_handler || !has_file || !has_hashes) {
+            throw ManifestInvalid("required fields version, handler, file or hashes missing");
+        }
+        if (image.file.empty()) {
+            throw ManifestInvalid("file is empty");
+        }
+        /* prefer blake3 if the producer provides it, sha256 stays the default */
+        if (!blake3.empty()) {
+            image.algorithm = "BLAKE3";
+            image.digest = std::move(blake3);
+        } else if (!sha256.empty()) {
+            image.algorithm = "SHA-256";
+            image.digest = std::move(sha256);
+        } else {
+            throw ManifestInvalid("no sha256 or blake3 hash for " + image.file);
+        }
+        return image;
+    }
+}
+
+UpdateManifest UpdateManifest::parse(std::string_view text) {
+    UpdateManifest manifest;
+    try {
+        json::Reader reader(text);
+        bool has_images = false;
+
+        if (reader.peek() != json::Type::OBJECT) {
+            throw ManifestInvalid("document is no object");
+        }
+        reader.begin_object();
+        std::string_view key;
+        while (reader.next_member(key)) {
+            if (key != "images") {
+                reader.skip();
+                continue;
+            }
+            if (reader.peek() != json::Type::OBJECT) {
+                throw ManifestInvalid("images is no object");
+            }
+            has_images = true;
+            reader.begin_object();
+            while (reader.next_member(key)) {
+                if (key != "updates") {
+                    reader.skip();
+                    continue;
+                }
+                if (reader.peek() != json::Type::ARRAY) {
+                    throw ManifestInvalid("updates is no array");
+                }
+                reader.begin_array();
+                while (reader.next_element()) {
+                    Image image = parse_image(reader);
+                    if (manifest.find(image.file)) {
+                        throw ManifestInvalid("image " + image.file + " listed twice");
+                    }
+                    manifest.images.push_back(std::move(image));
+                }
+            }
+        }
+        reader.finish();
+
+        if (!has_images) {
+            throw ManifestInvalid("node images missing");
+        }
+        if (manifest.images.empty()) {
+            throw ManifestInvalid("node updates is not available or empty");
+        }
+    } catch (const json::JsonInvalid& ex) {
+        throw ManifestInvalid(ex.what());
+    }
+    return manifest;
+}
+
+const UpdateManifest::Image* UpdateManifest::find(const std::string& file) const {
+    for (const Image& image : images) {
+        if (image.file == file) {
+            return &image;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace updater
@@ -0,0 +1,64 @@
+/**
+ * Typed content of fsupdate.json.
+ *
+ * The manifest is parsed and checked against its schema in one pass, so the
+ * rest of the updater works with validated fields instead of looking them up
+ * in a JSON tree. Unknown members are ignored, newer producers stay
+ * compatible with older devices.
+ */
+
+#pragma once
+
+#include "./../BaseException.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace updater {
+
+    class ManifestInvalid : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * fsupdate.json is no valid JSON or does not match the schema.
+         * @param msg Reason of rejection.
+         */
+        explicit ManifestInvalid(const std::string& msg) {
+            this->error_msg = std::string("Invalid fsupdate.json: ") + msg;
+        }
+    };
+
+    struct UpdateManifest {
+        struct Image {
+            std::string version;
+            std::string handler;
+            std::string file;
+            /* "BLAKE3" if the producer provides it, else "SHA-256" */
+            std::string algorithm;
+            /* lower case hex */
+            std::string digest;
+            /* extracted size, if announced */
+            std::optional<uint64_t> size;
+        };
+
+        std::vector<Image> images;
+
+        /**
+         * Parse and validate manifest.
+         * Schema: {"images": {"updates": [{"version", "handler", "file",
+         * "hashes": {"sha256" and/or "blake3"}, optional "size"}, ...]}}
+         * @param text Content of fsupdate.json.
+         * @return Manifest with at least one image.
+         * @throw ManifestInvalid
+         */
+        static UpdateManifest parse(std::string_view text);
+
+        /**
+         * @return Image with file name, nullptr if missing.
+         */
+        const Image* find(const std::string& file) const;
+    };
+
+} // namespace updater
@@ -0,0 +1,288 @@
+#include "updateMetrics.h"
+#include "writeEngine.h"
+
+#include <json/json.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+
+extern "C" {
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <stdlib.h>
+    #include <sys/resource.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+}
+
+namespace updater {
+
+namespace {
+    constexpr const char* PHASE_NAMES[PHASE_COUNT] = {
+        "header_parse",
+        "extract",
+        "manifest_hash",
+        "chain_validation",
+        "signature_verification",
+        "copy",
+        "fsync",
+        "rauc_install",
+        "env_flush"
+    };
+
+    /* phases of the running operation, shared by all threads */
+    struct Recorder {
+        std::atomic<bool> active{false};
+        std::mutex mutex;
+        std::array<PhaseMetrics, PHASE_COUNT> phases{};
+    };
+
+    Recorder& recorder() {
+        static Recorder instance;
+        return instance;
+    }
+
+    uint64_t microseconds_since(std::chrono::steady_clock::time_point start) {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    /* VmHWM, ru_maxrss without /proc. The mark is not reset, it belongs to
+     * the host process and may be watched by others. */
+    uint64_t peak_rss() {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, 6, "VmHWM:") == 0) {
+                return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+            }
+        }
+        struct rusage usage;
+        if (::getrusage(RUSAGE_SELF, &usage) == 0) {
+            return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+        }
+        return 0;
+    }
+
+    std::string seconds(uint64_t microseconds) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(6) << static_cast<double>(microseconds) / 1e6;
+        return out.str();
+    }
+
+    std::string number(double value) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(0) << value;
+        return out.str();
+    }
+
+    void gauge(std::string& out, const char* name, const char* help) {
+        out += std::string("# HELP ") + name + " " + help + "\n";
+        out += std::string("# TYPE ") + name + " gauge\n";
+    }
+}
+
+double PhaseMetrics::throughput() const {
+    if (bytes == 0 || duration_us == 0) {
+        return 0;
+    }
+    return static_cast<double>(bytes) * 1e6 / static_cast<double>(duration_us);
+}
+
+const PhaseMetrics& UpdateMetrics::phase(Phase phase) const {
+    return phases[static_cast<size_t>(phase)];
+}
+
+const char* UpdateMetrics::phase_name(Phase phase) {
+    return PHASE_NAMES[static_cast<size_t>(phase)];
+}
+
+std::string UpdateMetrics::to_json() const {
+    Json::Value root(Json::objectValue);
+    root["operation"] = operation;
+    root["succeeded"] = succeeded;
+    root["started"] = static_cast<Json::Int64>(started);
+    root["duration_us"] = static_cast<Json::UInt64>(duration_us);
+    root["peak_rss_bytes"] = static_cast<Json::UInt64>(peak_rss_bytes);
+    root["peak_rss_growth_bytes"] = static_cast<Json::UInt64>(peak_rss_growth_bytes);
+    root["env_reads"] = static_cast<Json::UInt64>(env_reads);
+    root["env_writes"] = static_cast<Json::UInt64>(env_writes);
+
+    Json::Value& phase_list = root["phases"] = Json::Value(Json::objectValue);
+    for (size_t i = 0; i < PHASE_COUNT; ++i) {
+        Json::Value& entry = phase_list[PHASE_NAMES[i]];
+        entry["count"] = phases[i].count;
+        entry["duration_us"] = static_cast<Json::UInt64>(phases[i].duration_us);
+        entry["bytes"] = static_cast<Json::UInt64>(phases[i].bytes);
+        entry["throughput"] = phases[i].throughput();
+    }
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "  ";
+    return Json::writeString(builder, root) + "\n";
+}
+
+std::string UpdateMetrics::to_prometheus() const {
+    /* operation names are identifiers, no label escaping needed */
+    const std::string operation_label = "operation=\"" + operation + "\"";
+    std::string out;
+
+    gauge(out, "fsupdate_last_run_start_time_seconds", "Start of the last update operation.");
+    out += "fsupdate_last_run_start_time_seconds{" + operation_label + "} " + std::to_string(started) + "\n";
+    gauge(out, "fsupdate_last_run_success", "Last update operation succeeded.");
+    out += "fsupdate_last_run_success{" + operation_label + "} " + (succeeded ? "1" : "0") + "\n";
+    gauge(out, "fsupdate_last_run_duration_seconds", "Duration of the last update operation.");
+    out += "fsupdate_last_run_duration_seconds{" + operation_label + "} " + seconds(duration_us) + "\n";
+    gauge(out, "fsupdate_last_run_peak_rss_bytes", "Peak resident memory of the process after the last update operation.");
+    out += "fsupdate_last_run_peak_rss_bytes{" + operation_label + "} " + std::to_string(peak_rss_bytes) + "\n";
+    gauge(out, "fsupdate_last_run_peak_rss_growth_bytes", "Rise of the peak resident memory during the last update operation.");
+    out += "fsupdate_last_run_peak_rss_growth_bytes{" + operation_label + "} " + std::to_string(peak_rss_growth_bytes) + "\n";
+    gauge(out, "fsupdate_last_run_env_reads", "U-Boot environment reads of the last update operation.");
+    out += "fsupdate_last_run_env_reads{" + operation_label + "} " + std::to_string(env_reads) + "\n";
+    gauge(out, "fsupdate_last_run_env_writes", "U-Boot environment writes of the last update operation.");
+    out += "fsupdate_last_run_env_writes{" + operation_label + "} " + std::to_string(env_writes) + "\n";
+
+    struct Series {
+        const char* name;
+        const char* help;
+        std::string (*value)(const PhaseMetrics&);
+    };
+    const Series series[] = {
+        {"fsupdate_phase_runs", "Times the phase ran in the last update operation.",
+         [](const PhaseMetrics& p) { return std::to_string(p.count); }},
+        {"fsupdate_phase_duration_seconds", "Time spent in the phase in the last update operation.",
+         [](const PhaseMetrics& p) { return seconds(p.duration_us); }},
+        {"fsupdate_phase_bytes", "Bytes processed by the phase in the last update operation.",
+         [](const PhaseMetrics& p) { return std::to_string(p.bytes); }},
+        {"fsupdate_phase_throughput_bytes_per_second", "Throughput of the phase in the last update operation.",
+         [](const PhaseMetrics& p) { return number(p.throughput()); }},
+    };
+    for (const Series& s : series) {
+        gauge(out, s.name, s.help);
+        for (size_t i = 0; i < PHASE_COUNT; ++i) {
+            out += std::string(s.name) + "{" + operation_label + ",phase=\"" + PHASE_NAMES[i] + "\"} " +
+                   s.value(phases[i]) + "\n";
+        }
+    }
+    return out;
+}
+
+void UpdateMetrics::write(const std::filesystem::path& path, MetricsFormat format) const {
+    const std::string content = (format == MetricsFormat::PROMETHEUS) ? to_prometheus() : to_json();
+
+    /* new file next to path, collectors only ever see complete content */
+    std::string tmp_template = path.string() + ".XXXXXX";
+    const int fd = ::mkostemp(tmp_template.data(), O_CLOEXEC);
+    if (fd < 0) {
+        throw WriteFailed(path.string(), std::string("mkostemp: ") + std::strerror(errno));
+    }
+    const std::string tmp_path(tmp_template);
+    auto fail = [&](const std::string& call) {
+        const int error = errno;
+        ::close(fd);
+        ::unlink(tmp_path.c_str());
+        throw WriteFailed(tmp_path, call + ": " + std::strerror(error));
+    };
+
+    /* mkostemp creates 0600, collectors run as another user */
+    if (::fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) != 0) {
+        fail("fchmod");
+    }
+    size_t offset = 0;
+    while (offset < content.size()) {
+        const ssize_t bytes = ::write(fd, content.data() + offset, content.size() - offset);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) {
+            fail("write");
+        }
+        offset += static_cast<size_t>(bytes);
+    }
+    if (::fsync(fd) != 0) {
+        fail("fsync");
+    }
+    if (::close(fd) != 0) {
+        const int error = errno;
+        ::unlink(tmp_path.c_str());
+        throw WriteFailed(tmp_path, std::string("close: ") + std::strerror(error));
+    }
+    if (::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        const int error = errno;
+        ::unlink(tmp_path.c_str());
+        throw WriteFailed(path.string(), std::string("rename: ") + std::strerror(error));
+    }
+}
+
+PhaseTimer::PhaseTimer(Phase phase, uint64_t bytes)
+    : phase_(phase), bytes_(bytes), active_(recorder().active.load(std::memory_order_relaxed)),
+      span_("phase", UpdateMetrics::phase_name(phase)) {
+    if (active_) {
+        start_ = std::chrono::steady_clock::now();
+    }
+}
+
+PhaseTimer::~PhaseTimer() {
+    if (!active_) {
+        return;
+    }
+    const uint64_t elapsed = microseconds_since(start_);
+    Recorder& r = recorder();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    PhaseMetrics& metrics = r.phases[static_cast<size_t>(phase_)];
+    ++metrics.count;
+    metrics.duration_us += elapsed;
+    metrics.bytes += bytes_;
+}
+
+MetricsScope::MetricsScope(const std::string& operation, UpdateMetrics& result, UBoot::UBoot& uboot)
+    : result_(result), uboot_(uboot), owner_(!recorder().active.exchange(true)),
+      uncaught_(std::uncaught_exceptions()) {
+    if (!owner_) {
+        return;
+    }
+    {
+        Recorder& r = recorder();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.phases = {};
+    }
+    result_ = UpdateMetrics();
+    result_.operation = operation;
+    result_.started = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    env_start_ = uboot_.getStatistics();
+    peak_rss_start_ = peak_rss();
+    start_ = std::chrono::steady_clock::now();
+}
+
+MetricsScope::~MetricsScope() {
+    if (!owner_) {
+        return;
+    }
+    result_.duration_us = microseconds_since(start_);
+    result_.succeeded = std::uncaught_exceptions() <= uncaught_;
+    result_.peak_rss_bytes = peak_rss();
+    result_.peak_rss_growth_bytes =
+        (result_.peak_rss_bytes > peak_rss_start_) ? result_.peak_rss_bytes - peak_rss_start_ : 0;
+
+    /* UBoot times its flushes itself, it does not depend on the updater */
+    const UBoot::EnvStatistics env = uboot_.getStatistics();
+    result_.env_reads = env.reads - env_start_.reads;
+    result_.env_writes = env.writes - env_start_.writes;
+
+    Recorder& r = recorder();
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        result_.phases = r.phases;
+    }
+    PhaseMetrics& env_flush = result_.phases[static_cast<size_t>(Phase::ENV_FLUSH)];
+    env_flush.count += static_cast<uint32_t>(result_.env_writes);
+    env_flush.duration_us += env.flush_us - env_start_.flush_us;
+    r.active.store(false);
+}
+
+} // namespace updater
@@ -0,0 +1,153 @@
+/**
+ * Timing of update operations.
+ *
+ * Every update operation records duration and bytes of its phases, the peak
+ * resident memory and the accesses of the U-Boot environment. FSUpdate keeps
+ * the result of the last operation, it can be exported as JSON or in the
+ * Prometheus text format for the node_exporter textfile collector. Phases are
+ * recorded where the work is done; a phase running outside of an operation
+ * costs one atomic load.
+ */
+
+#pragma once
+
+#include "../uboot_interface/UBoot.h"
+#include "../trace/trace.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace updater {
+
+    enum class Phase {
+        /* update header, fsupdate.json, application image header and trailer */
+        HEADER_PARSE,
+        EXTRACT,
+        /* checksums of fsupdate.json */
+        MANIFEST_HASH,
+        CHAIN_VALIDATION,
+        SIGNATURE_VERIFICATION,
+        /* application image into its slot, including delta and chunk assembly */
+        COPY,
+        FSYNC,
+        RAUC_INSTALL,
+        ENV_FLUSH
+    };
+
+    constexpr size_t PHASE_COUNT = static_cast<size_t>(Phase::ENV_FLUSH) + 1;
+
+    enum class MetricsFormat {
+        JSON,
+        PROMETHEUS
+    };
+
+    struct PhaseMetrics {
+        /* times the phase ran */
+        uint32_t count = 0;
+        uint64_t duration_us = 0;
+        uint64_t bytes = 0;
+
+        /**
+         * @return Bytes per second, 0 without bytes or duration.
+         */
+        double throughput() const;
+    };
+
+    struct UpdateMetrics {
+        /* e.g. "update_image", empty before the first operation */
+        std::string operation;
+        bool succeeded = false;
+        /* seconds since epoch */
+        int64_t started = 0;
+        uint64_t duration_us = 0;
+        std::array<PhaseMetrics, PHASE_COUNT> phases{};
+        /* high water mark of the resident memory at the end of the operation,
+         * it is never reset and may stem from earlier work of the process */
+        uint64_t peak_rss_bytes = 0;
+        /* rise of the high water mark during the operation */
+        uint64_t peak_rss_growth_bytes = 0;
+        uint64_t env_reads = 0;
+        uint64_t env_writes = 0;
+
+        const PhaseMetrics& phase(Phase phase) const;
+
+        /**
+         * @return Lower case name used in the exports, e.g. "header_parse".
+         */
+        static const char* phase_name(Phase phase);
+
+        std::string to_json() const;
+
+        /**
+         * Gauges with prefix fsupdate_, labelled with operation and phase.
+         */
+        std::string to_prometheus() const;
+
+        /**
+         * Replace file atomically, collectors never read a partial file.
+         * @param path Destination, e.g. /var/lib/node_exporter/fsupdate.prom.
+         * @param format Export format.
+         * @throw WriteFailed
+         */
+        void write(const std::filesystem::path& path, MetricsFormat format) const;
+    };
+
+    class PhaseTimer {
+    private:
+        Phase phase_;
+        uint64_t bytes_;
+        bool active_;
+        std::chrono::steady_clock::time_point start_;
+        /* phases are the I/O loops of the trace timeline */
+        trace::Span span_;
+
+    public:
+        /**
+         * Record phase from construction until destruction. Concurrent phases
+         * add up, a phase containing another one includes its time.
+         * @param phase Recorded phase.
+         * @param bytes Bytes processed, more may be added while running.
+         */
+        explicit PhaseTimer(Phase phase, uint64_t bytes = 0);
+        ~PhaseTimer();
+
+        void add_bytes(uint64_t bytes) {
+            bytes_ += bytes;
+        }
+
+        PhaseTimer(const PhaseTimer&) = delete;
+        PhaseTimer& operator=(const PhaseTimer&) = delete;
+    };
+
+    class MetricsScope {
+    private:
+        UpdateMetrics& result_;
+        UBoot::UBoot& uboot_;
+        bool owner_;
+        int uncaught_;
+        UBoot::EnvStatistics env_start_;
+        uint64_t peak_rss_start_ = 0;
+        std::chrono::steady_clock::time_point start_;
+
+    public:
+        /**
+         * Record an update operation until destruction. Scopes opened while
+         * another one is active belong to the outer operation, one operation
+         * is recorded per process at a time. The operation failed if the
+         * scope is left by an exception.
+         * @param operation Name of the operation.
+         * @param result Reset at construction, filled at destruction.
+         * @param uboot Environment accesses are taken from its statistics.
+         */
+        MetricsScope(const std::string& operation, UpdateMetrics& result, UBoot::UBoot& uboot);
+        ~MetricsScope();
+
+        MetricsScope(const MetricsScope&) = delete;
+        MetricsScope& operator=(const MetricsScope&) = delete;
+    };
+
+} // namespace updater
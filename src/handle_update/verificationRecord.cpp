@@ -0,0 +1,312 @@
+#include <fus_updater_lib/config.h>
+#include "verificationRecord.h"
+
+#include <botan/auto_rng.h>
+#include <botan/hash.h>
+#include <botan/hex.h>
+#include <botan/mac.h>
+
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+extern "C" {
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <stdlib.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+}
+
+namespace updater {
+
+namespace {
+    constexpr char RECORD_MAGIC[8] = {'F', 'S', 'V', 'E', 'R', 'R', 'E', 'C'};
+    constexpr uint32_t RECORD_FORMAT = 1;
+    constexpr size_t HMAC_SIZE = 32;
+    constexpr size_t KEY_SIZE = 32;
+    constexpr size_t RECORD_MAX_SIZE = 64 * 1024;
+    constexpr char KEY_FILE[] = "record.key";
+
+    std::string& record_dir() {
+        static std::string dir = FUS_LIB_VERIFY_RECORD_DIR;
+        return dir;
+    }
+
+    void append_u32(std::vector<uint8_t>& out, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    void append_u64(std::vector<uint8_t>& out, uint64_t value) {
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    void append_string(std::vector<uint8_t>& out, const std::string& value) {
+        append_u32(out, static_cast<uint32_t>(value.size()));
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+    void append_identity(std::vector<uint8_t>& out, const VerificationRecord::FileIdentity& id) {
+        append_u64(out, id.device);
+        append_u64(out, id.inode);
+        append_u64(out, id.size);
+        append_u64(out, static_cast<uint64_t>(id.mtime_sec));
+        append_u64(out, static_cast<uint64_t>(id.mtime_nsec));
+        append_u64(out, static_cast<uint64_t>(id.ctime_sec));
+        append_u64(out, static_cast<uint64_t>(id.ctime_nsec));
+    }
+
+    std::string canonical_path(const std::string& path) {
+        std::error_code ec;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(path, ec);
+        return ec ? path : canonical.string();
+    }
+
+    std::string record_path(const std::string& canonical) {
+        std::unique_ptr<Botan::HashFunction> hash = Botan::HashFunction::create("SHA-256");
+        if (!hash) {
+            throw std::runtime_error("SHA-256 not available");
+        }
+        hash->update(reinterpret_cast<const uint8_t*>(canonical.data()), canonical.size());
+        const Botan::secure_vector<uint8_t> digest = hash->final();
+        return record_dir() + "/" + Botan::hex_encode(digest.data(), digest.size(), false) + ".rec";
+    }
+
+    /* only files of our own user which nobody else can write are trusted */
+    bool read_private_file(const std::string& path, size_t max_size, std::vector<uint8_t>& content) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != ::geteuid() ||
+            (st.st_mode & (S_IRWXG | S_IRWXO)) != 0 || static_cast<uint64_t>(st.st_size) > max_size) {
+            ::close(fd);
+            return false;
+        }
+
+        content.resize(static_cast<size_t>(st.st_size));
+        size_t offset = 0;
+        while (offset < content.size()) {
+            ssize_t bytes = ::read(fd, content.data() + offset, content.size() - offset);
+            if (bytes < 0 && errno == EINTR) continue;
+            if (bytes <= 0) {
+                ::close(fd);
+                return false;
+            }
+            offset += static_cast<size_t>(bytes);
+        }
+        ::close(fd);
+        return true;
+    }
+
+    bool write_private_file(const std::string& path, const std::vector<uint8_t>& content, bool exclusive) {
+        /* mkostemp creates a new file with mode 0600 (O_EXCL), a planted symlink is not followed */
+        std::vector<char> tmp_template(path.begin(), path.end());
+        const char suffix[] = ".XXXXXX";
+        tmp_template.insert(tmp_template.end(), suffix, suffix + sizeof(suffix));
+        int fd = ::mkostemp(tmp_template.data(), O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        const std::string tmp_path(tmp_template.data());
+
+        size_t offset = 0;
+        while (offset < content.size()) {
+            ssize_t bytes = ::write(fd, content.data() + offset, content.size() - offset);
+            if (bytes < 0 && errno == EINTR) continue;
+            if (bytes <= 0) {
+                ::close(fd);
+                ::unlink(tmp_path.c_str());
+                return false;
+            }
+            offset += static_cast<size_t>(bytes);
+        }
+        ::close(fd);
+
+        /* link() fails if the file exists, so two processes agree on one key */
+        const int result = exclusive ? ::link(tmp_path.c_str(), path.c_str())
+                                     : ::rename(tmp_path.c_str(), path.c_str());
+        if (exclusive || result != 0) {
+            ::unlink(tmp_path.c_str());
+        }
+        return result == 0;
+    }
+
+    bool ensure_record_dir() {
+        const std::string& dir = record_dir();
+        const auto slash = dir.rfind('/');
+        if (slash != std::string::npos && slash > 0) {
+            ::mkdir(dir.substr(0, slash).c_str(), S_IRWXU);
+        }
+        if (::mkdir(dir.c_str(), S_IRWXU) != 0 && errno != EEXIST) {
+            return false;
+        }
+
+        struct stat st;
+        return ::lstat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == ::geteuid() &&
+               (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+    }
+
+    bool load_key(bool create, std::vector<uint8_t>& key) {
+        const std::string key_path = record_dir() + "/" + KEY_FILE;
+        if (read_private_file(key_path, KEY_SIZE, key) && key.size() == KEY_SIZE) {
+            return true;
+        }
+        if (!create) {
+            return false;
+        }
+
+        Botan::AutoSeeded_RNG rng;
+        std::vector<uint8_t> new_key(KEY_SIZE);
+        rng.randomize(new_key.data(), new_key.size());
+        write_private_file(key_path, new_key, true);
+
+        /* another process may have won the race, use what is on disk */
+        return read_private_file(key_path, KEY_SIZE, key) && key.size() == KEY_SIZE;
+    }
+
+    std::vector<uint8_t> hmac(const std::vector<uint8_t>& key, const uint8_t* data, size_t length) {
+        std::unique_ptr<Botan::MessageAuthenticationCode> mac = Botan::MessageAuthenticationCode::create("HMAC(SHA-256)");
+        if (!mac) {
+            throw std::runtime_error("HMAC(SHA-256) not available");
+        }
+        mac->set_key(key);
+        mac->update(data, length);
+        const Botan::secure_vector<uint8_t> tag = mac->final();
+        return std::vector<uint8_t>(tag.begin(), tag.end());
+    }
+
+    /* magic, format, path, identity, dependency path and identity */
+    std::vector<uint8_t> record_prefix(const std::string& canonical, const std::string& dependency) {
+        std::vector<uint8_t> prefix(RECORD_MAGIC, RECORD_MAGIC + sizeof(RECORD_MAGIC));
+        append_u32(prefix, RECORD_FORMAT);
+        append_string(prefix, canonical);
+        append_identity(prefix, VerificationRecord::identify(canonical));
+        append_string(prefix, dependency);
+        append_identity(prefix, dependency.empty() ? VerificationRecord::FileIdentity{}
+                                                   : VerificationRecord::identify(dependency));
+        return prefix;
+    }
+}
+
+VerificationRecord::FileIdentity VerificationRecord::identify(const std::string& path) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        throw std::runtime_error("Failed to stat " + path + ": " + std::strerror(errno));
+    }
+
+    FileIdentity id;
+    id.device = static_cast<uint64_t>(st.st_dev);
+    id.inode = static_cast<uint64_t>(st.st_ino);
+    id.size = static_cast<uint64_t>(st.st_size);
+    id.mtime_sec = static_cast<int64_t>(st.st_mtim.tv_sec);
+    id.mtime_nsec = static_cast<int64_t>(st.st_mtim.tv_nsec);
+    id.ctime_sec = static_cast<int64_t>(st.st_ctim.tv_sec);
+    id.ctime_nsec = static_cast<int64_t>(st.st_ctim.tv_nsec);
+    return id;
+}
+
+void VerificationRecord::store(const std::string& path, const std::vector<uint8_t>& digest,
+                               const std::string& dependency,
+                               const std::shared_ptr<logger::LoggerHandler>& logger) {
+    if (record_dir().empty()) {
+        return;
+    }
+
+    try {
+        std::vector<uint8_t> key;
+        if (!ensure_record_dir() || !load_key(true, key)) {
+            logger->setLogEntry(std::make_shared<logger::LogEntry>(
+                VERIFY_RECORD, "Record directory " + record_dir() + " not usable",
+                logger::logLevel::WARNING));
+            return;
+        }
+
+        const std::string canonical = canonical_path(path);
+        std::vector<uint8_t> record = record_prefix(canonical, dependency);
+        append_u32(record, static_cast<uint32_t>(digest.size()));
+        record.insert(record.end(), digest.begin(), digest.end());
+        const std::vector<uint8_t> tag = hmac(key, record.data(), record.size());
+        record.insert(record.end(), tag.begin(), tag.end());
+
+        if (!write_private_file(record_path(canonical), record, false)) {
+            logger->setLogEntry(std::make_shared<logger::LogEntry>(
+                VERIFY_RECORD, "Can not write record of " + canonical + ": " + std::strerror(errno),
+                logger::logLevel::WARNING));
+            return;
+        }
+
+        logger->setLogEntry(std::make_shared<logger::LogEntry>(
+            VERIFY_RECORD, "Stored verification record of " + canonical, logger::logLevel::DEBUG));
+    } catch (const std::exception& e) {
+        logger->setLogEntry(std::make_shared<logger::LogEntry>(
+            VERIFY_RECORD, "Can not store record of " + path + ": " + e.what(), logger::logLevel::WARNING));
+    }
+}
+
+bool VerificationRecord::lookup(const std::string& path, const std::string& dependency,
+                                std::vector<uint8_t>& digest,
+                                const std::shared_ptr<logger::LoggerHandler>& logger) {
+    if (record_dir().empty()) {
+        return false;
+    }
+
+    try {
+        const std::string canonical = canonical_path(path);
+        std::vector<uint8_t> record;
+        std::vector<uint8_t> key;
+        if (!read_private_file(record_path(canonical), RECORD_MAX_SIZE, record) || !load_key(false, key)) {
+            return false;
+        }
+
+        const std::vector<uint8_t> expected = record_prefix(canonical, dependency);
+        if (record.size() < expected.size() + 4 + HMAC_SIZE ||
+            std::memcmp(record.data(), expected.data(), expected.size()) != 0) {
+            logger->setLogEntry(std::make_shared<logger::LogEntry>(
+                VERIFY_RECORD, "Record of " + canonical + " is outdated", logger::logLevel::DEBUG));
+            return false;
+        }
+
+        const size_t body_size = record.size() - HMAC_SIZE;
+        const std::vector<uint8_t> tag = hmac(key, record.data(), body_size);
+        if (std::memcmp(tag.data(), record.data() + body_size, HMAC_SIZE) != 0) {
+            logger->setLogEntry(std::make_shared<logger::LogEntry>(
+                VERIFY_RECORD, "Record of " + canonical + " has invalid HMAC", logger::logLevel::WARNING));
+            return false;
+        }
+
+        size_t pos = expected.size();
+        uint32_t digest_size = 0;
+        for (int i = 0; i < 4; ++i) {
+            digest_size = (digest_size << 8) | record[pos++];
+        }
+        if (digest_size != body_size - pos) {
+            return false;
+        }
+        digest.assign(record.begin() + pos, record.begin() + body_size);
+        return true;
+    } catch (const std::exception& e) {
+        logger->setLogEntry(std::make_shared<logger::LogEntry>(
+            VERIFY_RECORD, "Can not read record of " + path + ": " + e.what(), logger::logLevel::DEBUG));
+        return false;
+    }
+}
+
+void VerificationRecord::remove(const std::string& path) {
+    if (record_dir().empty()) {
+        return;
+    }
+    ::unlink(record_path(canonical_path(path)).c_str());
+}
+
+void VerificationRecord::set_directory(const std::string& dir) {
+    record_dir() = dir;
+}
+
+} // namespace updater
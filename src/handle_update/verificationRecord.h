@@ -0,0 +1,89 @@
+/**
+ * Records of update files verified ahead of installation.
+ *
+ * A record binds the identity of a verified file (device, inode, size,
+ * mtime and ctime) to a content digest. Records are protected by an
+ * HMAC-SHA256 with a device local key, kept next to the records in a
+ * directory only accessible by the owner. Any change of the file, also
+ * one restoring its mtime, changes ctime and invalidates the record.
+ */
+
+#pragma once
+
+#include "../logger/LoggerHandler.h"
+#include "../logger/LoggerEntry.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+constexpr char VERIFY_RECORD[] = "verification record";
+
+namespace updater {
+
+    class VerificationRecord {
+    public:
+        struct FileIdentity {
+            uint64_t device = 0;
+            uint64_t inode = 0;
+            uint64_t size = 0;
+            int64_t mtime_sec = 0;
+            int64_t mtime_nsec = 0;
+            int64_t ctime_sec = 0;
+            int64_t ctime_nsec = 0;
+
+            bool operator==(const FileIdentity& other) const {
+                return device == other.device && inode == other.inode && size == other.size &&
+                       mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec &&
+                       ctime_sec == other.ctime_sec && ctime_nsec == other.ctime_nsec;
+            }
+            bool operator!=(const FileIdentity& other) const { return !(*this == other); }
+        };
+
+        VerificationRecord() = delete;
+
+        /**
+         * Identity of file.
+         * @throw std::runtime_error File can not be stat'ed.
+         */
+        static FileIdentity identify(const std::string& path);
+
+        /**
+         * Store record for a verified file. Failures are logged only, the
+         * file is verified again at installation then.
+         * @param path Verified file.
+         * @param digest Content digest to keep with the record.
+         * @param dependency File the verification depends on, e.g. the keyring. May be empty.
+         * @param logger Logger object reference.
+         */
+        static void store(const std::string& path, const std::vector<uint8_t>& digest,
+                          const std::string& dependency,
+                          const std::shared_ptr<logger::LoggerHandler>& logger);
+
+        /**
+         * Look up valid record of file.
+         * @param path File to install.
+         * @param dependency Same dependency as on store().
+         * @param digest Digest of record if valid.
+         * @param logger Logger object reference.
+         * @return Record exists and matches file and dependency: true, else false.
+         */
+        static bool lookup(const std::string& path, const std::string& dependency,
+                           std::vector<uint8_t>& digest,
+                           const std::shared_ptr<logger::LoggerHandler>& logger);
+
+        /**
+         * Remove record of file, e.g. after installation.
+         */
+        static void remove(const std::string& path);
+
+        /**
+         * Keep records in another directory than FUS_LIB_VERIFY_RECORD_DIR,
+         * e.g. in tests. Set it before records are stored or looked up.
+         * @param dir Record directory, empty to disable records.
+         */
+        static void set_directory(const std::string& dir);
+    };
+
+} // namespace updater
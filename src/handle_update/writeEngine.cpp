@@ -0,0 +1,97 @@
+#include "writeEngine.h"
+#include "resourcePolicy.h"
+#include "updateMetrics.h"
+
+#include <cstring>
+
+extern "C" {
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+}
+
+namespace updater {
+
+WriteEngine::WriteEngine(int fd, std::string path, uint64_t position, uint64_t window, bool drop_cache)
+    : fd_(fd), path_(std::move(path)), window_(window), drop_cache_(drop_cache),
+      position_(position), submitted_(position), synced_(position) {}
+
+void WriteEngine::preallocate(uint64_t size) {
+    if (size <= position_) {
+        return;
+    }
+    /* keep size, an interrupted write must not look complete */
+    if (::fallocate(fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(position_),
+                    static_cast<off_t>(size - position_)) != 0) {
+        if (errno == ENOSPC || errno == EFBIG) {
+            throw WriteFailed(path_, std::string("fallocate: ") + std::strerror(errno));
+        }
+        /* EOPNOTSUPP and friends: blocks are allocated on write */
+    }
+}
+
+void WriteEngine::write(const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = ::pwrite(fd_, data, length, static_cast<off_t>(position_));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            throw WriteFailed(path_, std::string("pwrite: ") + std::strerror(written < 0 ? errno : EIO));
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+        position_ += static_cast<uint64_t>(written);
+        IoThrottle::account(static_cast<uint64_t>(written));
+    }
+
+    if (window_ > 0) {
+        writeback();
+    }
+}
+
+void WriteEngine::writeback() {
+    while (position_ - submitted_ >= window_) {
+        /* start writeback of completed window */
+        if (::sync_file_range(fd_, static_cast<off_t>(submitted_), static_cast<off_t>(window_),
+                              SYNC_FILE_RANGE_WRITE) != 0) {
+            throw WriteFailed(path_, std::string("sync_file_range: ") + std::strerror(errno));
+        }
+
+        /* wait for the window before, it had a whole window of time */
+        if (submitted_ >= window_) {
+            const off_t previous = static_cast<off_t>(submitted_ - window_);
+            if (::sync_file_range(fd_, previous, static_cast<off_t>(window_),
+                                  SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                                  SYNC_FILE_RANGE_WAIT_AFTER) != 0) {
+                throw WriteFailed(path_, std::string("sync_file_range: ") + std::strerror(errno));
+            }
+            if (drop_cache_) {
+                ::posix_fadvise(fd_, previous, static_cast<off_t>(window_), POSIX_FADV_DONTNEED);
+            }
+        }
+        submitted_ += window_;
+    }
+}
+
+void WriteEngine::sync() {
+    PhaseTimer timer(Phase::FSYNC, position_ - synced_);
+    /* sync_file_range() neither writes metadata nor flushes the disk cache */
+    if (::fdatasync(fd_) != 0) {
+        throw WriteFailed(path_, std::string("fdatasync: ") + std::strerror(errno));
+    }
+    synced_ = position_;
+}
+
+void WriteEngine::finish() {
+    PhaseTimer timer(Phase::FSYNC, position_ - synced_);
+    if (::fsync(fd_) != 0) {
+        throw WriteFailed(path_, std::string("fsync: ") + std::strerror(errno));
+    }
+    synced_ = position_;
+    if (drop_cache_) {
+        ::posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+    }
+}
+
+} // namespace updater
@@ -0,0 +1,98 @@
+/**
+ * Sequential file writer with bounded dirty page cache.
+ *
+ * Writing a whole image and syncing once at the end accumulates hundreds of
+ * MB of dirty pages. Global writeback throttling then stalls unrelated
+ * processes and the final fsync takes seconds. The writer reserves the
+ * blocks of the file up front and starts writeback of every completed
+ * window with sync_file_range(), waiting only for the window before. At
+ * most two windows are dirty or under writeback at any time. Written
+ * windows can be dropped from the page cache, the data is not read again.
+ */
+
+#pragma once
+
+#include <fus_updater_lib/config.h>
+#include "./../BaseException.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace updater {
+
+    namespace writeback {
+        /* bytes per sync_file_range() window, 0 writes back on sync() only */
+        constexpr uint64_t WINDOW = static_cast<uint64_t>(FUS_LIB_WRITEBACK_WINDOW_KB) * 1024;
+        /* drop written windows from page cache */
+        constexpr bool DROP_CACHE = FUS_LIB_WRITEBACK_DROP_CACHE;
+    }
+
+    class WriteFailed : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Writing, reserving or syncing a file fails.
+         * @param path File written to.
+         * @param msg Failing call and reason.
+         */
+        WriteFailed(const std::string& path, const std::string& msg) {
+            this->error_msg = std::string("Error writing ") + path + ": " + msg;
+        }
+    };
+
+    class WriteEngine {
+    private:
+        int fd_;
+        std::string path_;
+        uint64_t window_;
+        bool drop_cache_;
+        /* end of written data */
+        uint64_t position_;
+        /* data before is submitted to writeback */
+        uint64_t submitted_;
+        /* data before is durable, accounted as bytes of the fsync phase */
+        uint64_t synced_;
+
+        void writeback();
+
+    public:
+        /**
+         * @param fd File opened for writing, owned by the caller.
+         * @param path Name of the file for error messages.
+         * @param position Offset of the first write, e.g. when resuming.
+         * @param window Bytes per writeback window.
+         * @param drop_cache Drop written windows from page cache.
+         */
+        WriteEngine(int fd, std::string path, uint64_t position = 0,
+                    uint64_t window = writeback::WINDOW, bool drop_cache = writeback::DROP_CACHE);
+
+        /**
+         * Reserve blocks up to size without changing the file size.
+         * Ignored if the file system does not support it.
+         * @throw WriteFailed Not enough space.
+         */
+        void preallocate(uint64_t size);
+
+        /**
+         * Append data at the current position. Writes are positional, the
+         * file offset of the descriptor is neither used nor changed.
+         * @throw WriteFailed
+         */
+        void write(const char* data, size_t length);
+
+        /**
+         * Make written data durable, e.g. before a checkpoint.
+         * @throw WriteFailed
+         */
+        void sync();
+
+        /**
+         * Make data and metadata durable after the last write.
+         * @throw WriteFailed
+         */
+        void finish();
+
+        uint64_t position() const { return position_; }
+    };
+
+} // namespace updater
@@ -3,9 +3,42 @@
 #include "../uboot_interface/allowed_uboot_variable_states.h"
 #include "../handle_update/utils.h"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 
+namespace
+{
+    /* progress steps of `rauc install` writing a slot, e.g. " 46% Copying image to rootfs.1" */
+    constexpr const char *SLOT_WRITE_STEPS[] = {"Copying image to ", "Updating slot "};
+
+    std::vector<std::string> written_slots(const std::string &output)
+    {
+        std::vector<std::string> slots;
+        std::istringstream lines(output);
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            for (const char *step : SLOT_WRITE_STEPS)
+            {
+                const size_t pos = line.find(step);
+                if (pos == std::string::npos)
+                {
+                    continue;
+                }
+                std::istringstream rest(line.substr(pos + std::strlen(step)));
+                std::string slot;
+                if ((rest >> slot) && std::find(slots.begin(), slots.end(), slot) == slots.end())
+                {
+                    slots.push_back(slot);
+                }
+            }
+        }
+        return slots;
+    }
+}
+
 rauc::memory_type rauc::rauc_handler::current_uboot_env_memory() noexcept
 {
     std::ifstream uboot_env(UBOOT_CONFIG_PATH, (std::ifstream::in));
@@ -49,11 +82,13 @@ rauc::rauc_handler::rauc_handler(const std::shared_ptr<UBoot::UBoot> &ptr, const
     rauc_mark_good_other("rauc status --output-format=json mark-good other"),
     rauc_rollback("rauc status --output-format=json mark-active other"),
     uboot_handler(ptr),
-    logger(logger)
+    logger(logger),
+    uboot_env_memory(memory_type::None)
 {
     this->logger->setLogEntry(std::make_shared<logger::LogEntry>(RAUC_DOMAIN, "handler constructed", logger::logLevel::DEBUG));
 
-    if (this->current_uboot_env_memory() == memory_type::eMMC)
+    this->uboot_env_memory = this->current_uboot_env_memory();
+    if (this->uboot_env_memory == memory_type::eMMC)
     {
         const std::string force_ro = std::string("/sys/block/") + FUS_LIB_UBOOT_ENV_MMC + "/force_ro";
         std::ofstream uboot_acc(force_ro, std::ios::app);
@@ -73,7 +108,7 @@ rauc::rauc_handler::rauc_handler(const std::shared_ptr<UBoot::UBoot> &ptr, const
 rauc::rauc_handler::~rauc_handler()
 {
     this->logger->setLogEntry(std::make_shared<logger::LogEntry>(RAUC_DOMAIN, "handler deconstructed", logger::logLevel::DEBUG));
-    if (this->current_uboot_env_memory() == memory_type::eMMC)
+    if (this->uboot_env_memory == memory_type::eMMC)
     {
         const std::string force_ro = std::string("/sys/block/") + FUS_LIB_UBOOT_ENV_MMC + "/force_ro";
         std::ofstream uboot_acc(force_ro, std::ios::app);
@@ -84,7 +119,7 @@ rauc::rauc_handler::~rauc_handler()
     }
 }
 
-void rauc::rauc_handler::installBundle(const std::string & path_to_bundle)
+std::vector<std::string> rauc::rauc_handler::installBundle(const std::string & path_to_bundle)
 {
     std::string command = this->rauc_install_cmd + std::string(path_to_bundle);
     this->logger->setLogEntry(std::make_shared<logger::LogEntry>(RAUC_DOMAIN, std::string("installBundle: execute cmd: ") + command, logger::logLevel::DEBUG));
@@ -96,6 +131,7 @@ void rauc::rauc_handler::installBundle(const std::string & path_to_bundle)
             this->logger->setLogEntry(std::make_shared<logger::LogEntry>(RAUC_DOMAIN, std::string("installBundle: error during execution: ") + handler.output(), logger::logLevel::ERROR));
             throw(RaucInstallBundle(path_to_bundle, handler.output()));
         }
+        return written_slots(handler.output());
     }
     catch(...)
     {
@@ -200,3 +236,46 @@ Json::Value rauc::rauc_handler::getStatus()
     return value;
 }
 
+rauc::system_status rauc::rauc_handler::getSystemStatus()
+{
+    this->logger->setLogEntry(std::make_shared<logger::LogEntry>(RAUC_DOMAIN, std::string("getSystemStatus: execute cmd: ") + this->rauc_status, logger::logLevel::DEBUG));
+    subprocess::Popen handler = subprocess::Popen(this->rauc_status);
+    if (handler.successful() == false)
+    {
+        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(RAUC_DOMAIN, std::string("getSystemStatus: error during execution: ") + handler.output(), logger::logLevel::ERROR));
+        throw(RaucGetStatus(handler.output()));
+    }
+
+    try
+    {
+        return system_status::parse(handler.output());
+    }
+    catch (const ParseJson &err)
+    {
+        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(RAUC_DOMAIN, std::string("getSystemStatus: ") + err.what(), logger::logLevel::ERROR));
+        throw;
+    }
+}
+
+rauc::bundle_info rauc::rauc_handler::getBundleInfo(const std::string & path_to_bundle)
+{
+    const std::string command = this->rauc_info_cmd + path_to_bundle;
+
+    this->logger->setLogEntry(std::make_shared<logger::LogEntry>(RAUC_DOMAIN, std::string("getBundleInfo: execute cmd: ") + command, logger::logLevel::DEBUG));
+    subprocess::Popen handler = subprocess::Popen(command);
+    if (handler.successful() == false)
+    {
+        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(RAUC_DOMAIN, std::string("getBundleInfo: error during execution: ") + handler.output(), logger::logLevel::ERROR));
+        throw(RaucGetArtifactInformation(path_to_bundle, handler.output()));
+    }
+
+    try
+    {
+        return bundle_info::parse(handler.output());
+    }
+    catch (const ParseJson &err)
+    {
+        this->logger->setLogEntry(std::make_shared<logger::LogEntry>(RAUC_DOMAIN, std::string("getBundleInfo: ") + err.what(), logger::logLevel::ERROR));
+        throw;
+    }
+}
@@ -5,11 +5,13 @@
 
 #include "../logger/LoggerHandler.h"
 #include "../logger/LoggerEntry.h"
+#include "rauc_json.h"
 
 #include <json/json.h>
 #include <string>
 #include <exception>
 #include <memory>
+#include <vector>
 
 
 constexpr char RAUC_DOMAIN[] = "RAUC";
@@ -174,6 +176,8 @@ namespace rauc
 
             std::shared_ptr<UBoot::UBoot> uboot_handler;
             std::shared_ptr<logger::LoggerHandler> logger;
+            /* detected once in constructor, reused to restore force_ro */
+            memory_type uboot_env_memory;
 
             memory_type current_uboot_env_memory() noexcept;
 
@@ -192,9 +196,11 @@ namespace rauc
             /**
              * Start RAUC install process for given artifact.
              * @param path_to_bundle Path to RAUC install artifact.
+             * @return Names of the slots RAUC reported writing, e.g. "rootfs.1";
+             *         empty if its progress output names none.
              * @throw RaucInstallBundle When rauc failed with install process.
              */
-            void installBundle(const std::string &);
+            std::vector<std::string> installBundle(const std::string &);
 
             /**
              * Return the information that can be read from the given RAUC install artifact.
@@ -222,5 +228,20 @@ namespace rauc
              * @return JSON object which represent the return value.
              */
             Json::Value getStatus();
+
+            /**
+             * Get the status of RAUC as typed slot list.
+             * @throw RaucGetStatus
+             * @throw ParseJson
+             */
+            system_status getSystemStatus();
+
+            /**
+             * Return typed information about the given RAUC install artifact.
+             * @param path_to_bundle Path to the RAUC artifact.
+             * @throw RaucGetArtifactInformation
+             * @throw ParseJson
+             */
+            bundle_info getBundleInfo(const std::string &);
     };
 }
\ No newline at end of file
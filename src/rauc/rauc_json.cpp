@@ -0,0 +1,163 @@
+#include "rauc_json.h"
+#include "rauc_handler.h"
+#include "../handle_update/jsonReader.h"
+
+namespace
+{
+    using updater::json::Reader;
+    using updater::json::Type;
+
+    /* strings as is, null and other types as empty string */
+    std::string optional_string(Reader &reader)
+    {
+        if (reader.peek() == Type::STRING)
+        {
+            return std::string(reader.string_value());
+        }
+        reader.skip();
+        return std::string();
+    }
+
+    uint64_t optional_uint(Reader &reader)
+    {
+        if (reader.peek() == Type::NUMBER)
+        {
+            return reader.uint_value();
+        }
+        reader.skip();
+        return 0;
+    }
+
+    /* [{"<name>": {...}}, ...] as used for slots and images */
+    template <typename Entry>
+    void named_objects(Reader &reader, std::vector<Entry> &entries, Entry (*parse_entry)(Reader &, std::string_view))
+    {
+        if (reader.peek() != Type::ARRAY)
+        {
+            reader.skip();
+            return;
+        }
+        reader.begin_array();
+        while (reader.next_element())
+        {
+            if (reader.peek() != Type::OBJECT)
+            {
+                reader.skip();
+                continue;
+            }
+            reader.begin_object();
+            std::string_view name;
+            while (reader.next_member(name))
+            {
+                entries.push_back(parse_entry(reader, name));
+            }
+        }
+    }
+
+    rauc::slot_status parse_slot(Reader &reader, std::string_view name)
+    {
+        rauc::slot_status slot;
+        slot.name = std::string(name);
+        if (reader.peek() != Type::OBJECT)
+        {
+            reader.skip();
+            return slot;
+        }
+        reader.begin_object();
+        std::string_view key;
+        while (reader.next_member(key))
+        {
+            if (key == "class") slot.slot_class = optional_string(reader);
+            else if (key == "device") slot.device = optional_string(reader);
+            else if (key == "type") slot.type = optional_string(reader);
+            else if (key == "bootname") slot.bootname = optional_string(reader);
+            else if (key == "state") slot.state = optional_string(reader);
+            else if (key == "mountpoint") slot.mountpoint = optional_string(reader);
+            else if (key == "boot_status") slot.boot_status = optional_string(reader);
+            else reader.skip();
+        }
+        return slot;
+    }
+
+    rauc::bundle_image parse_image(Reader &reader, std::string_view slot_class)
+    {
+        rauc::bundle_image image;
+        image.slot_class = std::string(slot_class);
+        if (reader.peek() != Type::OBJECT)
+        {
+            reader.skip();
+            return image;
+        }
+        reader.begin_object();
+        std::string_view key;
+        while (reader.next_member(key))
+        {
+            if (key == "filename") image.filename = optional_string(reader);
+            else if (key == "checksum") image.checksum = optional_string(reader);
+            else if (key == "size") image.size = optional_uint(reader);
+            else reader.skip();
+        }
+        return image;
+    }
+}
+
+rauc::system_status rauc::system_status::parse(std::string_view text)
+{
+    system_status status;
+    try
+    {
+        Reader reader(text);
+        if (reader.peek() != Type::OBJECT)
+        {
+            throw ParseJson("status is no object");
+        }
+        reader.begin_object();
+        std::string_view key;
+        while (reader.next_member(key))
+        {
+            if (key == "compatible") status.compatible = optional_string(reader);
+            else if (key == "variant") status.variant = optional_string(reader);
+            else if (key == "booted") status.booted = optional_string(reader);
+            else if (key == "boot_primary") status.boot_primary = optional_string(reader);
+            else if (key == "slots") named_objects(reader, status.slots, parse_slot);
+            else reader.skip();
+        }
+        reader.finish();
+    }
+    catch (const updater::json::JsonInvalid &ex)
+    {
+        throw ParseJson(ex.what());
+    }
+    return status;
+}
+
+rauc::bundle_info rauc::bundle_info::parse(std::string_view text)
+{
+    bundle_info info;
+    try
+    {
+        Reader reader(text);
+        if (reader.peek() != Type::OBJECT)
+        {
+            throw ParseJson("bundle info is no object");
+        }
+        reader.begin_object();
+        std::string_view key;
+        while (reader.next_member(key))
+        {
+            if (key == "compatible") info.compatible = optional_string(reader);
+            else if (key == "version") info.version = optional_string(reader);
+            else if (key == "description") info.description = optional_string(reader);
+            else if (key == "build") info.build = optional_string(reader);
+            else if (key == "hash") info.hash = optional_string(reader);
+            else if (key == "images") named_objects(reader, info.images, parse_image);
+            else reader.skip();
+        }
+        reader.finish();
+    }
+    catch (const updater::json::JsonInvalid &ex)
+    {
+        throw ParseJson(ex.what());
+    }
+    return info;
+}
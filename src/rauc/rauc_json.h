@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Typed output of `rauc status` and `rauc info` (--output-format=json).
+ * Parsed in one pass by the same reader as fsupdate.json. Members unknown
+ * to this version are ignored, JSON null reads as empty string.
+ */
+namespace rauc
+{
+    struct slot_status
+    {
+        std::string name;
+        std::string slot_class;
+        std::string device;
+        std::string type;
+        std::string bootname;
+        /* booted, active or inactive */
+        std::string state;
+        std::string mountpoint;
+        /* good or bad */
+        std::string boot_status;
+    };
+
+    struct system_status
+    {
+        std::string compatible;
+        std::string variant;
+        std::string booted;
+        std::string boot_primary;
+        std::vector<slot_status> slots;
+
+        /**
+         * Parse output of `rauc status --output-format=json`.
+         * @throw ParseJson
+         */
+        static system_status parse(std::string_view text);
+    };
+
+    struct bundle_image
+    {
+        std::string slot_class;
+        std::string filename;
+        std::string checksum;
+        uint64_t size = 0;
+    };
+
+    struct bundle_info
+    {
+        std::string compatible;
+        std::string version;
+        std::string description;
+        std::string build;
+        std::string hash;
+        std::vector<bundle_image> images;
+
+        /**
+         * Parse output of `rauc info --output-format=json`.
+         * @throw ParseJson
+         */
+        static bundle_info parse(std::string_view text);
+    };
+}
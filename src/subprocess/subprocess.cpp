@@ -1,4 +1,5 @@
 #include "subprocess.h"
+#include "../trace/trace.h"
 
 extern "C" {
     #include <unistd.h>
@@ -11,6 +12,7 @@ extern "C" {
 
 subprocess::Popen::Popen(const std::string &prog)
 {
+    trace::Span span("subprocess", "Popen", prog);
     int pipefd[2];
 
     int stat_pipe = pipe(pipefd);
@@ -0,0 +1,241 @@
+#include "trace.h"
+
+#include <fstream>
+
+#if FUS_LIB_TRACE
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+    #include <pthread.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+}
+#endif
+
+namespace trace {
+
+#if FUS_LIB_TRACE
+namespace {
+    struct Event {
+        const char* category;
+        const char* name;
+        uint64_t start_ns;
+        uint64_t duration_ns;
+        char detail[DETAIL_SIZE];
+    };
+
+    /* written by its thread only, events below count are complete */
+    struct ThreadBuffer {
+        explicit ThreadBuffer(size_t capacity) : events(capacity) {}
+
+        std::vector<Event> events;
+        std::atomic<size_t> count{0};
+        long tid = 0;
+        char name[16] = {};
+    };
+
+    struct Session {
+        std::atomic<bool> recording{false};
+        /* changed by start(), threads take a new buffer on their next span */
+        std::atomic<uint64_t> generation{0};
+        std::atomic<uint64_t> dropped{0};
+        std::mutex mutex;
+        size_t events_per_thread = DEFAULT_EVENTS_PER_THREAD;
+        /* kept after their thread exited, e.g. hash workers */
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    };
+
+    Session& session() {
+        static Session instance;
+        return instance;
+    }
+
+    struct ThreadState {
+        uint64_t generation = 0;
+        std::shared_ptr<ThreadBuffer> buffer;
+    };
+
+    thread_local ThreadState thread_state;
+
+    uint64_t now_ns() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    /* locks once per thread and recording only */
+    ThreadBuffer& thread_buffer() {
+        Session& s = session();
+        if (!thread_state.buffer || thread_state.generation != s.generation.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto buffer = std::make_shared<ThreadBuffer>(s.events_per_thread);
+            buffer->tid = ::syscall(SYS_gettid);
+            ::pthread_getname_np(::pthread_self(), buffer->name, sizeof(buffer->name));
+            s.buffers.push_back(buffer);
+            thread_state.buffer = std::move(buffer);
+            thread_state.generation = s.generation.load();
+        }
+        return *thread_state.buffer;
+    }
+
+    void append_escaped(std::string& out, const char* text) {
+        for (; *text != '\0'; ++text) {
+            const unsigned char c = static_cast<unsigned char>(*text);
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += static_cast<char>(c);
+            } else if (c < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            } else {
+                out += static_cast<char>(c);
+            }
+        }
+    }
+
+    /* trace-event time stamps are microseconds */
+    void append_microseconds(std::string& out, uint64_t ns) {
+        char number[32];
+        std::snprintf(number, sizeof(number), "%llu.%03u", static_cast<unsigned long long>(ns / 1000),
+                      static_cast<unsigned>(ns % 1000));
+        out += number;
+    }
+}
+
+bool supported() {
+    return true;
+}
+
+void start(size_t events_per_thread) {
+    Session& s = session();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.buffers.clear();
+    s.events_per_thread = std::max<size_t>(events_per_thread, 1);
+    s.dropped.store(0);
+    s.generation.fetch_add(1, std::memory_order_release);
+    s.recording.store(true);
+}
+
+void stop() {
+    session().recording.store(false);
+}
+
+uint64_t dropped() {
+    return session().dropped.load();
+}
+
+std::string to_json() {
+    Session& s = session();
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        buffers = s.buffers;
+    }
+
+    const std::string pid = std::to_string(::getpid());
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&out, &first]() {
+        out += first ? "\n" : ",\n";
+        first = false;
+    };
+
+    for (const auto& buffer : buffers) {
+        const std::string thread = "\"pid\":" + pid + ",\"tid\":" + std::to_string(buffer->tid);
+        separator();
+        out += "{\"ph\":\"M\",\"name\":\"thread_name\"," + thread + ",\"args\":{\"name\":\"";
+        append_escaped(out, buffer->name);
+        out += "\"}}";
+
+        const size_t count = std::min(buffer->count.load(std::memory_order_acquire), buffer->events.size());
+        for (size_t i = 0; i < count; ++i) {
+            const Event& event = buffer->events[i];
+            separator();
+            out += "{\"ph\":\"X\",\"cat\":\"";
+            append_escaped(out, event.category);
+            out += "\",\"name\":\"";
+            append_escaped(out, event.name);
+            out += "\"," + thread + ",\"ts\":";
+            append_microseconds(out, event.start_ns);
+            out += ",\"dur\":";
+            append_microseconds(out, event.duration_ns);
+            if (event.detail[0] != '\0') {
+                out += ",\"args\":{\"detail\":\"";
+                append_escaped(out, event.detail);
+                out += "\"}";
+            }
+            out += "}";
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+Span::Span(const char* category, const char* name, const std::string& detail)
+    : category_(category), name_(name), start_ns_(0) {
+    if (!session().recording.load(std::memory_order_relaxed)) {
+        return;
+    }
+    const size_t length = std::min(detail.size(), DETAIL_SIZE - 1);
+    std::memcpy(detail_, detail.data(), length);
+    detail_[length] = '\0';
+    start_ns_ = now_ns();
+}
+
+Span::~Span() {
+    if (start_ns_ == 0) {
+        return;
+    }
+    const uint64_t end_ns = now_ns();
+    ThreadBuffer& buffer = thread_buffer();
+    const size_t index = buffer.count.load(std::memory_order_relaxed);
+    if (index >= buffer.events.size()) {
+        session().dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Event& event = buffer.events[index];
+    event.category = category_;
+    event.name = name_;
+    event.start_ns = start_ns_;
+    event.duration_ns = end_ns - start_ns_;
+    std::memcpy(event.detail, detail_, std::strlen(detail_) + 1);
+    buffer.count.store(index + 1, std::memory_order_release);
+}
+#else
+bool supported() {
+    return false;
+}
+
+void start(size_t) {
+    throw TraceError("not supported by this build");
+}
+
+void stop() {
+}
+
+uint64_t dropped() {
+    return 0;
+}
+
+std::string to_json() {
+    return "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[]}\n";
+}
+#endif
+
+void write(const std::string& path) {
+    std::ofstream out(path, std::ofstream::trunc);
+    out << to_json();
+    out.close();
+    if (!out) {
+        throw TraceError("can not write " + path);
+    }
+}
+
+} // namespace trace
@@ -0,0 +1,103 @@
+/**
+ * Timeline of update operations in Chrome trace-event format.
+ *
+ * Spans mark update operations, Bootstate queries, U-Boot environment
+ * accesses, external programs and the I/O phases. Each thread appends its
+ * finished spans to its own preallocated buffer without locking, the buffers
+ * are exported as JSON that Perfetto (ui.perfetto.dev) and chrome://tracing
+ * open. Spans are compiled in with fs_trace only; otherwise Span is empty and
+ * disappears. Compiled in, a span outside of a recording costs one atomic load.
+ */
+
+#pragma once
+
+#include <fus_updater_lib/config.h>
+#include "./../BaseException.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace trace {
+
+    /* finished spans kept per thread, later spans are dropped */
+    constexpr size_t DEFAULT_EVENTS_PER_THREAD = 4096;
+    /* bytes of span details kept, e.g. of a command line */
+    constexpr size_t DETAIL_SIZE = 48;
+
+    class TraceError : public fs::BaseFSUpdateException {
+    public:
+        /**
+         * Tracing is not supported by this build or the trace can not be written.
+         * @param msg Reason.
+         */
+        explicit TraceError(const std::string& msg) {
+            this->error_msg = std::string("Trace: ") + msg;
+        }
+    };
+
+    /**
+     * @return Spans are compiled in (fs_trace).
+     */
+    bool supported();
+
+    /**
+     * Discard recorded spans and record the following ones.
+     * @param events_per_thread Buffer size of each recording thread.
+     * @throw TraceError Not supported by this build.
+     */
+    void start(size_t events_per_thread = DEFAULT_EVENTS_PER_THREAD);
+
+    /**
+     * Stop recording, recorded spans are kept for export.
+     */
+    void stop();
+
+    /**
+     * @return Spans recorded since start(), {"traceEvents": [...]}.
+     */
+    std::string to_json();
+
+    /**
+     * Write to_json() to a file.
+     * @throw TraceError
+     */
+    void write(const std::string& path);
+
+    /**
+     * @return Spans dropped since start() because a thread buffer was full.
+     */
+    uint64_t dropped();
+
+#if FUS_LIB_TRACE
+    class Span {
+    private:
+        const char* category_;
+        const char* name_;
+        uint64_t start_ns_;
+        char detail_[DETAIL_SIZE];
+
+    public:
+        /**
+         * Record span from construction until destruction.
+         * @param category Static string, e.g. "uboot".
+         * @param name Static string, e.g. "flush".
+         * @param detail Copied and truncated, e.g. command line.
+         */
+        Span(const char* category, const char* name, const std::string& detail = std::string());
+        ~Span();
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+    };
+#else
+    class Span {
+    public:
+        Span(const char*, const char*, const std::string& = std::string()) {}
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+    };
+#endif
+
+} // namespace trace
@@ -1,20 +1,33 @@
 #include "UBoot.h"
+#include "../trace/trace.h"
 #include <climits>
 #include <cstdlib>
 #include <algorithm>
+#include <chrono>
 
 extern "C"{
     #include <errno.h>
 }
 UBoot::UBoot::UBoot(const std::string & config_path)
-    : ctx(nullptr), env_open_count_(0)
+    : ctx(nullptr), config_path_(config_path), env_open_count_(0)
 {
+}
+
+void UBoot::UBoot::initializeContext()
+{
+    /* called with guard held; libubootenv is set up on first environment access */
+    if (this->ctx != nullptr)
+    {
+        return;
+    }
+
     if (::libuboot_initialize(&this->ctx, NULL) < 0)
     {
+        this->ctx = nullptr;
         throw(UBootEnv("Init libuboot failed"));
     }
 
-    if (::libuboot_read_config(ctx, config_path.c_str()) < 0)
+    if (::libuboot_read_config(ctx, this->config_path_.c_str()) < 0)
     {
 	    ::libuboot_exit(this->ctx);
         this->ctx = nullptr;
@@ -22,6 +35,18 @@ UBoot::UBoot::UBoot(const std::string & config_path)
     }
 }
 
+void UBoot::UBoot::loadEnv()
+{
+    trace::Span span("uboot", "open");
+    this->initializeContext();
+    if (::libuboot_open(this->ctx) < 0)
+    {
+        ::libuboot_close(this->ctx);
+        throw(UBootEnv("Opening of Env failed"));
+    }
+    ++this->statistics_.reads;
+}
+
 UBoot::UBoot::~UBoot()
 {
     if (this->env_open_count_ > 0)
@@ -42,11 +67,7 @@ void UBoot::UBoot::openEnv()
         ++this->env_open_count_;
         return;
     }
-    if (::libuboot_open(this->ctx) < 0)
-    {
-        ::libuboot_close(this->ctx);
-        throw(UBootEnv("Opening of Env failed"));
-    }
+    this->loadEnv();
     this->env_open_count_ = 1;
 }
 
@@ -71,11 +92,7 @@ std::string UBoot::UBoot::getVariable(const std::string & variableName)
 
     if (!caller_owns_env)
     {
-        if (::libuboot_open(this->ctx) < 0)
-        {
-            ::libuboot_close(this->ctx);
-            throw(UBootEnv("Opening of Env failed"));
-        }
+        this->loadEnv();
     }
 
     char * ptr_var = ::libuboot_get_env(this->ctx, variableName.c_str());
@@ -114,15 +131,23 @@ void UBoot::UBoot::freeVariables()
 void UBoot::UBoot::flushEnvironment()
 {
     std::lock_guard<std::mutex> lockGuard(this->guard);
+    /* failed flushes are accounted too, they cost the same on the device */
+    struct FlushTimer
+    {
+        uint64_t &total;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ~FlushTimer()
+        {
+            total += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count());
+        }
+    } flush_timer{this->statistics_.flush_us};
+    trace::Span span("uboot", "flush");
     const bool caller_owns_env = (this->env_open_count_ > 0);
 
     if (!caller_owns_env)
     {
-        if (::libuboot_open(this->ctx) < 0)
-        {
-            ::libuboot_close(this->ctx);
-            throw(UBootEnv("Opening of Env failed"));
-        }
+        this->loadEnv();
     }
 
     for (const auto & entry: this->variables)
@@ -138,6 +163,7 @@ void UBoot::UBoot::flushEnvironment()
         }
     }
     const int status_env_store = ::libuboot_env_store(this->ctx);
+    ++this->statistics_.writes;
     if (status_env_store != 0)
     {
         if (!caller_owns_env)
@@ -240,3 +266,9 @@ char UBoot::UBoot::getVariable(const std::string &variable_name, const std::vect
 
     return return_value;
 }
+
+UBoot::EnvStatistics UBoot::UBoot::getStatistics()
+{
+    std::lock_guard<std::mutex> lockGuard(this->guard);
+    return this->statistics_;
+}
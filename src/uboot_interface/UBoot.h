@@ -7,6 +7,7 @@ extern "C" {
 
 #include <string>
 #include <exception>
+#include <cstdint>
 #include <map>
 #include <mutex>
 #include <vector>
@@ -121,17 +122,48 @@ namespace UBoot
     /// UBoot declaration
     ///////////////////////////////////////////////////////////////////////////
 
+    /**
+     * Accesses of the UBoot-Environment storage since construction.
+     * Changes made by other processes, e.g. RAUC, are not included.
+     */
+    struct EnvStatistics
+    {
+        /* environment loaded from storage */
+        uint64_t reads = 0;
+        /* environment stored */
+        uint64_t writes = 0;
+        /* time spent in flushEnvironment() */
+        uint64_t flush_us = 0;
+    };
+
     class UBoot
     {
         private:
             struct uboot_ctx *ctx;
+            const std::string config_path_;
             std::map<std::string, std::string> variables;
             std::mutex guard;
             unsigned int env_open_count_;
+            EnvStatistics statistics_;
+
+            /**
+             * Load the UBoot-Environment from storage. Must be called with guard held.
+             * @throw UBootEnv If the environment cannot be opened.
+             */
+            void loadEnv();
+
+            /**
+             * Initialize libubootenv and read the fw_env.config on first use.
+             * Must be called with guard held.
+             * @throw UBootEnv If libubootenv or the configuration cannot be initialized.
+             */
+            void initializeContext();
 
         public:
             /**
              * Constructor of the UBoot-object.
+             * Only the configuration path is stored; libubootenv is initialized
+             * on the first access of the UBoot-Environment.
              * Be careful with multiple objects to handle parallel access.
              * @param config_path Path to the fw_env.config file which sets the UBoot-Environment memory.
              */
@@ -245,5 +277,12 @@ namespace UBoot
              * @throw UBootEnvVarNotAllowedContent When validator returns false.
              */
             std::string getVariable(const std::string &variable_name, bool (*validator)(const std::string &));
+
+            /**
+             * Return number of environment reads and writes, e.g. to compare
+             * the flash wear of update operations.
+             * @return Statistics since construction.
+             */
+            EnvStatistics getStatistics();
     };
 }
@@ -0,0 +1,95 @@
+/**
+ * Blake3 matches the official test vectors, fed at once and in pieces, and
+ * hash_file() returns the same digest with one and with several threads,
+ * also for files just above one and two segments.
+ */
+
+#include "test_util.h"
+
+#include "handle_update/blake3.h"
+
+namespace {
+    struct Vector {
+        size_t length;
+        const char* digest;
+    };
+
+    constexpr size_t SEGMENT = updater::blake3::SEGMENT_SIZE;
+
+    /* official vectors up to 1025 bytes, larger inputs hashed with the
+     * reference implementation; input byte i is i % 251 */
+    const Vector VECTORS[] = {
+        {0, "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262"},
+        {1, "2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213"},
+        {1023, "10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11"},
+        {1024, "42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7"},
+        {1025, "d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444"},
+        {SEGMENT, "74cb441fd087764ca9c3694da742ebe30cbeb3060a17009ca81825c7a8d10343"},
+        {SEGMENT + 1, "2f053cd7472cf0cd2f9adaf45c1180255b91b9a865404a63671a0ee5f792ed33"},
+        {SEGMENT + 1025, "860f19b5fefff01454de342be87a20059449529116a20fb22a21da665aafa071"},
+        {2 * SEGMENT, "96fbba37478c16b7614c890b26832f67b541cf14e69ab8ebf0c739818588c9f1"},
+        {2 * SEGMENT + 1, "52dc212cb4cc61cb94d25bd7b1d47b256e4c3a6d68956df50c235c37a2aeacd7"},
+        {3 * SEGMENT + 7, "8f3f67e881a256c8a2cc45cce1a0b500a1dd0500623fe5363fe7f77518267c5a"},
+    };
+
+    std::vector<uint8_t> make_input(size_t length) {
+        std::vector<uint8_t> input(length);
+        for (size_t i = 0; i < length; ++i) {
+            input[i] = static_cast<uint8_t>(i % 251);
+        }
+        return input;
+    }
+
+    std::string to_hex(const std::array<uint8_t, updater::blake3::OUT_LEN>& digest) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        for (uint8_t byte : digest) {
+            hex.push_back(digits[byte >> 4]);
+            hex.push_back(digits[byte & 0x0f]);
+        }
+        return hex;
+    }
+}
+
+int main() {
+    test::TempDir dir;
+    const std::filesystem::path path = dir.path() / "input";
+
+    for (const Vector& vector : VECTORS) {
+        const std::vector<uint8_t> input = make_input(vector.length);
+        std::fprintf(stderr, "length %zu\n", vector.length);
+
+        updater::Blake3 whole;
+        whole.update(input.data(), input.size());
+        CHECK(to_hex(whole.final()) == vector.digest);
+
+        /* pieces not aligned to blocks or chunks */
+        updater::Blake3 pieces;
+        for (size_t offset = 0; offset < input.size(); offset += 1000) {
+            pieces.update(input.data() + offset, std::min<size_t>(1000, input.size() - offset));
+        }
+        CHECK(to_hex(pieces.final()) == vector.digest);
+
+        test::write_file(path, input);
+        CHECK(updater::Blake3::hash_file(path.string(), 1) == vector.digest);
+        CHECK(updater::Blake3::hash_file(path.string(), 4) == vector.digest);
+    }
+
+    /* set flag stops hashing */
+    {
+        test::write_file(path, make_input(2 * SEGMENT));
+        const std::atomic<bool> cancel{true};
+        CHECK(updater::Blake3::hash_file(path.string(), 2, &cancel).empty());
+    }
+
+    bool failed = false;
+    try {
+        updater::Blake3::hash_file((dir.path() / "missing").string());
+    } catch (const std::runtime_error& ex) {
+        std::fprintf(stderr, "failed: %s\n", ex.what());
+        failed = true;
+    }
+    CHECK(failed);
+
+    return test::result();
+}
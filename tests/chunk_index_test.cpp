@@ -0,0 +1,148 @@
+/**
+ * ChunkIndex::assemble copies the chunks of the new image found in the seed
+ * from there and only the others from the bundle, also when data moved
+ * between the two images. The result equals the new image, and a bundle
+ * chunk that does not match the index is rejected.
+ */
+
+#include "test_util.h"
+
+#include "handle_update/chunkIndex.h"
+
+#include <algorithm>
+#include <random>
+
+extern "C" {
+    #include <fcntl.h>
+    #include <unistd.h>
+}
+
+namespace {
+    constexpr uint32_t MIN_SIZE = 2048;
+    constexpr uint32_t AVG_SIZE = 8192;
+    constexpr uint32_t MAX_SIZE = 32768;
+    constexpr size_t IMAGE_SIZE = 1024 * 1024;
+    /* payload follows a header in the application image */
+    constexpr uint64_t PAYLOAD_OFFSET = 512;
+
+    void append_be(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+        for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    std::vector<uint8_t> make_record(uint64_t image_size, const std::vector<updater::ChunkIndex::Chunk>& chunks) {
+        std::vector<uint8_t> record;
+        append_be(record, updater::cdc::ALGORITHM_GEAR_SHA256, 4);
+        append_be(record, MIN_SIZE, 4);
+        append_be(record, AVG_SIZE, 4);
+        append_be(record, MAX_SIZE, 4);
+        append_be(record, image_size, 8);
+        append_be(record, chunks.size(), 4);
+        for (const updater::ChunkIndex::Chunk& chunk : chunks) {
+            append_be(record, chunk.length, 4);
+            record.insert(record.end(), chunk.digest.begin(), chunk.digest.end());
+        }
+        return record;
+    }
+
+    /* index of image, split with the same parameters as on installation */
+    updater::ChunkIndex make_index(const std::filesystem::path& image, uint64_t size,
+                                   const std::shared_ptr<logger::LoggerHandler>& logger) {
+        const updater::ChunkIndex parameters = updater::ChunkIndex::parse(make_record(1, {{0, 1, {}}}));
+        const int fd = ::open(image.c_str(), O_RDONLY | O_CLOEXEC);
+        const std::vector<updater::ChunkIndex::Chunk> chunks = parameters.split(fd, size, logger);
+        ::close(fd);
+        return updater::ChunkIndex::parse(make_record(size, chunks));
+    }
+
+    void write_bundle(const std::filesystem::path& path, const std::vector<uint8_t>& image) {
+        std::vector<uint8_t> bundle(PAYLOAD_OFFSET, 0xee);
+        bundle.insert(bundle.end(), image.begin(), image.end());
+        test::write_file(path, bundle);
+    }
+}
+
+int main() {
+    test::TempDir dir;
+    const auto sink = std::make_shared<test::CaptureSink>();
+    const std::shared_ptr<logger::LoggerHandler> logger = logger::LoggerHandler::initLogger(sink);
+    const std::filesystem::path seed = dir.path() / "active.img";
+    const std::filesystem::path image = dir.path() / "new.img";
+    const std::filesystem::path bundle = dir.path() / "update.img";
+    const std::filesystem::path dest = dir.path() / "assembled.img";
+
+    std::mt19937 random(38);
+    auto random_bytes = [&random](size_t length) {
+        std::vector<uint8_t> bytes(length);
+        std::generate(bytes.begin(), bytes.end(), [&random]() { return static_cast<uint8_t>(random()); });
+        return bytes;
+    };
+
+    /* new image: 100 bytes inserted at the start, 16 KiB in the middle replaced */
+    const std::vector<uint8_t> active = random_bytes(IMAGE_SIZE);
+    std::vector<uint8_t> updated = random_bytes(100);
+    updated.insert(updated.end(), active.begin(), active.end());
+    const std::vector<uint8_t> changed = random_bytes(16 * 1024);
+    const size_t changed_at = IMAGE_SIZE / 2;
+    std::copy(changed.begin(), changed.end(), updated.begin() + changed_at);
+
+    test::write_file(seed, active);
+    test::write_file(image, updated);
+    write_bundle(bundle, updated);
+    const updater::ChunkIndex index = make_index(image, updated.size(), logger);
+    CHECK(index.chunks().size() > 50);
+    CHECK(std::all_of(index.chunks().begin(), index.chunks().end(), [](const updater::ChunkIndex::Chunk& chunk) {
+        return chunk.length <= MAX_SIZE;
+    }));
+
+    /* moved chunks are found in the seed, changed ones come from the bundle */
+    {
+        const updater::ChunkReuseStatistics stats = index.assemble(seed.string(), bundle.string(), PAYLOAD_OFFSET,
+                                                                   dest.string(), logger);
+        std::fprintf(stderr, "%zu/%zu chunks reused, %llu bytes copied\n", stats.reused_chunks, stats.chunks,
+                     static_cast<unsigned long long>(stats.copied_bytes));
+        CHECK(test::read_file(dest) == updated);
+        CHECK(stats.chunks == index.chunks().size());
+        CHECK(stats.reused_bytes + stats.copied_bytes == updated.size());
+        CHECK(stats.reused_chunks + 8 >= stats.chunks);
+        CHECK(stats.copied_bytes >= changed.size());
+        CHECK(stats.copied_bytes < 8 * MAX_SIZE);
+    }
+
+    /* seed equal to the new image */
+    {
+        const updater::ChunkReuseStatistics stats = index.assemble(image.string(), bundle.string(), PAYLOAD_OFFSET,
+                                                                   dest.string(), logger);
+        CHECK(test::read_file(dest) == updated);
+        CHECK(stats.reused_chunks == stats.chunks);
+        CHECK(stats.copied_bytes == 0);
+    }
+
+    /* no seed */
+    {
+        const updater::ChunkReuseStatistics stats = index.assemble((dir.path() / "missing").string(), bundle.string(),
+                                                                   PAYLOAD_OFFSET, dest.string(), logger);
+        CHECK(test::read_file(dest) == updated);
+        CHECK(stats.reused_chunks == 0);
+        CHECK(stats.copied_bytes == updated.size());
+        CHECK(sink->wait_for("no seed"));
+    }
+
+    /* bundle corrupted in a chunk not in the seed */
+    {
+        std::vector<uint8_t> corrupted = updated;
+        corrupted[changed_at + changed.size() / 2] ^= 0x01;
+        write_bundle(bundle, corrupted);
+        bool rejected = false;
+        try {
+            index.assemble(seed.string(), bundle.string(), PAYLOAD_OFFSET, dest.string(), logger);
+        } catch (const updater::ChunkAssemblyFailed& ex) {
+            std::fprintf(stderr, "rejected: %s\n", ex.what());
+            rejected = std::string(ex.what()).find("does not match index") != std::string::npos;
+        }
+        CHECK(rejected);
+    }
+
+    return test::result();
+}
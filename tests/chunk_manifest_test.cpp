@@ -0,0 +1,126 @@
+/**
+ * ChunkManifest::verify_file accepts a payload whose chunks all match and
+ * rejects a corrupted one, naming the first bad chunk. ChunkStreamVerifier
+ * stops at the same chunk, and parse() rejects a manifest whose digest list
+ * does not match its root digest.
+ */
+
+#include "test_util.h"
+
+#include "handle_update/chunkManifest.h"
+#include "handle_update/hashEngine.h"
+
+#include <algorithm>
+#include <random>
+
+namespace {
+    constexpr uint32_t CHUNK_SIZE = updater::chunk::MIN_CHUNK_SIZE;
+    /* ten full chunks and a short last one */
+    constexpr size_t PAYLOAD_SIZE = 10 * CHUNK_SIZE + 100;
+    /* payload follows a header in the application image */
+    constexpr uint64_t PAYLOAD_OFFSET = 512;
+
+    void append_be(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+        for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    /* algorithm, chunk size, payload size, count, root digest, chunk digests */
+    std::vector<uint8_t> make_manifest(const std::vector<uint8_t>& payload) {
+        std::unique_ptr<updater::HashEngine> hash = updater::HashEngine::create("SHA-256");
+        std::vector<uint8_t> digests;
+        for (size_t offset = 0; offset < payload.size(); offset += CHUNK_SIZE) {
+            hash->update(payload.data() + offset, std::min<size_t>(CHUNK_SIZE, payload.size() - offset));
+            const std::vector<uint8_t> digest = hash->final();
+            digests.insert(digests.end(), digest.begin(), digest.end());
+        }
+        hash->update(digests.data(), digests.size());
+        const std::vector<uint8_t> root = hash->final();
+
+        std::vector<uint8_t> record;
+        append_be(record, updater::chunk::HASH_SHA256, 4);
+        append_be(record, CHUNK_SIZE, 4);
+        append_be(record, payload.size(), 8);
+        append_be(record, digests.size() / updater::chunk::DIGEST_SIZE, 4);
+        record.insert(record.end(), root.begin(), root.end());
+        record.insert(record.end(), digests.begin(), digests.end());
+        return record;
+    }
+
+    void write_image(const std::filesystem::path& path, const std::vector<uint8_t>& payload) {
+        std::vector<uint8_t> image(PAYLOAD_OFFSET, 0xee);
+        image.insert(image.end(), payload.begin(), payload.end());
+        test::write_file(path, image);
+    }
+
+    /* index of the chunk ChunkStreamVerifier rejects, -1 if none */
+    long stream_mismatch(const updater::ChunkManifest& manifest, const std::vector<uint8_t>& payload) {
+        updater::ChunkStreamVerifier verifier(manifest);
+        try {
+            /* pieces across chunk borders */
+            for (size_t offset = 0; offset < payload.size(); offset += 3000) {
+                verifier.update(payload.data() + offset, std::min<size_t>(3000, payload.size() - offset));
+            }
+            verifier.finish();
+        } catch (const updater::ChunkMismatch& ex) {
+            const std::string msg = ex.what();
+            return std::stol(msg.substr(msg.find("chunk ") + 6));
+        }
+        return -1;
+    }
+}
+
+int main() {
+    test::TempDir dir;
+    const auto sink = std::make_shared<test::CaptureSink>();
+    const std::shared_ptr<logger::LoggerHandler> logger = logger::LoggerHandler::initLogger(sink);
+    const std::filesystem::path image = dir.path() / "app.img";
+
+    std::vector<uint8_t> payload(PAYLOAD_SIZE);
+    std::mt19937 random(30);
+    std::generate(payload.begin(), payload.end(), [&random]() { return static_cast<uint8_t>(random()); });
+    const updater::ChunkManifest manifest = updater::ChunkManifest::parse(make_manifest(payload));
+    CHECK(manifest.chunk_count() == 11);
+    CHECK(manifest.chunk_length(10) == 100);
+
+    /* intact payload */
+    write_image(image, payload);
+    CHECK(manifest.verify_file(image.string(), PAYLOAD_OFFSET, logger, 1));
+    CHECK(manifest.verify_file(image.string(), PAYLOAD_OFFSET, logger, 4));
+    CHECK(stream_mismatch(manifest, payload) == -1);
+
+    /* chunks 3 and 7 corrupted: the first bad one is named */
+    std::vector<uint8_t> corrupted = payload;
+    corrupted[3 * CHUNK_SIZE + 17] ^= 0x01;
+    corrupted[7 * CHUNK_SIZE] ^= 0x80;
+    write_image(image, corrupted);
+    CHECK(!manifest.verify_file(image.string(), PAYLOAD_OFFSET, logger, 1));
+    CHECK(sink->wait_for("Payload chunk 3 does not match manifest"));
+    CHECK(!manifest.verify_file(image.string(), PAYLOAD_OFFSET, logger, 4));
+    CHECK(stream_mismatch(manifest, corrupted) == 3);
+
+    /* short last chunk */
+    corrupted = payload;
+    corrupted.back() ^= 0xff;
+    CHECK(stream_mismatch(manifest, corrupted) == 10);
+
+    /* image shorter than the payload */
+    std::vector<uint8_t> truncated(payload.begin(), payload.end() - 1);
+    write_image(image, truncated);
+    CHECK(!manifest.verify_file(image.string(), PAYLOAD_OFFSET, logger, 2));
+
+    /* digest list does not match the root digest */
+    std::vector<uint8_t> record = make_manifest(payload);
+    record.back() ^= 0x01;
+    bool rejected = false;
+    try {
+        updater::ChunkManifest::parse(record);
+    } catch (const updater::ChunkManifestInvalid& ex) {
+        std::fprintf(stderr, "rejected: %s\n", ex.what());
+        rejected = true;
+    }
+    CHECK(rejected);
+
+    return test::result();
+}
@@ -0,0 +1,97 @@
+/**
+ * applicationImage::copyImage resumes an interrupted copy at the last
+ * checkpoint of its journal, and the result equals the payload.
+ */
+
+#include "test_util.h"
+
+#include "handle_update/applicationImage.h"
+#include "handle_update/progressJournal.h"
+
+extern "C" {
+    #include <zlib.h>
+}
+
+#include <algorithm>
+#include <random>
+
+namespace {
+    /* more than two checkpoints and not a multiple of the copy buffer */
+    constexpr uint64_t PAYLOAD_SIZE = 2 * updater::journal::CHECKPOINT_INTERVAL + 12345;
+
+    void append_be(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+        for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    /* v1 image: size, version, crc32 of both, payload, timestamp */
+    std::vector<uint8_t> make_image(const std::vector<uint8_t>& payload) {
+        std::vector<uint8_t> image;
+        append_be(image, payload.size(), 8);
+        append_be(image, APP_IMAGE_VERSION_1, 4);
+        append_be(image, crc32(crc32(0L, Z_NULL, 0), image.data(), 12), 4);
+        image.insert(image.end(), payload.begin(), payload.end());
+        const std::string timestamp = "2026-01-01 00:00:00 +0000";
+        image.insert(image.end(), timestamp.begin(), timestamp.end());
+        image.resize(image.size() + SIZE_CERT_APP_DATE_SIGN - timestamp.size(), 0);
+        return image;
+    }
+
+    /* state left by a copy interrupted after its first checkpoint, with
+     * unsynced data after it */
+    void interrupt_copy(const std::string& image_path, const std::string& dest, const std::vector<uint8_t>& payload,
+                        bool corrupt_prefix) {
+        const uint64_t checkpoint = updater::journal::CHECKPOINT_INTERVAL;
+        std::vector<uint8_t> partial(payload.begin(), payload.begin() + checkpoint + 1024 * 1024);
+        std::fill(partial.begin() + checkpoint, partial.end(), 0xa5);
+        if (corrupt_prefix) {
+            partial[4096] ^= 0xff;
+        }
+        test::write_file(dest, partial);
+        updater::ProgressJournal(dest + ".journal", "copy", image_path).checkpoint({0, checkpoint});
+    }
+}
+
+int main() {
+    test::TempDir dir;
+    auto sink = std::make_shared<test::CaptureSink>();
+    const std::shared_ptr<logger::LoggerHandler> logger = logger::LoggerHandler::initLogger(sink);
+
+    std::vector<uint8_t> payload(PAYLOAD_SIZE);
+    std::mt19937 random(42);
+    std::generate(payload.begin(), payload.end(), [&random]() { return static_cast<uint8_t>(random()); });
+    const std::string image_path = (dir.path() / "update.app").string();
+    test::write_file(image_path, make_image(payload));
+
+    /* resumed copy */
+    {
+        const std::string dest = (dir.path() / "resumed.app").string();
+        interrupt_copy(image_path, dest, payload, false);
+        applicationImage image(image_path, logger);
+        image.copyImage(dest);
+        CHECK(sink->wait_for("copyImage: resume at " + std::to_string(updater::journal::CHECKPOINT_INTERVAL)));
+        CHECK(test::read_file(dest) == payload);
+        CHECK(!std::filesystem::exists(dest + ".journal"));
+    }
+
+    /* copied part differs from the source, copy starts over */
+    {
+        const std::string dest = (dir.path() / "restarted.app").string();
+        interrupt_copy(image_path, dest, payload, true);
+        applicationImage image(image_path, logger);
+        image.copyImage(dest);
+        CHECK(test::read_file(dest) == payload);
+        CHECK(!std::filesystem::exists(dest + ".journal"));
+    }
+
+    /* uninterrupted copy */
+    {
+        const std::string dest = (dir.path() / "copied.app").string();
+        applicationImage image(image_path, logger);
+        image.copyImage(dest);
+        CHECK(test::read_file(dest) == payload);
+    }
+
+    return test::result();
+}
@@ -0,0 +1,231 @@
+/**
+ * HttpSource resumes an interrupted transfer with a Range request only if
+ * the resource has a validator. Without one it starts over while nothing
+ * was read, and fails once the reader holds data. A local HTTP server
+ * stands in for the update server.
+ */
+
+#include "test_util.h"
+
+#include "handle_update/httpSource.h"
+
+extern "C" {
+    #include <arpa/inet.h>
+    #include <netinet/in.h>
+    #include <strings.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+}
+
+#include <algorithm>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <istream>
+#include <random>
+
+namespace {
+    constexpr size_t BODY_SIZE = 512 * 1024;
+    /* sent by the first response before the connection drops */
+    constexpr size_t CUT = 128 * 1024;
+
+    /* serves body, drops the first connection after CUT bytes */
+    class Server {
+    private:
+        std::string body_;
+        std::string etag_;
+        int listen_fd_ = -1;
+        uint16_t port_ = 0;
+        std::thread thread_;
+        std::mutex lock_;
+        std::condition_variable changed_;
+        std::vector<std::string> requests_;
+        bool release_ = false;
+
+        static void send_all(int fd, const std::string& data) {
+            size_t sent = 0;
+            while (sent < data.size()) {
+                const ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0) {
+                    return;
+                }
+                sent += static_cast<size_t>(n);
+            }
+        }
+
+        void serve(int fd, bool first) {
+            std::string request;
+            char buffer[4096];
+            while (request.find("\r\n\r\n") == std::string::npos) {
+                const ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+                if (n <= 0) {
+                    return;
+                }
+                request.append(buffer, static_cast<size_t>(n));
+            }
+            {
+                std::lock_guard<std::mutex> guard(lock_);
+                requests_.push_back(request);
+            }
+            changed_.notify_all();
+
+            size_t start = 0;
+            const size_t range = header(request, "Range: bytes=");
+            if (range != std::string::npos && header(request, "If-Range: " + etag_) != std::string::npos) {
+                start = std::strtoul(request.c_str() + range, nullptr, 10);
+            }
+            std::string response = (start > 0) ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+            if (!etag_.empty()) {
+                response += "ETag: " + etag_ + "\r\n";
+            }
+            if (start > 0) {
+                response += "Content-Range: bytes " + std::to_string(start) + "-" + std::to_string(body_.size() - 1) +
+                            "/" + std::to_string(body_.size()) + "\r\n";
+            }
+            response += "Content-Length: " + std::to_string(body_.size() - start) + "\r\nConnection: close\r\n\r\n";
+            send_all(fd, response);
+
+            if (first) {
+                send_all(fd, body_.substr(start, CUT));
+                std::unique_lock<std::mutex> guard(lock_);
+                changed_.wait(guard, [this]() { return release_; });
+                return;
+            }
+            send_all(fd, body_.substr(start));
+        }
+
+        void run() {
+            bool first = true;
+            while (true) {
+                const int fd = ::accept(listen_fd_, nullptr, nullptr);
+                if (fd < 0) {
+                    return;
+                }
+                serve(fd, first);
+                first = false;
+                ::close(fd);
+            }
+        }
+
+    public:
+        Server(std::string body, std::string etag) : body_(std::move(body)), etag_(std::move(etag)) {
+            listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+            if (listen_fd_ < 0 || ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), length) != 0 ||
+                ::listen(listen_fd_, 4) != 0 ||
+                ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+                std::perror("listen");
+                std::exit(EXIT_FAILURE);
+            }
+            port_ = ntohs(address.sin_port);
+            thread_ = std::thread(&Server::run, this);
+        }
+
+        ~Server() {
+            release();
+            ::shutdown(listen_fd_, SHUT_RDWR);
+            thread_.join();
+            ::close(listen_fd_);
+        }
+
+        /* start of value after name, case insensitive */
+        static size_t header(const std::string& request, const std::string& name) {
+            for (size_t line = request.find("\r\n"); line != std::string::npos; line = request.find("\r\n", line + 2)) {
+                if (strncasecmp(request.c_str() + line + 2, name.c_str(), name.size()) == 0) {
+                    return line + 2 + name.size();
+                }
+            }
+            return std::string::npos;
+        }
+
+        std::string url() const {
+            return "http://127.0.0.1:" + std::to_string(port_) + "/update.fs";
+        }
+
+        /* let the first connection drop */
+        void release() {
+            {
+                std::lock_guard<std::mutex> guard(lock_);
+                release_ = true;
+            }
+            changed_.notify_all();
+        }
+
+        bool wait_requests(size_t count) {
+            std::unique_lock<std::mutex> guard(lock_);
+            return changed_.wait_for(guard, std::chrono::seconds(10), [this, count]() { return requests_.size() >= count; });
+        }
+
+        std::vector<std::string> requests() {
+            std::lock_guard<std::mutex> guard(lock_);
+            return requests_;
+        }
+    };
+
+    std::string read_all(std::istream& in) {
+        return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    }
+}
+
+int main() {
+    std::signal(SIGPIPE, SIG_IGN);
+    const std::shared_ptr<logger::LoggerHandler> logger =
+        logger::LoggerHandler::initLogger(std::make_shared<test::CaptureSink>());
+
+    std::string body(BODY_SIZE, '\0');
+    std::mt19937 random(7);
+    std::generate(body.begin(), body.end(), [&random]() { return static_cast<char>(random()); });
+
+    /* with validator: resumed with Range and If-Range */
+    {
+        Server server(body, "\"v1\"");
+        updater::HttpSource source(server.url(), logger);
+        std::istream in(&source);
+        std::string head(1024, '\0');
+        in.read(head.data(), static_cast<std::streamsize>(head.size()));
+        server.release();
+        const std::string data = head + read_all(in);
+        CHECK(data == body);
+        const std::vector<std::string> requests = server.requests();
+        CHECK(requests.size() == 2);
+        CHECK(requests.size() == 2 && Server::header(requests[1], "Range: bytes=") != std::string::npos);
+        CHECK(requests.size() == 2 && Server::header(requests[1], "If-Range: \"v1\"") != std::string::npos);
+    }
+
+    /* no validator, nothing read yet: starts over without Range */
+    {
+        Server server(body, "");
+        server.release();
+        updater::HttpSource source(server.url(), logger);
+        CHECK(server.wait_requests(2));
+        std::istream in(&source);
+        CHECK(read_all(in) == body);
+        const std::vector<std::string> requests = server.requests();
+        CHECK(requests.size() == 2 && Server::header(requests[1], "Range:") == std::string::npos);
+    }
+
+    /* no validator, reader holds data: fails instead of a ranged retry */
+    {
+        Server server(body, "");
+        updater::HttpSource source(server.url(), logger);
+        std::istream in(&source);
+        std::string head(1024, '\0');
+        in.read(head.data(), static_cast<std::streamsize>(head.size()));
+        server.release();
+        bool failed = false;
+        try {
+            read_all(in);
+            source.check();
+        } catch (const updater::HttpSourceError& ex) {
+            std::fprintf(stderr, "failed: %s\n", ex.what());
+            failed = true;
+        }
+        CHECK(failed);
+        CHECK(server.requests().size() == 1);
+    }
+
+    return test::result();
+}
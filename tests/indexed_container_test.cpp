@@ -0,0 +1,215 @@
+/**
+ * UpdateStore extracts the requested images of an indexed container only:
+ * the other members are not decompressed, so a corrupt one does not stop
+ * the extraction, and the checksum check covers the requested images.
+ * Without a selection every member is extracted; a missing component and a
+ * damaged member table are rejected.
+ */
+
+#include "test_util.h"
+
+#include "handle_update/UpdateStore.h"
+#include "handle_update/fs_exceptions.h"
+#include "handle_update/hashEngine.h"
+#include "handle_update/indexedContainer.h"
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <zlib.h>
+
+#include <cstring>
+#include <functional>
+#include <random>
+
+namespace {
+    struct Content {
+        std::string name;
+        std::vector<uint8_t> data;
+        uint32_t compression;
+    };
+
+    void append_be(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+        for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+            out.push_back(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    std::vector<uint8_t> bzip2(const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> out(data.size() + 64 * 1024);
+        size_t used = 0;
+        archive* a = archive_write_new();
+        archive_write_add_filter_bzip2(a);
+        archive_write_set_format_raw(a);
+        archive_write_open_memory(a, out.data(), out.size(), &used);
+        archive_entry* entry = archive_entry_new();
+        archive_entry_set_filetype(entry, AE_IFREG);
+        archive_write_header(a, entry);
+        archive_write_data(a, data.data(), data.size());
+        archive_entry_free(entry);
+        archive_write_close(a);
+        archive_write_free(a);
+        out.resize(used);
+        return out;
+    }
+
+    /* member table with CRC32, then the stored or compressed members */
+    std::vector<uint8_t> make_container(const std::vector<Content>& contents) {
+        std::vector<std::vector<uint8_t>> stored;
+        for (const Content& content : contents) {
+            stored.push_back(content.compression == updater::container::COMPRESSION_BZIP2 ? bzip2(content.data)
+                                                                                          : content.data);
+        }
+
+        std::vector<uint8_t> container(updater::container::MAGIC,
+                                       updater::container::MAGIC + updater::container::MAGIC_SIZE);
+        append_be(container, updater::container::VERSION, 4);
+        append_be(container, contents.size(), 4);
+        uint64_t offset = updater::container::HEADER_SIZE + contents.size() * updater::container::ENTRY_SIZE + 4;
+        for (size_t i = 0; i < contents.size(); ++i) {
+            std::vector<uint8_t> name(updater::container::NAME_SIZE, 0);
+            std::copy(contents[i].name.begin(), contents[i].name.end(), name.begin());
+            container.insert(container.end(), name.begin(), name.end());
+            append_be(container, offset, 8);
+            append_be(container, stored[i].size(), 8);
+            append_be(container, contents[i].data.size(), 8);
+            append_be(container, contents[i].compression, 4);
+            append_be(container, 0, 4);
+            offset += stored[i].size();
+        }
+        append_be(container, ::crc32(0, container.data(), static_cast<uInt>(container.size())), 4);
+        for (const std::vector<uint8_t>& member : stored) {
+            container.insert(container.end(), member.begin(), member.end());
+        }
+        return container;
+    }
+
+    /* update header declaring the container size, followed by the container */
+    std::vector<uint8_t> make_image(const std::vector<uint8_t>& container) {
+        fs::fs_header_v1_0 header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.info.magic, "FSLX", 4);
+        header.info.file_size_low = static_cast<uint32_t>(container.size());
+        std::memcpy(header.type, "CERT", 4);
+        std::vector<uint8_t> image(reinterpret_cast<const uint8_t*>(&header),
+                                   reinterpret_cast<const uint8_t*>(&header) + sizeof(header));
+        image.insert(image.end(), container.begin(), container.end());
+        return image;
+    }
+
+    std::string sha256_hex(const std::vector<uint8_t>& data) {
+        static const char digits[] = "0123456789abcdef";
+        std::unique_ptr<updater::HashEngine> hash = updater::HashEngine::create("SHA-256");
+        hash->update(data.data(), data.size());
+        std::string hex;
+        for (uint8_t byte : hash->final()) {
+            hex.push_back(digits[byte >> 4]);
+            hex.push_back(digits[byte & 0x0f]);
+        }
+        return hex;
+    }
+
+    std::vector<uint8_t> make_manifest(const std::vector<Content>& images) {
+        std::string text = "{\"images\": {\"updates\": [";
+        for (size_t i = 0; i < images.size(); ++i) {
+            text += (i > 0 ? ", " : "");
+            text += "{\"version\": \"2\", \"handler\": \"fus-updater\", \"file\": \"" + images[i].name +
+                    "\", \"hashes\": {\"sha256\": \"" + sha256_hex(images[i].data) + "\"}}";
+        }
+        text += "]}}";
+        return std::vector<uint8_t>(text.begin(), text.end());
+    }
+
+    /* extraction into a new directory below dir, false if rejected */
+    bool extract(const std::filesystem::path& image, const std::filesystem::path& target,
+                 const std::vector<std::string>& components, const std::shared_ptr<logger::LoggerHandler>& logger,
+                 const std::function<void(fs::UpdateStore&)>& check = nullptr) {
+        std::filesystem::create_directories(target);
+        fs::UpdateStore store(logger);
+        store.SetExtractDirectory(target);
+        try {
+            store.ExtractUpdateStore(image, components);
+        } catch (const fs::GenericException& ex) {
+            std::fprintf(stderr, "rejected: %s\n", ex.what());
+            return false;
+        }
+        if (check) {
+            check(store);
+        }
+        return true;
+    }
+}
+
+int main() {
+    test::TempDir dir;
+    const std::shared_ptr<logger::LoggerHandler> logger =
+        logger::LoggerHandler::initLogger(std::make_shared<test::CaptureSink>());
+    using updater::container::COMPRESSION_BZIP2;
+    using updater::container::COMPRESSION_STORED;
+
+    std::mt19937 random(47);
+    auto random_bytes = [&random](size_t length, unsigned range) {
+        std::vector<uint8_t> bytes(length);
+        std::generate(bytes.begin(), bytes.end(), [&random, range]() { return static_cast<uint8_t>(random() % range); });
+        return bytes;
+    };
+    const Content app{"update.app", random_bytes(512 * 1024, 256), COMPRESSION_STORED};
+    const Content fw{"update.fw", random_bytes(256 * 1024, 16), COMPRESSION_BZIP2};
+    const Content manifest{updater::manifest::FILE_NAME, make_manifest({app, fw}), COMPRESSION_STORED};
+    const std::filesystem::path image = dir.path() / "update.fs";
+    test::write_file(image, make_image(make_container({manifest, fw, app})));
+
+    /* application only */
+    {
+        const std::filesystem::path target = dir.path() / "app_only";
+        CHECK(extract(image, target, {"update.app"}, logger, [&target](fs::UpdateStore& store) {
+            CHECK(store.CheckUpdateSha256Sum(target));
+        }));
+        CHECK(test::read_file(target / "update.app") == app.data);
+        CHECK(!std::filesystem::exists(target / "update.fw"));
+        CHECK(test::read_file(target / updater::manifest::FILE_NAME) == manifest.data);
+    }
+
+    /* all members, the compressed one decompressed */
+    {
+        const std::filesystem::path target = dir.path() / "all";
+        CHECK(extract(image, target, {}, logger, [&target](fs::UpdateStore& store) {
+            CHECK(store.CheckUpdateSha256Sum(target));
+        }));
+        CHECK(test::read_file(target / "update.app") == app.data);
+        CHECK(test::read_file(target / "update.fw") == fw.data);
+    }
+
+    /* firmware corrupt: not touched when only the application is extracted */
+    {
+        std::vector<uint8_t> corrupted = make_image(make_container({manifest, fw, app}));
+        const size_t fw_offset = sizeof(fs::fs_header_v1_0) + updater::container::HEADER_SIZE +
+                                 3 * updater::container::ENTRY_SIZE + 4 + manifest.data.size();
+        std::fill(corrupted.begin() + fw_offset + 16, corrupted.begin() + fw_offset + 48, 0);
+        const std::filesystem::path corrupted_image = dir.path() / "corrupted.fs";
+        test::write_file(corrupted_image, corrupted);
+        const std::filesystem::path target = dir.path() / "corrupted";
+        CHECK(extract(corrupted_image, target, {"update.app"}, logger));
+        CHECK(test::read_file(target / "update.app") == app.data);
+        CHECK(!extract(corrupted_image, target, {}, logger));
+    }
+
+    /* requested image not in the container */
+    {
+        const Content fw_manifest{updater::manifest::FILE_NAME, make_manifest({fw}), COMPRESSION_STORED};
+        const std::filesystem::path fw_image = dir.path() / "firmware.fs";
+        test::write_file(fw_image, make_image(make_container({fw_manifest, fw})));
+        CHECK(!extract(fw_image, dir.path() / "missing", {"update.app"}, logger));
+        CHECK(extract(fw_image, dir.path() / "firmware", {"update.fw"}, logger));
+    }
+
+    /* member table damaged */
+    {
+        std::vector<uint8_t> damaged = make_image(make_container({manifest, fw, app}));
+        damaged[sizeof(fs::fs_header_v1_0) + updater::container::HEADER_SIZE + 40] ^= 0x01;
+        const std::filesystem::path damaged_image = dir.path() / "damaged.fs";
+        test::write_file(damaged_image, damaged);
+        CHECK(!extract(damaged_image, dir.path() / "damaged", {"update.app"}, logger));
+    }
+
+    return test::result();
+}
@@ -0,0 +1,91 @@
+/**
+ * SlotDigestIndex::matches hashes a slot image without a valid entry,
+ * records the digest and answers from the index afterwards. An entry is
+ * ignored once the slot file changes, also if its size and mtime are kept;
+ * forget() drops it and damaged index lines are skipped.
+ */
+
+#include "test_util.h"
+
+#include "handle_update/slotDigestIndex.h"
+#include "handle_update/hashEngine.h"
+
+#include <fstream>
+
+extern "C" {
+    #include <fcntl.h>
+    #include <sys/stat.h>
+}
+
+namespace {
+    std::vector<uint8_t> sha256(const std::vector<uint8_t>& data) {
+        std::unique_ptr<updater::HashEngine> hash = updater::HashEngine::create("SHA-256");
+        hash->update(data.data(), data.size());
+        return hash->final();
+    }
+
+    /* timestamps come from a coarse clock, let the next change get a new one */
+    void next_tick() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+}
+
+int main() {
+    test::TempDir dir;
+    const auto sink = std::make_shared<test::CaptureSink>();
+    const std::shared_ptr<logger::LoggerHandler> logger = logger::LoggerHandler::initLogger(sink);
+    const std::string slot_a = (dir.path() / "app_a.img").string();
+    const std::string slot_b = (dir.path() / "app_b.img").string();
+    const std::filesystem::path index_file = dir.path() / "slot_digests";
+    updater::SlotDigestIndex index(dir.path().string(), logger);
+
+    const std::vector<uint8_t> image_a = {'s', 'l', 'o', 't', ' ', 'a'};
+    const std::vector<uint8_t> image_b = {'s', 'l', 'o', 't', ' ', 'b'};
+    test::write_file(slot_a, image_a);
+    test::write_file(slot_b, image_b);
+
+    /* missing slot */
+    CHECK(!index.matches((dir.path() / "missing.img").string(), sha256(image_a)));
+
+    /* hashed on first use and recorded */
+    CHECK(!std::filesystem::exists(index_file));
+    CHECK(index.matches(slot_a, sha256(image_a)));
+    CHECK(sink->wait_for("hashed " + slot_a));
+    CHECK(std::filesystem::exists(index_file));
+    CHECK(!index.matches(slot_a, sha256(image_b)));
+    CHECK(index.matches(slot_b, sha256(image_b)));
+
+    /* recorded digest is used as long as the file is unchanged */
+    const std::vector<uint8_t> recorded = sha256({'r', 'e', 'c', 'o', 'r', 'd', 'e', 'd'});
+    index.record(slot_a, recorded);
+    CHECK(index.matches(slot_a, recorded));
+    CHECK(!index.matches(slot_a, sha256(image_a)));
+    CHECK(index.matches(slot_b, sha256(image_b)));
+
+    /* rewritten with the same size and mtime: the entry is ignored */
+    struct stat st;
+    CHECK(::stat(slot_a.c_str(), &st) == 0);
+    next_tick();
+    const std::vector<uint8_t> image_a2 = {'S', 'L', 'O', 'T', ' ', 'A'};
+    test::write_file(slot_a, image_a2);
+    const struct timespec times[2] = {{0, UTIME_OMIT}, st.st_mtim};
+    CHECK(::utimensat(AT_FDCWD, slot_a.c_str(), times, 0) == 0);
+    CHECK(!index.matches(slot_a, recorded));
+    CHECK(index.matches(slot_a, sha256(image_a2)));
+
+    /* forgotten entry */
+    index.record(slot_a, recorded);
+    index.forget(slot_a);
+    CHECK(!index.matches(slot_a, recorded));
+    CHECK(index.matches(slot_a, sha256(image_a2)));
+
+    /* damaged lines are skipped, valid entries still used */
+    index.record(slot_b, recorded);
+    {
+        std::ofstream out(index_file, std::ios::app);
+        out << "app_b.img 1 2\n" << "app_b.img 0 0 0 0 0 0 0 xyz\n";
+    }
+    CHECK(index.matches(slot_b, recorded));
+
+    return test::result();
+}
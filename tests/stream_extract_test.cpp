@@ -0,0 +1,241 @@
+/**
+ * UpdateStore extracts an update image from a pipe while it arrives: the
+ * extracted file grows before the download is complete. Timings against
+ * storing the download first are reported. The stream must end with the
+ * archive size declared in the update header.
+ */
+
+#include "test_util.h"
+
+#include "handle_update/UpdateStore.h"
+#include "handle_update/fs_exceptions.h"
+
+#include <archive.h>
+#include <archive_entry.h>
+
+extern "C" {
+    #include <unistd.h>
+}
+
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <sstream>
+
+namespace {
+    constexpr size_t PAYLOAD_SIZE = 8 * 1024 * 1024;
+    constexpr size_t DOWNLOAD_CHUNK = 64 * 1024;
+    /* paces the simulated download */
+    constexpr std::chrono::milliseconds CHUNK_DELAY(5);
+
+    std::vector<uint8_t> make_archive(const std::vector<uint8_t>& payload) {
+        std::vector<uint8_t> out(payload.size() + 1024 * 1024);
+        size_t used = 0;
+        archive* a = archive_write_new();
+        archive_write_add_filter_bzip2(a);
+        archive_write_set_format_pax_restricted(a);
+        archive_write_open_memory(a, out.data(), out.size(), &used);
+        archive_entry* entry = archive_entry_new();
+        archive_entry_set_pathname(entry, "update.app");
+        archive_entry_set_size(entry, static_cast<la_int64_t>(payload.size()));
+        archive_entry_set_filetype(entry, AE_IFREG);
+        archive_entry_set_perm(entry, 0644);
+        archive_write_header(a, entry);
+        archive_write_data(a, payload.data(), payload.size());
+        archive_entry_free(entry);
+        archive_write_close(a);
+        archive_write_free(a);
+        out.resize(used);
+        return out;
+    }
+
+    /* update header declaring size, followed by archive */
+    std::vector<uint8_t> make_image(const std::vector<uint8_t>& archive, uint64_t size) {
+        fs::fs_header_v1_0 header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.info.magic, "FSLX", 4);
+        header.info.file_size_low = static_cast<uint32_t>(size);
+        header.info.file_size_high = static_cast<uint32_t>(size >> 32);
+        std::memcpy(header.type, "CERT", 4);
+        std::vector<uint8_t> image(reinterpret_cast<const uint8_t*>(&header),
+                                   reinterpret_cast<const uint8_t*>(&header) + sizeof(header));
+        image.insert(image.end(), archive.begin(), archive.end());
+        return image;
+    }
+
+    /* writes image into a pipe at download pace, returns the read end;
+     * before_last runs before the last chunk is written */
+    int start_download(const std::vector<uint8_t>& image, std::thread& writer,
+                       std::function<void()> before_last = nullptr) {
+        int fds[2];
+        if (::pipe(fds) != 0) {
+            std::perror("pipe");
+            std::exit(EXIT_FAILURE);
+        }
+        writer = std::thread([&image, fd = fds[1], before_last]() {
+            for (size_t offset = 0; offset < image.size(); offset += DOWNLOAD_CHUNK) {
+                if (before_last && offset + DOWNLOAD_CHUNK >= image.size()) {
+                    before_last();
+                }
+                const size_t length = std::min(DOWNLOAD_CHUNK, image.size() - offset);
+                size_t written = 0;
+                while (written < length) {
+                    const ssize_t n = ::write(fd, image.data() + offset + written, length - written);
+                    if (n <= 0) {
+                        break;
+                    }
+                    written += static_cast<size_t>(n);
+                }
+                std::this_thread::sleep_for(CHUNK_DELAY);
+            }
+            ::close(fd);
+        });
+        return fds[0];
+    }
+
+    double seconds_since(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /* extraction failed with a GenericException */
+    bool rejected(const std::function<void()>& extract) {
+        try {
+            extract();
+        } catch (const fs::GenericException& ex) {
+            std::fprintf(stderr, "rejected: %s\n", ex.what());
+            return true;
+        }
+        return false;
+    }
+}
+
+int main() {
+    /* the rejected reader closes the pipe before the writer is done */
+    std::signal(SIGPIPE, SIG_IGN);
+    test::TempDir dir;
+    const std::shared_ptr<logger::LoggerHandler> logger =
+        logger::LoggerHandler::initLogger(std::make_shared<test::CaptureSink>());
+    const std::filesystem::path target = dir.path() / "extract";
+    std::filesystem::create_directories(target);
+    const std::filesystem::path extracted = target / "update.app";
+
+    /* compressible, so decompression takes a while */
+    std::vector<uint8_t> payload(PAYLOAD_SIZE);
+    std::mt19937 random(42);
+    std::generate(payload.begin(), payload.end(), [&random]() { return static_cast<uint8_t>(random() % 16); });
+    const std::vector<uint8_t> archive = make_archive(payload);
+    const std::vector<uint8_t> image = make_image(archive, archive.size());
+
+    /* stored first: download to a file, then extract it */
+    double stored_time;
+    {
+        std::filesystem::remove(extracted);
+        const std::filesystem::path stored = dir.path() / "update.fs";
+        const auto start = std::chrono::steady_clock::now();
+        std::thread writer;
+        const int fd = start_download(image, writer);
+        {
+            std::ofstream out(stored, std::ofstream::binary);
+            std::vector<char> buffer(DOWNLOAD_CHUNK);
+            ssize_t n;
+            while ((n = ::read(fd, buffer.data(), buffer.size())) > 0) {
+                out.write(buffer.data(), n);
+            }
+        }
+        ::close(fd);
+        writer.join();
+        fs::UpdateStore store(logger);
+        store.SetExtractDirectory(target);
+        store.ExtractUpdateStore(stored);
+        stored_time = seconds_since(start);
+        CHECK(test::read_file(extracted) == payload);
+    }
+
+    /* streamed: extract while the download arrives, the last chunk is held
+     * back until extracted data shows up */
+    double streamed_time;
+    bool overlapped = false;
+    {
+        std::filesystem::remove(extracted);
+        const auto start = std::chrono::steady_clock::now();
+        std::thread writer;
+        const int fd = start_download(image, writer, [&]() {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (!overlapped && std::chrono::steady_clock::now() < deadline) {
+                std::error_code ec;
+                overlapped = std::filesystem::file_size(extracted, ec) > 0 && !ec;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        });
+        fs::UpdateStore store(logger);
+        store.SetExtractDirectory(target);
+        store.ExtractUpdateStore(fd);
+        streamed_time = seconds_since(start);
+        ::close(fd);
+        writer.join();
+        CHECK(test::read_file(extracted) == payload);
+    }
+
+    std::printf("stored first: %.3f s, streamed: %.3f s\n", stored_time, streamed_time);
+    CHECK(overlapped);
+
+    /* pipe ends before the declared size */
+    {
+        std::thread writer;
+        const std::vector<uint8_t> short_image = make_image(archive, archive.size() + 4096);
+        const int fd = start_download(short_image, writer);
+        fs::UpdateStore store(logger);
+        store.SetExtractDirectory(target);
+        CHECK(rejected([&]() { store.ExtractUpdateStore(fd); }));
+        ::close(fd);
+        writer.join();
+    }
+
+    /* pipe continues after the declared size */
+    {
+        std::thread writer;
+        std::vector<uint8_t> long_image = image;
+        long_image.resize(long_image.size() + 4096, 0x5a);
+        const int fd = start_download(long_image, writer);
+        fs::UpdateStore store(logger);
+        store.SetExtractDirectory(target);
+        CHECK(rejected([&]() { store.ExtractUpdateStore(fd); }));
+        ::close(fd);
+        writer.join();
+    }
+
+    /* same checks on a stream */
+    {
+        const std::string exact(image.begin(), image.end());
+        std::istringstream stream(exact);
+        fs::UpdateStore store(logger);
+        store.SetExtractDirectory(target);
+        CHECK(!rejected([&]() { store.ExtractUpdateStore(stream); }));
+
+        std::istringstream trailing(exact + "trailing");
+        CHECK(rejected([&]() { store.ExtractUpdateStore(trailing); }));
+
+        const std::vector<uint8_t> short_image = make_image(archive, archive.size() + 4096);
+        std::istringstream truncated(std::string(short_image.begin(), short_image.end()));
+        CHECK(rejected([&]() { store.ExtractUpdateStore(truncated); }));
+    }
+
+    /* payload is no archive, libarchive fails to open it */
+    {
+        const std::vector<uint8_t> garbage(4096, 0x5a);
+        const std::vector<uint8_t> garbage_image = make_image(garbage, garbage.size());
+        std::istringstream stream(std::string(garbage_image.begin(), garbage_image.end()));
+        fs::UpdateStore store(logger);
+        store.SetExtractDirectory(target);
+        CHECK(rejected([&]() { store.ExtractUpdateStore(stream); }));
+
+        std::thread writer;
+        const int fd = start_download(garbage_image, writer);
+        CHECK(rejected([&]() { store.ExtractUpdateStore(fd); }));
+        ::close(fd);
+        writer.join();
+    }
+
+    return test::result();
+}
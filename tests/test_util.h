@@ -0,0 +1,122 @@
+/**
+ * Helpers shared by the tests.
+ *
+ * Tests are plain executables run by ctest; they report failed checks on
+ * stderr and exit non-zero.
+ */
+
+#pragma once
+
+#include "logger/LoggerHandler.h"
+#include "logger/LoggerSinkBase.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace test {
+
+    inline int& failures() {
+        static int count = 0;
+        return count;
+    }
+
+    /* exit code of the test */
+    inline int result() {
+        if (failures() > 0) {
+            std::fprintf(stderr, "%d check(s) failed\n", failures());
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+#define CHECK(condition)                                                                   \
+    do {                                                                                   \
+        if (!(condition)) {                                                                \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++test::failures();                                                            \
+        }                                                                                  \
+    } while (0)
+
+    /* directory below TMPDIR, removed with its content */
+    class TempDir {
+    private:
+        std::filesystem::path path_;
+
+    public:
+        TempDir() {
+            std::string pattern = (std::filesystem::temp_directory_path() / "fs-updater-test.XXXXXX").string();
+            if (::mkdtemp(pattern.data()) == nullptr) {
+                std::perror("mkdtemp");
+                std::exit(EXIT_FAILURE);
+            }
+            path_ = pattern;
+        }
+
+        ~TempDir() {
+            std::error_code ec;
+            std::filesystem::remove_all(path_, ec);
+        }
+
+        TempDir(const TempDir&) = delete;
+        TempDir& operator=(const TempDir&) = delete;
+
+        const std::filesystem::path& path() const {
+            return path_;
+        }
+    };
+
+    inline std::vector<uint8_t> read_file(const std::filesystem::path& path) {
+        std::ifstream in(path, std::ifstream::binary);
+        return std::vector<uint8_t>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    }
+
+    inline void write_file(const std::filesystem::path& path, const std::vector<uint8_t>& data) {
+        std::ofstream out(path, std::ofstream::binary | std::ofstream::trunc);
+        out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+
+    /* keeps log messages, to check which path the code under test took */
+    class CaptureSink : public logger::LoggerSinkBase {
+    private:
+        mutable std::mutex lock_;
+        std::vector<std::string> messages_;
+
+    public:
+        void setLogEntry(const std::shared_ptr<logger::LogEntry>& entry) override {
+            std::lock_guard<std::mutex> guard(lock_);
+            messages_.push_back(entry->getLogMessage());
+        }
+
+        /**
+         * Wait for a message containing text; the logger delivers asynchronously.
+         * @return Such a message was logged in time.
+         */
+        bool wait_for(const std::string& text,
+                      std::chrono::milliseconds timeout = std::chrono::milliseconds(2000)) const {
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            do {
+                {
+                    std::lock_guard<std::mutex> guard(lock_);
+                    for (const std::string& message : messages_) {
+                        if (message.find(text) != std::string::npos) {
+                            return true;
+                        }
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            } while (std::chrono::steady_clock::now() < deadline);
+            return false;
+        }
+    };
+
+} // namespace test
@@ -0,0 +1,129 @@
+/**
+ * UpdateMetrics exports every phase with its counters as JSON and in the
+ * Prometheus text format, and write() replaces the file without leaving a
+ * temporary file behind.
+ */
+
+#include "test_util.h"
+
+#include "handle_update/updateMetrics.h"
+#include "handle_update/writeEngine.h"
+
+#include <json/json.h>
+
+#include <sstream>
+
+extern "C" {
+    #include <sys/stat.h>
+}
+
+namespace {
+    updater::UpdateMetrics make_metrics() {
+        updater::UpdateMetrics metrics;
+        metrics.operation = "update_image";
+        metrics.succeeded = true;
+        metrics.started = 1767225600;
+        metrics.duration_us = 2500000;
+        metrics.peak_rss_bytes = 48 * 1024 * 1024;
+        metrics.peak_rss_growth_bytes = 4 * 1024 * 1024;
+        metrics.env_reads = 3;
+        metrics.env_writes = 1;
+        updater::PhaseMetrics& copy = metrics.phases[static_cast<size_t>(updater::Phase::COPY)];
+        copy.count = 1;
+        copy.duration_us = 2000000;
+        copy.bytes = 64 * 1024 * 1024;
+        return metrics;
+    }
+
+    Json::Value parse(const std::string& text) {
+        Json::CharReaderBuilder builder;
+        std::istringstream in(text);
+        Json::Value root;
+        std::string errs;
+        if (!Json::parseFromStream(builder, in, &root, &errs)) {
+            std::fprintf(stderr, "invalid JSON: %s\n", errs.c_str());
+        }
+        return root;
+    }
+
+    bool has_line(const std::string& text, const std::string& line) {
+        std::istringstream in(text);
+        std::string current;
+        while (std::getline(in, current)) {
+            if (current == line) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+int main() {
+    const updater::UpdateMetrics metrics = make_metrics();
+
+    /* throughput is bytes per second of the phase, 0 without duration */
+    CHECK(metrics.phase(updater::Phase::COPY).throughput() == 32.0 * 1024 * 1024);
+    CHECK(metrics.phase(updater::Phase::FSYNC).throughput() == 0);
+
+    /* JSON */
+    {
+        const Json::Value root = parse(metrics.to_json());
+        CHECK(root["operation"].asString() == "update_image");
+        CHECK(root["succeeded"].asBool());
+        CHECK(root["started"].asInt64() == 1767225600);
+        CHECK(root["duration_us"].asUInt64() == 2500000);
+        CHECK(root["peak_rss_bytes"].asUInt64() == 48 * 1024 * 1024);
+        CHECK(root["peak_rss_growth_bytes"].asUInt64() == 4 * 1024 * 1024);
+        CHECK(root["env_reads"].asUInt64() == 3);
+        CHECK(root["env_writes"].asUInt64() == 1);
+        CHECK(root["phases"].size() == updater::PHASE_COUNT);
+        for (size_t i = 0; i < updater::PHASE_COUNT; ++i) {
+            CHECK(root["phases"].isMember(updater::UpdateMetrics::phase_name(static_cast<updater::Phase>(i))));
+        }
+        const Json::Value& copy = root["phases"]["copy"];
+        CHECK(copy["count"].asUInt() == 1);
+        CHECK(copy["duration_us"].asUInt64() == 2000000);
+        CHECK(copy["bytes"].asUInt64() == 64 * 1024 * 1024);
+        CHECK(copy["throughput"].asDouble() == 32.0 * 1024 * 1024);
+    }
+
+    /* Prometheus text format */
+    {
+        const std::string text = metrics.to_prometheus();
+        const std::string label = "{operation=\"update_image\"}";
+        CHECK(has_line(text, "# TYPE fsupdate_last_run_success gauge"));
+        CHECK(has_line(text, "fsupdate_last_run_success" + label + " 1"));
+        CHECK(has_line(text, "fsupdate_last_run_start_time_seconds" + label + " 1767225600"));
+        CHECK(has_line(text, "fsupdate_last_run_peak_rss_growth_bytes" + label + " 4194304"));
+        CHECK(has_line(text, "fsupdate_last_run_env_writes" + label + " 1"));
+        CHECK(has_line(text, "fsupdate_phase_runs{operation=\"update_image\",phase=\"copy\"} 1"));
+        CHECK(has_line(text, "fsupdate_phase_bytes{operation=\"update_image\",phase=\"copy\"} 67108864"));
+        CHECK(has_line(text, "fsupdate_phase_runs{operation=\"update_image\",phase=\"env_flush\"} 0"));
+        CHECK(text.back() == '\n');
+    }
+
+    /* write() replaces the file, readable by collectors of another user */
+    {
+        test::TempDir dir;
+        const std::filesystem::path path = dir.path() / "fsupdate.prom";
+        test::write_file(path, {'o', 'l', 'd'});
+        metrics.write(path, updater::MetricsFormat::PROMETHEUS);
+        const std::vector<uint8_t> written = test::read_file(path);
+        CHECK(std::string(written.begin(), written.end()) == metrics.to_prometheus());
+
+        struct stat st;
+        CHECK(::stat(path.c_str(), &st) == 0 && (st.st_mode & S_IROTH) != 0);
+        CHECK(std::distance(std::filesystem::directory_iterator(dir.path()), std::filesystem::directory_iterator()) == 1);
+
+        bool failed = false;
+        try {
+            metrics.write(dir.path() / "missing" / "fsupdate.json", updater::MetricsFormat::JSON);
+        } catch (const updater::WriteFailed& ex) {
+            std::fprintf(stderr, "failed: %s\n", ex.what());
+            failed = true;
+        }
+        CHECK(failed);
+    }
+
+    return test::result();
+}
@@ -0,0 +1,125 @@
+/**
+ * A VerificationRecord is found again for the unchanged file and dependency
+ * and returns the stored digest. Changing the file's mtime, ctime or size,
+ * changing the dependency or tampering with the record invalidates it.
+ */
+
+#include "test_util.h"
+
+#include "handle_update/verificationRecord.h"
+
+extern "C" {
+    #include <fcntl.h>
+    #include <sys/stat.h>
+}
+
+namespace {
+    const std::vector<uint8_t> DIGEST = {0x5e, 0xc0, 0x4d, 0x00, 0xff, 0x17};
+
+    /* timestamps come from a coarse clock, let the next change get a new one */
+    void next_tick() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    bool lookup(const std::filesystem::path& path, const std::filesystem::path& dependency,
+                const std::shared_ptr<logger::LoggerHandler>& logger) {
+        std::vector<uint8_t> digest;
+        return updater::VerificationRecord::lookup(path.string(), dependency.string(), digest, logger) &&
+               digest == DIGEST;
+    }
+
+    void store(const std::filesystem::path& path, const std::filesystem::path& dependency,
+               const std::shared_ptr<logger::LoggerHandler>& logger) {
+        updater::VerificationRecord::store(path.string(), DIGEST, dependency.string(), logger);
+    }
+
+    /* the single record file in dir */
+    std::filesystem::path record_file(const std::filesystem::path& dir) {
+        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+            if (entry.path().extension() == ".rec") {
+                return entry.path();
+            }
+        }
+        return {};
+    }
+}
+
+int main() {
+    test::TempDir dir;
+    const auto sink = std::make_shared<test::CaptureSink>();
+    const std::shared_ptr<logger::LoggerHandler> logger = logger::LoggerHandler::initLogger(sink);
+    const std::filesystem::path records = dir.path() / "verified";
+    const std::filesystem::path image = dir.path() / "update.fs";
+    const std::filesystem::path keyring = dir.path() / "keyring.pem";
+    updater::VerificationRecord::set_directory(records.string());
+
+    test::write_file(image, {'i', 'm', 'a', 'g', 'e'});
+    test::write_file(keyring, {'k', 'e', 'y'});
+
+    /* unchanged file and dependency */
+    store(image, keyring, logger);
+    CHECK(lookup(image, keyring, logger));
+    CHECK(!lookup(image, "", logger));
+    struct stat st;
+    CHECK(::stat(records.c_str(), &st) == 0 && (st.st_mode & 0777) == 0700);
+    CHECK(::stat(record_file(records).c_str(), &st) == 0 && (st.st_mode & 0777) == 0600);
+
+    /* mtime changed, content and size kept */
+    next_tick();
+    struct timespec times[2] = {{0, UTIME_OMIT}, {1000000000, 0}};
+    CHECK(::utimensat(AT_FDCWD, image.c_str(), times, 0) == 0);
+    CHECK(!lookup(image, keyring, logger));
+
+    /* ctime only: mode changed and back, also rewritten with the old mtime */
+    store(image, keyring, logger);
+    CHECK(lookup(image, keyring, logger));
+    next_tick();
+    std::filesystem::permissions(image, std::filesystem::perms::others_read, std::filesystem::perm_options::remove);
+    std::filesystem::permissions(image, std::filesystem::perms::others_read, std::filesystem::perm_options::add);
+    CHECK(!lookup(image, keyring, logger));
+
+    store(image, keyring, logger);
+    CHECK(lookup(image, keyring, logger));
+    next_tick();
+    test::write_file(image, {'I', 'M', 'A', 'G', 'E'});
+    CHECK(::utimensat(AT_FDCWD, image.c_str(), times, 0) == 0);
+    CHECK(!lookup(image, keyring, logger));
+
+    /* size changed */
+    store(image, keyring, logger);
+    CHECK(lookup(image, keyring, logger));
+    next_tick();
+    test::write_file(image, {'i', 'm', 'a', 'g', 'e', '2'});
+    CHECK(!lookup(image, keyring, logger));
+
+    /* dependency changed */
+    store(image, keyring, logger);
+    CHECK(lookup(image, keyring, logger));
+    next_tick();
+    test::write_file(keyring, {'k', 'e', 'y', '2'});
+    CHECK(!lookup(image, keyring, logger));
+
+    /* digest in the record tampered with */
+    store(image, keyring, logger);
+    CHECK(lookup(image, keyring, logger));
+    const std::filesystem::path record = record_file(records);
+    std::vector<uint8_t> content = test::read_file(record);
+    CHECK(content.size() > 40);
+    content[content.size() - 33] ^= 0x01;
+    test::write_file(record, content);
+    CHECK(!lookup(image, keyring, logger));
+    CHECK(sink->wait_for("has invalid HMAC"));
+
+    /* removed after installation */
+    store(image, keyring, logger);
+    CHECK(lookup(image, keyring, logger));
+    updater::VerificationRecord::remove(image.string());
+    CHECK(!lookup(image, keyring, logger));
+
+    /* records disabled */
+    updater::VerificationRecord::set_directory("");
+    store(image, keyring, logger);
+    CHECK(!lookup(image, keyring, logger));
+
+    return test::result();
+}